@@ -31,6 +31,7 @@
 #include "lib/utils.h"
 #include "stardict.h"
 #include "lib/xml_str.h"
+#include "lib/prerendered.h"
 
 #include "articleview.h"
 #include "desktop.h"
@@ -186,6 +187,10 @@ public:
 	{
 		return gpAppFrame->oLibs.GetStorageFileContent(iLib, key);
 	}
+	GdkPixbuf *get_image(void)
+	{
+		return gpAppFrame->oLibs.GetStorageImage(iLib, key);
+	}
 	const std::string& get_key(void) const
 	{
 		return key;
@@ -197,12 +202,12 @@ private:
 };
 
 struct ArticleView::ParseResultItemWithMark {
-	ParseResultItem* item;
+	const ParseResultItem* item;
 	std::string mark;
 	int char_offset;
 	// true if a tmp char is added after the mark
 	bool tmp_char;
-	ParseResultItemWithMark(ParseResultItem* item, int char_offset, 
+	ParseResultItemWithMark(const ParseResultItem* item, int char_offset, 
 		bool tmp_char=false)
 	: item(item), char_offset(char_offset), tmp_char(tmp_char)
 	{
@@ -253,32 +258,59 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 {
 	std::string mark;
 
+	StarDictParseDataPlugins &plugins = gpAppFrame->oStarDictPlugins->ParseDataPlugins;
+	/* Fields parsed by plugins come from the cache if the article was shown before. */
+	const gchar *article = data;
+	const StarDictParseDataPlugins::ParsedFieldList *cached = plugins.find_parsed(article, oword);
+	StarDictParseDataPlugins::ParsedFieldList::const_iterator cached_it;
+	if (cached)
+		cached_it = cached->begin();
+	StarDictParseDataPlugins::ParsedFieldList parsed;
+
 	guint32 sec_size=0;
 	const guint32 data_size=get_uint32(data);
 	data+=sizeof(guint32);
 	const gchar *p=data;
 	bool first_time = true;
 	size_t iPlugin;
-	size_t nPlugins = gpAppFrame->oStarDictPlugins->ParseDataPlugins.nplugins();
+	size_t nPlugins = cached ? 0 : plugins.nplugins();
 	unsigned int parsed_size;
 	ParseResult parse_result;
+	bool after_prerendered = false;
 	while (guint32(p - data)<data_size) {
+		if (after_prerendered) {
+			after_prerendered = false;
+			if (is_prerendered_data_type(*p)) {
+				p += 1 + strlen(p+1) + 1;
+				continue;
+			}
+		}
 		if (first_time)
 			first_time=false;
 		else
 			mark+= "\n";
+		if (cached && cached_it != cached->end() && cached_it->offset == guint32(p - data)) {
+			append_and_mark_orig_word(mark, real_oword, LinksPosList());
+			mark.clear();
+			append_data_parse_result(real_oword, cached_it->result);
+			p += cached_it->parsed_size;
+			++cached_it;
+			continue;
+		}
 		for (iPlugin = 0; iPlugin < nPlugins; iPlugin++) {
 			parse_result.clear();
-			if (gpAppFrame->oStarDictPlugins->ParseDataPlugins.parse(iPlugin, p, &parsed_size, parse_result, oword)) {
-				p += parsed_size;
+			if (plugins.parse(iPlugin, p, &parsed_size, parse_result, oword))
 				break;
-			}
 		}
 		if (iPlugin != nPlugins) {
 			append_and_mark_orig_word(mark, real_oword, LinksPosList());
 			mark.clear();
 			append_data_parse_result(real_oword, parse_result);
-			parse_result.clear();
+			parsed.push_back(StarDictParseDataPlugins::ParsedField());
+			parsed.back().offset = p - data;
+			parsed.back().parsed_size = parsed_size;
+			parsed.back().result.item_list.swap(parse_result.item_list);
+			p += parsed_size;
 			continue;
 		}
 		switch (*p) {
@@ -360,6 +392,20 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 				}
 				sec_size++;
 				break;
+			case 'G':
+				p++;
+				sec_size=g_ntohl(get_uint32(p));
+				parse_result.clear();
+				if (deserialize_parse_result(p+sizeof(guint32), sec_size, parse_result)) {
+					append_and_mark_orig_word(mark, real_oword, LinksPosList());
+					mark.clear();
+					append_data_parse_result(real_oword, parse_result);
+				} else {
+					mark += _("<span foreground=\"red\">[Pre-rendered data is corrupt!]</span>");
+				}
+				after_prerendered = true;
+				sec_size += sizeof(guint32);
+				break;
 			/*case 'W':
 				{
 				p++;
@@ -413,6 +459,8 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 	}
 
 	append_and_mark_orig_word(mark, real_oword, LinksPosList());
+	if (!cached)
+		plugins.put_parsed(article, oword, parsed);
 }
 
 void ArticleView::AppendNewline()
@@ -573,7 +621,7 @@ void ArticleView::append_resource_file_list(const gchar *p)
 }
 
 void ArticleView::append_data_parse_result(const gchar *real_oword, 
-	ParseResult& parse_result)
+	const ParseResult& parse_result)
 {
 	/* Why ParseResultItem's cannot be inserted into the pango_view_ in the 
 	 * order they appear in the parse_result list? 
@@ -633,7 +681,7 @@ void ArticleView::append_data_parse_result(const gchar *real_oword,
 		int char_offset = 0;
 		const char tmp_char = 'x'; // may be any unicode char excluding '<', '&', '>'
 
-		for (std::list<ParseResultItem>::iterator it = parse_result.item_list.begin(); 
+		for (std::list<ParseResultItem>::const_iterator it = parse_result.item_list.begin(); 
 			it != parse_result.item_list.end(); ++it) {
 			switch (it->type) {
 				case ParseResultItemType_mark:
@@ -790,24 +838,43 @@ void ArticleView::append_data_res_image(
 			pango_view_->insert_pixbuf(NULL, key.c_str(), mark.c_str());
 	} else {
 		GdkPixbuf* pixbuf = NULL;
+		GtkWidget *widget = NULL;
 		if (dict_index.type == InstantDictType_LOCAL) {
 			StorageType type = gpAppFrame->oLibs.GetStorageType(dict_index.index);
 			if (type == StorageType_DATABASE || type == StorageType_FILE) {
-				if(const char* content = gpAppFrame->oLibs.GetStorageFileContent
-					(dict_index.index, key)) {
-					const guint32 size = get_uint32(content);
-					const guchar *data = (const guchar *)(content+sizeof(guint32));
-					GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
-					gdk_pixbuf_loader_write(loader, data, size, NULL);
-					gdk_pixbuf_loader_close(loader, NULL);
-					pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
-					if(pixbuf)
-						g_object_ref(G_OBJECT(pixbuf));
-					g_object_unref(loader);
+				gint width, height;
+				if (gpAppFrame->oLibs.GetStorageImageSize(dict_index.index, key, width, height)) {
+					/* Reserve the space and decode the image when it is drawn
+					 * for the first time. Images of a long article that are
+					 * never scrolled into view are never decoded. */
+					ResData *pResData
+						= new ResData(dict_index.index, key);
+					widget = gtk_image_new();
+					g_object_ref_sink(G_OBJECT(widget));
+					gtk_widget_set_size_request(widget, width, height);
+					gtk_widget_show(widget);
+					g_signal_connect(G_OBJECT(widget), "destroy",
+						G_CALLBACK(on_resource_button_destroy), (gpointer)pResData);
+#if GTK_MAJOR_VERSION >= 3
+					g_signal_connect(G_OBJECT(widget), "draw",
+						G_CALLBACK(on_lazy_image_draw), (gpointer)pResData);
+#else
+					g_signal_connect(G_OBJECT(widget), "expose-event",
+						G_CALLBACK(on_lazy_image_expose), (gpointer)pResData);
+#endif
+				} else {
+					pixbuf = gpAppFrame->oLibs.GetStorageImage(dict_index.index, key);
 				}
 			}
 		}
-		if (pixbuf) {
+		if (widget) {
+			loaded = true;
+			if(mark.empty())
+				pango_view_->append_widget(widget);
+			else
+				pango_view_->insert_widget(widget, mark.c_str());
+			g_object_unref(widget);
+		} else if (pixbuf) {
 			loaded = true;
 			if(mark.empty())
 				pango_view_->append_pixbuf(pixbuf, key.c_str());
@@ -991,6 +1058,39 @@ void ArticleView::on_resource_button_destroy(GtkWidget *object, gpointer user_da
 	delete (ResData*)user_data;
 }
 
+#if GTK_MAJOR_VERSION >= 3
+gboolean ArticleView::on_lazy_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+	g_signal_handlers_disconnect_by_func(G_OBJECT(widget),
+		(gpointer)on_lazy_image_draw, user_data);
+	load_lazy_image(widget, user_data);
+	return FALSE;
+}
+#else
+gboolean ArticleView::on_lazy_image_expose(GtkWidget *widget, GdkEventExpose *event, gpointer user_data)
+{
+	g_signal_handlers_disconnect_by_func(G_OBJECT(widget),
+		(gpointer)on_lazy_image_expose, user_data);
+	load_lazy_image(widget, user_data);
+	return FALSE;
+}
+#endif
+
+void ArticleView::load_lazy_image(GtkWidget *widget, gpointer user_data)
+{
+	ResData *pResData = (ResData*)user_data;
+	GdkPixbuf *pixbuf = pResData->get_image();
+	if (pixbuf) {
+		gtk_image_set_from_pixbuf(GTK_IMAGE(widget), pixbuf);
+		g_object_unref(pixbuf);
+	} else {
+		g_warning("Unable to load resource: %s", pResData->get_key().c_str());
+		gtk_widget_set_size_request(widget, -1, -1);
+		gtk_image_set_from_stock(GTK_IMAGE(widget), GTK_STOCK_MISSING_IMAGE,
+			GTK_ICON_SIZE_BUTTON);
+	}
+}
+
 void ArticleView::on_sound_button_clicked(GtkWidget *object, gpointer user_data)
 {
 	ResData *pResData = (ResData*)user_data;
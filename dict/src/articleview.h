@@ -99,7 +99,7 @@ private:
 				       const gchar *origword,
 				       const LinksPosList& links);
 	void append_resource_file_list(const gchar *p);
-	void append_data_parse_result(const gchar *real_oword, ParseResult& parse_result);
+	void append_data_parse_result(const gchar *real_oword, const ParseResult& parse_result);
 	void append_data_res_image(const std::string& key, const std::string& mark,
 		bool& loaded);
 	void append_data_res_sound(const std::string& key, const std::string& mark,
@@ -113,6 +113,12 @@ private:
 	static void on_video_button_clicked(GtkWidget *object, gpointer user_data);
 	static void on_attachment_button_clicked(GtkWidget *object, gpointer user_data);
 	static void on_resource_button_realize(GtkWidget *object, gpointer user_data);
+#if GTK_MAJOR_VERSION >= 3
+	static gboolean on_lazy_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data);
+#else
+	static gboolean on_lazy_image_expose(GtkWidget *widget, GdkEventExpose *event, gpointer user_data);
+#endif
+	static void load_lazy_image(GtkWidget *widget, gpointer user_data);
 };
 
 
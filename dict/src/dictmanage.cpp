@@ -26,6 +26,7 @@
 #include "stardict.h"
 #include "lib/pluginmanager.h"
 #include "lib/verify_dict.h"
+#include "lib/cachestore.h"
 
 class GetAllDictList {
 public:
@@ -717,7 +718,9 @@ void UpdatePluginList(std::list<DictItemId> &plugin_new_install_list)
 
 void RemoveCacheFiles(void)
 {
-	/* We may not simply remove all ".oft" and ".clt" files in all known
+	/* Caches are kept in the cache store now. Remove ".oft" and ".clt" files
+	 * of older versions too.
+	 * We may not simply remove all ".oft" and ".clt" files in all known
 	 * directories, there are resource storage directories! */
 #ifdef _WIN32
 	std::list<std::string> dict_list;
@@ -755,4 +758,7 @@ void RemoveCacheFiles(void)
 		}
 		g_dir_close(dir);
 	}
+	CacheStore *store = get_cache_store();
+	if(!store->clear())
+		g_warning("Unable to clear cache store %s", store->get_filename().c_str());
 }
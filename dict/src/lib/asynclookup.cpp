@@ -0,0 +1,186 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "asynclookup.h"
+
+struct AsyncLookup::Job {
+	AsyncLookup *owner;
+	Libs *libs;
+	AsyncLookupResult result;
+	gint max_results;
+	/* LookupState, see lookup_state_check. When LookupState_STOP, the job is
+	 * not owned by AsyncLookup any more. */
+	gint state;
+	/* progress in 1/10000 */
+	gint progress;
+	on_async_lookup_end_func_t func;
+	gpointer user_data;
+
+	~Job()
+	{
+		for (size_t i=0; i<result.words.size(); ++i)
+			g_free(result.words[i]);
+		for (size_t i=0; i<result.data_reslist.size(); ++i)
+			for (size_t j=0; j<result.data_reslist[i].size(); ++j)
+				g_free(result.data_reslist[i][j]);
+	}
+};
+
+AsyncLookup::AsyncLookup(Libs *libs)
+:
+	libs(libs),
+	thread(NULL),
+	cur_job(NULL),
+	next_seq(1),
+	paused(0)
+{
+}
+
+AsyncLookup::~AsyncLookup()
+{
+	cancel();
+}
+
+unsigned int AsyncLookup::start(AsyncLookupType type, const gchar *word, gint max_results,
+	const std::vector<InstantDictIndex> &dictmask,
+	on_async_lookup_end_func_t func, gpointer user_data)
+{
+	cancel();
+	Job *job = new Job;
+	job->owner = this;
+	job->libs = libs;
+	job->result.type = type;
+	job->result.seq = next_seq++;
+	job->result.word = word;
+	job->result.dictmask = dictmask;
+	job->result.found = false;
+	job->max_results = max_results;
+	job->state = LookupState_RUN;
+	job->progress = 0;
+	job->func = func;
+	job->user_data = user_data;
+	cur_job = job;
+	thread = g_thread_new("lookup_thread", worker_thread, job);
+	/* started while the caller uses Libs */
+	if (paused)
+		lookup_state_pause(&job->state);
+	return job->result.seq;
+}
+
+void AsyncLookup::cancel(void)
+{
+	if (!cur_job)
+		return;
+	/* The job is freed in on_job_done. */
+	lookup_state_stop(&cur_job->state);
+	cur_job = NULL;
+	join();
+}
+
+void AsyncLookup::pause(void)
+{
+	if (paused++ == 0 && cur_job)
+		lookup_state_pause(&cur_job->state);
+}
+
+void AsyncLookup::resume(void)
+{
+	if (paused > 0 && --paused == 0 && cur_job)
+		lookup_state_resume(&cur_job->state);
+}
+
+gdouble AsyncLookup::get_progress(void) const
+{
+	if (!cur_job)
+		return 0;
+	return gdouble(g_atomic_int_get(&cur_job->progress)) / 10000;
+}
+
+void AsyncLookup::join(void)
+{
+	if (thread) {
+		g_thread_join(thread);
+		thread = NULL;
+	}
+}
+
+gpointer AsyncLookup::worker_thread(gpointer data)
+{
+	Job *job = static_cast<Job *>(data);
+	AsyncLookupResult &result = job->result;
+	const gchar *word = result.word.c_str();
+	switch (result.type) {
+	case AsyncLookupType_FUZZY:
+	{
+		std::vector<gchar *> reslist(job->max_results);
+		result.found = job->libs->LookupWithFuzzy(word, &reslist[0], job->max_results,
+			result.dictmask, &job->state);
+		for (size_t i=0; i<reslist.size() && reslist[i]; ++i)
+			result.words.push_back(reslist[i]);
+		break;
+	}
+	case AsyncLookupType_RULE:
+	case AsyncLookupType_REGEX:
+	{
+		//Need to be MAX_MATCH_ITEM_PER_LIB*2 as Libs::LookupWithRule looks up in index and synonyms.
+		gchar **ppMatchWord = (gchar **)g_malloc(sizeof(gchar *) * (MAX_MATCH_ITEM_PER_LIB*2) * (result.dictmask.size()+1));
+		gint iMatchCount;
+		if (result.type == AsyncLookupType_RULE)
+			iMatchCount = job->libs->LookupWithRule(word, ppMatchWord, result.dictmask, &job->state);
+		else
+			iMatchCount = job->libs->LookupWithRegex(word, ppMatchWord, result.dictmask, &job->state);
+		result.words.assign(ppMatchWord, ppMatchWord + iMatchCount);
+		result.found = iMatchCount > 0;
+		g_free(ppMatchWord);
+		break;
+	}
+	case AsyncLookupType_DATA:
+		if (result.dictmask.empty())
+			break;
+		result.data_reslist.resize(result.dictmask.size());
+		result.found = job->libs->LookupData(word, &result.data_reslist[0],
+			on_data_progress, job, &job->state, result.dictmask);
+		break;
+	}
+	lookup_state_done(&job->state);
+	/* back to main thread */
+	g_idle_add(on_job_done, job);
+	return NULL;
+}
+
+gboolean AsyncLookup::on_job_done(gpointer data)
+{
+	Job *job = static_cast<Job *>(data);
+	if (g_atomic_int_get(&job->state) != LookupState_STOP) {
+		AsyncLookup *owner = job->owner;
+		owner->cur_job = NULL;
+		owner->join();
+		job->func(&job->result, job->user_data);
+	}
+	delete job;
+	return FALSE;
+}
+
+void AsyncLookup::on_data_progress(gpointer data, gdouble fraction)
+{
+	Job *job = static_cast<Job *>(data);
+	g_atomic_int_set(&job->progress, gint(fraction * 10000));
+}
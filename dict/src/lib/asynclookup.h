@@ -0,0 +1,104 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASYNC_LOOKUP_H_
+#define _ASYNC_LOOKUP_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+#include "stddict.h"
+
+enum AsyncLookupType {
+	AsyncLookupType_FUZZY,
+	AsyncLookupType_RULE,
+	AsyncLookupType_REGEX,
+	AsyncLookupType_DATA,
+};
+
+struct AsyncLookupResult {
+	AsyncLookupType type;
+	unsigned int seq;
+	std::string word;
+	std::vector<InstantDictIndex> dictmask;
+	bool found;
+	/* fuzzy, rule and regex lookups: matched words, best match first. */
+	std::vector<gchar *> words;
+	/* full-text lookup: found words for each item of dictmask. */
+	std::vector< std::vector<gchar *> > data_reslist;
+};
+
+/* The callback may take ownership of the strings in words and data_reslist,
+ * it must clear the vectors in that case. */
+typedef void (*on_async_lookup_end_func_t)(AsyncLookupResult *result, gpointer user_data);
+
+/* Runs heavy lookups in local dictionaries (fuzzy, pattern, regex and
+full-text search) on a worker thread, so they do not freeze the UI.
+At most one query runs at a time, a new query supersedes the running one.
+Results are delivered in the main loop, every query gets a sequence number
+the same way as StarDict net requests tracked by CompositeLookup,
+results of superseded queries are dropped.
+
+Libs is not thread-safe. While a query is running, the main thread must not use
+Libs. Call cancel() before a lookup that replaces the query, it stops the worker
+and waits till the worker leaves Libs, so it takes no longer than checking one
+word. Other lookups, for example those in the floating window, are done while
+the query is paused with AsyncLookupPause. */
+class AsyncLookup
+{
+public:
+	AsyncLookup(Libs *libs);
+	~AsyncLookup();
+	/* Returns the sequence number of the new query. */
+	unsigned int start(AsyncLookupType type, const gchar *word, gint max_results,
+		const std::vector<InstantDictIndex> &dictmask,
+		on_async_lookup_end_func_t func, gpointer user_data);
+	void cancel(void);
+	/* The worker waits between two words till resume() is called as many
+	 * times as pause(), the query goes on then. */
+	void pause(void);
+	void resume(void);
+	bool is_running(void) const { return cur_job != NULL; }
+	/* progress of the running query in the range [0, 1].
+	 * Only full-text search reports progress. */
+	gdouble get_progress(void) const;
+private:
+	struct Job;
+	static gpointer worker_thread(gpointer data);
+	static gboolean on_job_done(gpointer data);
+	static void on_data_progress(gpointer data, gdouble fraction);
+	void join(void);
+
+	Libs *libs;
+	GThread *thread;
+	Job *cur_job;
+	unsigned int next_seq;
+	int paused;
+};
+
+/* Pauses the query for the lifetime of the object. */
+class AsyncLookupPause
+{
+public:
+	explicit AsyncLookupPause(AsyncLookup &lookup) : lookup(lookup) { lookup.pause(); }
+	~AsyncLookupPause() { lookup.resume(); }
+private:
+	AsyncLookup &lookup;
+};
+
+#endif
@@ -0,0 +1,542 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#ifndef _WIN32
+#  include <unistd.h>
+#endif
+
+#include "mapfile.h"
+#include "iappdirs.h"
+#include "cachestore.h"
+
+#define CACHE_STORE_FILENAME "cache.db"
+#define CACHE_STORE_MAGIC_DATA "StarDict's cache store\n"
+static const guint32 CACHE_STORE_VERSION = 2;
+static const guint32 CACHE_RECORD_MAGIC = 0x43524453;
+/* a record that drops all records before it, see CacheStore::clear */
+static const guint32 CACHE_CLEAR_MAGIC = 0x4C434453;
+/* do not compact smaller garbage */
+static const guint64 CACHE_STORE_MIN_GARBAGE = 64 * 1024;
+/* see CacheStore::retired */
+static const size_t CACHE_STORE_MAX_RETIRED = 8;
+
+/* All numbers are in the native byte order, a file written on a machine with
+ * another byte order fails the version check and is replaced. */
+struct CacheStoreHeader {
+	char magic[24];
+	guint32 version;
+	guint32 generation;
+};
+
+/* followed by the key, then by count guint32 values,
+ * the key and the values are padded to 8 bytes */
+struct CacheRecordHeader {
+	guint32 magic;
+	/* of the rest of the header, the key and the values */
+	guint32 checksum;
+	/* length of the key including the terminating '\0' */
+	guint32 key_size;
+	guint32 count;
+	guint64 mtime;
+	guint64 size;
+};
+
+static inline guint64 align8(guint64 n)
+{
+	return (n + 7) & ~G_GUINT64_CONSTANT(7);
+}
+
+static inline guint64 record_size(guint32 key_size, guint32 count)
+{
+	return sizeof(CacheRecordHeader) + align8(key_size) + align8(guint64(count) * sizeof(guint32));
+}
+
+static inline guint64 record_size(const CacheRecordHeader *rec)
+{
+	return record_size(rec->key_size, rec->count);
+}
+
+static inline const gchar *record_key(const CacheRecordHeader *rec)
+{
+	return reinterpret_cast<const gchar *>(rec + 1);
+}
+
+static inline const guint32 *record_data(const CacheRecordHeader *rec)
+{
+	return reinterpret_cast<const guint32 *>(record_key(rec) + align8(rec->key_size));
+}
+
+static inline bool record_matches(const CacheRecordHeader *rec,
+	const CacheStamp& stamp, guint32 count)
+{
+	return rec && rec->mtime == stamp.mtime && rec->size == stamp.size && rec->count == count;
+}
+
+/* FNV-1a */
+static guint32 checksum_update(guint32 hash, const void *data, size_t len)
+{
+	const guchar *p = static_cast<const guchar *>(data);
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* the same a value at a time, the values take most of the file */
+static guint32 checksum_update_values(guint32 hash, const guint32 *data, guint32 count)
+{
+	for (guint32 i = 0; i < count; ++i) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* A record of another instance of StarDict interleaved with this one or
+ * a record cut short fails the check, the record is dropped. */
+static guint32 record_checksum(const CacheRecordHeader *rec)
+{
+	guint32 hash = 2166136261U;
+	hash = checksum_update(hash, &rec->key_size, sizeof(rec->key_size));
+	hash = checksum_update(hash, &rec->count, sizeof(rec->count));
+	hash = checksum_update(hash, &rec->mtime, sizeof(rec->mtime));
+	hash = checksum_update(hash, &rec->size, sizeof(rec->size));
+	hash = checksum_update(hash, record_key(rec), rec->key_size);
+	return checksum_update_values(hash, record_data(rec), rec->count);
+}
+
+static void build_record(std::vector<gchar>& buf, guint32 magic, const std::string& key,
+	const CacheStamp& stamp, const guint32 *data, guint32 count)
+{
+	const guint32 key_size = key.length() + 1;
+	buf.assign(record_size(key_size, count), '\0');
+	CacheRecordHeader *rec = reinterpret_cast<CacheRecordHeader *>(&buf[0]);
+	rec->magic = magic;
+	rec->key_size = key_size;
+	rec->count = count;
+	rec->mtime = stamp.mtime;
+	rec->size = stamp.size;
+	memcpy(&buf[0] + sizeof(CacheRecordHeader), key.c_str(), key_size);
+	if (count)
+		memcpy(const_cast<guint32 *>(record_data(rec)), data, count * sizeof(guint32));
+	rec->checksum = record_checksum(rec);
+}
+
+/* Replace filename with newfilename.
+ * Never remove filename first. On Windows a file mapped by another instance
+ * of StarDict could only be marked for deletion then, and no file could be
+ * created in its place until that instance quits. */
+static bool replace_file(const std::string& newfilename, const std::string& filename)
+{
+#ifdef _WIN32
+	std::string newfilename_utf8, filename_utf8;
+	std_win_string newfilename_win, filename_win;
+	if (!file_name_to_utf8(newfilename, newfilename_utf8)
+		|| !utf8_to_windows(newfilename_utf8, newfilename_win)
+		|| !file_name_to_utf8(filename, filename_utf8)
+		|| !utf8_to_windows(filename_utf8, filename_win))
+		return false;
+	return MoveFileEx(newfilename_win.c_str(), filename_win.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return g_rename(newfilename.c_str(), filename.c_str()) == 0;
+#endif
+}
+
+/* Append buf to the file with one write. Writes to a file opened for
+ * appending do not interleave, unlike those of stdio, which splits data
+ * larger than its buffer. */
+static bool append_to_file(const std::string& filename, const std::vector<gchar>& buf)
+{
+	const gchar *p = &buf[0];
+	size_t left = buf.size();
+#ifdef _WIN32
+	std::string filename_utf8;
+	std_win_string filename_win;
+	if (!file_name_to_utf8(filename, filename_utf8)
+		|| !utf8_to_windows(filename_utf8, filename_win))
+		return false;
+	HANDLE file = CreateFile(filename_win.c_str(), FILE_APPEND_DATA,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	while (left > 0) {
+		DWORD written;
+		if (!WriteFile(file, p, DWORD(left), &written, NULL) || written == 0)
+			break;
+		p += written;
+		left -= written;
+	}
+	const bool res = CloseHandle(file) != 0 && left == 0;
+#else
+	int fd = g_open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0)
+		return false;
+	/* a short write is completed, the record fails the checksum if another
+	 * one got in between */
+	while (left > 0) {
+		const ssize_t written = write(fd, p, left);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		p += written;
+		left -= written;
+	}
+	const bool res = close(fd) == 0 && left == 0;
+#endif
+	return res;
+}
+
+static bool write_header(FILE *out, guint32 generation)
+{
+	CacheStoreHeader header;
+	memset(&header, 0, sizeof(header));
+	strncpy(header.magic, CACHE_STORE_MAGIC_DATA, sizeof(header.magic));
+	header.version = CACHE_STORE_VERSION;
+	header.generation = generation;
+	return fwrite(&header, sizeof(header), 1, out) == 1;
+}
+
+static guint32 new_generation(void)
+{
+	/* 0 means no valid file */
+	return g_random_int() | 1;
+}
+
+bool CacheStamp::get(const std::string& url)
+{
+	stardict_stat_t st;
+	if (g_stat(url.c_str(), &st) != 0)
+		return false;
+	mtime = st.st_mtime;
+	size = st.st_size;
+	return true;
+}
+
+CacheStore::CacheStore(const std::string& _filename)
+:
+	filename(_filename),
+	opened(false),
+	current(NULL),
+	mapped_size(0),
+	current_pinned(false),
+	file_size(0),
+	scanned_size(0),
+	garbage_size(0),
+	broken(false),
+	generation(0)
+{
+	g_mutex_init(&mutex);
+	index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+}
+
+CacheStore::~CacheStore()
+{
+	g_hash_table_destroy(index);
+	delete current;
+	for (size_t i = 0; i < retired.size(); ++i)
+		delete retired[i];
+	g_mutex_clear(&mutex);
+}
+
+const guint32 *CacheStore::find(const std::string& key, const CacheStamp& stamp, guint32 count)
+{
+	g_mutex_lock(&mutex);
+	if (!opened)
+		open();
+	guint64 offset = lookup(key);
+	/* Another instance of StarDict may have added the entry. */
+	if (!record_matches(offset ? record_at(offset) : NULL, stamp, count) && refresh())
+		offset = lookup(key);
+	const CacheRecordHeader *rec = offset ? record_at(offset) : NULL;
+	const guint32 *data = NULL;
+	if (record_matches(rec, stamp, count)) {
+		data = record_data(rec);
+		current_pinned = true;
+	}
+	g_mutex_unlock(&mutex);
+	return data;
+}
+
+bool CacheStore::add(const std::string& key, const CacheStamp& stamp,
+	const guint32 *data, guint32 count)
+{
+	std::vector<gchar> buf;
+	build_record(buf, CACHE_RECORD_MAGIC, key, stamp, data, count);
+	g_mutex_lock(&mutex);
+	if (!opened)
+		open();
+	const bool res = append(buf);
+	g_mutex_unlock(&mutex);
+	return res;
+}
+
+bool CacheStore::clear(void)
+{
+	std::vector<gchar> buf;
+	build_record(buf, CACHE_CLEAR_MAGIC, "", CacheStamp(), NULL, 0);
+	g_mutex_lock(&mutex);
+	if (!opened)
+		open();
+	if (generation == 0)
+		refresh();
+	/* nothing is stored without a valid file */
+	const bool res = generation == 0 || append(buf);
+	if (res)
+		g_hash_table_remove_all(index);
+	g_mutex_unlock(&mutex);
+	return res;
+}
+
+bool CacheStore::append(const std::vector<gchar>& buf)
+{
+	if (generation == 0)
+		refresh();
+	if (generation == 0 && !create())
+		return false;
+	const bool res = append_to_file(filename, buf);
+	if (res)
+		file_size += buf.size();
+	return res;
+}
+
+void CacheStore::open(void)
+{
+	opened = true;
+	stardict_stat_t st;
+	if (g_stat(filename.c_str(), &st) != 0)
+		return;
+	if (!map(st.st_size))
+		return;
+	scan();
+	if (broken || (garbage_size >= CACHE_STORE_MIN_GARBAGE && garbage_size > mapped_size / 2))
+		compact();
+}
+
+bool CacheStore::map(guint64 size)
+{
+	if (size == 0)
+		return false;
+	MapFile *mf = new MapFile;
+	if (!mf->open(filename.c_str(), size)) {
+		delete mf;
+		return false;
+	}
+	release_current();
+	current = mf;
+	mapped_size = size;
+	file_size = size;
+	return true;
+}
+
+void CacheStore::release_current(void)
+{
+	if (current_pinned)
+		retired.push_back(current);
+	else
+		delete current;
+	current = NULL;
+	current_pinned = false;
+	mapped_size = 0;
+}
+
+/* Return value: offset of the record of key, 0 if there is none. */
+guint64 CacheStore::lookup(const std::string& key) const
+{
+	const guint64 *offset = static_cast<const guint64 *>(g_hash_table_lookup(index, key.c_str()));
+	return offset ? *offset : 0;
+}
+
+const CacheRecordHeader *CacheStore::record_at(guint64 offset) const
+{
+	return reinterpret_cast<const CacheRecordHeader *>(current->begin() + offset);
+}
+
+void CacheStore::scan(void)
+{
+	const gchar *begin = current->begin();
+	if (scanned_size == 0) {
+		const CacheStoreHeader *header = reinterpret_cast<const CacheStoreHeader *>(begin);
+		if (mapped_size < sizeof(CacheStoreHeader)
+			|| strncmp(header->magic, CACHE_STORE_MAGIC_DATA, sizeof(header->magic)) != 0
+			|| header->version != CACHE_STORE_VERSION || header->generation == 0) {
+			broken = true;
+			return;
+		}
+		generation = header->generation;
+		scanned_size = sizeof(CacheStoreHeader);
+	}
+	while (mapped_size - scanned_size >= sizeof(CacheRecordHeader)) {
+		const CacheRecordHeader *rec = reinterpret_cast<const CacheRecordHeader *>(begin + scanned_size);
+		if ((rec->magic != CACHE_RECORD_MAGIC && rec->magic != CACHE_CLEAR_MAGIC)
+			|| rec->key_size == 0)
+			break;
+		const guint64 size = record_size(rec);
+		/* a record cut short or being appended right now */
+		if (size > mapped_size - scanned_size)
+			break;
+		const gchar *key = record_key(rec);
+		if (key[rec->key_size - 1] != '\0' || record_checksum(rec) != rec->checksum)
+			break;
+		scanned_size += size;
+		if (rec->magic == CACHE_CLEAR_MAGIC) {
+			g_hash_table_remove_all(index);
+			garbage_size = scanned_size - sizeof(CacheStoreHeader);
+			continue;
+		}
+		const guint64 offset_val = scanned_size - size;
+		guint64 *offset = static_cast<guint64 *>(g_hash_table_lookup(index, key));
+		if (offset) {
+			garbage_size += record_size(record_at(*offset));
+			*offset = offset_val;
+		} else {
+			offset = g_new(guint64, 1);
+			*offset = offset_val;
+			g_hash_table_insert(index, g_strdup(key), offset);
+		}
+	}
+	broken = scanned_size != mapped_size;
+}
+
+void CacheStore::reset_index(void)
+{
+	g_hash_table_remove_all(index);
+	scanned_size = 0;
+	garbage_size = 0;
+	broken = false;
+	generation = 0;
+}
+
+/* Index the records added to the file by other instances of StarDict since
+ * it was scanned.
+ * Return value: true if something new was indexed. */
+bool CacheStore::refresh(void)
+{
+	stardict_stat_t st;
+	if (g_stat(filename.c_str(), &st) != 0)
+		return false;
+	const guint64 size = st.st_size;
+	if (size == file_size)
+		return false;
+	/* Do not pile up mappings, the entry will be rebuilt instead. */
+	if (current_pinned && retired.size() >= CACHE_STORE_MAX_RETIRED)
+		return false;
+	if (!map(size))
+		return false;
+	/* The file was created anew by another instance of StarDict. */
+	const CacheStoreHeader *header = reinterpret_cast<const CacheStoreHeader *>(current->begin());
+	if (size < scanned_size || size < sizeof(CacheStoreHeader) || header->generation != generation)
+		reset_index();
+	const guint64 old_scanned_size = scanned_size;
+	scan();
+	return scanned_size != old_scanned_size;
+}
+
+/* Rewrite the file with the indexed records only.
+ * Called when the file is opened, before any data is returned to the callers,
+ * so the mapping may be released. */
+bool CacheStore::compact(void)
+{
+	const std::string newfilename = filename + ".new";
+	FILE *out = g_fopen(newfilename.c_str(), "wb");
+	if (!out) {
+		g_warning("Unable to compact cache store %s", filename.c_str());
+		return false;
+	}
+	bool res = write_header(out, new_generation());
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, index);
+	while (res && g_hash_table_iter_next(&iter, &key, &value)) {
+		const CacheRecordHeader *rec = record_at(*static_cast<guint64 *>(value));
+		res = fwrite(rec, 1, record_size(rec), out) == record_size(rec);
+	}
+	res = fclose(out) == 0 && res;
+
+	reset_index();
+	release_current();
+	file_size = 0;
+	res = res && replace_file(newfilename, filename);
+	if (!res) {
+		/* the old file is used further */
+		g_remove(newfilename.c_str());
+		g_warning("Unable to compact cache store %s", filename.c_str());
+	}
+	refresh();
+	return res;
+}
+
+/* Replace the file with an empty one. Never truncate the file, another
+ * instance of StarDict may have it mapped. */
+bool CacheStore::create(void)
+{
+	glib::CharStr dirname(g_path_get_dirname(filename.c_str()));
+	if (g_mkdir_with_parents(get_impl(dirname), 0700) != 0)
+		return false;
+	const std::string newfilename = filename + ".new";
+	FILE *out = g_fopen(newfilename.c_str(), "wb");
+	if (!out)
+		return false;
+	const guint32 new_gen = new_generation();
+	bool res = write_header(out, new_gen);
+	res = fclose(out) == 0 && res;
+	res = res && replace_file(newfilename, filename);
+	if (!res) {
+		g_remove(newfilename.c_str());
+		g_warning("Unable to create cache store %s", filename.c_str());
+		return false;
+	}
+	reset_index();
+	release_current();
+	generation = new_gen;
+	scanned_size = sizeof(CacheStoreHeader);
+	file_size = sizeof(CacheStoreHeader);
+	return true;
+}
+
+namespace {
+	struct CacheStoreHolder {
+		CacheStore *store;
+		~CacheStoreHolder() { delete store; }
+	};
+}
+
+static GMutex cache_store_mutex;
+static CacheStoreHolder cache_store_holder;
+
+CacheStore *get_cache_store(void)
+{
+	g_mutex_lock(&cache_store_mutex);
+	if (!cache_store_holder.store)
+		cache_store_holder.store = new CacheStore(
+			build_path(app_dirs->get_user_cache_dir(), CACHE_STORE_FILENAME));
+	CacheStore *store = cache_store_holder.store;
+	g_mutex_unlock(&cache_store_mutex);
+	return store;
+}
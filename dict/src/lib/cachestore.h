@@ -0,0 +1,119 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CACHE_STORE_H_
+#define _CACHE_STORE_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+class MapFile;
+struct CacheRecordHeader;
+
+/* Identifies the version of a file a cache entry was built for. */
+struct CacheStamp {
+	guint64 mtime;
+	guint64 size;
+
+	CacheStamp() : mtime(0), size(0) {}
+	/* Stamp of the file url. Return value: true - success. */
+	bool get(const std::string& url);
+};
+
+/* One file holding the caches of all dictionaries: page offsets of index and
+ * synonym files, collation orders and resource hash tables.
+ *
+ * The file is append-only. It starts with a header, then follows a sequence
+ * of records, each record holds a key, the stamp of the file the cache was
+ * built for and an array of guint32 values. A record supersedes earlier
+ * records with the same key.
+ * The file is mapped into memory and indexed once, when it is used the first
+ * time. Then a lookup is a hash table search, the data is returned in place.
+ * Records appended by this store are not seen until the store is opened
+ * again, the file is mapped anew only when another instance of StarDict
+ * appended to it.
+ * The store is compacted when it is opened if more than half of the file
+ * are superseded records or the tail of the file is broken.
+ *
+ * Data returned by find remains valid until the store is destroyed, even if
+ * the file is cleared or compacted meanwhile.
+ * All methods may be called from any thread. */
+class CacheStore {
+public:
+	explicit CacheStore(const std::string& _filename);
+	~CacheStore();
+	/* Return the data of the entry key if it was built for the file with stamp
+	 * and holds count values, NULL otherwise. */
+	const guint32 *find(const std::string& key, const CacheStamp& stamp, guint32 count);
+	/* Append a new entry key to the file. The data is copied.
+	 * Return value: true - success. */
+	bool add(const std::string& key, const CacheStamp& stamp,
+		const guint32 *data, guint32 count);
+	/* Drop all entries. A record saying so is appended, the file shrinks
+	 * when it is compacted. Return value: true - success. */
+	bool clear(void);
+	const std::string& get_filename(void) const { return filename; }
+	/* number of mappings held, for tests */
+	size_t get_map_count(void) const { return retired.size() + (current ? 1 : 0); }
+private:
+	CacheStore(const CacheStore&);
+	CacheStore& operator=(const CacheStore&);
+
+	void open(void);
+	bool map(guint64 size);
+	void release_current(void);
+	guint64 lookup(const std::string& key) const;
+	const CacheRecordHeader *record_at(guint64 offset) const;
+	void scan(void);
+	void reset_index(void);
+	bool refresh(void);
+	bool compact(void);
+	bool create(void);
+	bool append(const std::vector<gchar>& buf);
+
+	std::string filename;
+	GMutex mutex;
+	bool opened;
+	/* maps the file as it was when last mapped */
+	MapFile *current;
+	guint64 mapped_size;
+	/* data of current was returned to a caller */
+	bool current_pinned;
+	/* Older mappings still referenced by the callers, at most
+	 * CACHE_STORE_MAX_RETIRED (8) of them. Unreferenced mappings are released
+	 * as soon as the file is mapped again. */
+	std::vector<MapFile *> retired;
+	/* size of the file including the records appended by this store,
+	 * the file is mapped again only if somebody else changed it */
+	guint64 file_size;
+	/* key -> offset of the record header in the file */
+	GHashTable *index;
+	/* the records before this offset of the current file are indexed */
+	guint64 scanned_size;
+	/* bytes taken by superseded records */
+	guint64 garbage_size;
+	/* scan stopped on a broken record */
+	bool broken;
+	/* of the file, changes when the file is created anew */
+	guint32 generation;
+};
+
+/* The store in the user cache directory. */
+CacheStore *get_cache_store(void);
+
+#endif
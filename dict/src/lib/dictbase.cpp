@@ -29,6 +29,7 @@
 
 #include "dictbase.h"
 #include "utils.h"
+#include "libcommon.h"
 
 /* may contain lower-case chars only, otherwise changes in DictBase::SearchData needed. */
 const gchar* const DICT_DATA_TYPE_SEARCH_DATA_STR = "mgxtykwh";
@@ -42,7 +43,7 @@ inline bool is_dict_data_type_lower_case(gchar c)
 /* return true if c is one of the upper-case character type identifies */
 inline bool is_dict_data_type_upper_case(gchar c)
 {
-	return strchr("P", c);
+	return strchr("PG", c);
 }
 
 /* return true if c is one of the character type identifies which data may be
@@ -55,6 +56,7 @@ inline bool is_dict_data_type_search_data(gchar c)
 DictBase::DictBase()
 {
 	dictfile = NULL;
+	overlay_dictfile = NULL;
 	cache_cur =0;
 }
 
@@ -62,6 +64,8 @@ DictBase::~DictBase()
 {
 	if (dictfile)
 		fclose(dictfile);
+	if (overlay_dictfile)
+		fclose(overlay_dictfile);
 }
 
 /* load dictionary
@@ -69,19 +73,39 @@ DictBase::~DictBase()
  * We try filebasename + "." + mainext + ".dz" file first, 
  * then filebasename + "." + mainext. */
 bool DictBase::load(const std::string& filebasename, const char* mainext)
+{
+	if (!open_data_file(filebasename, mainext, dictfile, dictdzfile))
+		return false;
+	if (dictdzfile.get())
+		dictdzfile->set_stats(&stats);
+	return true;
+}
+
+bool DictBase::load_overlay(const std::string& filebasename, const char* mainext)
+{
+	if (!open_data_file(filebasename, mainext, overlay_dictfile, overlay_dictdzfile))
+		return false;
+	if (overlay_dictdzfile.get())
+		overlay_dictdzfile->set_stats(&stats);
+	return true;
+}
+
+bool DictBase::open_data_file(const std::string& filebasename, const char* mainext,
+	FILE *&file, std::auto_ptr<dictData>& dzfile)
 {
 	std::string fullfilename;
 	fullfilename = filebasename + "." + mainext + ".dz";
 	if (g_file_test(fullfilename.c_str(), G_FILE_TEST_EXISTS)) {
-		dictdzfile.reset(new dictData);
-		if (!dictdzfile->open(fullfilename, 0)) {
+		dzfile.reset(new dictData);
+		if (!dzfile->open(fullfilename, 0)) {
 			//g_print("open file %s failed!\n",fullfilename);
+			dzfile.reset();
 			return false;
 		}
 	} else {
 		fullfilename = filebasename + "." + mainext;
-		dictfile = fopen(fullfilename.c_str(),"rb");
-		if (!dictfile) {
+		file = fopen(fullfilename.c_str(),"rb");
+		if (!file) {
 			//g_print("open file %s failed!\n",fullfilename);
 			return false;
 		}
@@ -89,28 +113,44 @@ bool DictBase::load(const std::string& filebasename, const char* mainext)
 	return true;
 }
 
-gchar* DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
+/* read size bytes at offset of the dictionary data file or
+ * of the delta data file if offset is marked with OVERLAY_DATA_OFFSET */
+void DictBase::read_data(gchar *data, guint64 offset, guint32 size)
+{
+	FILE *file = dictfile;
+	dictData *dzfile = dictdzfile.get();
+	if (offset & OVERLAY_DATA_OFFSET) {
+		offset &= ~OVERLAY_DATA_OFFSET;
+		file = overlay_dictfile;
+		dzfile = overlay_dictdzfile.get();
+	}
+	if (file) {
+		stardict_fseek(file, offset, SEEK_SET);
+		size_t fread_size;
+		fread_size = fread(data, size, 1, file);
+		if (fread_size != 1) {
+			g_print("fread error!\n");
+		}
+		query_stats_count(&stats, DictCounter_BYTES_READ, size);
+	} else {
+		dzfile->read(data, offset, size);
+	}
+}
+
+gchar* DictBase::GetWordData(guint64 idxitem_offset, guint32 idxitem_size)
 {
 	for (int i=0; i<WORDDATA_CACHE_NUM; i++)
-		if (cache[i].data && cache[i].offset == idxitem_offset)
+		if (cache[i].data && cache[i].offset == idxitem_offset) {
+			query_stats_count(&stats, DictCounter_ARTICLE_CACHE_HITS);
 			return cache[i].data;
-
-	if (dictfile)
-		fseek(dictfile, idxitem_offset, SEEK_SET);
+		}
+	query_stats_count(&stats, DictCounter_ARTICLE_CACHE_MISSES);
 
 	gchar *data;
 	if (!sametypesequence.empty()) {
 		gchar *origin_data = (gchar *)g_malloc(idxitem_size);
 
-		if (dictfile) {
-			size_t fread_size;
-			fread_size = fread(origin_data, idxitem_size, 1, dictfile);
-			if (fread_size != 1) {
-				g_print("fread error!\n");
-			}
-		} else {
-			dictdzfile->read(origin_data, idxitem_offset, idxitem_size);
-		}
+		read_data(origin_data, idxitem_offset, idxitem_size);
 
 		const gint sametypesequence_len = sametypesequence.length();
 		guint32 data_size = idxitem_size + sametypesequence_len;
@@ -188,15 +228,7 @@ gchar* DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
 		memcpy(data, &data_size, sizeof(guint32));
 	} else {
 		data = (gchar *)g_malloc(idxitem_size + sizeof(guint32));
-		if (dictfile) {
-			size_t fread_size;
-			fread_size = fread(data+sizeof(guint32), idxitem_size, 1, dictfile);
-			if (fread_size != 1) {
-				g_print("fread error!\n");
-			}
-		} else {
-			dictdzfile->read(data+sizeof(guint32), idxitem_offset, idxitem_size);
-		}
+		read_data(data+sizeof(guint32), idxitem_offset, idxitem_size);
 		memcpy(data, &idxitem_size, sizeof(guint32));
 	}
 	g_free(cache[cache_cur].data);
@@ -209,23 +241,13 @@ gchar* DictBase::GetWordData(guint32 idxitem_offset, guint32 idxitem_size)
 	return data;
 }
 
-bool DictBase::SearchData(std::vector<std::string> &SearchWords, guint32 idxitem_offset, guint32 idxitem_size, gchar *origin_data)
+bool DictBase::SearchData(std::vector<std::string> &SearchWords, guint64 idxitem_offset, guint32 idxitem_size, gchar *origin_data)
 {
 	const int nWord = SearchWords.size();
 	std::vector<bool> WordFind(nWord, false);
 	int nfound=0;
 
-	if (dictfile)
-		fseek(dictfile, idxitem_offset, SEEK_SET);
-	if (dictfile) {
-		size_t fread_size;
-		fread_size = fread(origin_data, idxitem_size, 1, dictfile);
-		if (fread_size != 1) {
-			g_print("fread error!\n");
-		}
-	} else {
-		dictdzfile->read(origin_data, idxitem_offset, idxitem_size);
-	}
+	read_data(origin_data, idxitem_offset, idxitem_size);
 	gchar *p = origin_data;
 	guint32 sec_size;
 	int j;
@@ -27,6 +27,7 @@
 #include <stdio.h>
 
 #include "dictziplib.h"
+#include "querystats.h"
 
 enum InstantDictType {
 	InstantDictType_UNKNOWN = 0,
@@ -41,13 +42,15 @@ struct InstantDictIndex {
 };
 
 struct cacheItem {
-  guint32 offset;
+  guint64 offset;
 	gchar *data;
   cacheItem() {data= NULL;}
   ~cacheItem() {g_free(data);}
 };
 
 const int WORDDATA_CACHE_NUM = 10;
+/* this bit is set in offsets of data in the delta layer data file */
+const guint64 OVERLAY_DATA_OFFSET = G_GUINT64_CONSTANT(1) << 63;
 const int UNSET_INDEX = -1;
 const int INVALID_INDEX=-100;
 extern const gchar* const DICT_DATA_TYPE_SEARCH_DATA_STR;
@@ -58,7 +61,10 @@ public:
 	DictBase();
 	~DictBase();
 	bool load(const std::string& filebasename, const char* mainext);
-	gchar * GetWordData(guint32 idxitem_offset, guint32 idxitem_size);
+	/* load the data file of the delta layer, see overlay_index.
+	 * Offsets of the delta data are marked with OVERLAY_DATA_OFFSET. */
+	bool load_overlay(const std::string& filebasename, const char* mainext);
+	gchar * GetWordData(guint64 idxitem_offset, guint32 idxitem_size);
 	bool containSearchData() {
 		if (sametypesequence.empty())
 			return true;
@@ -66,12 +72,20 @@ public:
 		return sametypesequence.find_first_of(DICT_DATA_TYPE_SEARCH_DATA_STR) !=
 			std::string::npos;
 	}
-	bool SearchData(std::vector<std::string> &SearchWords, guint32 idxitem_offset, guint32 idxitem_size, gchar *origin_data);
+	bool SearchData(std::vector<std::string> &SearchWords, guint64 idxitem_offset, guint32 idxitem_size, gchar *origin_data);
+	/* lookup metrics of the dictionary, see querystats.h */
+	DictStats *get_stats() { return &stats; }
 protected:
 	std::string sametypesequence;
+	DictStats stats;
 private:
+	static bool open_data_file(const std::string& filebasename, const char* mainext,
+		FILE *&file, std::auto_ptr<dictData>& dzfile);
+	void read_data(gchar *data, guint64 offset, guint32 size);
 	FILE *dictfile;
 	std::auto_ptr<dictData> dictdzfile;
+	FILE *overlay_dictfile;
+	std::auto_ptr<dictData> overlay_dictdzfile;
 	cacheItem cache[WORDDATA_CACHE_NUM];
 	gint cache_cur;
 };
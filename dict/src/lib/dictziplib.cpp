@@ -333,10 +333,10 @@ void dictData::close()
 	}
 }
 
-void dictData::read(char *buffer, unsigned long start, unsigned long size)
+void dictData::read(char *buffer, guint64 start, guint32 size)
 {
 	char          *pt;
-	unsigned long end;
+	guint64       end;
 	int           count;
 	char          *inBuffer;
 	char          outBuffer[OUT_BUFFER_SIZE];
@@ -415,7 +415,10 @@ void dictData::read(char *buffer, unsigned long start, unsigned long size)
 			if (found) {
 				count = this->cache[target].count;
 				inBuffer = this->cache[target].inBuffer;
+				query_stats_count(stats, DictCounter_DICTZIP_CACHE_HITS);
 			} else {
+				query_stats_count(stats, DictCounter_DICTZIP_INFLATES);
+				query_stats_count(stats, DictCounter_BYTES_READ, this->chunks[i]);
 				this->cache[target].chunk = i;
 				if (!this->cache[target].inBuffer)
 					this->cache[target].inBuffer = (char *)malloc( IN_BUFFER_SIZE );
@@ -25,6 +25,7 @@
 #include <zlib.h>
 
 #include "mapfile.h"
+#include "querystats.h"
 
 
 #define DICT_CACHE_SIZE 5
@@ -37,10 +38,12 @@ struct dictCache {
 };
 
 struct dictData {
-	dictData() {}
+	dictData() : stats(NULL) {}
 	bool open(const std::string& filename, int computeCRC);
 	void close();
-	void read(char *buffer, unsigned long start, unsigned long size);
+	void read(char *buffer, guint64 start, guint32 size);
+	/* count chunk inflates and cache hits in stats, may be NULL */
+	void set_stats(DictStats *_stats) { stats = _stats; }
 	~dictData() { close(); }
 private:
 	const char    *start;	/* start of mmap'd area */
@@ -69,6 +72,7 @@ private:
 	unsigned long compressedLength;
 	dictCache     cache[DICT_CACHE_SIZE];
 	MapFile mapfile;
+	DictStats *stats;
 
 	int read_header(const std::string &filename, int computeCRC);
 };
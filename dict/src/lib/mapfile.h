@@ -87,7 +87,9 @@ inline bool MapFile::open(const char *file_name, unsigned long file_size)
 		return false;
 	if(!utf8_to_windows(file_name_utf8, file_name_win))
 		return false;
-  hFile = CreateFile(file_name_win.c_str(), GENERIC_READ, 0, NULL, OPEN_ALWAYS, 
+  /* Let others append to the file, see CacheStore. */
+  hFile = CreateFile(file_name_win.c_str(), GENERIC_READ,
+		     FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, 
 		     FILE_ATTRIBUTE_NORMAL, 0);
   hFileMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0,  
 			       file_size, NULL);
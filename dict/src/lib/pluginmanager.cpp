@@ -27,10 +27,12 @@
 
 #include <string>
 #include <cstring>
+#include <algorithm>
 
 #include "pluginmanager.h"
 #include "file-utils.h"
 #include "iappdirs.h"
+#include "utils.h"
 
 StarDictPluginBaseObject::StarDictPluginBaseObject(const char *filename, GModule *module_, plugin_configure_func_t configure_func_):
 	plugin_filename(filename), module(module_), configure_func(configure_func_)
@@ -71,9 +73,11 @@ const char *StarDictPluginBase::get_filename()
 
 StarDictPlugins::StarDictPlugins(const std::string& dirpath,
 	const std::list<std::string>& order_list,
-	const std::list<std::string>& disable_list)
+	const std::list<std::string>& disable_list,
+	StarDictPlugInType load_type)
 {
 	plugindirpath = dirpath;
+	plugin_load_type = load_type;
 	load(dirpath, order_list, disable_list);
 }
 
@@ -285,6 +289,11 @@ void StarDictPlugins::load_plugin(const char *filename)
 		return;
 	}
 	StarDictPlugInType ptype = plugin_obj->type;
+	if (plugin_load_type != StarDictPlugInType_UNKNOWN && ptype != plugin_load_type) {
+		g_module_close (module);
+		delete plugin_obj;
+		return;
+	}
 	StarDictPluginBaseObject *baseobj = new StarDictPluginBaseObject(filename, module, plugin_obj->configure_func);
 	delete plugin_obj;
 	if (ptype == StarDictPlugInType_VIRTUALDICT) {
@@ -487,15 +496,73 @@ void StarDictPlugins::configure_plugin(const char *filename, StarDictPlugInType
 // class StarDictVirtualDictPlugins begin.
 //
 
-StarDictVirtualDictPlugins::StarDictVirtualDictPlugins()
+/* A lookup of one virtual dictionary, reported in the main loop. */
+struct VirtualDictLookup {
+	StarDictVirtualDictPlugins *plugins;
+	StarDictVirtualDictPlugin *plugin;
+	std::string word;
+	StarDictVirtualDictPlugins::on_lookup_end_func_t func;
+	gpointer user_data;
+	/* the lookup was run, it was superseded otherwise */
+	bool started;
+	/* the lookup ran past its deadline and was reported already */
+	bool timed_out;
+	char **ppWord;
+	char ***pppWordData;
+};
+
+static void free_virtual_dict_result(char **ppWord, char ***pppWordData)
+{
+	if (!ppWord)
+		return;
+	for (size_t i=0; ppWord[i]; i++) {
+		g_free(ppWord[i]);
+		for (size_t j=0; pppWordData[i][j]; j++)
+			g_free(pppWordData[i][j]);
+		g_free(pppWordData[i]);
+	}
+	g_free(ppWord);
+	g_free(pppWordData);
+}
+
+static void free_virtual_dict_lookup(VirtualDictLookup *task)
+{
+	free_virtual_dict_result(task->ppWord, task->pppWordData);
+	delete task;
+}
+
+StarDictVirtualDictPlugins::StarDictVirtualDictPlugins():
+	pool(NULL), done_source_id(0)
 {
+	g_mutex_init(&done_mutex);
 }
 
 StarDictVirtualDictPlugins::~StarDictVirtualDictPlugins()
 {
+	oPlugins.insert(oPlugins.end(), unloaded.begin(), unloaded.end());
 	for (std::vector<StarDictVirtualDictPlugin *>::iterator i = oPlugins.begin(); i != oPlugins.end(); ++i) {
-		delete *i;
+		StarDictVirtualDictPlugin *plugin = *i;
+		if (plugin->timeout_id)
+			g_source_remove(plugin->timeout_id);
+		if (plugin->deferred)
+			free_virtual_dict_lookup(plugin->deferred);
+		// Running lookups are given till their deadline. A plugin hanging
+		// longer is never unloaded, its lookup may not end at all.
+		if (!plugin->wait_idle() && plugin->detach())
+			continue;
+		delete plugin;
 	}
+	// only the threads of detached plugins may be running
+	if (pool)
+		g_thread_pool_free(pool, FALSE, FALSE);
+	g_mutex_lock(&done_mutex);
+	if (done_source_id)
+		g_source_remove(done_source_id);
+	for (std::list<VirtualDictLookup *>::iterator i = done_lookups.begin(); i != done_lookups.end(); ++i)
+		free_virtual_dict_lookup(*i);
+	done_lookups.clear();
+	g_mutex_unlock(&done_mutex);
+	g_mutex_clear(&done_mutex);
 }
 
 void StarDictVirtualDictPlugins::add(StarDictPluginBaseObject *baseobj, StarDictVirtualDictPlugInObject *virtualdict_plugin_obj)
@@ -508,8 +575,35 @@ void StarDictVirtualDictPlugins::unload_plugin(const char *filename)
 {
 	for (std::vector<StarDictVirtualDictPlugin *>::iterator iter = oPlugins.begin(); iter != oPlugins.end(); ++iter) {
 		if (strcmp((*iter)->get_filename(), filename) == 0) {
-			delete *iter;
+			StarDictVirtualDictPlugin *plugin = *iter;
 			oPlugins.erase(iter);
+			// The results of the plugin are not reported any more.
+			if (plugin->timeout_id) {
+				g_source_remove(plugin->timeout_id);
+				plugin->timeout_id = 0;
+			}
+			if (plugin->deferred) {
+				free_virtual_dict_lookup(plugin->deferred);
+				plugin->deferred = NULL;
+			}
+			const bool idle = plugin->wait_idle();
+			g_mutex_lock(&done_mutex);
+			for (std::list<VirtualDictLookup *>::iterator i = done_lookups.begin(); i != done_lookups.end(); ) {
+				// the lookup still running is left to on_lookup_done
+				if ((*i)->plugin == plugin && (idle || !(*i)->started)) {
+					free_virtual_dict_lookup(*i);
+					i = done_lookups.erase(i);
+				} else {
+					++i;
+				}
+			}
+			g_mutex_unlock(&done_mutex);
+			if (idle) {
+				delete plugin;
+			} else {
+				g_warning("Virtual dictionary %s is busy, it is unloaded when the lookup ends.", plugin->dict_name());
+				unloaded.push_back(plugin);
+			}
 			break;
 		}
 	}
@@ -519,15 +613,154 @@ void StarDictVirtualDictPlugins::configure_plugin(const char *filename)
 {
 	for (std::vector<StarDictVirtualDictPlugin *>::iterator iter = oPlugins.begin(); iter != oPlugins.end(); ++iter) {
 		if (strcmp((*iter)->get_filename(), filename) == 0) {
-			(*iter)->configure();
+			if ((*iter)->wait_idle())
+				(*iter)->configure();
+			else
+				g_warning("Virtual dictionary %s is busy, it cannot be configured.", (*iter)->dict_name());
 			break;
 		}
 	}
 }
 
-void StarDictVirtualDictPlugins::lookup(size_t iPlugin, const gchar *word, char ***pppWord, char ****ppppWordData)
-{
-	oPlugins[iPlugin]->lookup(word, pppWord, ppppWordData);
+void StarDictVirtualDictPlugins::lookup_thread(gpointer data, gpointer user_data)
+{
+	VirtualDictLookup *task = static_cast<VirtualDictLookup *>(data);
+	StarDictVirtualDictPlugins *plugins = static_cast<StarDictVirtualDictPlugins *>(user_data);
+	StarDictVirtualDictPlugin *plugin = task->plugin;
+	plugin->lookup(task->word.c_str(), &task->ppWord, &task->pppWordData);
+	g_mutex_lock(&plugin->mutex);
+	// plugins may be destroyed already if the plugin is detached
+	if (plugin->detached)
+		free_virtual_dict_lookup(task);
+	else
+		plugins->finish_lookup(task);
+	plugin->running = false;
+	g_cond_broadcast(&plugin->idle_cond);
+	// Do not touch the plugin afterwards, it may be unloaded at once.
+	g_mutex_unlock(&plugin->mutex);
+}
+
+void StarDictVirtualDictPlugins::start_lookup(VirtualDictLookup *task)
+{
+	StarDictVirtualDictPlugin *plugin = task->plugin;
+	task->started = true;
+	plugin->busy = true;
+	plugin->current = task;
+	g_mutex_lock(&plugin->mutex);
+	plugin->running = true;
+	plugin->deadline = g_get_monotonic_time() + VIRTUAL_DICT_LOOKUP_TIMEOUT * G_TIME_SPAN_MILLISECOND;
+	g_mutex_unlock(&plugin->mutex);
+	plugin->timeout_id = g_timeout_add(VIRTUAL_DICT_LOOKUP_TIMEOUT, on_lookup_timeout, task);
+	if (!pool)
+		pool = g_thread_pool_new(lookup_thread, this, -1, FALSE, NULL);
+	g_thread_pool_push(pool, task, NULL);
+}
+
+/* Queue the task to be reported in the main loop. May be called from any thread. */
+void StarDictVirtualDictPlugins::finish_lookup(VirtualDictLookup *task)
+{
+	g_mutex_lock(&done_mutex);
+	done_lookups.push_back(task);
+	if (!done_source_id)
+		done_source_id = g_idle_add(on_lookup_done, this);
+	g_mutex_unlock(&done_mutex);
+}
+
+gboolean StarDictVirtualDictPlugins::on_lookup_done(gpointer data)
+{
+	StarDictVirtualDictPlugins *plugins = static_cast<StarDictVirtualDictPlugins *>(data);
+	std::list<VirtualDictLookup *> done;
+	g_mutex_lock(&plugins->done_mutex);
+	done.swap(plugins->done_lookups);
+	plugins->done_source_id = 0;
+	g_mutex_unlock(&plugins->done_mutex);
+	for (std::list<VirtualDictLookup *>::iterator i = done.begin(); i != done.end(); ++i) {
+		VirtualDictLookup *task = *i;
+		StarDictVirtualDictPlugin *plugin = task->plugin;
+		if (task->started && plugin->timeout_id) {
+			g_source_remove(plugin->timeout_id);
+			plugin->timeout_id = 0;
+		}
+		std::vector<StarDictVirtualDictPlugin *>::iterator iter =
+			std::find(plugins->oPlugins.begin(), plugins->oPlugins.end(), plugin);
+		if (iter != plugins->oPlugins.end() && !task->timed_out)
+			task->func(iter - plugins->oPlugins.begin(), task->word.c_str(),
+				task->ppWord, task->pppWordData, task->user_data);
+		const bool started = task->started;
+		if (started) {
+			plugin->busy = false;
+			plugin->current = NULL;
+		}
+		free_virtual_dict_lookup(task);
+		if (iter == plugins->oPlugins.end()) {
+			// the lookup of a plugin unloaded while it was running has ended
+			if (started) {
+				plugins->unloaded.erase(std::find(plugins->unloaded.begin(), plugins->unloaded.end(), plugin));
+				delete plugin;
+			}
+			continue;
+		}
+		if (!plugin->busy && plugin->deferred) {
+			VirtualDictLookup *next = plugin->deferred;
+			plugin->deferred = NULL;
+			plugins->start_lookup(next);
+		}
+	}
+	return FALSE;
+}
+
+gboolean StarDictVirtualDictPlugins::on_lookup_timeout(gpointer data)
+{
+	VirtualDictLookup *task = static_cast<VirtualDictLookup *>(data);
+	StarDictVirtualDictPlugins *plugins = task->plugins;
+	StarDictVirtualDictPlugin *plugin = task->plugin;
+	plugin->timeout_id = 0;
+	task->timed_out = true;
+	g_warning("Virtual dictionary %s did not look up %s in %d ms, the result is dropped.",
+		plugin->dict_name(), task->word.c_str(), VIRTUAL_DICT_LOOKUP_TIMEOUT);
+	std::vector<StarDictVirtualDictPlugin *>::iterator iter =
+		std::find(plugins->oPlugins.begin(), plugins->oPlugins.end(), plugin);
+	task->func(iter - plugins->oPlugins.begin(), task->word.c_str(), NULL, NULL, task->user_data);
+	// the word asked meanwhile is not waited on either
+	if (plugin->deferred) {
+		plugins->finish_lookup(plugin->deferred);
+		plugin->deferred = NULL;
+	}
+	return FALSE;
+}
+
+void StarDictVirtualDictPlugins::lookup_async(const std::vector<InstantDictIndex> &dictmask, const gchar *word,
+	on_lookup_end_func_t func, gpointer user_data)
+{
+	for (size_t iLib=0; iLib<dictmask.size(); iLib++) {
+		if (dictmask[iLib].type != InstantDictType_VIRTUAL)
+			continue;
+		VirtualDictLookup *task = new VirtualDictLookup;
+		task->plugins = this;
+		task->plugin = oPlugins[dictmask[iLib].index];
+		task->word = word;
+		task->func = func;
+		task->user_data = user_data;
+		task->started = false;
+		task->timed_out = false;
+		task->ppWord = NULL;
+		task->pppWordData = NULL;
+		StarDictVirtualDictPlugin *plugin = task->plugin;
+		if (!plugin->busy) {
+			start_lookup(task);
+			continue;
+		}
+		if (plugin->current->timed_out) {
+			// the plugin hangs, it is skipped
+			finish_lookup(task);
+			continue;
+		}
+		if (plugin->deferred)
+			finish_lookup(plugin->deferred);
+		else
+			g_debug("Virtual dictionary %s is busy, the lookup of %s is deferred.", plugin->dict_name(), word);
+		plugin->deferred = task;
+	}
 }
 
 const char *StarDictVirtualDictPlugins::dict_name(size_t iPlugin)
@@ -559,11 +792,48 @@ StarDictVirtualDictPlugin::StarDictVirtualDictPlugin(StarDictPluginBaseObject *b
 	StarDictPluginBase(baseobj_)
 {
 	obj = virtualdict_plugin_obj;
+	g_mutex_init(&mutex);
+	g_cond_init(&idle_cond);
+	running = false;
+	deadline = 0;
+	detached = false;
+	busy = false;
+	current = NULL;
+	timeout_id = 0;
+	deferred = NULL;
 }
 
 StarDictVirtualDictPlugin::~StarDictVirtualDictPlugin()
 {
+	// The plugin is deleted when it is idle or its lookup has just ended,
+	// wait till the pool thread is done with it.
+	g_mutex_lock(&mutex);
+	while (running)
+		g_cond_wait(&idle_cond, &mutex);
+	g_mutex_unlock(&mutex);
 	delete obj;
+	g_mutex_clear(&mutex);
+	g_cond_clear(&idle_cond);
+}
+
+bool StarDictVirtualDictPlugin::wait_idle()
+{
+	g_mutex_lock(&mutex);
+	while (running) {
+		if (!g_cond_wait_until(&idle_cond, &mutex, deadline))
+			break;
+	}
+	const bool idle = !running;
+	g_mutex_unlock(&mutex);
+	return idle;
+}
+
+bool StarDictVirtualDictPlugin::detach()
+{
+	g_mutex_lock(&mutex);
+	detached = running;
+	g_mutex_unlock(&mutex);
+	return detached;
 }
 
 void StarDictVirtualDictPlugin::lookup(const char *word, char ***pppWord, char ****ppppWordData)
@@ -848,6 +1118,8 @@ const char *StarDictTtsPlugin::tts_name()
 //
 
 StarDictParseDataPlugins::StarDictParseDataPlugins()
+:
+	parsed_cache_size(0)
 {
 }
 
@@ -862,6 +1134,7 @@ void StarDictParseDataPlugins::add(StarDictPluginBaseObject *baseobj, StarDictPa
 {
 	StarDictParseDataPlugin *plugin = new StarDictParseDataPlugin(baseobj, tts_plugin_obj);
 	oPlugins.push_back(plugin);
+	clear_parsed_cache();
 }
 
 void StarDictParseDataPlugins::unload_plugin(const char *filename)
@@ -870,6 +1143,7 @@ void StarDictParseDataPlugins::unload_plugin(const char *filename)
 		if (strcmp((*iter)->get_filename(), filename) == 0) {
 			delete *iter;
 			oPlugins.erase(iter);
+			clear_parsed_cache();
 			break;
 		}
 	}
@@ -880,6 +1154,8 @@ void StarDictParseDataPlugins::configure_plugin(const char *filename)
 	for (std::vector<StarDictParseDataPlugin *>::iterator iter = oPlugins.begin(); iter != oPlugins.end(); ++iter) {
 		if (strcmp((*iter)->get_filename(), filename) == 0) {
 			(*iter)->configure();
+			/* the output of the plugin may change */
+			clear_parsed_cache();
 			break;
 		}
 	}
@@ -890,6 +1166,118 @@ bool StarDictParseDataPlugins::parse(size_t iPlugin, const char *p, unsigned int
 	return oPlugins[iPlugin]->parse(p, parsed_size, result, oword);
 }
 
+/* FNV-1a */
+static guint64 parsed_cache_hash(guint64 hash, const gchar *data, gsize len)
+{
+	for (gsize i = 0; i < len; ++i) {
+		hash ^= guchar(data[i]);
+		hash *= G_GUINT64_CONSTANT(1099511628211);
+	}
+	return hash;
+}
+
+StarDictParseDataPlugins::ParsedKey StarDictParseDataPlugins::parsed_cache_key(const gchar *data, const gchar *oword)
+{
+	if (!oword)
+		oword = "";
+	const gsize word_len = strlen(oword) + 1;
+	const gsize data_len = sizeof(guint32) + get_uint32(data);
+	ParsedKey key;
+	key.hash = parsed_cache_hash(G_GUINT64_CONSTANT(14695981039346656037), oword, word_len);
+	key.hash = parsed_cache_hash(key.hash, data, data_len);
+	key.length = word_len + data_len;
+	return key;
+}
+
+/* article - oword, '\0', article data of a cached article with the same key */
+static bool parsed_cache_match(const std::string& article, const gchar *data, const gchar *oword)
+{
+	if (!oword)
+		oword = "";
+	const gsize word_len = strlen(oword) + 1;
+	return memcmp(article.data(), oword, word_len) == 0
+		&& memcmp(article.data() + word_len, data, article.length() - word_len) == 0;
+}
+
+/* approximate memory used by the parse result */
+static gsize parse_result_size(const ParseResult &result)
+{
+	gsize size = 0;
+	for (std::list<ParseResultItem>::const_iterator it = result.item_list.begin();
+		it != result.item_list.end(); ++it) {
+		size += sizeof(ParseResultItem) + 2*sizeof(void *);
+		if (it->type == ParseResultItemType_mark) {
+			size += sizeof(ParseResultMarkItem) + it->mark->pango.capacity();
+		} else if (it->type == ParseResultItemType_link) {
+			size += sizeof(ParseResultLinkItem) + it->link->pango.capacity();
+			for (LinksPosList::const_iterator link = it->link->links_list.begin();
+				link != it->link->links_list.end(); ++link)
+				size += sizeof(LinkDesc) + 2*sizeof(void *) + link->link_.capacity();
+		} else if (it->type == ParseResultItemType_res) {
+			size += sizeof(ParseResultResItem) + it->res->type.capacity() + it->res->key.capacity();
+		} else {
+			size += sizeof(ParseResultFormatBegItem);
+		}
+	}
+	return size;
+}
+
+const StarDictParseDataPlugins::ParsedFieldList *StarDictParseDataPlugins::find_parsed(const gchar *data, const gchar *oword)
+{
+	std::map<ParsedKey, ParsedList::iterator>::iterator it
+		= parsed_map.find(parsed_cache_key(data, oword));
+	if (it == parsed_map.end() || !parsed_cache_match(it->second->article, data, oword))
+		return NULL;
+	parsed_list.splice(parsed_list.begin(), parsed_list, it->second);
+	return &it->second->fields;
+}
+
+void StarDictParseDataPlugins::put_parsed(const gchar *data, const gchar *oword, ParsedFieldList &fields)
+{
+	gsize size = 0;
+	for (ParsedFieldList::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+		for (std::list<ParseResultItem>::const_iterator item = it->result.item_list.begin();
+			item != it->result.item_list.end(); ++item) {
+			/* widgets are owned by the view they are shown in */
+			if (item->type == ParseResultItemType_widget) {
+				fields.clear();
+				return;
+			}
+		}
+		size += sizeof(ParsedField) + parse_result_size(it->result);
+	}
+	const ParsedKey key(parsed_cache_key(data, oword));
+	/* an article with the same hash is kept */
+	if (size > PARSED_CACHE_SIZE / 8 || parsed_map.find(key) != parsed_map.end()) {
+		fields.clear();
+		return;
+	}
+	while (parsed_cache_size + size > PARSED_CACHE_SIZE) {
+		const ParsedArticle& last = parsed_list.back();
+		parsed_cache_size -= last.size;
+		parsed_map.erase(last.key);
+		parsed_list.pop_back();
+	}
+	parsed_list.push_front(ParsedArticle());
+	ParsedArticle& article = parsed_list.front();
+	article.key = key;
+	if (oword)
+		article.article = oword;
+	article.article += '\0';
+	article.article.append(data, sizeof(guint32) + get_uint32(data));
+	article.size = size;
+	article.fields.splice(article.fields.end(), fields);
+	parsed_map[key] = parsed_list.begin();
+	parsed_cache_size += size;
+}
+
+void StarDictParseDataPlugins::clear_parsed_cache(void)
+{
+	parsed_list.clear();
+	parsed_map.clear();
+	parsed_cache_size = 0;
+}
+
 //
 // class StarDictParseDataPlugin begin.
 //
@@ -1035,6 +1423,7 @@ void StarDictTtsPlugins::reorder(const std::list<std::string>& order_list)
 void StarDictParseDataPlugins::reorder(const std::list<std::string>& order_list)
 {
 	plugins_reorder<std::vector<StarDictParseDataPlugin *>, std::vector<StarDictParseDataPlugin *>::iterator>(oPlugins, order_list);
+	clear_parsed_cache();
 }
 
 void StarDictMiscPlugins::reorder(const std::list<std::string>& order_list)
@@ -25,6 +25,7 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
 #include "plugin.h"
 #include "virtualdictplugin.h"
 #include "netdictplugin.h"
@@ -52,6 +53,12 @@ protected:
 	StarDictPluginBaseObject *baseobj;
 };
 
+struct VirtualDictLookup;
+
+/* A virtual dictionary lookup running longer is reported without a result
+ * and the plugin is not waited on any more, in milliseconds. */
+const gint VIRTUAL_DICT_LOOKUP_TIMEOUT = 1000;
+
 class StarDictVirtualDictPlugin : public StarDictPluginBase {
 public:
 	StarDictVirtualDictPlugin(StarDictPluginBaseObject *baseobj, StarDictVirtualDictPlugInObject *virtualdict_plugin_obj);
@@ -59,8 +66,34 @@ public:
 	void lookup(const char *word, char ***pppWord, char ****ppppWordData);
 	const char *dict_name();
 	const char *dict_id();
+	/* Wait till the lookup running on the thread pool is finished, but not
+	 * past its deadline. Return value: true - the plugin is idle. */
+	bool wait_idle();
 private:
+	friend class StarDictVirtualDictPlugins;
+	/* Leave the running lookup to itself, its result is dropped in the pool
+	 * thread. Return value: false - the plugin is idle, nothing is done. */
+	bool detach();
+
 	StarDictVirtualDictPlugInObject *obj;
+	/* guards running, deadline and detached */
+	GMutex mutex;
+	GCond idle_cond;
+	/* a lookup is running in a pool thread */
+	bool running;
+	/* monotonic time the running lookup is waited on till */
+	gint64 deadline;
+	bool detached;
+	/* A lookup was started and its result is not reported yet.
+	 * Used in the main thread only, as are the fields below. */
+	bool busy;
+	/* the lookup started last */
+	VirtualDictLookup *current;
+	/* reports current without a result when its deadline passes */
+	guint timeout_id;
+	/* The last lookup asked while the plugin was busy, it is started when the
+	 * running one is done. */
+	VirtualDictLookup *deferred;
 };
 
 class StarDictVirtualDictPlugins {
@@ -68,7 +101,21 @@ public:
 	StarDictVirtualDictPlugins();
 	~StarDictVirtualDictPlugins();
 	void add(StarDictPluginBaseObject *baseobj, StarDictVirtualDictPlugInObject *virtualdict_plugin_obj);
-	void lookup(size_t iPlugin, const gchar *word, char ***pppWord, char ****ppppWordData);
+	/* The result of a lookup started by lookup_async. ppWord is NULL if
+	 * nothing was found or the lookup was superseded. The result is freed
+	 * when the function returns. */
+	typedef void (*on_lookup_end_func_t)(size_t iPlugin, const char *word,
+		char **ppWord, char ***pppWordData, gpointer user_data);
+	/* Look up word in all virtual dictionaries of dictmask on the thread pool,
+	 * the plugins run concurrently. func is called in the main loop once for
+	 * every virtual item of dictmask.
+	 * A busy plugin looks up the word when it is done with the running lookup,
+	 * only the last word asked meanwhile is looked up, the others are
+	 * reported as superseded.
+	 * A lookup is reported without a result when it takes longer than
+	 * VIRTUAL_DICT_LOOKUP_TIMEOUT. Till it ends, the plugin is skipped. */
+	void lookup_async(const std::vector<InstantDictIndex> &dictmask, const gchar *word,
+		on_lookup_end_func_t func, gpointer user_data);
 	size_t ndicts() { return oPlugins.size(); }
 	const char *dict_name(size_t iPlugin);
 	const char *dict_id(size_t iPlugin);
@@ -77,7 +124,22 @@ public:
 	void configure_plugin(const char *filename);
 	void reorder(const std::list<std::string>& order_list);
 private:
+	void start_lookup(VirtualDictLookup *task);
+	void finish_lookup(VirtualDictLookup *task);
+	static void lookup_thread(gpointer data, gpointer user_data);
+	static gboolean on_lookup_done(gpointer data);
+	static gboolean on_lookup_timeout(gpointer data);
 	std::vector<StarDictVirtualDictPlugin *> oPlugins;
+	/* Plugins unloaded while running past the deadline, they are deleted when
+	 * their lookup ends. */
+	std::vector<StarDictVirtualDictPlugin *> unloaded;
+	/* created on the first lookup_async */
+	GThreadPool *pool;
+	/* guards done_lookups and done_source_id */
+	GMutex done_mutex;
+	/* lookups to report in on_lookup_done */
+	std::list<VirtualDictLookup *> done_lookups;
+	guint done_source_id;
 };
 
 class StarDictNetDictPlugin : public StarDictPluginBase {
@@ -173,6 +235,15 @@ private:
 
 class StarDictParseDataPlugins {
 public:
+	/* A field of an article parsed by a plugin,
+	 * offset - position of the field in the article data. */
+	struct ParsedField {
+		guint32 offset;
+		unsigned int parsed_size;
+		ParseResult result;
+	};
+	typedef std::list<ParsedField> ParsedFieldList;
+
 	StarDictParseDataPlugins();
 	~StarDictParseDataPlugins();
 	void add(StarDictPluginBaseObject *baseobj, StarDictParseDataPlugInObject *parsedata_plugin_obj);
@@ -181,8 +252,45 @@ public:
 	void unload_plugin(const char *filename);
 	void configure_plugin(const char *filename);
 	void reorder(const std::list<std::string>& order_list);
+	/* data - article data starting with the size field as returned by
+	 * Libs::poGetOrigWordData.
+	 * Return fields of the article parsed by plugins when it was shown with
+	 * the word oword the last time, NULL if the article is not in the cache.
+	 * Fields missing in the list are not handled by any plugin. */
+	const ParsedFieldList *find_parsed(const gchar *data, const gchar *oword);
+	/* Remember parsed fields of the article, fields is cleared. */
+	void put_parsed(const gchar *data, const gchar *oword, ParsedFieldList &fields);
 private:
+	void clear_parsed_cache(void);
+
 	std::vector<StarDictParseDataPlugin *> oPlugins;
+	/* Results of the plugins, so switching between articles does not parse
+	 * them again. The cache is cleared when the plugin set or plugin
+	 * configuration changes. The results take about PARSED_CACHE_SIZE bytes. */
+	static const gsize PARSED_CACHE_SIZE = 8*1024*1024;
+	/* hash and length of oword, '\0', article data */
+	struct ParsedKey {
+		guint64 hash;
+		gsize length;
+		bool operator<(const ParsedKey& right) const
+		{
+			return hash < right.hash || (hash == right.hash && length < right.length);
+		}
+	};
+	struct ParsedArticle {
+		ParsedKey key;
+		/* oword, '\0', article data, compared when the keys are equal */
+		std::string article;
+		/* memory used by fields */
+		gsize size;
+		ParsedFieldList fields;
+	};
+	typedef std::list<ParsedArticle> ParsedList;
+	static ParsedKey parsed_cache_key(const gchar *data, const gchar *oword);
+	/* most recently used articles first */
+	ParsedList parsed_list;
+	std::map<ParsedKey, ParsedList::iterator> parsed_map;
+	gsize parsed_cache_size;
 };
 
 class StarDictMiscPlugin : public StarDictPluginBase {
@@ -214,9 +322,12 @@ struct StarDictPluginInfo {
 
 class StarDictPlugins {
 public:
+	/* load_type - load plugins of this type only,
+	 * StarDictPlugInType_UNKNOWN - load all plugins. */
 	StarDictPlugins(const std::string& dirpath,
 		const std::list<std::string>& order_list,
-		const std::list<std::string>& disable_list);
+		const std::list<std::string>& disable_list,
+		StarDictPlugInType load_type = StarDictPlugInType_UNKNOWN);
 	~StarDictPlugins();
 	void get_plugin_list(const std::list<std::string>& order_list, std::list<std::pair<StarDictPlugInType, std::list<StarDictPluginInfo> > > &plugin_list);
 	bool get_loaded(const char *filename);
@@ -232,6 +343,7 @@ public:
 	StarDictMiscPlugins MiscPlugins;
 private:
 	std::string plugindirpath;
+	StarDictPlugInType plugin_load_type;
 	/* Plugins that we've tried to load irrespective of the fact were they loaded
 	 * successfully or not. */
 	std::list<std::string> loaded_plugin_list;
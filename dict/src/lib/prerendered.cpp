@@ -0,0 +1,187 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "prerendered.h"
+
+const gchar* const PRERENDERED_DATA_TYPE_STR = "xhwk";
+
+/* item kinds */
+static const char ITEM_MARK = 'm';
+static const char ITEM_LINK = 'l';
+static const char ITEM_RES = 'r';
+static const char ITEM_FORMAT_BEG = 'b';
+static const char ITEM_FORMAT_END = 'e';
+
+static void append_string(std::string& data, const std::string& str)
+{
+	data.append(str.c_str(), str.length() + 1);
+}
+
+static void append_uint32(std::string& data, guint32 val)
+{
+	guint32 val_be = g_htonl(val);
+	data.append(reinterpret_cast<const char *>(&val_be), sizeof(guint32));
+}
+
+bool serialize_parse_result(const ParseResult& result, std::string& data)
+{
+	std::string res;
+	for (std::list<ParseResultItem>::const_iterator it = result.item_list.begin();
+		it != result.item_list.end(); ++it) {
+		switch (it->type) {
+		case ParseResultItemType_mark:
+			res += ITEM_MARK;
+			append_string(res, it->mark->pango);
+			break;
+		case ParseResultItemType_link:
+			res += ITEM_LINK;
+			append_string(res, it->link->pango);
+			append_uint32(res, it->link->links_list.size());
+			for (LinksPosList::const_iterator link = it->link->links_list.begin();
+				link != it->link->links_list.end(); ++link) {
+				append_uint32(res, link->pos_);
+				append_uint32(res, link->len_);
+				append_string(res, link->link_);
+			}
+			break;
+		case ParseResultItemType_res:
+			res += ITEM_RES;
+			append_string(res, it->res->type);
+			append_string(res, it->res->key);
+			break;
+		case ParseResultItemType_FormatBeg:
+			res += ITEM_FORMAT_BEG;
+			res += char(it->format_beg->type);
+			break;
+		case ParseResultItemType_FormatEnd:
+			res += ITEM_FORMAT_END;
+			res += char(it->format_end->type);
+			break;
+		default:
+			return false;
+		}
+	}
+	data += res;
+	return true;
+}
+
+/* Reads the data of a 'G' field checking that it does not run past the end. */
+class PrerenderedReader {
+public:
+	PrerenderedReader(const char *data, guint32 size)
+	:
+		p(data),
+		end(data + size)
+	{
+	}
+	bool eof(void) const { return p == end; }
+	bool read_char(char& c)
+	{
+		if (p == end)
+			return false;
+		c = *p++;
+		return true;
+	}
+	bool read_string(std::string& str)
+	{
+		const char *e = static_cast<const char *>(memchr(p, '\0', end - p));
+		if (!e)
+			return false;
+		str.assign(p, e - p);
+		p = e + 1;
+		return true;
+	}
+	bool read_uint32(guint32& val)
+	{
+		if (end - p < (long)sizeof(guint32))
+			return false;
+		guint32 val_be;
+		memcpy(&val_be, p, sizeof(guint32));
+		val = g_ntohl(val_be);
+		p += sizeof(guint32);
+		return true;
+	}
+private:
+	const char *p;
+	const char *end;
+};
+
+bool deserialize_parse_result(const char *data, guint32 size, ParseResult& result)
+{
+	PrerenderedReader reader(data, size);
+	ParseResultItem item;
+	char kind, format;
+	while (!reader.eof()) {
+		reader.read_char(kind);
+		switch (kind) {
+		case ITEM_MARK:
+			item.type = ParseResultItemType_mark;
+			item.mark = new ParseResultMarkItem;
+			result.item_list.push_back(item);
+			if (!reader.read_string(item.mark->pango))
+				return false;
+			break;
+		case ITEM_LINK:
+			{
+			item.type = ParseResultItemType_link;
+			item.link = new ParseResultLinkItem;
+			result.item_list.push_back(item);
+			guint32 nlinks, pos, len;
+			std::string link;
+			if (!reader.read_string(item.link->pango) || !reader.read_uint32(nlinks))
+				return false;
+			for (guint32 i = 0; i < nlinks; ++i) {
+				if (!reader.read_uint32(pos) || !reader.read_uint32(len)
+					|| !reader.read_string(link))
+					return false;
+				item.link->links_list.push_back(LinkDesc(pos, len, link));
+			}
+			}
+			break;
+		case ITEM_RES:
+			item.type = ParseResultItemType_res;
+			item.res = new ParseResultResItem;
+			result.item_list.push_back(item);
+			if (!reader.read_string(item.res->type) || !reader.read_string(item.res->key))
+				return false;
+			break;
+		case ITEM_FORMAT_BEG:
+			if (!reader.read_char(format) || format != ParseResultItemFormatType_Indent)
+				return false;
+			item.type = ParseResultItemType_FormatBeg;
+			item.format_beg = new ParseResultFormatBegItem;
+			item.format_beg->type = ParseResultItemFormatType(format);
+			result.item_list.push_back(item);
+			break;
+		case ITEM_FORMAT_END:
+			if (!reader.read_char(format) || format != ParseResultItemFormatType_Indent)
+				return false;
+			item.type = ParseResultItemType_FormatEnd;
+			item.format_end = new ParseResultFormatEndItem;
+			item.format_end->type = ParseResultItemFormatType(format);
+			result.item_list.push_back(item);
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PRERENDERED_H_
+#define _PRERENDERED_H_
+
+#include <glib.h>
+#include <cstring>
+#include <string>
+#include "parsedata_plugin.h"
+
+/* Pre-rendered article fields, type 'G'.
+ * A 'G' field holds the result of a parse-data plugin, so StarDict may show
+ * the field without parsing it again. See the "G" type in StarDictFileFormat
+ * for the format of the field data. */
+
+/* Types of fields that may be pre-rendered. The original field may follow
+ * the 'G' field, it is not shown then. */
+extern const gchar* const PRERENDERED_DATA_TYPE_STR;
+
+inline bool is_prerendered_data_type(gchar c)
+{
+	return c && strchr(PRERENDERED_DATA_TYPE_STR, c);
+}
+
+/* Append the serialized result to data.
+ * Return false if the result cannot be serialized, that is it contains
+ * widgets. data is not changed in that case. */
+bool serialize_parse_result(const ParseResult& result, std::string& data);
+/* data, size - contents of a 'G' field without the size prefix.
+ * Return false if the data is corrupt. */
+bool deserialize_parse_result(const char *data, guint32 size, ParseResult& result);
+
+#endif // _PRERENDERED_H_
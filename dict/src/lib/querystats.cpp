@@ -0,0 +1,217 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdarg>
+#include <cstring>
+
+#include "querystats.h"
+
+gboolean query_stats_enabled = FALSE;
+
+/* guards all counters, the global and the per dictionary ones */
+static GMutex query_stats_mutex;
+static QueryTypeStats query_stats[QueryType_NUMS];
+static gint64 query_stats_start = 0;
+
+static const char *const query_type_names[QueryType_NUMS] = {
+	"word",
+	"synonym",
+	"similar",
+	"fuzzy",
+	"pattern",
+	"regex",
+	"fulltext",
+	"article",
+	"resource",
+};
+
+static const char *const dict_counter_names[DictCounter_NUMS] = {
+	"index_page_loads",
+	"syn_page_loads",
+	"article_cache_hits",
+	"article_cache_misses",
+	"dictzip_inflates",
+	"dictzip_cache_hits",
+	"bytes_read",
+};
+
+const char *query_type_name(QueryType type)
+{
+	return query_type_names[type];
+}
+
+const char *dict_counter_name(DictCounter counter)
+{
+	return dict_counter_names[counter];
+}
+
+void DictStats::clear()
+{
+	memset(lookups, 0, sizeof(lookups));
+	memset(lookup_time, 0, sizeof(lookup_time));
+	memset(counters, 0, sizeof(counters));
+}
+
+void QueryTypeStats::clear()
+{
+	count = 0;
+	total_time = 0;
+	max_time = 0;
+	memset(histogram, 0, sizeof(histogram));
+}
+
+guint64 QueryTypeStats::percentile(double p) const
+{
+	if (count == 0)
+		return 0;
+	guint64 rank = guint64(p * count);
+	if (rank >= count)
+		rank = count - 1;
+	guint64 seen = 0;
+	for (int i = 0; i < QUERY_STATS_BUCKETS - 1; ++i) {
+		seen += histogram[i];
+		if (seen > rank) {
+			guint64 bound = G_GUINT64_CONSTANT(1) << i;
+			return bound < max_time ? bound : max_time;
+		}
+	}
+	return max_time;
+}
+
+static int query_stats_bucket(guint64 time)
+{
+	int bucket = 0;
+	while (time && bucket < QUERY_STATS_BUCKETS - 1) {
+		time >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+void query_stats_set_enabled(bool enabled)
+{
+	g_mutex_lock(&query_stats_mutex);
+	if (enabled && !query_stats_enabled)
+		query_stats_start = g_get_monotonic_time();
+	query_stats_enabled = enabled;
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+void query_stats_reset(void)
+{
+	g_mutex_lock(&query_stats_mutex);
+	for (int i = 0; i < QueryType_NUMS; ++i)
+		query_stats[i].clear();
+	query_stats_start = g_get_monotonic_time();
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+void query_stats_get(QueryStatsSnapshot &snapshot)
+{
+	g_mutex_lock(&query_stats_mutex);
+	for (int i = 0; i < QueryType_NUMS; ++i)
+		snapshot.queries[i] = query_stats[i];
+	snapshot.elapsed = query_stats_start ? g_get_monotonic_time() - query_stats_start : 0;
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+void query_stats_get_dict(const DictStats *dict, DictStats &copy)
+{
+	g_mutex_lock(&query_stats_mutex);
+	copy = *dict;
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+void query_stats_clear_dict(DictStats *dict)
+{
+	g_mutex_lock(&query_stats_mutex);
+	dict->clear();
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+void query_stats_add_query(QueryType type, DictStats *dict, bool whole, gint64 time)
+{
+	if (time < 0)
+		time = 0;
+	g_mutex_lock(&query_stats_mutex);
+	if (whole) {
+		QueryTypeStats &stats = query_stats[type];
+		++stats.count;
+		stats.total_time += time;
+		if (guint64(time) > stats.max_time)
+			stats.max_time = time;
+		++stats.histogram[query_stats_bucket(time)];
+	}
+	if (dict) {
+		++dict->lookups[type];
+		dict->lookup_time[type] += time;
+	}
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+void query_stats_add_counter(DictStats *dict, DictCounter counter, guint64 n)
+{
+	g_mutex_lock(&query_stats_mutex);
+	dict->counters[counter] += n;
+	g_mutex_unlock(&query_stats_mutex);
+}
+
+static void append_printf(std::string &str, const char *format, ...) G_GNUC_PRINTF(2, 3);
+
+static void append_printf(std::string &str, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	gchar *buf = g_strdup_vprintf(format, args);
+	va_end(args);
+	str += buf;
+	g_free(buf);
+}
+
+std::string QueryStatsSnapshot::to_string() const
+{
+	std::string res;
+	append_printf(res, "query stats for %.1f s\n", elapsed / 1e6);
+	for (int i = 0; i < QueryType_NUMS; ++i) {
+		const QueryTypeStats &stats = queries[i];
+		if (!stats.count)
+			continue;
+		append_printf(res, "%-9s count %" G_GUINT64_FORMAT ", avg %" G_GUINT64_FORMAT
+			" us, p50 %" G_GUINT64_FORMAT " us, p99 %" G_GUINT64_FORMAT
+			" us, max %" G_GUINT64_FORMAT " us\n",
+			query_type_name(QueryType(i)), stats.count, stats.total_time / stats.count,
+			stats.percentile(0.5), stats.percentile(0.99), stats.max_time);
+	}
+	for (size_t i = 0; i < dicts.size(); ++i) {
+		const DictStats &stats = dicts[i].stats;
+		append_printf(res, "dict \"%s\":", dicts[i].bookname.c_str());
+		for (int j = 0; j < QueryType_NUMS; ++j) {
+			if (stats.lookups[j])
+				append_printf(res, " %s %" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT " ms),",
+					query_type_name(QueryType(j)), stats.lookups[j], stats.lookup_time[j] / 1000);
+		}
+		for (int j = 0; j < DictCounter_NUMS; ++j)
+			append_printf(res, " %s %" G_GUINT64_FORMAT "%s",
+				dict_counter_name(DictCounter(j)), stats.counters[j],
+				j == DictCounter_NUMS - 1 ? "\n" : ",");
+	}
+	return res;
+}
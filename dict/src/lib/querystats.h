@@ -0,0 +1,162 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _QUERY_STATS_H_
+#define _QUERY_STATS_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+/* Lookup metrics: latency histogram of every kind of query plus per dictionary
+ * lookup counts, index page loads, article and dictzip cache efficiency and
+ * bytes read from the dictionary files.
+ *
+ * Counting is off by default. While it is off, an instrumented place costs
+ * a test of query_stats_enabled and nothing more.
+ * Counters may be updated from any thread, Libs is used from the worker threads
+ * of AsyncLookup and of background reload. */
+
+enum QueryType {
+	/* exact match of a word, Libs::LookupWord */
+	QueryType_WORD,
+	QueryType_SYNONYM,
+	/* the word in another case or without a suffix, Libs::LookupSimilarWord */
+	QueryType_SIMILAR,
+	QueryType_FUZZY,
+	QueryType_PATTERN,
+	QueryType_REGEX,
+	QueryType_FULLTEXT,
+	/* data of a found word, Libs::poGetOrigWordData */
+	QueryType_ARTICLE,
+	QueryType_RESOURCE,
+	QueryType_NUMS,
+};
+
+enum DictCounter {
+	DictCounter_INDEX_PAGE_LOADS,
+	DictCounter_SYN_PAGE_LOADS,
+	/* cache of DictBase::GetWordData */
+	DictCounter_ARTICLE_CACHE_HITS,
+	DictCounter_ARTICLE_CACHE_MISSES,
+	/* chunk cache of a .dict.dz file */
+	DictCounter_DICTZIP_INFLATES,
+	DictCounter_DICTZIP_CACHE_HITS,
+	/* from the index, synonym and data files; compressed bytes of .dict.dz */
+	DictCounter_BYTES_READ,
+	DictCounter_NUMS,
+};
+
+struct DictStats {
+	guint64 lookups[QueryType_NUMS];
+	/* time spent in the dictionary, in microseconds */
+	guint64 lookup_time[QueryType_NUMS];
+	guint64 counters[DictCounter_NUMS];
+
+	DictStats() { clear(); }
+	void clear();
+};
+
+/* Bucket 0 counts queries shorter than 1 microsecond, bucket i counts queries
+ * of [2^(i-1), 2^i) microseconds, the last bucket counts all longer queries. */
+const int QUERY_STATS_BUCKETS = 26;
+
+struct QueryTypeStats {
+	guint64 count;
+	/* in microseconds */
+	guint64 total_time;
+	guint64 max_time;
+	guint64 histogram[QUERY_STATS_BUCKETS];
+
+	QueryTypeStats() { clear(); }
+	void clear();
+	/* Upper bound of the bucket holding the p-quantile, 0 <= p <= 1,
+	 * in microseconds. */
+	guint64 percentile(double p) const;
+};
+
+struct QueryStatsSnapshot {
+	/* microseconds since counting was enabled or reset */
+	gint64 elapsed;
+	QueryTypeStats queries[QueryType_NUMS];
+	struct DictItem {
+		std::string bookname;
+		std::string ifofilename;
+		DictStats stats;
+	};
+	std::vector<DictItem> dicts;
+
+	QueryStatsSnapshot() : elapsed(0) {}
+	/* human readable report, one line per query type and per dictionary */
+	std::string to_string() const;
+};
+
+extern gboolean query_stats_enabled;
+
+const char *query_type_name(QueryType type);
+const char *dict_counter_name(DictCounter counter);
+void query_stats_set_enabled(bool enabled);
+/* Clear the latency histograms.
+ * Libs::reset_query_stats() clears the counters of the dictionaries too. */
+void query_stats_reset(void);
+/* Fill elapsed and queries of the snapshot, see Libs::get_query_stats(). */
+void query_stats_get(QueryStatsSnapshot &snapshot);
+void query_stats_get_dict(const DictStats *dict, DictStats &copy);
+void query_stats_clear_dict(DictStats *dict);
+
+/* implementation of query_stats_count() and QueryTimer */
+void query_stats_add_query(QueryType type, DictStats *dict, bool whole, gint64 time);
+void query_stats_add_counter(DictStats *dict, DictCounter counter, guint64 n);
+
+/* dict may be NULL, nothing is counted then */
+inline void query_stats_count(DictStats *dict, DictCounter counter, guint64 n = 1)
+{
+	if (G_UNLIKELY(query_stats_enabled) && dict)
+		query_stats_add_counter(dict, counter, n);
+}
+
+/* Measures the time from construction to destruction.
+ * The time is added to the latency histogram of type, and to the lookups
+ * of dict if it is not NULL.
+ * whole - false if the timer measures the part of a query spent in dict,
+ * such a part is not added to the histogram. */
+class QueryTimer {
+public:
+	QueryTimer(QueryType _type, DictStats *_dict = NULL, bool _whole = true)
+	:
+		type(_type),
+		dict(_dict),
+		whole(_whole),
+		start(G_UNLIKELY(query_stats_enabled) ? g_get_monotonic_time() : -1)
+	{
+	}
+	~QueryTimer()
+	{
+		if (G_UNLIKELY(start >= 0))
+			query_stats_add_query(type, dict, whole, g_get_monotonic_time() - start);
+	}
+private:
+	QueryTimer(const QueryTimer&);
+	QueryTimer& operator=(const QueryTimer&);
+
+	QueryType type;
+	DictStats *dict;
+	bool whole;
+	gint64 start;
+};
+
+#endif
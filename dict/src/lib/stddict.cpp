@@ -163,7 +163,7 @@ private:
 
 	// The length of "word_str" should be less than MAX_INDEX_KEY_SIZE. 
 	// See doc/StarDictFileFormat.
-	gchar wordentry_buf[MAX_INDEX_KEY_SIZE+sizeof(guint32)*2];
+	gchar wordentry_buf[MAX_INDEX_KEY_SIZE+sizeof(guint64)+sizeof(guint32)];
 	struct index_entry {
 		glong idx; // page number
 		std::string keystr;
@@ -180,7 +180,8 @@ private:
 
 	struct page_entry {
 		gchar *keystr;
-		guint32 off, size;
+		guint64 off;
+		guint32 size;
 	};
 	std::vector<gchar> page_data;
 	struct page_t {
@@ -188,7 +189,7 @@ private:
 		page_entry entries[ENTR_PER_PAGE];
 
 		page_t(): idx(-1) {}
-		void fill(gchar *data, gint nent, glong idx_);
+		void fill(const offset_index *index, gchar *data, gint nent, glong idx_);
 	} page;
 	gulong load_page(glong page_idx);
 	const gchar *read_first_on_page_key(glong page_idx);
@@ -217,6 +218,81 @@ private:
 	std::vector<gchar *> wordlist;
 };
 
+/* Index with a delta layer on top of the index of the dictionary.
+ * The delta layer is a small index file (".delta.idx") in the format of the
+ * ".idx" file of the dictionary plus a data file (".delta.dict" or ".delta.dict.dz").
+ * Delta entries replace all base entries with the same key.
+ * A delta entry with zero data size is a tombstone: it removes the base entries
+ * with its key and does not appear in the index itself.
+ *
+ * The merged index is never built. It consists of runs of consecutive entries
+ * taken either from the base index or from the delta index,
+ * an entry is found with a binary search on the runs. */
+class overlay_index : public index_file {
+public:
+	overlay_index();
+	/* Load the delta index. Call set_idxoffsetbits first. */
+	bool load_delta(const std::string& url);
+	/* base - loaded index of the dictionary, this object takes ownership of it.
+	 * baseurl - the file of the base index. */
+	void set_base(index_file *_base, const std::string& _baseurl);
+	/* url - the delta index file, wc and fsize are not used */
+	bool load(const std::string& url, gulong wc, gulong fsize,
+		  bool CreateCacheFile, CollationLevelType CollationLevel,
+		  CollateFunctions _CollateFunction, show_progress_t *sp);
+	void get_data(glong idx);
+	const gchar *get_key_and_data(glong idx);
+	glong get_synonym_target(glong idx);
+private:
+	const gchar *get_key(glong idx);
+	bool lookup(const char *str, glong &idx, glong &idx_suggest);
+	/* find the run containing idx, return index in the base or in live */
+	glong find_run(glong idx, bool &delta) const;
+	/* index of a base entry in the merged index, INVALID_INDEX if removed */
+	glong base_to_merged(glong base_idx) const;
+
+	std::auto_ptr<index_file> base;
+	std::string baseurl;
+	/* whole delta index file in memory */
+	std::vector<gchar> deltadata;
+	/* pointers to the keys of live (not tombstone) entries in deltadata */
+	std::vector<const gchar *> live;
+	/* delta entries with the same key */
+	struct group_t {
+		const gchar *key;
+		/* live entries of the group, [live_begin, live_begin + live_count) */
+		glong live_begin;
+		glong live_count;
+		/* base entries replaced by the group, [base_idx, base_idx + base_count).
+		 * If base_count == 0, base_idx is the position of the key in the base. */
+		glong base_idx;
+		glong base_count;
+		/* index of the first live entry of the group in the merged index */
+		glong merged_idx;
+	};
+	std::vector<group_t> groups;
+	struct run_t {
+		/* index of the first entry of the run in the merged index */
+		glong merged_idx;
+		/* index of the first entry in the base or in live */
+		glong idx;
+		bool delta;
+	};
+	std::vector<run_t> runs;
+	static bool compare_run_with_idx(glong idx, const run_t& run)
+	{
+		return idx < run.merged_idx;
+	}
+	static bool compare_group_with_base_idx(glong idx, const group_t& group)
+	{
+		return idx < group.base_idx;
+	}
+	static bool compare_group_with_key(const group_t& group, const char *str)
+	{
+		return stardict_strcmp(group.key, str) < 0;
+	}
+};
+
 offset_index::offset_index() : oft_file(CacheFileType_oft, COLLATE_FUNC_NONE)
 {
 	idxfile = NULL;
@@ -229,7 +305,7 @@ offset_index::~offset_index()
 		fclose(idxfile);
 }
 
-void offset_index::page_t::fill(gchar *data, gint nent, glong idx_)
+void offset_index::page_t::fill(const offset_index *index, gchar *data, gint nent, glong idx_)
 {
 	idx=idx_;
 	gchar *p=data;
@@ -238,10 +314,8 @@ void offset_index::page_t::fill(gchar *data, gint nent, glong idx_)
 		entries[i].keystr=p;
 		len=strlen(p);
 		p+=len+1;
-		entries[i].off=g_ntohl(get_uint32(p));
-		p+=sizeof(guint32);
-		entries[i].size=g_ntohl(get_uint32(p));
-		p+=sizeof(guint32);
+		index->read_entry_data(p, entries[i].off, entries[i].size);
+		p+=index->entry_data_size();
 	}
 }
 
@@ -259,6 +333,7 @@ inline const gchar *offset_index::read_first_on_page_key(glong page_idx)
 	if (fread_size != 1) {
 		g_print("fread error!\n");
 	}
+	query_stats_count(stats, DictCounter_BYTES_READ, minsize);
 	if(!check_key_str_len(wordentry_buf, minsize)) {
 		wordentry_buf[minsize-1] = '\0';
 		g_critical("Index key length exceeds allowed limit. Key: %s, "
@@ -286,279 +361,76 @@ cache_file::cache_file(CacheFileType _cachefiletype, CollateFunctions _cltfunc)
 {
 	wordoffset = NULL;
 	npages = 0;
-	mf = NULL;
+	stored = false;
 	cachefiletype = _cachefiletype;
 	cltfunc = _cltfunc;
+	has_stamp = false;
 }
 
 
 cache_file::~cache_file()
 {
-	if (mf)
-		delete mf;
-	else
+	if (!stored)
 		g_free(wordoffset);
 }
 
-#define OFFSETFILE_MAGIC_DATA "StarDict's oft file\nversion=2.4.8\n"
-#define COLLATIONFILE_MAGIC_DATA "StarDict's clt file\nversion=2.4.8\n"
-
-MapFile* cache_file::find_and_load_cache_file(const gchar *filename,
-	const std::string &url, const std::string &saveurl,
-	glong filedatasize, int next) const
+std::string cache_file::get_cache_key(const std::string& saveurl) const
 {
-	stardict_stat_t cachestat;
-	if (g_stat(filename, &cachestat)!=0)
-		return NULL;
-	std::auto_ptr<MapFile> mf(new MapFile);
-	if (!mf->open(filename, cachestat.st_size))
-		return NULL;
-	guint32  word_off_size = (get_uint32(mf->begin()) + 1) * sizeof(guint32);
-	if (word_off_size >= static_cast<guint32>(cachestat.st_size) ||
-	    *(mf->begin() + cachestat.st_size - 1) != '\0')
-		return NULL;
-
-	gchar *p = mf->begin() + word_off_size;
-	gboolean has_prefix;
-	if (cachefiletype == CacheFileType_oft)
-		has_prefix = g_str_has_prefix(p, OFFSETFILE_MAGIC_DATA);
-	else
-		has_prefix = g_str_has_prefix(p, COLLATIONFILE_MAGIC_DATA);
-	if (!has_prefix)
-		return NULL;
+	const char *type;
 	if (cachefiletype == CacheFileType_oft)
-		p+= sizeof(OFFSETFILE_MAGIC_DATA)-1-1;
+		type = "oft";
+	else if (cachefiletype == CacheFileType_rht)
+		type = "rht";
+	else if (cachefiletype == CacheFileType_clt)
+		type = "clt";
 	else
-		p+= sizeof(COLLATIONFILE_MAGIC_DATA)-1-1;
-	gchar *p2;
-	p2 = strstr(p, "\nurl=");
-	if (!p2)
-		return NULL;
-	p2+=sizeof("\nurl=")-1;
-	gchar *p3;
-	p3 = strchr(p2, '\n');
-	if (!p3)
-		return NULL;
-	std::string tmpstr(p2, p3-p2);
+		type = "server_clt";
+	glib::CharStr prefix(g_strdup_printf("%s:%d:", type, cltfunc));
 #ifdef _WIN32
-	tmpstr = abs_path_to_data_dir(tmpstr);
+	return get_impl(prefix) + rel_path_to_data_dir(saveurl);
+#else
+	return get_impl(prefix) + saveurl;
 #endif
-	if (is_equal_paths(saveurl, tmpstr)) {
-		if (cachefiletype == CacheFileType_clt) {
-			p2 = strstr(p, "\nfunc=");
-			if (!p2)
-				return NULL;
-			p2 += sizeof("\nfunc=")-1;
-			p3 = strchr(p2, '\n');
-			if (!p3)
-				return NULL;
-			tmpstr.assign(p2, p3-p2);
-			if (atoi(tmpstr.c_str())!=cltfunc)
-				return NULL;
-		}
-
-		if (static_cast<gulong>(cachestat.st_size)
-			!= static_cast<gulong>(filedatasize + sizeof(guint32) + strlen(mf->begin() + word_off_size) +1))
-			return NULL;
-		stardict_stat_t idxstat;
-		if (g_stat(url.c_str(), &idxstat)!=0)
-			return NULL;
-		if (cachestat.st_mtime<idxstat.st_mtime)
-			return NULL;
-		//g_print("Using map file: %s\n", filename);
-		return mf.release();
-	}
-	mf.reset();
-	glib::CharStr basename(g_path_get_basename(saveurl.c_str()));
-	p = strrchr(get_impl(basename), '.');
-	if (!p)
-		return NULL;
-	*p='\0';
-	gchar *extendname = p+1;
-	glib::CharStr dirname(g_path_get_dirname(filename));
-	glib::CharStr nextfilename(get_next_filename(get_impl(dirname),
-		get_impl(basename), next, extendname));
-	return find_and_load_cache_file(get_impl(nextfilename), url, saveurl, filedatasize, next+1);
 }
 
 bool cache_file::load_cache(const std::string& url, const std::string& saveurl,
 	glong filedatasize)
 {
 	g_assert(!wordoffset);
-	std::string oftfilename;
-	build_primary_cache_filename(saveurl, oftfilename);
-	/* First search the file in the dictionary directory, then in the cache 
-	 * directory. */
-	for (int i=0; i<2; i++) {
-		if (i==1) {
-			if (!build_primary_cache_filename_in_user_cache(saveurl, oftfilename, false))
-				break;
-		}
-		mf = find_and_load_cache_file(oftfilename.c_str(), url, saveurl, filedatasize, 2);
-		if (!mf)
-			continue;
-		wordoffset = reinterpret_cast<guint32 *>(mf->begin()) + 1;
-		npages = get_uint32(mf->begin());
-		return true;
-	}
-	return false;
-}
-
-bool cache_file::build_primary_cache_filename_in_user_cache(const std::string& url, std::string &cachefilename, bool create) const
-{
-	const std::string cache_dir(app_dirs->get_user_cache_dir());
-	if (create) {
-		if (!g_file_test(cache_dir.c_str(), G_FILE_TEST_EXISTS)) {
-			if (-1 == g_mkdir_with_parents(cache_dir.c_str(), 0700))
-				return false;
-		}
-	}
-	if (!g_file_test(cache_dir.c_str(), G_FILE_TEST_IS_DIR))
+	has_stamp = stamp.get(url);
+	if (!has_stamp)
 		return false;
-
-	gchar *base=g_path_get_basename(url.c_str());
-	build_primary_cache_filename(build_path(cache_dir, base), cachefilename);
-	g_free(base);
+	const size_t count = filedatasize / sizeof(guint32);
+	const guint32 *data = get_cache_store()->find(get_cache_key(saveurl), stamp, count);
+	if (!data)
+		return false;
+	wordoffset = const_cast<guint32 *>(data);
+	npages = count;
+	stored = true;
 	return true;
 }
 
-FILE* cache_file::find_and_open_for_overwrite_cache_file(const gchar *filename, const std::string &saveurl, int next, std::string &cfilename) const
-{
-	cfilename = filename;
-	stardict_stat_t oftstat;
-	if (g_stat(filename, &oftstat)!=0) {
-		return fopen(filename, "wb");
-	}
-	MapFile mf;
-	if (!mf.open(filename, oftstat.st_size)) {
-		return fopen(filename, "wb");
-	}
-	guint32  word_off_size = (get_uint32(mf.begin()) + 1) * sizeof(guint32);
-	if (word_off_size >= static_cast<guint32>(oftstat.st_size) ||
-	    *(mf.begin() + oftstat.st_size - 1) != '\0')
-		return fopen(filename, "wb");
-
-	gchar *p = mf.begin() + word_off_size;
-	bool has_prefix;
-	if (cachefiletype == CacheFileType_oft)
-		has_prefix = g_str_has_prefix(p, OFFSETFILE_MAGIC_DATA);
-	else
-		has_prefix = g_str_has_prefix(p, COLLATIONFILE_MAGIC_DATA);
-	if (!has_prefix) {
-		return fopen(filename, "wb");
-	}
-	if (cachefiletype == CacheFileType_oft)
-		p+= sizeof(OFFSETFILE_MAGIC_DATA)-1-1;
-	else
-		p+= sizeof(COLLATIONFILE_MAGIC_DATA)-1-1;
-	gchar *p2;
-	p2 = strstr(p, "\nurl=");
-	if (!p2) {
-		return fopen(filename, "wb");
-	}
-	p2+=sizeof("\nurl=")-1;
-	gchar *p3;
-	p3 = strchr(p2, '\n');
-	if (!p3) {
-		return fopen(filename, "wb");
-	}
-	std::string tmpstr(p2, p3-p2);
-#ifdef _WIN32
-	tmpstr = abs_path_to_data_dir(tmpstr);
-#endif
-	if (is_equal_paths(saveurl, tmpstr)) {
-		return fopen(filename, "wb");
-	}
-	mf.close();
-	glib::CharStr basename(g_path_get_basename(saveurl.c_str()));
-	p = strrchr(get_impl(basename), '.');
-	if (!p)
-		return NULL;
-	*p='\0';
-	gchar *extendname = p+1;
-	glib::CharStr dirname(g_path_get_dirname(filename));
-	glib::CharStr nextfilename(get_next_filename(get_impl(dirname),
-		get_impl(basename), next, extendname));
-	return find_and_open_for_overwrite_cache_file(get_impl(nextfilename), saveurl, next+1, cfilename);
-}
-
 bool cache_file::save_cache(const std::string& saveurl) const
 {
-	std::string oftfilename;
-	build_primary_cache_filename(saveurl, oftfilename);
-	for (int i=0;i<2;i++) {
-		if (i==1) {
-			if (!build_primary_cache_filename_in_user_cache(saveurl, oftfilename, true))
-				break;
-		}
-		std::string cfilename;
-		FILE *out= find_and_open_for_overwrite_cache_file(oftfilename.c_str(), saveurl, 2, cfilename);
-		if (!out)
-			continue;
-		guint32 nentries = npages;
-		fwrite(&nentries, sizeof(nentries), 1, out);
-		fwrite(wordoffset, sizeof(guint32), npages, out);
-		if (cachefiletype == CacheFileType_oft)
-			fwrite(OFFSETFILE_MAGIC_DATA, 1, sizeof(OFFSETFILE_MAGIC_DATA)-1, out);
-		else
-			fwrite(COLLATIONFILE_MAGIC_DATA, 1, sizeof(COLLATIONFILE_MAGIC_DATA)-1, out);
-		fwrite("url=", 1, sizeof("url=")-1, out);
-#ifdef _WIN32
-		const std::string url_rel(rel_path_to_data_dir(saveurl));
-		fwrite(url_rel.c_str(), 1, url_rel.length(), out);
-#else
-		fwrite(saveurl.c_str(), 1, saveurl.length(), out);
-#endif
-		if (cachefiletype == CacheFileType_clt) {
-#ifdef _MSC_VER
-			fprintf_s(out, "\nfunc=%d", cltfunc);
-#else
-			fprintf(out, "\nfunc=%d", cltfunc);
-#endif
-		}
-		fwrite("\n", 1, 2, out);
-		fclose(out);
-		g_print("Save cache file: %s\n", cfilename.c_str());
-		return true;
-	}
-	return false;
+	if (!has_stamp)
+		return false;
+	return get_cache_store()->add(get_cache_key(saveurl), stamp, wordoffset, npages);
 }
 
 void cache_file::allocate_wordoffset(size_t _npages)
 {
 	g_assert(!wordoffset);
-	if(mf) {
-		delete mf;
-		mf = NULL;
-	}
 	wordoffset = (guint32 *)g_malloc(_npages * sizeof(guint32));
 	npages = _npages;
 }
 
-gchar *cache_file::get_next_filename(
-	const gchar *dirname, const gchar *basename, int num,
-	const gchar *extendname) const
-{
-	if (cachefiletype == CacheFileType_oft)
-		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.oft", dirname, basename, num, extendname);
-	else if (cachefiletype == CacheFileType_clt)
-		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.clt", dirname, basename, num, extendname);
-	else
-		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.%d.clt", dirname, basename, num, extendname, cltfunc);
-}
-
-void cache_file::build_primary_cache_filename(const std::string &url,
-	std::string &filename) const
+void cache_file::drop_cache(void)
 {
-	if (cachefiletype == CacheFileType_oft) {
-		filename=url+".oft";
-	} else if (cachefiletype == CacheFileType_clt) {
-		filename=url+".clt";
-	} else {
-		gchar *func = g_strdup_printf("%d", cltfunc);
-		filename=url+'.'+func+".clt";
-		g_free(func);
-	}
+	if (!stored)
+		g_free(wordoffset);
+	wordoffset = NULL;
+	npages = 0;
+	stored = false;
 }
 
 collation_file::collation_file(idxsyn_file *_idx_file, CacheFileType _cachefiletype,
@@ -649,7 +521,8 @@ static gint sort_collation_index(gconstpointer a, gconstpointer b, gpointer user
 idxsyn_file::idxsyn_file()
 :
 	clt_file(NULL),
-	wordcount(0)
+	wordcount(0),
+	stats(NULL)
 {
 	memset(clt_files, 0, sizeof(clt_files));
 }
@@ -675,6 +548,11 @@ const gchar *idxsyn_file::getWord(glong idx, CollationLevelType CollationLevel,
 
 bool idxsyn_file::Lookup(const char *str, glong &idx, glong &idx_suggest, CollationLevelType CollationLevel, int servercollatefunc)
 {
+	if (wordcount == 0) {
+		idx = INVALID_INDEX;
+		idx_suggest = INVALID_INDEX;
+		return false;
+	}
 	if (CollationLevel == CollationLevel_NONE)
 		return lookup(str, idx, idx_suggest);
 	if (CollationLevel == CollationLevel_SINGLE)
@@ -743,7 +621,7 @@ bool offset_index::load(const std::string& url, gulong wc, gulong fsize,
 		gulong index_size;
 		guint32 j=0;
 		for (guint32 i=0; i<wc; i++) {
-			index_size=strlen(p1) +1 + 2*sizeof(guint32);
+			index_size=strlen(p1) +1 + entry_data_size();
 			if (i % ENTR_PER_PAGE==0) {
 				oft_file.get_wordoffset(j)=p1-idxdatabuffer;
 				++j;
@@ -795,7 +673,9 @@ inline gulong offset_index::load_page(glong page_idx)
 		if (fread_size != page_data_size) {
 			g_print("fread error!\n");
 		}
-		page.fill(&page_data[0], nentr, page_idx);
+		page.fill(this, &page_data[0], nentr, page_idx);
+		query_stats_count(stats, DictCounter_INDEX_PAGE_LOADS);
+		query_stats_count(stats, DictCounter_BYTES_READ, page_data_size);
 	}
 
 	return nentr;
@@ -951,7 +831,7 @@ bool compressed_index::load(const std::string& url, gulong wc, gulong fsize,
 	guint32 i;
 	for (i=0; i<wc; i++) {
 		wordlist[i] = p1;
-		p1 += strlen(p1) +1 + 2*sizeof(guint32);
+		p1 += strlen(p1) +1 + entry_data_size();
 	}
 	/* pointer to the next to last word entry */
 	wordlist[wc] = p1;
@@ -978,9 +858,7 @@ const gchar *compressed_index::get_key(glong idx)
 void compressed_index::get_data(glong idx)
 {
 	gchar *p1 = wordlist[idx]+strlen(wordlist[idx])+sizeof(gchar);
-	wordentry_offset = g_ntohl(get_uint32(p1));
-	p1 += sizeof(guint32);
-	wordentry_size = g_ntohl(get_uint32(p1));
+	read_entry_data(p1, wordentry_offset, wordentry_size);
 }
 
 const gchar *compressed_index::get_key_and_data(glong idx)
@@ -1038,7 +916,250 @@ bool compressed_index::lookup(const char *str, glong &idx, glong &idx_suggest)
 	return bFound;
 }
 
+overlay_index::overlay_index()
+{
+}
+
+bool overlay_index::load_delta(const std::string& url)
+{
+	gchar *contents;
+	gsize length;
+	if (!g_file_get_contents(url.c_str(), &contents, &length, NULL))
+		return false;
+	deltadata.assign(contents, contents + length);
+	g_free(contents);
+	const gchar *p = deltadata.empty() ? NULL : &deltadata[0];
+	const gchar *end = p + deltadata.size();
+	while (p < end) {
+		const gchar *key = p;
+		const gchar *key_end = static_cast<const gchar *>(memchr(p, '\0', end - p));
+		if (!key_end || gulong(end - key_end - 1) < entry_data_size()) {
+			g_warning("Delta index %s is corrupted.", url.c_str());
+			return false;
+		}
+		guint64 offset;
+		guint32 size;
+		read_entry_data(key_end + 1, offset, size);
+		p = key_end + 1 + entry_data_size();
+		if (groups.empty() || strcmp(groups.back().key, key) != 0) {
+			if (!groups.empty() && stardict_strcmp(groups.back().key, key) > 0) {
+				g_warning("Delta index %s is not sorted.", url.c_str());
+				return false;
+			}
+			group_t group;
+			group.key = key;
+			group.live_begin = live.size();
+			group.live_count = 0;
+			group.base_idx = 0;
+			group.base_count = 0;
+			group.merged_idx = 0;
+			groups.push_back(group);
+		}
+		if (size) {
+			live.push_back(key);
+			++groups.back().live_count;
+		}
+	}
+	return true;
+}
+
+void overlay_index::set_base(index_file *_base, const std::string& _baseurl)
+{
+	base.reset(_base);
+	baseurl = _baseurl;
+}
+
+bool overlay_index::load(const std::string& url, gulong wc, gulong fsize,
+			 bool CreateCacheFile, CollationLevelType CollationLevel,
+			 CollateFunctions _CollateFunction, show_progress_t *sp)
+{
+	const glong base_wc = base->get_word_count();
+	/* find base entries with keys of the groups */
+	for (size_t i=0; i<groups.size(); ++i) {
+		group_t& group = groups[i];
+		glong idx, idx_suggest;
+		if (base->lookup(group.key, idx, idx_suggest)) {
+			glong last = idx;
+			while (idx > 0 && strcmp(base->get_key(idx-1), group.key) == 0)
+				--idx;
+			while (last < base_wc-1 && strcmp(base->get_key(last+1), group.key) == 0)
+				++last;
+			group.base_idx = idx;
+			group.base_count = last - idx + 1;
+		} else {
+			group.base_idx = idx == INVALID_INDEX ? base_wc : idx;
+			group.base_count = 0;
+		}
+	}
+	/* build runs of the merged index */
+	glong merged = 0, base_pos = 0;
+	for (size_t i=0; i<groups.size(); ++i) {
+		group_t& group = groups[i];
+		if (group.base_idx > base_pos) {
+			run_t run = { merged, base_pos, false };
+			runs.push_back(run);
+			merged += group.base_idx - base_pos;
+		}
+		group.merged_idx = merged;
+		if (group.live_count) {
+			run_t run = { merged, group.live_begin, true };
+			runs.push_back(run);
+			merged += group.live_count;
+		}
+		base_pos = std::max(base_pos, group.base_idx + group.base_count);
+	}
+	if (base_pos < base_wc) {
+		run_t run = { merged, base_pos, false };
+		runs.push_back(run);
+		merged += base_wc - base_pos;
+	}
+	/* a delta may delete every base entry, the dictionary has no words then */
+	wordcount = merged;
+
+	if (CollationLevel != CollationLevel_NONE) {
+		/* The collation depends on both indexes. The cache file is named after
+		 * the delta index and must not be older than any of them. */
+		std::string dateurl = url;
+		stardict_stat_t basestat, deltastat;
+		if (g_stat(baseurl.c_str(), &basestat) == 0 && g_stat(url.c_str(), &deltastat) == 0
+			&& basestat.st_mtime > deltastat.st_mtime)
+			dateurl = baseurl;
+		collate_save_info(dateurl, url);
+		if (CollationLevel == CollationLevel_SINGLE)
+			collate_load(_CollateFunction, CollationLevel_SINGLE, sp);
+	}
+	return true;
+}
+
+glong overlay_index::find_run(glong idx, bool &delta) const
+{
+	std::vector<run_t>::const_iterator it
+		= std::upper_bound(runs.begin(), runs.end(), idx, compare_run_with_idx);
+	--it;
+	delta = it->delta;
+	return it->idx + (idx - it->merged_idx);
+}
+
+glong overlay_index::base_to_merged(glong base_idx) const
+{
+	std::vector<group_t>::const_iterator it
+		= std::upper_bound(groups.begin(), groups.end(), base_idx, compare_group_with_base_idx);
+	if (it == groups.begin())
+		return base_idx;
+	--it;
+	const glong group_end = it->base_idx + it->base_count;
+	if (base_idx < group_end)
+		return INVALID_INDEX;
+	return it->merged_idx + it->live_count + (base_idx - group_end);
+}
+
+const gchar *overlay_index::get_key(glong idx)
+{
+	bool delta;
+	const glong i = find_run(idx, delta);
+	if (delta)
+		return live[i];
+	return base->get_key(i);
+}
+
+void overlay_index::get_data(glong idx)
+{
+	get_key_and_data(idx);
+}
+
+const gchar *overlay_index::get_key_and_data(glong idx)
+{
+	bool delta;
+	const glong i = find_run(idx, delta);
+	if (delta) {
+		const gchar *key = live[i];
+		read_entry_data(key + strlen(key) + 1, wordentry_offset, wordentry_size);
+		wordentry_offset |= OVERLAY_DATA_OFFSET;
+		return key;
+	}
+	const gchar *key = base->get_key_and_data(i);
+	wordentry_offset = base->wordentry_offset;
+	wordentry_size = base->wordentry_size;
+	return key;
+}
+
+/* Synonyms refer to base entries. A synonym of a replaced entry refers to
+ * the first replacement, a synonym of a deleted entry refers to nothing. */
+glong overlay_index::get_synonym_target(glong idx)
+{
+	const glong merged_idx = base_to_merged(idx);
+	if (merged_idx != INVALID_INDEX)
+		return merged_idx;
+	std::vector<group_t>::const_iterator it
+		= std::upper_bound(groups.begin(), groups.end(), idx, compare_group_with_base_idx);
+	--it;
+	return it->live_count ? it->merged_idx : INVALID_INDEX;
+}
+
+bool overlay_index::lookup(const char *str, glong &idx, glong &idx_suggest)
+{
+	if (wordcount == 0) {
+		idx = INVALID_INDEX;
+		idx_suggest = INVALID_INDEX;
+		return false;
+	}
+	glong base_idx, base_suggest;
+	bool bFound = base->lookup(str, base_idx, base_suggest);
+	if (base_idx == INVALID_INDEX)
+		base_idx = base->get_word_count();
+	std::vector<group_t>::const_iterator it
+		= std::lower_bound(groups.begin(), groups.end(), str, compare_group_with_key);
+	if (it != groups.end() && strcmp(it->key, str) == 0) {
+		/* a tombstone leaves the position where the key would be */
+		bFound = it->live_count > 0;
+		idx = it->merged_idx;
+	} else if (bFound) {
+		idx = base_to_merged(base_idx);
+	} else if (it == groups.begin()) {
+		idx = base_idx;
+	} else {
+		/* base entries between the previous group and str follow its live entries */
+		--it;
+		idx = it->merged_idx + it->live_count + (base_idx - (it->base_idx + it->base_count));
+	}
+	if (bFound) {
+		idx_suggest = idx;
+		return true;
+	}
+	if (idx >= wordcount) {
+		idx = INVALID_INDEX;
+		idx_suggest = wordcount-1;
+		return false;
+	}
+	idx_suggest = idx;
+	gint best, back;
+	best = prefix_match (str, get_key(idx_suggest));
+	for (;;) {
+		glong iTo = idx_suggest-1;
+		if (iTo < 0)
+			break;
+		back = prefix_match (str, get_key(iTo));
+		if (!back || back < best)
+			break;
+		best = back;
+		idx_suggest = iTo;
+	}
+	return false;
+}
+
 //===================================================================
+void index_file::read_entry_data(const gchar *p, guint64 &offset, guint32 &size) const
+{
+	if (idxoffsetbits == 64) {
+		offset = GUINT64_FROM_BE(get_uint64(p));
+		p += sizeof(guint64);
+	} else {
+		offset = g_ntohl(get_uint32(p));
+		p += sizeof(guint32);
+	}
+	size = g_ntohl(get_uint32(p));
+}
+
 index_file* index_file::Create(const std::string& filebasename, 
 		const char* mainext, std::string& fullfilename)
 {
@@ -1092,6 +1213,7 @@ inline const gchar *synonym_file::read_first_on_page_key(glong page_idx)
 	if (fread_size != 1) {
 		g_print("fread error!\n");
 	}
+	query_stats_count(stats, DictCounter_BYTES_READ, minsize);
 	return wordentry_buf;
 }
 
@@ -1181,6 +1303,8 @@ inline gulong synonym_file::load_page(glong page_idx)
 			g_print("fread error!\n");
 		}
 		page.fill(&page_data[0], nentr, page_idx);
+		query_stats_count(stats, DictCounter_SYN_PAGE_LOADS);
+		query_stats_count(stats, DictCounter_BYTES_READ, page_data_size);
 	}
 
 	return nentr;
@@ -1286,33 +1410,88 @@ Dict::~Dict()
 	delete storage;
 }
 
+std::string Dict::get_files_stamp(const std::string& filebasename)
+{
+	static const char *const exts[] = { ".ifo", ".idx", ".idx.gz", ".dict", ".dict.dz",
+		".syn", ".delta.idx", ".delta.dict", ".delta.dict.dz", NULL };
+	std::string stamp;
+	for (int i=0; exts[i]; ++i) {
+		stardict_stat_t stats;
+		if (g_stat((filebasename + exts[i]).c_str(), &stats)) {
+			stamp += "-;";
+		} else {
+			gchar *buf = g_strdup_printf("%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ";",
+				(guint64)stats.st_mtime, (guint64)stats.st_size);
+			stamp += buf;
+			g_free(buf);
+		}
+	}
+	return stamp;
+}
+
+bool Dict::is_changed() const
+{
+	const std::string filebasename
+		= ifo_file_name.substr(0, ifo_file_name.length()-sizeof(".ifo")+1);
+	return get_files_stamp(filebasename) != files_stamp;
+}
+
 bool Dict::load(const std::string& ifofilename, bool CreateCacheFile,
 	CollationLevelType CollationLevel, CollateFunctions CollateFunction,
 	show_progress_t *sp)
 {
 	gulong idxfilesize;
 	glong wordcount, synwordcount;
-	if (!load_ifofile(ifofilename, idxfilesize, wordcount, synwordcount))
+	guint32 idxoffsetbits;
+	if (!load_ifofile(ifofilename, idxfilesize, wordcount, synwordcount, idxoffsetbits))
 		return false;
 	sp->notify_about_start(_("Loading..."));
 
 	// ifofilename without extension - base file name
 	std::string filebasename
 		= ifofilename.substr(0, ifofilename.length()-sizeof(".ifo")+1);
+	/* taken before the files are read, so changes made while loading are noticed */
+	files_stamp = get_files_stamp(filebasename);
 	if(!DictBase::load(filebasename, "dict"))
 		return false;
 
+	/* optional delta layer, see overlay_index */
+	std::auto_ptr<overlay_index> overlay;
+	const std::string deltafilename = filebasename + ".delta.idx";
+	if (g_file_test(deltafilename.c_str(), G_FILE_TEST_EXISTS)) {
+		overlay.reset(new overlay_index);
+		overlay->set_idxoffsetbits(idxoffsetbits);
+		if (!overlay->load_delta(deltafilename)
+			|| !DictBase::load_overlay(filebasename + ".delta", "dict")) {
+			g_warning("Unable to load the delta layer of %s, ignoring it.", ifofilename.c_str());
+			overlay.reset();
+		}
+	}
+
 	std::string fullfilename;
 	idx_file.reset(index_file::Create(filebasename, "idx", fullfilename));
+	idx_file->set_idxoffsetbits(idxoffsetbits);
+	/* the delta index is in memory, only the base index reads pages */
+	idx_file->set_stats(&stats);
+	/* the merged index is collated, not the base one */
 	if (!idx_file->load(fullfilename, wordcount, idxfilesize,
-			    CreateCacheFile, CollationLevel,
+			    CreateCacheFile, overlay.get() ? CollationLevel_NONE : CollationLevel,
 			    CollateFunction, sp))
 		return false;
+	if (overlay.get()) {
+		overlay->set_base(idx_file.release(), fullfilename);
+		idx_file.reset(overlay.release());
+		if (!idx_file->load(deltafilename, 0, 0, CreateCacheFile,
+				CollationLevel, CollateFunction, sp))
+			return false;
+		wordcount = idx_file->get_word_count();
+	}
 
 	if (synwordcount) {
 		fullfilename = filebasename + ".syn";
 		if (g_file_test(fullfilename.c_str(), G_FILE_TEST_EXISTS)) {
 			syn_file.reset(new synonym_file);
+			syn_file->set_stats(&stats);
 			if (!syn_file->load(fullfilename, synwordcount,
 					    CreateCacheFile, CollationLevel,
 					    CollateFunction, sp))
@@ -1328,7 +1507,7 @@ bool Dict::load(const std::string& ifofilename, bool CreateCacheFile,
 	return true;
 }
 
-bool Dict::load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glong &wordcount, glong &synwordcount)
+bool Dict::load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glong &wordcount, glong &synwordcount, guint32 &idxoffsetbits)
 {
 	DictInfo dict_info;
 	if (!dict_info.load_from_ifo_file(ifofilename, DictInfoType_NormDict))
@@ -1340,6 +1519,7 @@ bool Dict::load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glo
 	idxfilesize=dict_info.get_index_file_size();
 	wordcount=dict_info.get_wordcount();
 	synwordcount=dict_info.get_synwordcount();
+	idxoffsetbits=dict_info.get_idxoffsetbits();
 
 	sametypesequence=dict_info.get_sametypesequence();
 	dicttype=dict_info.get_dicttype();
@@ -1452,50 +1632,121 @@ bool Dict::LookupSynonym(const char *str, glong &synidx, glong &synidx_suggest,
 	return syn_file->Lookup(str, synidx, synidx_suggest, CollationLevel, servercollatefunc);
 }
 
-bool Dict::LookupWithRule(GPatternSpec *pspec, glong *aIndex, int iBuffLen)
+/* Guards the changes of lookup states other than LookupState_RUN, a running
+ * lookup only reads its state with g_atomic_int_get. */
+static GMutex lookup_state_mutex;
+static GCond lookup_state_cond;
+
+bool lookup_state_check(gint *state)
+{
+	if (g_atomic_int_get(state) == LookupState_RUN)
+		return false;
+	g_mutex_lock(&lookup_state_mutex);
+	if (g_atomic_int_get(state) == LookupState_PAUSE) {
+		g_atomic_int_set(state, LookupState_PAUSED);
+		g_cond_broadcast(&lookup_state_cond);
+	}
+	while (g_atomic_int_get(state) == LookupState_PAUSED)
+		g_cond_wait(&lookup_state_cond, &lookup_state_mutex);
+	const bool stop = g_atomic_int_get(state) == LookupState_STOP;
+	g_mutex_unlock(&lookup_state_mutex);
+	return stop;
+}
+
+void lookup_state_done(gint *state)
+{
+	g_mutex_lock(&lookup_state_mutex);
+	if (g_atomic_int_get(state) != LookupState_STOP)
+		g_atomic_int_set(state, LookupState_DONE);
+	g_cond_broadcast(&lookup_state_cond);
+	g_mutex_unlock(&lookup_state_mutex);
+}
+
+void lookup_state_stop(gint *state)
+{
+	g_mutex_lock(&lookup_state_mutex);
+	g_atomic_int_set(state, LookupState_STOP);
+	g_cond_broadcast(&lookup_state_cond);
+	g_mutex_unlock(&lookup_state_mutex);
+}
+
+void lookup_state_pause(gint *state)
+{
+	g_mutex_lock(&lookup_state_mutex);
+	if (g_atomic_int_get(state) == LookupState_RUN)
+		g_atomic_int_set(state, LookupState_PAUSE);
+	while (g_atomic_int_get(state) == LookupState_PAUSE)
+		g_cond_wait(&lookup_state_cond, &lookup_state_mutex);
+	g_mutex_unlock(&lookup_state_mutex);
+}
+
+void lookup_state_resume(gint *state)
+{
+	g_mutex_lock(&lookup_state_mutex);
+	const gint old = g_atomic_int_get(state);
+	if (old == LookupState_PAUSE || old == LookupState_PAUSED) {
+		g_atomic_int_set(state, LookupState_RUN);
+		g_cond_broadcast(&lookup_state_cond);
+	}
+	g_mutex_unlock(&lookup_state_mutex);
+}
+
+bool Dict::LookupWithRule(GPatternSpec *pspec, glong *aIndex, int iBuffLen, gint *state)
 {
 	int iIndexCount=0;
-	for (glong i=0; i<narticles() && iIndexCount<iBuffLen-1; i++)
+	for (glong i=0; i<narticles() && iIndexCount<iBuffLen-1; i++) {
+		if (state && lookup_state_check(state))
+			break;
 		// Need to deal with same word in index? But this will slow down processing in most case.
 		if (g_pattern_match_string(pspec, idx_file->getWord(i, CollationLevel_NONE, 0)))
 			aIndex[iIndexCount++]=i;
+	}
 	aIndex[iIndexCount]= -1; // -1 is the end.
 	return (iIndexCount>0);
 }
 
-bool Dict::LookupWithRuleSynonym(GPatternSpec *pspec, glong *aIndex, int iBuffLen)
+bool Dict::LookupWithRuleSynonym(GPatternSpec *pspec, glong *aIndex, int iBuffLen, gint *state)
 {
 	if (syn_file.get() == NULL)
 		return false;
 	int iIndexCount=0;
-	for (glong i=0; i<nsynarticles() && iIndexCount<iBuffLen-1; i++)
+	for (glong i=0; i<nsynarticles() && iIndexCount<iBuffLen-1; i++) {
+		if (state && lookup_state_check(state))
+			break;
 		// Need to deal with same word in index? But this will slow down processing in most case.
 		if (g_pattern_match_string(pspec, syn_file->getWord(i, CollationLevel_NONE, 0)))
 			aIndex[iIndexCount++]=i;
+	}
 	aIndex[iIndexCount]= -1; // -1 is the end.
 	return (iIndexCount>0);
 }
 
-bool Dict::LookupWithRegex(GRegex *regex, glong *aIndex, int iBuffLen)
+bool Dict::LookupWithRegex(GRegex *regex, glong *aIndex, int iBuffLen, gint *state)
 {
 	int iIndexCount=0;
-	for (glong i=0; i<narticles() && iIndexCount<iBuffLen-1; i++)
+	for (glong i=0; i<narticles() && iIndexCount<iBuffLen-1; i++) {
+		if (state && lookup_state_check(state))
+			break;
 		// Need to deal with same word in index? But this will slow down processing in most case.
 		if (g_regex_match(regex, idx_file->getWord(i, CollationLevel_NONE, 0), (GRegexMatchFlags)0, NULL))
 			aIndex[iIndexCount++]=i;
+	}
 	aIndex[iIndexCount]= -1; // -1 is the end.
 	return (iIndexCount>0);
 }
 
-bool Dict::LookupWithRegexSynonym(GRegex *regex, glong *aIndex, int iBuffLen)
+bool Dict::LookupWithRegexSynonym(GRegex *regex, glong *aIndex, int iBuffLen, gint *state)
 {
 	if (syn_file.get() == NULL)
 		return false;
 	int iIndexCount=0;
-	for (glong i=0; i<nsynarticles() && iIndexCount<iBuffLen-1; i++)
+	for (glong i=0; i<nsynarticles() && iIndexCount<iBuffLen-1; i++) {
+		if (state && lookup_state_check(state))
+			break;
 		// Need to deal with same word in index? But this will slow down processing in most case.
 		if (g_regex_match(regex, syn_file->getWord(i, CollationLevel_NONE, 0), (GRegexMatchFlags)0, NULL))
 			aIndex[iIndexCount++]=i;
+	}
 	aIndex[iIndexCount]= -1; // -1 is the end.
 	return (iIndexCount>0);
 }
@@ -1509,6 +1760,10 @@ Libs::Libs(show_progress_t *sp, bool create_cache_files, CollationLevelType leve
 	show_progress(NULL),
 	CreateCacheFile(create_cache_files)
 {
+#ifdef SD_CLIENT_CODE
+	reload_job = NULL;
+	reload_thread = NULL;
+#endif
 #ifdef SD_SERVER_CODE
 	root_info_item = NULL;
 #endif
@@ -1521,6 +1776,9 @@ Libs::Libs(show_progress_t *sp, bool create_cache_files, CollationLevelType leve
 
 Libs::~Libs()
 {
+#ifdef SD_CLIENT_CODE
+	cancel_reload();
+#endif
 #ifdef SD_SERVER_CODE
 	if (root_info_item)
 		delete root_info_item;
@@ -2083,6 +2341,7 @@ void Libs::load(const std::list<std::string> &load_list)
 
 void Libs::reload(const std::list<std::string> &load_list, CollationLevelType NewCollationLevel, CollateFunctions collf)
 {
+	cancel_reload();
 	ValidateCollateParams(NewCollationLevel, collf);
 	if (NewCollationLevel == CollationLevel && collf == CollateFunction) {
 		std::vector<Dict *> prev(oLib);
@@ -2090,7 +2349,7 @@ void Libs::reload(const std::list<std::string> &load_list, CollationLevelType Ne
 		for (std::list<std::string>::const_iterator i = load_list.begin(); i != load_list.end(); ++i) {
 			std::vector<Dict *>::iterator it;
 			for (it=prev.begin(); it!=prev.end(); ++it) {
-				if ((*it)->ifofilename()==*i)
+				if ((*it)->ifofilename()==*i && !(*it)->is_changed())
 					break;
 			}
 			if (it==prev.end()) {
@@ -2115,6 +2374,168 @@ void Libs::reload(const std::list<std::string> &load_list, CollationLevelType Ne
 		load(load_list);
 	}
 }
+
+bool Libs::has_changed_dicts() const
+{
+	for (std::vector<Dict *>::const_iterator it = oLib.begin(); it != oLib.end(); ++it)
+		if ((*it)->is_changed())
+			return true;
+	return false;
+}
+
+struct Libs::ReloadJob {
+	std::vector<std::string> load_list;
+	/* current dictionaries that are kept, NULL - the dictionary is loaded anew */
+	std::vector<Dict *> kept;
+	/* dictionaries loaded by the worker thread, NULL - kept or failed to load */
+	std::vector<Dict *> loaded;
+	bool CreateCacheFile;
+	CollationLevelType CollationLevel;
+	CollateFunctions CollateFunction;
+	/* Set by cancel_reload, the worker thread stops loading before the next
+	 * dictionary. Accessed with g_atomic_int_*. When non-zero, on_reload_loaded
+	 * frees the job. */
+	gint cancel;
+	/* the worker thread is done, set in the main loop */
+	bool done;
+	on_reload_end_func_t func;
+	gpointer user_data;
+
+	~ReloadJob()
+	{
+		for (size_t i=0; i<loaded.size(); ++i)
+			delete loaded[i];
+	}
+};
+
+void Libs::start_reload(const std::list<std::string> &load_list, CollationLevelType NewCollationLevel, CollateFunctions collf,
+	on_reload_end_func_t func, gpointer user_data)
+{
+	cancel_reload();
+	ValidateCollateParams(NewCollationLevel, collf);
+	const bool same_collation = NewCollationLevel == CollationLevel && collf == CollateFunction;
+	ReloadJob *job = new ReloadJob;
+	for (std::list<std::string>::const_iterator i = load_list.begin(); i != load_list.end(); ++i) {
+		Dict *kept = NULL;
+		for (std::vector<Dict *>::iterator it=oLib.begin(); same_collation && it!=oLib.end(); ++it) {
+			if ((*it)->ifofilename()==*i && !(*it)->is_changed()) {
+				kept = *it;
+				break;
+			}
+		}
+		job->load_list.push_back(*i);
+		job->kept.push_back(kept);
+	}
+	job->loaded.resize(job->load_list.size(), NULL);
+	job->CreateCacheFile = CreateCacheFile;
+	job->CollationLevel = NewCollationLevel;
+	job->CollateFunction = collf;
+	job->cancel = 0;
+	job->done = false;
+	job->func = func;
+	job->user_data = user_data;
+	/* The current dictionaries keep using the old collation till finish_reload. */
+	if (!same_collation)
+		init_collations(NewCollationLevel, collf);
+	reload_job = job;
+	reload_thread = g_thread_new("reload_thread", reload_thread_func, job);
+}
+
+gpointer Libs::reload_thread_func(gpointer data)
+{
+	ReloadJob *job = static_cast<ReloadJob *>(data);
+	for (size_t i=0; i<job->load_list.size() && !g_atomic_int_get(&job->cancel); ++i) {
+		if (job->kept[i])
+			continue;
+		/* The progress of a background reload is not shown. */
+		Dict *lib = new Dict;
+		if (lib->load(job->load_list[i], job->CreateCacheFile, job->CollationLevel,
+			job->CollateFunction, &default_show_progress))
+			job->loaded[i] = lib;
+		else
+			delete lib;
+	}
+	g_idle_add(on_reload_loaded, job);
+	return NULL;
+}
+
+gboolean Libs::on_reload_loaded(gpointer data)
+{
+	ReloadJob *job = static_cast<ReloadJob *>(data);
+	if (g_atomic_int_get(&job->cancel)) {
+		delete job;
+		return FALSE;
+	}
+	job->done = true;
+	job->func(job->user_data);
+	return FALSE;
+}
+
+void Libs::join_reload_thread()
+{
+	if (reload_thread) {
+		g_thread_join(reload_thread);
+		reload_thread = NULL;
+	}
+}
+
+void Libs::finish_reload()
+{
+	ReloadJob *job = reload_job;
+	if (!job || !job->done)
+		return;
+	reload_job = NULL;
+	join_reload_thread();
+	const bool same_collation = job->CollationLevel == CollationLevel && job->CollateFunction == CollateFunction;
+	std::vector<Dict *> prev;
+	prev.swap(oLib);
+	for (size_t i=0; i<job->load_list.size(); ++i) {
+		Dict *lib = job->kept[i] ? job->kept[i] : job->loaded[i];
+		job->loaded[i] = NULL;
+		if (!lib && same_collation) {
+			/* A changed dictionary failed to load, maybe it is being written
+			 * yet. Keep the old one, it is still changed, so it is loaded
+			 * again on the next check. */
+			for (std::vector<Dict *>::iterator it=prev.begin(); it!=prev.end(); ++it) {
+				if ((*it)->ifofilename() == job->load_list[i]) {
+					lib = *it;
+					*it = NULL;
+					break;
+				}
+			}
+		}
+		if (lib)
+			oLib.push_back(lib);
+	}
+	for (std::vector<Dict *>::iterator it=prev.begin(); it!=prev.end(); ++it) {
+		if (*it && std::find(job->kept.begin(), job->kept.end(), *it) == job->kept.end())
+			delete *it;
+	}
+	if (!same_collation) {
+		free_collations();
+		CollationLevel = job->CollationLevel;
+		CollateFunction = job->CollateFunction;
+	}
+	delete job;
+}
+
+void Libs::cancel_reload()
+{
+	ReloadJob *job = reload_job;
+	if (!job)
+		return;
+	reload_job = NULL;
+	const bool done = job->done;
+	if (!done) {
+		/* The job is freed in on_reload_loaded. */
+		g_atomic_int_set(&job->cancel, 1);
+	}
+	join_reload_thread();
+	if (job->CollationLevel != CollationLevel || job->CollateFunction != CollateFunction)
+		free_collations(job->CollationLevel, job->CollateFunction);
+	if (done)
+		delete job;
+}
 #endif
 
 glong Libs::CltIndexToOrig(glong cltidx, size_t iLib, int servercollatefunc)
@@ -2504,6 +2925,7 @@ bool Libs::LookupSynonymSimilarWord(const gchar* sWord, glong &iSynonymWordIndex
 {
 	if (oLib[iLib]->syn_file.get() == NULL)
 		return false;
+	QueryTimer timer(QueryType_SIMILAR, oLib[iLib]->get_stats());
 
 	glong iIndex;
 	glong iIndex_suggest;
@@ -2614,6 +3036,7 @@ bool Libs::LookupSimilarWordTryWord(const gchar *sTryWord, const gchar *sWord,
  * searching for the best partial match. */
 bool Libs::LookupSimilarWord(const gchar* sWord, glong & iWordIndex, glong &idx_suggest, size_t iLib, int servercollatefunc)
 {
+	QueryTimer timer(QueryType_SIMILAR, oLib[iLib]->get_stats());
 	glong iIndex;
 	bool bFound=false;
 	gchar *casestr;
@@ -2993,7 +3416,7 @@ bool Libs::LookupSimilarWord(const gchar* sWord, glong & iWordIndex, glong &idx_
 
 bool Libs::SimpleLookupWord(const gchar* sWord, glong & iWordIndex, glong &idx_suggest, size_t iLib, int servercollatefunc)
 {
-	bool bFound = oLib[iLib]->Lookup(sWord, iWordIndex, idx_suggest, CollationLevel, servercollatefunc);
+	bool bFound = LookupWord(sWord, iWordIndex, idx_suggest, iLib, servercollatefunc);
 	if (!bFound)
 		bFound = LookupSimilarWord(sWord, iWordIndex, idx_suggest, iLib, servercollatefunc);
 	return bFound;
@@ -3001,7 +3424,7 @@ bool Libs::SimpleLookupWord(const gchar* sWord, glong & iWordIndex, glong &idx_s
 
 bool Libs::SimpleLookupSynonymWord(const gchar* sWord, glong & iWordIndex, glong &synidx_suggest, size_t iLib, int servercollatefunc)
 {
-	bool bFound = oLib[iLib]->LookupSynonym(sWord, iWordIndex, synidx_suggest, CollationLevel, servercollatefunc);
+	bool bFound = LookupSynonymWord(sWord, iWordIndex, synidx_suggest, iLib, servercollatefunc);
 	if (!bFound)
 		bFound = LookupSynonymSimilarWord(sWord, iWordIndex, synidx_suggest, iLib, servercollatefunc);
 	return bFound;
@@ -3030,10 +3453,11 @@ static inline void unicode_strdown(gunichar *str)
 	}
 }
 
-bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_size, std::vector<InstantDictIndex> &dictmask)
+bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_size, std::vector<InstantDictIndex> &dictmask, gint *state)
 {
 	if (sWord[0] == '\0')
 		return false;
+	QueryTimer timer(QueryType_FUZZY);
 
 	std::vector<Fuzzystruct> oFuzzystruct(reslist_size);
 
@@ -3059,12 +3483,14 @@ bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_si
 		if (dictmask[iLib].type != InstantDictType_LOCAL)
 			continue;
 		iRealLib = dictmask[iLib].index;
+		QueryTimer dict_timer(QueryType_FUZZY, oLib[iRealLib]->get_stats(), false);
 		for (gint synLib=0; synLib<2; synLib++) {
 			if (synLib==1) {
 				if (oLib[iRealLib]->syn_file.get()==NULL)
 					break;
 			}
-			show_progress->notify_about_work();
+			if (!state)
+				show_progress->notify_about_work();
 
 			//if (stardict_strcmp(sWord, poGetWord(0,iRealLib))>=0 && stardict_strcmp(sWord, poGetWord(narticles(iRealLib)-1,iRealLib))<=0) {
 			//there are Chinese dicts and English dicts...
@@ -3075,6 +3501,8 @@ bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_si
 				else
 					iwords = nsynarticles(iRealLib);
 				for (glong index=0; index<iwords; index++) {
+					if (state && lookup_state_check(state))
+						goto fuzzy_out;
 					// Need to deal with same word in index? But this will slow down processing in most case.
 					if (synLib==0)
 						sCheck = poGetOrigWord(index,iRealLib);
@@ -3125,6 +3553,7 @@ bool Libs::LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_si
 			}   // ok for search
 		}  // synLib
 	}   // each lib
+fuzzy_out:
 	g_free(ucs4_str2);
 
 	if (Found)// sort with distance
@@ -3140,10 +3569,11 @@ static inline bool less_for_compare(const char *lh, const char *rh) {
 	return stardict_strcmp(lh, rh)<0;
 }
 
-gint Libs::LookupWithRule(const gchar *word, gchar **ppMatchWord, std::vector<InstantDictIndex> &dictmask)
+gint Libs::LookupWithRule(const gchar *word, gchar **ppMatchWord, std::vector<InstantDictIndex> &dictmask, gint *state)
 {
 	glong aiIndex[MAX_MATCH_ITEM_PER_LIB+1];
 	gint iMatchCount = 0;
+	QueryTimer timer(QueryType_PATTERN);
 	GPatternSpec *pspec = g_pattern_spec_new(word);
 
 	const gchar * sMatchWord;
@@ -3155,8 +3585,10 @@ gint Libs::LookupWithRule(const gchar *word, gchar **ppMatchWord, std::vector<In
 		if (dictmask[iLib].type != InstantDictType_LOCAL)
 			continue;
 		iRealLib = dictmask[iLib].index;
-		if (oLib[iRealLib]->LookupWithRule(pspec, aiIndex, MAX_MATCH_ITEM_PER_LIB+1)) {
-			show_progress->notify_about_work();
+		QueryTimer dict_timer(QueryType_PATTERN, oLib[iRealLib]->get_stats(), false);
+		if (oLib[iRealLib]->LookupWithRule(pspec, aiIndex, MAX_MATCH_ITEM_PER_LIB+1, state)) {
+			if (!state)
+				show_progress->notify_about_work();
 			for (int i=0; aiIndex[i]!=-1; i++) {
 				sMatchWord = poGetOrigWord(aiIndex[i],iRealLib);
 				bAlreadyInList = false;
@@ -3170,8 +3602,9 @@ gint Libs::LookupWithRule(const gchar *word, gchar **ppMatchWord, std::vector<In
 					ppMatchWord[iMatchCount++] = g_strdup(sMatchWord);
 			}
 		}
-		if (oLib[iRealLib]->LookupWithRuleSynonym(pspec, aiIndex, MAX_MATCH_ITEM_PER_LIB+1)) {
-			show_progress->notify_about_work();
+		if (oLib[iRealLib]->LookupWithRuleSynonym(pspec, aiIndex, MAX_MATCH_ITEM_PER_LIB+1, state)) {
+			if (!state)
+				show_progress->notify_about_work();
 			for (int i=0; aiIndex[i]!=-1; i++) {
 				sMatchWord = poGetOrigSynonymWord(aiIndex[i],iRealLib);
 				bAlreadyInList = false;
@@ -3193,10 +3626,11 @@ gint Libs::LookupWithRule(const gchar *word, gchar **ppMatchWord, std::vector<In
 	return iMatchCount;
 }
 
-gint Libs::LookupWithRegex(const gchar *word, gchar **ppMatchWord, std::vector<InstantDictIndex> &dictmask)
+gint Libs::LookupWithRegex(const gchar *word, gchar **ppMatchWord, std::vector<InstantDictIndex> &dictmask, gint *state)
 {
 	glong aiIndex[MAX_MATCH_ITEM_PER_LIB+1];
 	gint iMatchCount = 0;
+	QueryTimer timer(QueryType_REGEX);
 	GRegex *regex = g_regex_new(word, G_REGEX_OPTIMIZE, (GRegexMatchFlags)0, NULL);
 
 	const gchar * sMatchWord;
@@ -3208,8 +3642,10 @@ gint Libs::LookupWithRegex(const gchar *word, gchar **ppMatchWord, std::vector<I
 		if (dictmask[iLib].type != InstantDictType_LOCAL)
 			continue;
 		iRealLib = dictmask[iLib].index;
-		if (oLib[iRealLib]->LookupWithRegex(regex, aiIndex, MAX_MATCH_ITEM_PER_LIB+1)) {
-			show_progress->notify_about_work();
+		QueryTimer dict_timer(QueryType_REGEX, oLib[iRealLib]->get_stats(), false);
+		if (oLib[iRealLib]->LookupWithRegex(regex, aiIndex, MAX_MATCH_ITEM_PER_LIB+1, state)) {
+			if (!state)
+				show_progress->notify_about_work();
 			for (int i=0; aiIndex[i]!=-1; i++) {
 				sMatchWord = poGetOrigWord(aiIndex[i],iRealLib);
 				bAlreadyInList = false;
@@ -3223,8 +3659,9 @@ gint Libs::LookupWithRegex(const gchar *word, gchar **ppMatchWord, std::vector<I
 					ppMatchWord[iMatchCount++] = g_strdup(sMatchWord);
 			}
 		}
-		if (oLib[iRealLib]->LookupWithRegexSynonym(regex, aiIndex, MAX_MATCH_ITEM_PER_LIB+1)) {
-			show_progress->notify_about_work();
+		if (oLib[iRealLib]->LookupWithRegexSynonym(regex, aiIndex, MAX_MATCH_ITEM_PER_LIB+1, state)) {
+			if (!state)
+				show_progress->notify_about_work();
 			for (int i=0; aiIndex[i]!=-1; i++) {
 				sMatchWord = poGetOrigSynonymWord(aiIndex[i],iRealLib);
 				bAlreadyInList = false;
@@ -3246,7 +3683,7 @@ gint Libs::LookupWithRegex(const gchar *word, gchar **ppMatchWord, std::vector<I
 	return iMatchCount;
 }
 
-bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateSearchDialog_func search_func, gpointer search_data, bool *cancel, std::vector<InstantDictIndex> &dictmask)
+bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateSearchDialog_func search_func, gpointer search_data, gint *state, std::vector<InstantDictIndex> &dictmask)
 {
 	std::vector<std::string> SearchWords;
 	std::string SearchWord;
@@ -3286,6 +3723,7 @@ bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateS
 	}
 	if (SearchWords.empty())
 		return false;
+	QueryTimer timer(QueryType_FULLTEXT);
 
 	glong search_count=0;
 	glong total_count=0;
@@ -3305,12 +3743,14 @@ bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateS
 		iRealLib = dictmask[i].index;
 		if (!oLib[iRealLib]->containSearchData())
 			continue;
+		QueryTimer dict_timer(QueryType_FULLTEXT, oLib[iRealLib]->get_stats(), false);
 		const gulong iwords = narticles(iRealLib);
 		const gchar *key;
-		guint32 offset, size;
+		guint64 offset;
+		guint32 size;
 		for (gulong j=0; j<iwords; ++j) {
 			if (search_func) {
-				if (*cancel)
+				if (state && lookup_state_check(state))
 					goto search_out;
 				if (search_count % 10000 == 0) {
 					search_func(search_data, (gdouble)search_count/(gdouble)total_count);
@@ -3351,6 +3791,7 @@ FileHolder Libs::GetStorageFilePath(size_t iLib, const std::string &key)
 {
 	if (oLib[iLib]->storage == NULL)
 		return FileHolder();
+	QueryTimer timer(QueryType_RESOURCE, oLib[iLib]->get_stats());
 	return oLib[iLib]->storage->get_file_path(key);
 }
 
@@ -3358,25 +3799,70 @@ const char *Libs::GetStorageFileContent(size_t iLib, const std::string &key)
 {
 	if (oLib[iLib]->storage == NULL)
 		return NULL;
+	QueryTimer timer(QueryType_RESOURCE, oLib[iLib]->get_stats());
 	return oLib[iLib]->storage->get_file_content(key);
 }
 
+GdkPixbuf *Libs::GetStorageImage(size_t iLib, const std::string &key)
+{
+	if (oLib[iLib]->storage == NULL)
+		return NULL;
+	QueryTimer timer(QueryType_RESOURCE, oLib[iLib]->get_stats());
+	return oLib[iLib]->storage->get_image(key);
+}
+
+bool Libs::GetStorageImageSize(size_t iLib, const std::string &key, gint &width, gint &height)
+{
+	if (oLib[iLib]->storage == NULL)
+		return false;
+	QueryTimer timer(QueryType_RESOURCE, oLib[iLib]->get_stats());
+	return oLib[iLib]->storage->get_image_size(key, width, height);
+}
+
+void Libs::get_query_stats(QueryStatsSnapshot &snapshot) const
+{
+	query_stats_get(snapshot);
+	snapshot.dicts.resize(oLib.size());
+	for (size_t i=0; i<oLib.size(); ++i) {
+		snapshot.dicts[i].bookname = oLib[i]->dict_name();
+		snapshot.dicts[i].ifofilename = oLib[i]->ifofilename();
+		query_stats_get_dict(oLib[i]->get_stats(), snapshot.dicts[i].stats);
+	}
+}
+
+void Libs::reset_query_stats()
+{
+	query_stats_reset();
+	for (size_t i=0; i<oLib.size(); ++i)
+		query_stats_clear_dict(oLib[i]->get_stats());
+}
+
 void Libs::init_collations()
 {
-	if (CollationLevel == CollationLevel_SINGLE) {
-		if (utf8_collate_init(CollateFunction))
+	init_collations(CollationLevel, CollateFunction);
+}
+
+void Libs::free_collations()
+{
+	free_collations(CollationLevel, CollateFunction);
+}
+
+void Libs::init_collations(CollationLevelType level, CollateFunctions func)
+{
+	if (level == CollationLevel_SINGLE) {
+		if (utf8_collate_init(func))
 			g_print("Init collate function failed!\n");
-	} else if (CollationLevel == CollationLevel_MULTI){
+	} else if (level == CollationLevel_MULTI){
 		if (utf8_collate_init_all())
 			g_print("Init collate functions failed!\n");
 	}
 }
 
-void Libs::free_collations()
+void Libs::free_collations(CollationLevelType level, CollateFunctions func)
 {
-	if(CollationLevel == CollationLevel_SINGLE)
-		utf8_collate_end(CollateFunction);
-	else if(CollationLevel == CollationLevel_MULTI)
+	if(level == CollationLevel_SINGLE)
+		utf8_collate_end(func);
+	else if(level == CollationLevel_MULTI)
 		utf8_collate_end_all();
 }
 
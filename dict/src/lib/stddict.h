@@ -34,6 +34,8 @@
 #include "storage.h"
 #include "libcommon.h"
 #include "dictitemid.h"
+#include "querystats.h"
+#include "cachestore.h"
 
 const int MAX_FUZZY_DISTANCE= 3; // at most MAX_FUZZY_DISTANCE-1 differences allowed when find similar words
 const int MAX_MATCH_ITEM_PER_LIB=100;
@@ -74,12 +76,13 @@ enum CacheFileType {
 	CacheFileType_oft,
 	CacheFileType_clt,
 	CacheFileType_server_clt,
+	CacheFileType_rht,
 };
 
 /* url and saveurl parameters that appear on the same level, function parameters,
  * for example, normally have the following meaning.
  * url - the real file, the cache was build for. That file exists in file system.
- * saveurl - the file that url represents. Use saveurl to construct cache file name.
+ * saveurl - the file that url represents. Use saveurl to name the cache.
  * Often url = saveurl.
  * They may be different in the case url is a compressed index, then saveurl
  * names uncompressed index. For example,
@@ -90,33 +93,27 @@ enum CacheFileType {
  * url = ".../mydict.idx"
  * saveurl = ".../mydict.idx"
  *
- * Cache file searching algorithm
- *
- * This algorithm is used in load_cache and save_cache functions.
- * 1. Search for cache file in the directory of the saveurl parameter.
- * 1.1. Build primary file name: saveurl + ".oft". (We use here .oft file as example)
- * 1.2. Check if that file is the target cache file. If yes, stop search.
- * 1.3. Build next file name: dirname(saveurl) + "/" + basename(saveurl) + "(" + num + ")" + ext(saveurl) + ".oft"
- * 1.4. num++, goto 1.2.
- * 2. Search for cache file in the user cache directory (app_dirs->get_user_cache_dir()).
- * 2.1. Build primary file name: user_cache_dir + filename(saveurl) + ".oft"
- * ...
+ * Caches are kept in the cache store of the user cache directory, see
+ * get_cache_store(). The key of a cache is made of the cache type,
+ * the collate function and saveurl. A cache is valid while url has
+ * the modification time and the size it had when the cache was saved.
  * */
 class cache_file {
 public:
 	cache_file(CacheFileType _cachefiletype, CollateFunctions _cltfunc);
 	~cache_file();
 	/* Return value: true - success, false - fault.
-	 * If loaded successfully, mf contains the loaded file,
-	 * wordoffset points to the portion of the mapped file containing offsets.
-	 * If load failed, mf and wordoffset are not changed. */
+	 * If loaded successfully, wordoffset points to the data in the cache store.
+	 * If load failed, wordoffset is not changed.
+	 * Remembers the stamp of url for save_cache. */
 	bool load_cache(const std::string& url, const std::string& saveurl, glong filedatasize);
-	/* (Re)create cache file. Member data do not change.
-	 * Content of the cache file is build from wordoffset array and parameters of this function.
-	 * Note that this function does not load the saved file, mf member is not used. */
+	/* Save wordoffset array to the cache store. Member data do not change.
+	 * The cache is stamped with url of the preceding load_cache call. */
 	bool save_cache(const std::string& saveurl) const;
 	// datasize in bytes
 	void allocate_wordoffset(size_t _npages);
+	/* Forget the data loaded by load_cache, so it may be built anew. */
+	void drop_cache(void);
 	guint32& get_wordoffset(size_t ind)
 	{
 		return wordoffset[ind];
@@ -131,23 +128,18 @@ public:
 	}
 
 private:
-	/* If mf != NULL, then wordoffset points to part of mapped file, it should not be freed.
+	/* If stored, then wordoffset points to data of the cache store, it should not be freed.
 	 * Otherwise wordoffset must be freed with g_free. */
 	guint32 *wordoffset;
 	/* size of the wordoffset array */
 	size_t npages;
 	CacheFileType cachefiletype;
-	MapFile *mf;
+	bool stored;
 	CollateFunctions cltfunc;
-	/* The following functions do not change member data, they return result though parameters. */
-	bool build_primary_cache_filename_in_user_cache(const std::string& url, std::string &cachefilename, bool create) const;
-	MapFile* find_and_load_cache_file(const gchar *filename, const std::string &url, const std::string &saveurl, glong filedatasize, int next) const;
-	FILE* find_and_open_for_overwrite_cache_file(const gchar *filename, const std::string &saveurl, int next, std::string &cfilename) const;
-	gchar *get_next_filename(
-		const gchar *dirname, const gchar *basename, int num,
-		const gchar *extendname) const;
-	void build_primary_cache_filename(const std::string &url,
-		std::string &filename) const;
+	/* of url passed to load_cache, valid if has_stamp */
+	CacheStamp stamp;
+	bool has_stamp;
+	std::string get_cache_key(const std::string& saveurl) const;
 };
 
 class idxsyn_file;
@@ -199,6 +191,8 @@ public:
 	collation_file * get_clt_file(void) { return clt_file; }
 	collation_file * get_clt_file(size_t ind) { return clt_files[ind]; }
 	glong get_word_count(void) const { return wordcount; }
+	/* count page loads and bytes read in stats, may be NULL */
+	void set_stats(DictStats *_stats) { stats = _stats; }
 private:
 	collation_file * collate_load_impl(
 		const std::string& _url, const std::string& _saveurl,
@@ -210,15 +204,20 @@ private:
 protected:
 	// number of words in the index
 	glong wordcount;
+	DictStats *stats;
 };
 
 class index_file : public idxsyn_file {
 public:
 	/* get_data and get_key_and_data methods return their result through these
 	 * members. */
-	guint32 wordentry_offset;
+	guint64 wordentry_offset;
 	guint32 wordentry_size;
 
+	index_file() : idxoffsetbits(32) {}
+	/* Must be called before load. bits - 32 or 64, see idxoffsetbits in ".ifo" file. */
+	void set_idxoffsetbits(guint32 bits) { idxoffsetbits = bits; }
+
 	static index_file* Create(const std::string& filebasename,
 		const char* mainext, std::string& fullfilename);
 	virtual bool load(const std::string& url, gulong wc, gulong fsize,
@@ -227,6 +226,18 @@ public:
 	virtual void get_data(glong idx) = 0;
 	virtual const gchar *get_key_and_data(glong idx) = 0;
 	virtual bool lookup(const char *str, glong &idx, glong &idx_suggest) = 0;
+	/* idx - index of an entry in the .idx file, as stored in the .syn file.
+	 * Return the index of that entry in this index, INVALID_INDEX if it was deleted. */
+	virtual glong get_synonym_target(glong idx) { return idx; }
+protected:
+	/* size of data offset and size following the word in an index entry */
+	gulong entry_data_size() const
+	{
+		return (idxoffsetbits == 64 ? sizeof(guint64) : sizeof(guint32)) + sizeof(guint32);
+	}
+	/* p points to the data offset of an index entry */
+	void read_entry_data(const gchar *p, guint64 &offset, guint32 &size) const;
+	guint32 idxoffsetbits;
 };
 
 class synonym_file : public idxsyn_file {
@@ -284,9 +295,12 @@ private:
 	std::string ifo_file_name;
 	std::string bookname; // in utf-8
 	std::string dicttype; // in utf-8
+	/* modification times and sizes of the dictionary files when it was loaded */
+	std::string files_stamp;
 
+	static std::string get_files_stamp(const std::string& filebasename);
 	/* ifofilename in file name encoding */
-	bool load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glong &wordcount, glong &synwordcount);
+	bool load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glong &wordcount, glong &synwordcount, guint32 &idxoffsetbits);
 public:
 	std::auto_ptr<index_file> idx_file;
 	std::auto_ptr<synonym_file> syn_file;
@@ -305,13 +319,16 @@ public:
 	const std::string& dict_type() const { return dicttype; }
 	const std::string& ifofilename() const { return ifo_file_name; }
 	DictItemId id() const { return DictItemId(ifo_file_name); }
+	/* true if files of the dictionary were changed, added or removed
+	 * after the dictionary was loaded */
+	bool is_changed() const;
 
 	gchar *get_data(glong index)
 	{
 		idx_file->get_data(index);
 		return DictBase::GetWordData(idx_file->wordentry_offset, idx_file->wordentry_size);
 	}
-	void get_key_and_data(glong index, const gchar **key, guint32 *offset, guint32 *size)
+	void get_key_and_data(glong index, const gchar **key, guint64 *offset, guint32 *size)
 	{
 		*key = idx_file->get_key_and_data(index);
 		*offset = idx_file->wordentry_offset;
@@ -322,15 +339,39 @@ public:
 		return idx_file->Lookup(str, idx, idx_suggest, CollationLevel, servercollatefunc);
 	}
 	bool LookupSynonym(const char *str, glong &synidx, glong &synidx_suggest, CollationLevelType CollationLevel, int servercollatefunc);
-	bool LookupWithRule(GPatternSpec *pspec, glong *aIndex, int iBuffLen);
-	bool LookupWithRuleSynonym(GPatternSpec *pspec, glong *aIndex, int iBuffLen);
-	bool LookupWithRegex(GRegex *regex, glong *aIndex, int iBuffLen);
-	bool LookupWithRegexSynonym(GRegex *regex, glong *aIndex, int iBuffLen);
+	bool LookupWithRule(GPatternSpec *pspec, glong *aIndex, int iBuffLen, gint *state = NULL);
+	bool LookupWithRuleSynonym(GPatternSpec *pspec, glong *aIndex, int iBuffLen, gint *state = NULL);
+	bool LookupWithRegex(GRegex *regex, glong *aIndex, int iBuffLen, gint *state = NULL);
+	bool LookupWithRegexSynonym(GRegex *regex, glong *aIndex, int iBuffLen, gint *state = NULL);
 	gint GetOrigWordCount(glong& iWordIndex, bool isidx);
 	bool GetWordPrev(glong iWordIndex, glong &pidx, bool isidx, CollationLevelType CollationLevel, int servercollatefunc);
 	void GetWordNext(glong &iWordIndex, bool isidx, CollationLevelType CollationLevel, int servercollatefunc);
 };
 
+/* State of a lookup that may run outside of the main thread, see AsyncLookup.
+ * It is changed with the functions below only. */
+enum LookupState {
+	LookupState_RUN,
+	/* the lookup returns as soon as possible */
+	LookupState_STOP,
+	/* the lookup is asked to wait in lookup_state_check */
+	LookupState_PAUSE,
+	/* the lookup waits in lookup_state_check */
+	LookupState_PAUSED,
+	/* the lookup has returned */
+	LookupState_DONE,
+};
+
+/* Called by the lookup between two words, waits while the lookup is paused.
+ * Return value: true - the lookup must stop. */
+bool lookup_state_check(gint *state);
+/* Called by the thread running the lookup after it has returned. */
+void lookup_state_done(gint *state);
+void lookup_state_stop(gint *state);
+/* Wait till the lookup waits or has returned, the caller may use Libs then. */
+void lookup_state_pause(gint *state);
+void lookup_state_resume(gint *state);
+
 struct CurrentIndex {
 	glong idx;
 	glong idx_suggest;
@@ -371,6 +412,22 @@ public:
 	bool find_lib_by_id(const DictItemId& filename, size_t &iLib);
 	void load(const std::list<std::string> &load_list);
 	void reload(const std::list<std::string> &load_list, CollationLevelType NewCollationLevel, CollateFunctions collf);
+	/* true if files of a loaded dictionary changed since it was loaded */
+	bool has_changed_dicts() const;
+	typedef void (*on_reload_end_func_t)(gpointer user_data);
+	/* Reload dictionaries like reload() does, but load new and changed
+	dictionaries on a worker thread. Libs keeps serving lookups from the
+	current dictionaries meanwhile. When loading is done, func is called in
+	the main loop, it must stop all users of Libs and call finish_reload(),
+	that publishes the new dictionary set and frees dictionaries that are
+	not used any more. A changed dictionary that fails to load is kept as it
+	was. */
+	void start_reload(const std::list<std::string> &load_list, CollationLevelType NewCollationLevel, CollateFunctions collf,
+		on_reload_end_func_t func, gpointer user_data);
+	void finish_reload();
+	/* Waits till the worker finishes loading the current dictionary. */
+	void cancel_reload();
+	bool is_reloading() const { return reload_job != NULL; }
 #endif
 
 	glong narticles(size_t idict) const { return oLib[idict]->narticles(); }
@@ -391,15 +448,17 @@ public:
 	const gchar * poGetOrigSynonymWord(glong iSynonymIndex,size_t iLib) const {
 		return oLib[iLib]->syn_file->getWord(iSynonymIndex, CollationLevel_NONE, 0);
 	}
+	/* Return INVALID_INDEX if the word of the synonym was deleted in the delta layer. */
 	glong poGetOrigSynonymWordIdx(glong iSynonymIndex, size_t iLib) const {
 		oLib[iLib]->syn_file->getWord(iSynonymIndex, CollationLevel_NONE, 0);
-		return oLib[iLib]->syn_file->wordentry_index;
+		return oLib[iLib]->idx_file->get_synonym_target(oLib[iLib]->syn_file->wordentry_index);
 	}
 	glong CltIndexToOrig(glong cltidx, size_t iLib, int servercollatefunc);
 	glong CltSynIndexToOrig(glong cltidx, size_t iLib, int servercollatefunc);
 	gchar * poGetOrigWordData(glong iIndex,size_t iLib) {
 		if (iIndex==INVALID_INDEX)
 			return NULL;
+		QueryTimer timer(QueryType_ARTICLE, oLib[iLib]->get_stats());
 		return oLib[iLib]->get_data(iIndex);
 	}
 	const gchar *GetSuggestWord(const gchar *sWord, CurrentIndex *iCurrent, std::vector<InstantDictIndex> &dictmask, int servercollatefunc);
@@ -407,9 +466,11 @@ public:
 	const gchar *poGetNextWord(const gchar *word, CurrentIndex *iCurrent, std::vector<InstantDictIndex> &dictmask, int servercollatefunc);
 	const gchar *poGetPreWord(const gchar *word, CurrentIndex *iCurrent, std::vector<InstantDictIndex> &dictmask, int servercollatefunc);
 	bool LookupWord(const gchar* sWord, glong& iWordIndex, glong &idx_suggest, size_t iLib, int servercollatefunc) {
+		QueryTimer timer(QueryType_WORD, oLib[iLib]->get_stats());
 		return oLib[iLib]->Lookup(sWord, iWordIndex, idx_suggest, CollationLevel, servercollatefunc);
 	}
 	bool LookupSynonymWord(const gchar* sWord, glong& iSynonymIndex, glong &synidx_suggest, size_t iLib, int servercollatefunc) {
+		QueryTimer timer(QueryType_SYNONYM, oLib[iLib]->get_stats());
 		return oLib[iLib]->LookupSynonym(sWord, iSynonymIndex, synidx_suggest, CollationLevel, servercollatefunc);
 	}
 	bool LookupSimilarWord(const gchar* sWord, glong &iWordIndex, glong &idx_suggest, size_t iLib, int servercollatefunc);
@@ -426,18 +487,37 @@ public:
 		oLib[iLib]->GetWordNext(iWordIndex, isidx, CollationLevel, servercollatefunc);
 	}
 
-	bool LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_size, std::vector<InstantDictIndex> &dictmask);
-	gint LookupWithRule(const gchar *sWord, gchar *reslist[], std::vector<InstantDictIndex> &dictmask);
-	gint LookupWithRegex(const gchar *sWord, gchar *reslist[], std::vector<InstantDictIndex> &dictmask);
+	/* state - when not NULL, a LookupState checked with lookup_state_check
+	 * between two words, the lookup stops or waits as it says.
+	 * Such lookups may run outside of the main thread (see AsyncLookup),
+	 * show_progress is not notified about work for them. */
+	bool LookupWithFuzzy(const gchar *sWord, gchar *reslist[], gint reslist_size, std::vector<InstantDictIndex> &dictmask, gint *state = NULL);
+	gint LookupWithRule(const gchar *sWord, gchar *reslist[], std::vector<InstantDictIndex> &dictmask, gint *state = NULL);
+	gint LookupWithRegex(const gchar *sWord, gchar *reslist[], std::vector<InstantDictIndex> &dictmask, gint *state = NULL);
 
 	typedef void (*updateSearchDialog_func)(gpointer data, gdouble fraction);
-	bool LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateSearchDialog_func func, gpointer data, bool *cancel, std::vector<InstantDictIndex> &dictmask);
+	bool LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateSearchDialog_func func, gpointer data, gint *state, std::vector<InstantDictIndex> &dictmask);
 	StorageType GetStorageType(size_t iLib);
 	FileHolder GetStorageFilePath(size_t iLib, const std::string &key);
 	const char *GetStorageFileContent(size_t iLib, const std::string &key);
+	GdkPixbuf *GetStorageImage(size_t iLib, const std::string &key);
+	bool GetStorageImageSize(size_t iLib, const std::string &key, gint &width, gint &height);
+
+	/* Lookup metrics, see querystats.h. Call query_stats_set_enabled() to start counting.
+	 * The snapshot has an item for every loaded dictionary. */
+	void get_query_stats(QueryStatsSnapshot &snapshot) const;
+	void reset_query_stats();
 private:
 	void init_collations();
 	void free_collations();
+	static void init_collations(CollationLevelType level, CollateFunctions func);
+	static void free_collations(CollationLevelType level, CollateFunctions func);
+#ifdef SD_CLIENT_CODE
+	struct ReloadJob;
+	static gpointer reload_thread_func(gpointer data);
+	static gboolean on_reload_loaded(gpointer data);
+	void join_reload_thread();
+#endif
 	bool LookupSimilarWordTryWord(const gchar *sTryWord, const gchar *sWord,
 		int servercollatefunc, size_t iLib,
 		glong &iIndex, glong &idx_suggest, gint &best_match);
@@ -451,6 +531,10 @@ private:
 	CollationLevelType CollationLevel;
 	CollateFunctions CollateFunction;
 	static show_progress_t default_show_progress;
+#ifdef SD_CLIENT_CODE
+	ReloadJob *reload_job;
+	GThread *reload_thread;
+#endif
 
 #ifdef SD_SERVER_CODE
 	struct DictInfoItem;
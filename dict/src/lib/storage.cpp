@@ -19,6 +19,7 @@
 
 #include <glib.h>
 #include <string.h>
+#include <algorithm>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 #ifdef _WIN32
@@ -214,11 +215,54 @@ rindex_file* rindex_file::Create(const std::string& filebasename,
 	return rindex;
 }
 
+/* FNV-1a, it must not change, hash values are saved in cache files */
+guint32 rindex_file::hash_key(const char *str)
+{
+	guint32 hash = 2166136261U;
+	for (const guchar *p = (const guchar *)str; *p; ++p) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+guint32 rindex_file::get_hash_table_size(gulong filecount)
+{
+	guint32 nslots = 2;
+	while (nslots < 2*filecount)
+		nslots *= 2;
+	return nslots;
+}
+
+void rindex_file::hash_table_insert(guint32 *slots, guint32 nslots,
+	guint32 hash, guint32 value)
+{
+	guint32 i = hash & (nslots-1);
+	while (slots[2*i+1])
+		i = (i+1) & (nslots-1);
+	slots[2*i] = hash;
+	slots[2*i+1] = value;
+}
+
+bool rindex_file::hash_table_valid(const guint32 *slots, guint32 nslots,
+	gulong filecount, guint32 max_value)
+{
+	gulong used = 0;
+	for (guint32 i = 0; i < nslots; i++) {
+		if (!slots[2*i+1])
+			continue;
+		if (slots[2*i+1] > max_value)
+			return false;
+		used++;
+	}
+	return used == filecount && used < nslots;
+}
+
 offset_rindex::offset_rindex(void)
 :
-	oft_file(CacheFileType_oft, COLLATE_FUNC_NONE),
-	idxfile(NULL),
-	npages(0)
+	rht_file(CacheFileType_rht, COLLATE_FUNC_NONE),
+	nslots(0),
+	idxfile(NULL)
 {
 
 }
@@ -233,29 +277,29 @@ bool offset_rindex::load(const std::string& url, gulong _filecount, gulong fsize
 	bool CreateCacheFile)
 {
 	filecount = _filecount;
-	npages=(filecount-1)/ENTR_PER_PAGE+2;
-	if (!oft_file.load_cache(url, url, npages*sizeof(guint32))) {
+	nslots = get_hash_table_size(filecount);
+	bool loaded = rht_file.load_cache(url, url, 2*nslots*sizeof(guint32));
+	if (loaded && !hash_table_valid(rht_file.get_wordoffset(), nslots, filecount, fsize)) {
+		g_warning("Broken resource index cache of %s, it is built anew.", url.c_str());
+		rht_file.drop_cache();
+		loaded = false;
+	}
+	if (!loaded) {
 		MapFile map_file;
 		if (!map_file.open(url.c_str(), fsize))
 			return false;
 		const gchar *idxdatabuffer=map_file.begin();
-		/* oft_file.wordoffset[i] holds offset of the i-th page in the index file */
-		oft_file.allocate_wordoffset(npages);
+		rht_file.allocate_wordoffset(2*nslots);
+		guint32 *slots = rht_file.get_wordoffset();
+		memset(slots, 0, 2*nslots*sizeof(guint32));
 		const gchar *p1 = idxdatabuffer;
-		gulong index_size;
-		guint32 j=0;
 		for (guint32 i=0; i<filecount; i++) {
-			index_size=strlen(p1) +1 + 2*sizeof(guint32);
-			if (i % ENTR_PER_PAGE==0) {
-				oft_file.get_wordoffset(j)=p1-idxdatabuffer;
-				++j;
-			}
-			p1 += index_size;
+			hash_table_insert(slots, nslots, hash_key(p1), p1-idxdatabuffer+1);
+			p1 += strlen(p1) +1 + 2*sizeof(guint32);
 		}
-		oft_file.get_wordoffset(j)=p1-idxdatabuffer;
 		map_file.close();
 		if (CreateCacheFile) {
-			if (!oft_file.save_cache(url))
+			if (!rht_file.save_cache(url))
 				g_printerr("Cache update failed.\n");
 		}
 	}
@@ -263,92 +307,36 @@ bool offset_rindex::load(const std::string& url, gulong _filecount, gulong fsize
 	if (!(idxfile = fopen(url.c_str(), "rb"))) {
 		return false;
 	}
-
-	first.assign(0, read_first_on_page_key(0));
-	last.assign(npages-2, read_first_on_page_key(npages-2));
-	middle.assign((npages-2)/2, read_first_on_page_key((npages-2)/2));
-	real_last.assign(filecount-1, get_key(filecount-1));
-
 	return true;
 }
 
 bool offset_rindex::lookup(const char *str, guint32 &entry_offset, guint32 &entry_size)
 {
-	glong idx;
-	if(!lookup(str, idx))
-		return false;
-	get_data(idx, entry_offset, entry_size);
-	return true;
-}
-
-bool offset_rindex::lookup(const char *str, glong &idx)
-{
-	bool bFound=false;
-	glong iTo=npages-2;
-	glong iFrom;
-	glong iThisIndex;
-	gint cmpint;
-	if (strcmp(str, first.keystr.c_str())<0) {
-		return false;
-	} else if (strcmp(str, real_last.keystr.c_str()) >0) {
-		return false;
-	} else {
-		iFrom=0;
-		while (iFrom<=iTo) {
-			iThisIndex=(iFrom+iTo)/2;
-			cmpint = strcmp(str, get_first_on_page_key(iThisIndex));
-			if (cmpint>0)
-				iFrom=iThisIndex+1;
-			else if (cmpint<0)
-				iTo=iThisIndex-1;
-			else {
-				bFound=true;
-				break;
-			}
-		}
-		if (!bFound) {
-			// iTo - prev. page
-			// the key must on page iTo if anywhere
-			idx = iTo; 
-		} else {
-			idx = iThisIndex; // the key found in the first position of this page
-		}
-	}
-	// idx now is a page number where the key may be
-	if (!bFound) {
-		gulong netr=load_page(idx);
-		iFrom=1; // Needn't search the first word anymore.
-		iTo=netr-1;
-		iThisIndex=0;
-		while (iFrom<=iTo) {
-			iThisIndex=(iFrom+iTo)/2;
-			cmpint = strcmp(str, page.entries[iThisIndex].keystr);
-			if (cmpint>0)
-				iFrom=iThisIndex+1;
-			else if (cmpint<0)
-				iTo=iThisIndex-1;
-			else {
-				bFound=true;
-				break;
-			}
-		}
-		if(!bFound)
+	const guint32 *slots = rht_file.get_wordoffset();
+	const guint32 hash = hash_key(str);
+	guint32 i = hash & (nslots-1);
+	for (guint32 n = 0; n < nslots && slots[2*i+1]; n++, i = (i+1) & (nslots-1)) {
+		if (slots[2*i] != hash)
+			continue;
+		const gchar *entry = read_entry(slots[2*i+1]-1);
+		if (!entry)
 			return false;
-		idx *= ENTR_PER_PAGE;
-		idx += iThisIndex;
-		return true;
-	} else {
-		idx *= ENTR_PER_PAGE;
-		return true;
+		if (strcmp(str, entry) == 0) {
+			const gchar *p = entry + strlen(entry) + 1;
+			entry_offset = g_ntohl(get_uint32(p));
+			p += sizeof(guint32);
+			entry_size = g_ntohl(get_uint32(p));
+			return true;
+		}
 	}
+	return false;
 }
 
-const gchar *offset_rindex::read_first_on_page_key(glong page_idx)
+const gchar *offset_rindex::read_entry(guint32 entry_offset)
 {
-	fseek(idxfile, oft_file.get_wordoffset(page_idx), SEEK_SET);
-	size_t size_to_read = DEFAULT_KEY_SIZE;
-	const char* end_of_line;
-	int inewdata = 0;
+	fseek(idxfile, entry_offset, SEEK_SET);
+	size_t size_to_read = DEFAULT_KEY_SIZE + 2*sizeof(guint32);
+	size_t inewdata = 0;
 	size_t size_read;
 	while(true) {
 		buffer.resize(inewdata+size_to_read+1);
@@ -357,8 +345,8 @@ const gchar *offset_rindex::read_first_on_page_key(glong page_idx)
 		if(size_read == 0) // nothing read
 			return NULL;
 		buffer[inewdata+size_read]='\0';
-		end_of_line = strchr(&buffer[inewdata], '\0');
-		if(end_of_line != &buffer[inewdata+size_read])
+		const size_t key_len = strlen(&buffer[0]);
+		if(key_len + 1 + 2*sizeof(guint32) <= inewdata+size_read)
 			return &buffer[0];
 		if(size_read != size_to_read) // no more data
 			return NULL;
@@ -368,75 +356,6 @@ const gchar *offset_rindex::read_first_on_page_key(glong page_idx)
 	return NULL;
 }
 
-const gchar *offset_rindex::get_first_on_page_key(glong page_idx)
-{
-	if (page_idx<middle.page_idx) {
-		if (page_idx==first.page_idx)
-			return first.keystr.c_str();
-		return read_first_on_page_key(page_idx);
-	} else if (page_idx>middle.page_idx) {
-		if (page_idx==last.page_idx)
-			return last.keystr.c_str();
-		return read_first_on_page_key(page_idx);
-	} else
-		return middle.keystr.c_str();
-}
-
-const gchar *offset_rindex::get_key(glong idx)
-{
-	load_page(idx/ENTR_PER_PAGE);
-	glong idx_in_page=idx%ENTR_PER_PAGE;
-	return page.entries[idx_in_page].keystr;
-}
-
-void offset_rindex::get_data(glong idx, guint32 &entry_offset, guint32 &entry_size)
-{
-	load_page(idx/ENTR_PER_PAGE);
-	glong idx_in_page=idx%ENTR_PER_PAGE;
-	entry_offset = page.entries[idx_in_page].off;
-	entry_size = page.entries[idx_in_page].size;
-}
-
-gulong offset_rindex::load_page(glong page_idx)
-{
-	g_assert(gulong(page_idx+1)<npages);
-	gulong nentr=ENTR_PER_PAGE;
-	if (page_idx==glong(npages-2))
-		if ((nentr=filecount%ENTR_PER_PAGE)==0)
-			nentr=ENTR_PER_PAGE;
-
-
-	if (page_idx!=page.page_idx) {
-		page_data.resize(oft_file.get_wordoffset(page_idx+1)-oft_file.get_wordoffset(page_idx));
-		fseek(idxfile, oft_file.get_wordoffset(page_idx), SEEK_SET);
-		size_t fread_size;
-		size_t page_data_size = page_data.size();
-		fread_size = fread(&page_data[0], 1, page_data_size, idxfile);
-		if (fread_size != page_data_size) {
-			g_print("fread error!\n");
-		}
-		page.fill(&page_data[0], nentr, page_idx);
-	}
-
-	return nentr;
-}
-
-void offset_rindex::page_t::fill(gchar *data, gint nent, glong page_idx_)
-{
-	page_idx=page_idx_;
-	gchar *p=data;
-	glong len;
-	for (gint i=0; i<nent; ++i) {
-		entries[i].keystr=p;
-		len=strlen(p);
-		p+=len+1;
-		entries[i].off=g_ntohl(get_uint32(p));
-		p+=sizeof(guint32);
-		entries[i].size=g_ntohl(get_uint32(p));
-		p+=sizeof(guint32);
-	}
-}
-
 compressed_rindex::compressed_rindex(void)
 :
 	idxdatabuf(NULL)
@@ -477,6 +396,11 @@ bool compressed_rindex::load(const std::string& url, gulong _filecount,
 	/* pointer to the next to last file entry */
 	filelist[filecount] = p1;
 
+	const guint32 nslots = get_hash_table_size(filecount);
+	slots.assign(2*nslots, 0);
+	for (i=0; i<filecount; i++)
+		hash_table_insert(&slots[0], nslots, hash_key(filelist[i]), i+1);
+
 	return true;
 }
 
@@ -491,32 +415,16 @@ bool compressed_rindex::lookup(const char *str, guint32 &entry_offset, guint32 &
 
 bool compressed_rindex::lookup(const char *str, glong &idx)
 {
-	bool bFound=false;
-	glong iTo=filelist.size()-2;
-
-	if (strcmp(str, get_key(0))<0) {
-	} else if (strcmp(str, get_key(iTo)) >0) {
-	} else {
-		glong iThisIndex=0;
-		glong iFrom=0;
-		gint cmpint;
-		while (iFrom<=iTo) {
-			iThisIndex=(iFrom+iTo)/2;
-			cmpint = strcmp(str, get_key(iThisIndex));
-			if (cmpint>0)
-				iFrom=iThisIndex+1;
-			else if (cmpint<0)
-				iTo=iThisIndex-1;
-			else {
-				bFound=true;
-				break;
-			}
-		}
-		if (bFound) {
-			idx = iThisIndex;
+	const guint32 nslots = slots.size()/2;
+	const guint32 hash = hash_key(str);
+	guint32 i = hash & (nslots-1);
+	for (guint32 n = 0; n < nslots && slots[2*i+1]; n++, i = (i+1) & (nslots-1)) {
+		if (slots[2*i] == hash && strcmp(str, get_key(slots[2*i+1]-1)) == 0) {
+			idx = slots[2*i+1]-1;
+			return true;
 		}
 	}
-	return bFound;
+	return false;
 }
 
 const gchar *compressed_rindex::get_key(glong idx)
@@ -596,12 +504,14 @@ ResourceStorage::ResourceStorage()
 :
 	storage_type(StorageType_UNKNOWN),
 	file_storage(NULL),
-	database_storage(NULL)
+	database_storage(NULL),
+	image_cache_size(0)
 {
 }
 
 ResourceStorage::~ResourceStorage()
 {
+	clear_image_cache();
 	delete file_storage;
 	delete database_storage;
 }
@@ -683,6 +593,115 @@ const char *ResourceStorage::get_file_content(const std::string &key)
 	}
 }
 
+GdkPixbuf *ResourceStorage::get_image(const std::string &key)
+{
+	std::map<std::string, ImageList::iterator>::iterator it = image_map.find(key);
+	if(it != image_map.end()) {
+		image_list.splice(image_list.begin(), image_list, it->second);
+		return GDK_PIXBUF(g_object_ref(it->second->second));
+	}
+	GdkPixbuf *pixbuf = load_image(key);
+	if(pixbuf)
+		put_image_in_cache(key, pixbuf);
+	return pixbuf;
+}
+
+GdkPixbuf *ResourceStorage::load_image(const std::string &key)
+{
+	if(storage_type == StorageType_FILE) {
+		const std::string& filename = file_storage->get_file_path(key);
+		if(filename.empty())
+			return NULL;
+		return gdk_pixbuf_new_from_file(filename.c_str(), NULL);
+	}
+	const char *content = get_file_content(key);
+	if(!content)
+		return NULL;
+	const guint32 size = get_uint32(content);
+	const guchar *data = (const guchar *)(content+sizeof(guint32));
+	GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+	gdk_pixbuf_loader_write(loader, data, size, NULL);
+	gdk_pixbuf_loader_close(loader, NULL);
+	GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+	if(pixbuf)
+		g_object_ref(G_OBJECT(pixbuf));
+	g_object_unref(loader);
+	return pixbuf;
+}
+
+static void on_image_size_prepared(GdkPixbufLoader *loader, gint width, gint height,
+	gpointer data)
+{
+	gint *size = static_cast<gint *>(data);
+	size[0] = width;
+	size[1] = height;
+}
+
+bool ResourceStorage::get_image_size(const std::string &key, gint &width, gint &height)
+{
+	std::map<std::string, ImageList::iterator>::iterator it = image_map.find(key);
+	if(it != image_map.end()) {
+		width = gdk_pixbuf_get_width(it->second->second);
+		height = gdk_pixbuf_get_height(it->second->second);
+		return true;
+	}
+	if(storage_type == StorageType_FILE) {
+		const std::string& filename = file_storage->get_file_path(key);
+		if(filename.empty())
+			return false;
+		return gdk_pixbuf_get_file_info(filename.c_str(), &width, &height) != NULL;
+	}
+	const char *content = get_file_content(key);
+	if(!content)
+		return false;
+	const guint32 size = get_uint32(content);
+	const guchar *data = (const guchar *)(content+sizeof(guint32));
+	/* Feed the loader until it knows the size, the header is usually
+	 * in the first chunk. */
+	static const guint32 CHUNK_SIZE = 4*1024;
+	gint image_size[2] = { -1, -1 };
+	GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+	g_signal_connect(G_OBJECT(loader), "size-prepared",
+		G_CALLBACK(on_image_size_prepared), image_size);
+	for(guint32 pos = 0; pos < size && image_size[0] < 0; pos += CHUNK_SIZE) {
+		if(!gdk_pixbuf_loader_write(loader, data + pos, std::min(CHUNK_SIZE, size - pos), NULL))
+			break;
+	}
+	gdk_pixbuf_loader_close(loader, NULL);
+	g_object_unref(loader);
+	if(image_size[0] < 0)
+		return false;
+	width = image_size[0];
+	height = image_size[1];
+	return true;
+}
+
+void ResourceStorage::put_image_in_cache(const std::string &key, GdkPixbuf *pixbuf)
+{
+	const gsize size = gsize(gdk_pixbuf_get_rowstride(pixbuf)) * gdk_pixbuf_get_height(pixbuf);
+	if(size > IMAGE_CACHE_SIZE)
+		return;
+	while(image_cache_size + size > IMAGE_CACHE_SIZE) {
+		GdkPixbuf *last = image_list.back().second;
+		image_cache_size -= gsize(gdk_pixbuf_get_rowstride(last)) * gdk_pixbuf_get_height(last);
+		g_object_unref(last);
+		image_map.erase(image_list.back().first);
+		image_list.pop_back();
+	}
+	image_list.push_front(std::make_pair(key, GDK_PIXBUF(g_object_ref(pixbuf))));
+	image_map[key] = image_list.begin();
+	image_cache_size += size;
+}
+
+void ResourceStorage::clear_image_cache(void)
+{
+	for(ImageList::iterator it = image_list.begin(); it != image_list.end(); ++it)
+		g_object_unref(it->second);
+	image_list.clear();
+	image_map.clear();
+	image_cache_size = 0;
+}
+
 File_ResourceStorage::File_ResourceStorage(const std::string &resdir_)
 :
 	resdir(resdir_),
@@ -740,7 +759,6 @@ const char *File_ResourceStorage::get_file_content(const std::string &key)
 
 Database_ResourceStorage::Database_ResourceStorage(void)
 :
-cur_cache_ind(0),
 ridx_file(NULL),
 dict(NULL)
 {
@@ -779,9 +797,8 @@ bool Database_ResourceStorage::load(const std::string& rifofilename,
 
 FileHolder Database_ResourceStorage::get_file_path(const std::string& key)
 {
-	int ind = find_in_cache(key);
-	if(ind >= 0)
-		return FileCache[ind].file;
+	if(const FileHolder *cached = find_in_cache(key))
+		return *cached;
 
 	guint32 entry_offset, entry_size;
 	if(!ridx_file->lookup(key.c_str(), entry_offset, entry_size))
@@ -819,8 +836,8 @@ FileHolder Database_ResourceStorage::get_file_path(const std::string& key)
 	}
 	close(fd);
 #endif
-	ind = put_in_cache(key, file);
-	return FileCache[ind].file;
+	put_in_cache(key, file);
+	return file;
 }
 
 const char *Database_ResourceStorage::get_file_content(const std::string &key)
@@ -833,27 +850,28 @@ const char *Database_ResourceStorage::get_file_content(const std::string &key)
 
 void Database_ResourceStorage::clear_cache(void)
 {
-	for(size_t i=0; i<FILE_CACHE_SIZE; ++i) {
-		FileCache[i].key.clear();
-		FileCache[i].file.clear();
-	}
+	file_list.clear();
+	file_map.clear();
 }
 
-int Database_ResourceStorage::find_in_cache(const std::string& key) const
+/* move the found item to the front of the list */
+const FileHolder *Database_ResourceStorage::find_in_cache(const std::string& key)
 {
-	for(size_t i=0; i<FILE_CACHE_SIZE; ++i)
-		if(FileCache[i].key == key)
-			return i;
-	return -1;
+	std::map<std::string, FileList::iterator>::iterator it = file_map.find(key);
+	if(it == file_map.end())
+		return NULL;
+	file_list.splice(file_list.begin(), file_list, it->second);
+	return &it->second->second;
 }
 
-size_t Database_ResourceStorage::put_in_cache(const std::string& key, const FileHolder& file)
+void Database_ResourceStorage::put_in_cache(const std::string& key, const FileHolder& file)
 {
-	size_t ind = cur_cache_ind;
-	FileCache[ind].key = key;
-	FileCache[ind].file = file;
-	cur_cache_ind = (ind + 1) % FILE_CACHE_SIZE;
-	return ind;
+	if(file_list.size() >= FILE_CACHE_SIZE) {
+		file_map.erase(file_list.back().first);
+		file_list.pop_back();
+	}
+	file_list.push_front(std::make_pair(key, file));
+	file_map[key] = file_list.begin();
 }
 
 bool Database_ResourceStorage::load_rifofile(const std::string& rifofilename,
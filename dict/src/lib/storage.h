@@ -22,7 +22,9 @@
 
 #include <string>
 #include <list>
+#include <map>
 #include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
 #include "lib_res_store.h"
 
 class show_progress_t;
@@ -63,8 +65,20 @@ public:
 	FileHolder get_file_path(const std::string& key);
 	/* key in utf-8, DB_DIR_SEPARATOR path separator */
 	const char *get_file_content(const std::string &key);
+	/* key in utf-8, DB_DIR_SEPARATOR path separator
+	 * Return the decoded image, the caller must unref it.
+	 * Return NULL if the resource is not found or it is not an image. */
+	GdkPixbuf *get_image(const std::string &key);
+	/* key in utf-8, DB_DIR_SEPARATOR path separator
+	 * Get the size of an image without decoding it.
+	 * Return false if the resource is not found or it is not an image. */
+	bool get_image_size(const std::string &key, gint &width, gint &height);
 	StorageType get_storage_type(void) const { return storage_type; }
 private:
+	/* key in utf-8 */
+	GdkPixbuf *load_image(const std::string &key);
+	void put_image_in_cache(const std::string &key, GdkPixbuf *pixbuf);
+	void clear_image_cache(void);
 	/* resdir in file name encoding */
 	bool load_filesdir(const std::string &resdir, show_progress_t *sp);
 	/* rifofilename in file name encoding */
@@ -73,6 +87,14 @@ private:
 	StorageType storage_type;
 	File_ResourceStorage *file_storage;
 	Database_ResourceStorage *database_storage;
+	/* Decoded images, so repeated images in articles are decoded only once.
+	 * The cache holds at most IMAGE_CACHE_SIZE bytes of pixel data. */
+	static const gsize IMAGE_CACHE_SIZE = 16*1024*1024;
+	typedef std::list<std::pair<std::string, GdkPixbuf *> > ImageList;
+	/* most recently used images first */
+	ImageList image_list;
+	std::map<std::string, ImageList::iterator> image_map;
+	gsize image_cache_size;
 };
 
 #endif
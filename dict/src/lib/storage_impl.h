@@ -39,6 +39,20 @@ public:
 	/* str in utf-8 */
 	virtual bool lookup(const char *str, guint32 &entry_offset, guint32 &entry_size) = 0;
 protected:
+	/* Resource keys are looked up by exact match only, so the index is accessed
+	 * through an open addressing hash table instead of a binary search.
+	 * The table is an array of nslots pairs of guint32 values:
+	 * slots[2*i] - hash of the key,
+	 * slots[2*i+1] - entry number + 1, 0 marks an empty slot.
+	 * nslots is a power of 2, at least twice as large as filecount. */
+	static guint32 hash_key(const char *str);
+	static guint32 get_hash_table_size(gulong filecount);
+	static void hash_table_insert(guint32 *slots, guint32 nslots,
+		guint32 hash, guint32 value);
+	/* Check a table read from the cache: it holds filecount values, none of
+	 * them above max_value, so a probe always reaches an empty slot. */
+	static bool hash_table_valid(const guint32 *slots, guint32 nslots,
+		gulong filecount, guint32 max_value);
 	// number of files in the index
 	gulong filecount;
 };
@@ -54,64 +68,21 @@ public:
 	/* str in utf-8 */
 	bool lookup(const char *str, guint32 &entry_offset, guint32 &entry_size);
 private:
-	/* str in utf-8 */
-	bool lookup(const char *str, glong &idx);
-	const gchar *read_first_on_page_key(glong page_idx);
-	const gchar *get_first_on_page_key(glong page_idx);
-	const gchar *get_key(glong idx);
-	void get_data(glong idx, guint32 &entry_offset, guint32 &entry_size);
-	gulong load_page(glong page_idx);
+	/* Read the index entry starting at offset entry_offset in the index file.
+	 * Return the key followed by data offset and size, NULL on failure. */
+	const gchar *read_entry(guint32 entry_offset);
 
-	static const gint ENTR_PER_PAGE=32;
 	/* default length of a key in the index. may be any integer > 0.
 	 * Size of a key in index is not limited. Use this value to allocate a buffer
 	 * and read the first chunk from the index file. */
 	static const size_t DEFAULT_KEY_SIZE=256;
-	/* oft_file.get_wordoffset(page_num) - offset of the first element on the page
-	 * number page_num. 0<= page_num <= npages-2
-	 * oft_file.get_wordoffset(npages-1) - offset of the next to the last element 
-	 * in the index file
-	 * oft_file.get_wordoffset(page_num+1) - oft_file.get_wordoffset(page_num) 
-	 * - size of data on the page number page_num, in bytes. */
-	cache_file oft_file;
+	/* Hash table of the index, see rindex_file, saved in the .rht cache file.
+	 * The values are offsets of the entries in the index file + 1. */
+	cache_file rht_file;
+	guint32 nslots;
 	FILE *idxfile;
-	/* use this buffer to read keys */
+	/* use this buffer to read entries */
 	std::vector<char> buffer;
-	/* number of pages = ((filecount-1)/ENTR_PER_PAGE) + 2 
-	 * The page number npages-2 always contains at least one element.
-	 * It may contain from 1 to ENTR_PER_PAGE elements.
-	 * To be exact it contains nentr elements, that may be calculated as follows:
-	 * nentr = filecount%ENTR_PER_PAGE;
-	 * if(nentr == 0)
-	 *   nentr = ENTR_PER_PAGE;
-	 * The page number npages-1 (the last) is always empty. */
-	gulong npages;
-	struct index_entry {
-		glong page_idx;
-		std::string keystr; // in utf-8
-		void assign(glong i, const std::string& str) {
-			page_idx=i;
-			keystr.assign(str);
-		}
-	};
-	/* first - first key on the first page - first key in the index
-	 * last - first key on the pre-last page (last page addressing real data)
-	 * middle - first key on the middle page
-	 * read_last - last key in the index */
-	index_entry first, last, middle, real_last;
-
-	struct page_entry {
-		gchar *keystr; // in utf-8
-		guint32 off, size;
-	};
-	std::vector<gchar> page_data;
-	struct page_t {
-		glong page_idx;
-		page_entry entries[ENTR_PER_PAGE];
-
-		page_t(): page_idx(-1) {}
-		void fill(gchar *data, gint nent, glong page_idx_);
-	} page;
 };
 
 class compressed_rindex: public rindex_file
@@ -137,6 +108,9 @@ private:
 	 * followed by data offset and size. See ".ridx" file format. 
 	 * filelist.size() == number of files + 1 */
 	std::vector<gchar *> filelist;
+	/* Hash table of the index, see rindex_file.
+	 * The values are indexes in filelist + 1. It is built on load. */
+	std::vector<guint32> slots;
 };
 
 class File_ResourceStorage {
@@ -172,19 +146,15 @@ private:
 		gulong& indexfilesize);
 	void clear_cache(void);
 	/* key in utf-8 */
-	int find_in_cache(const std::string& key) const;
+	const FileHolder *find_in_cache(const std::string& key);
 	/* key in utf-8 */
-	size_t put_in_cache(const std::string& key, const FileHolder& file);
+	void put_in_cache(const std::string& key, const FileHolder& file);
 private:
 	static const size_t FILE_CACHE_SIZE = 20;
-	/* the entity is not used if key.empty() */
-	struct FileCacheEntity
-	{
-		std::string key; // in utf-8
-		FileHolder file;
-	};
-	FileCacheEntity FileCache[FILE_CACHE_SIZE];
-	size_t cur_cache_ind; // index to be reused
+	typedef std::list<std::pair<std::string, FileHolder> > FileList;
+	/* most recently used files first, key in utf-8 */
+	FileList file_list;
+	std::map<std::string, FileList::iterator> file_map;
 	rindex_file *ridx_file;
 	ResDict *dict;
 };
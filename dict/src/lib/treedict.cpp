@@ -26,6 +26,7 @@
 #endif
 
 #include <cstring>
+#include <glib/gstdio.h>
 #include "file-utils.h"
 #include "utils.h"
 
@@ -33,19 +34,53 @@
 
 GtkTreeStore *TreeDict::model=NULL;
 
+/* model columns */
+enum {
+	TREEDICT_WORD_COLUMN,
+	TREEDICT_OFFSET_COLUMN,
+	TREEDICT_SIZE_COLUMN,
+	TREEDICT_NODE_COLUMN,
+	TREEDICT_COLUMN_NUMBER
+};
+
+/* node header: word, offset, size and number of children */
+static const gchar *read_node(const gchar *p, const gchar *end,
+	guint32 *offset, guint32 *size, guint32 *subentry_count)
+{
+	const gchar *word_end = (const gchar *)memchr(p, '\0', end - p);
+	if (!word_end || end - word_end < glong(1 + 3*sizeof(guint32)))
+		return NULL;
+	p = word_end + 1;
+	*offset = g_ntohl(get_uint32(p));
+	p += sizeof(guint32);
+	*size = g_ntohl(get_uint32(p));
+	p += sizeof(guint32);
+	*subentry_count = g_ntohl(get_uint32(p));
+	p += sizeof(guint32);
+	return p;
+}
+
 TreeDict::TreeDict()
+:
+	tdxbuffer(NULL),
+	tdxdata(NULL),
+	tdxfilesize(0)
 {
 	if (model)
 		return;
 
 	// It is said G_TYPE_UINT will always be 32 bit.
 	// see http://bugzilla.gnome.org/show_bug.cgi?id=337966
-	model = gtk_tree_store_new (3, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_UINT); //word, offset, size
+	model = gtk_tree_store_new (TREEDICT_COLUMN_NUMBER, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT); //word, offset, size, node
+}
+
+TreeDict::~TreeDict()
+{
+	g_free(tdxbuffer);
 }
 
 bool TreeDict::load(const std::string& ifofilename)
 {
-	gulong tdxfilesize;
 	if (!load_ifofile(ifofilename, &tdxfilesize))
 		return false;
 
@@ -56,7 +91,6 @@ bool TreeDict::load(const std::string& ifofilename)
 	std::string fullfilename(ifofilename);
 	fullfilename.replace(fullfilename.length()-sizeof("ifo")+1, sizeof("ifo")-1, "tdx.gz");
 
-	gchar *buffer= NULL;
 	if (g_file_test(fullfilename.c_str(), G_FILE_TEST_EXISTS)) {
 		gzFile in;
 		in = gzopen(fullfilename.c_str(),"rb");
@@ -65,40 +99,31 @@ bool TreeDict::load(const std::string& ifofilename)
 			return false;
 		}
 
-		buffer = (gchar *)g_malloc(tdxfilesize);
+		tdxbuffer = (gchar *)g_malloc(tdxfilesize);
 
 		gulong len;
-		len = gzread(in, buffer, tdxfilesize);
-		if (len < 0) {
-			g_free(buffer);
+		len = gzread(in, tdxbuffer, tdxfilesize);
+		if (len < 0)
 			return false;
-		}
 		gzclose(in);
-		if (len != tdxfilesize) {
-			g_free(buffer);
+		if (len != tdxfilesize)
 			return false;
-		}
+		tdxdata = tdxbuffer;
 	} else {
 		fullfilename.erase(fullfilename.length()-sizeof(".gz")+1, sizeof(".gz")-1);
-		FILE *file;
-		if (!(file = fopen (fullfilename.c_str(), "rb"))) {
-			//g_print("Open file %s failed!\n",fullfilename);
+		stardict_stat_t stats;
+		if (g_stat(fullfilename.c_str(), &stats) || gulong(stats.st_size) != tdxfilesize)
 			return false;
-		}
-		buffer = (gchar *)g_malloc(tdxfilesize);
-		gulong read_len;
-		read_len = fread(buffer, 1, tdxfilesize, file);
-		fclose(file);
-		if (read_len!=tdxfilesize) {
-			g_free(buffer);
+		if (!tdxmap.open(fullfilename.c_str(), tdxfilesize)) {
+			//g_print("Open file %s failed!\n",fullfilename);
 			return false;
 		}
+		tdxdata = tdxmap.begin();
 	}
 
-	gchar *tmp_buffer = buffer;
-	load_model(&tmp_buffer, NULL, 1); // tmp_buffer will be changed.
-	g_free(buffer);
-	return true;
+	/* The rows of the model are matched to the dictionaries by position, a
+	 * dictionary without a row must not be loaded. */
+	return append_node(0, 0, NULL);
 }
 
 bool TreeDict::load_ifofile(const std::string& ifofilename, gulong *tdxfilesize)
@@ -113,26 +138,70 @@ bool TreeDict::load_ifofile(const std::string& ifofilename, gulong *tdxfilesize)
 	return true;
 }
 
-void TreeDict::load_model(gchar **buffer, GtkTreeIter *parent, guint32 count)
+bool TreeDict::index_nodes(const gchar **p, guint32 count)
 {
-	GtkTreeIter iter;
-	gchar *p1;
 	guint32 offset, size, subentry_count;
 
 	for (guint32 i=0; i< count; i++) {
-		p1 = *buffer + strlen(*buffer) +1;
-		offset = g_ntohl(get_uint32(p1));
-		p1 += sizeof(guint32);
-		size = g_ntohl(get_uint32(p1));
-		p1 += sizeof(guint32);
-		subentry_count = g_ntohl(get_uint32(p1));
-		p1 += sizeof(guint32);
-		gtk_tree_store_append(model, &iter, parent);
-		gtk_tree_store_set(model, &iter, 0, *buffer, 1, offset, 2, size, -1);
-		*buffer = p1;
-		if (subentry_count)
-			load_model(buffer, &iter, subentry_count);
+		const guint32 node = node_pos.size();
+		node_pos.push_back(*p - tdxdata);
+		subtree_size.push_back(1);
+		*p = read_node(*p, tdxdata + tdxfilesize, &offset, &size, &subentry_count);
+		if (!*p)
+			return false;
+		if (subentry_count && !index_nodes(p, subentry_count))
+			return false;
+		subtree_size[node] = node_pos.size() - node;
 	}
+	return true;
+}
+
+bool TreeDict::append_node(guint32 node, guint32 pos, GtkTreeIter *parent)
+{
+	guint32 offset, size, subentry_count;
+	const gchar *word = tdxdata + pos;
+	if (!read_node(word, tdxdata + tdxfilesize, &offset, &size, &subentry_count))
+		return false;
+	GtkTreeIter iter;
+	gtk_tree_store_append(model, &iter, parent);
+	gtk_tree_store_set(model, &iter, TREEDICT_WORD_COLUMN, word,
+		TREEDICT_OFFSET_COLUMN, offset, TREEDICT_SIZE_COLUMN, size,
+		TREEDICT_NODE_COLUMN, node, -1);
+	if (subentry_count) {
+		GtkTreeIter placeholder;
+		gtk_tree_store_append(model, &placeholder, &iter);
+	}
+	return true;
+}
+
+void TreeDict::load_children(GtkTreeIter *iter)
+{
+	GtkTreeIter placeholder;
+	if (!gtk_tree_model_iter_children(GTK_TREE_MODEL(model), &placeholder, iter))
+		return;
+	gchar *word;
+	gtk_tree_model_get(GTK_TREE_MODEL(model), &placeholder, TREEDICT_WORD_COLUMN, &word, -1);
+	if (word) {
+		g_free(word);
+		return;
+	}
+	if (node_pos.empty()) {
+		const gchar *p = tdxdata;
+		index_nodes(&p, 1);
+	}
+	guint32 node;
+	gtk_tree_model_get(GTK_TREE_MODEL(model), iter, TREEDICT_NODE_COLUMN, &node, -1);
+	guint32 offset, size, subentry_count;
+	if (node >= node_pos.size() || !read_node(tdxdata + node_pos[node],
+		tdxdata + tdxfilesize, &offset, &size, &subentry_count))
+		return;
+	guint32 child = node + 1;
+	for (guint32 i=0; i<subentry_count && child<node_pos.size(); i++) {
+		if (!append_node(child, node_pos[child], iter))
+			break;
+		child += subtree_size[child];
+	}
+	gtk_tree_store_remove(model, &placeholder);
 }
 
 
@@ -182,3 +251,8 @@ gchar* TreeDicts::poGetWordData(guint32 offset, guint32 size, int iTreeDict)
 {
 	return oTreeDict[iTreeDict]->GetWordData(offset, size);
 }
+
+void TreeDicts::load_children(GtkTreeIter *iter, int iTreeDict)
+{
+	oTreeDict[iTreeDict]->load_children(iter);
+}
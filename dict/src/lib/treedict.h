@@ -21,22 +21,47 @@
 #define _TREEDICT_HPP_
 
 #include <gtk/gtk.h>
+#include <vector>
 
 #include "ifo_file.h"
 #include "dictbase.h"
+#include "mapfile.h"
 
 typedef std::list<std::string> strlist_t;
 
+/* Nodes are added to the model lazily. At first the model contains only the
+ * root node of every dictionary, a node with children gets an empty
+ * placeholder child row. The real children are added by load_children when
+ * the row is expanded. */
 class TreeDict : public DictBase {
 public:
 	TreeDict();
+	~TreeDict();
 	bool load(const std::string& ifofilename);
+	/* Replace the placeholder child of the row with the real children.
+	 * Does nothing if the children are loaded already. */
+	void load_children(GtkTreeIter *iter);
 	static GtkTreeStore *get_model() { return model; }
 private:
 	static GtkTreeStore *model;
 
 	bool load_ifofile(const std::string& ifofilename, gulong *tdxfilesize);
-	void load_model(gchar **buffer, GtkTreeIter *parent, guint32 count);
+	bool index_nodes(const gchar **p, guint32 count);
+	/* pos - offset of the node in the .tdx file.
+	 * Return value: false - the node is broken, no row is added. */
+	bool append_node(guint32 node, guint32 pos, GtkTreeIter *parent);
+
+	/* the .tdx file, mapped, or read into tdxbuffer if it is compressed */
+	MapFile tdxmap;
+	gchar *tdxbuffer;
+	const gchar *tdxdata;
+	gulong tdxfilesize;
+	/* Nodes in the .tdx file order, indexed on the first expansion.
+	 * node_pos[i] - offset of node i in the .tdx file,
+	 * subtree_size[i] - number of nodes in the subtree of node i, including itself.
+	 * The first child of node i is node i+1, the next sibling is i+subtree_size[i]. */
+	std::vector<guint32> node_pos;
+	std::vector<guint32> subtree_size;
 };
 
 class TreeDicts {
@@ -48,6 +73,7 @@ public:
 			   const strlist_t& order_list,
 			   const strlist_t& disable_list);
 	gchar * poGetWordData(guint32 offset, guint32 size, int iTreeDict);
+	void load_children(GtkTreeIter *iter, int iTreeDict);
 private:
 	std::vector<TreeDict *> oTreeDict;
 };
@@ -37,8 +37,15 @@ static inline guint32 get_uint32(const gchar *addr)
 	memcpy(&result, addr, sizeof(guint32));
 	return result;
 }
+static inline guint64 get_uint64(const gchar *addr)
+{
+	guint64 result;
+	memcpy(&result, addr, sizeof(guint64));
+	return result;
+}
 #else
 #define get_uint32(x) *reinterpret_cast<const guint32 *>(x)
+#define get_uint64(x) *reinterpret_cast<const guint64 *>(x)
 #endif
 
 extern void ProcessGtkEvent();
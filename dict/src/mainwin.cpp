@@ -413,6 +413,7 @@ void TopWin::do_back()
 		gtk_editable_select_region(GTK_EDITABLE(gtk_bin_get_child(GTK_BIN(WordCombo))), 0, -1);
 	if (((BackListData *)(list->data))->adjustment_value != -1) {
 		ProcessGtkEvent(); // so all the definition text have been inserted.
+		gpAppFrame->oMidWin.oTextWin.FlushPending();
 		gpAppFrame->oMidWin.oTextWin.view->scroll_to(((BackListData *)(list->data))->adjustment_value);
 	}
 }
@@ -439,6 +440,7 @@ void TopWin::do_forward()
 		gtk_editable_select_region(GTK_EDITABLE(gtk_bin_get_child(GTK_BIN(WordCombo))), 0, -1);
 	if (((BackListData *)(list->data))->adjustment_value != -1) {
 		ProcessGtkEvent(); // so all the definition text have been inserted.
+		gpAppFrame->oMidWin.oTextWin.FlushPending();
 		gpAppFrame->oMidWin.oTextWin.view->scroll_to(((BackListData *)(list->data))->adjustment_value);
 	}
 }
@@ -1270,6 +1272,7 @@ bool TreeWin::Create(GtkWidget *notebook)
 	g_signal_connect (G_OBJECT (selection), "changed", G_CALLBACK (on_selection_changed), this);
 
 	g_signal_connect (G_OBJECT (treeview), "button_press_event", G_CALLBACK (on_button_press), this);
+	g_signal_connect (G_OBJECT (treeview), "test-expand-row", G_CALLBACK (on_test_expand_row), this);
 	GtkWidget *scrolledwindow = gtk_scrolled_window_new (NULL, NULL);
 	gtk_widget_show(scrolledwindow);
 	gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolledwindow),
@@ -1323,6 +1326,14 @@ gboolean TreeWin::on_button_press(GtkWidget * widget, GdkEventButton * event, Tr
 	}
 }
 
+gboolean TreeWin::on_test_expand_row(GtkTreeView *treeview, GtkTreeIter *iter, GtkTreePath *path, TreeWin *oTreeWin)
+{
+	// every tree dictionary has one top-level row
+	gint iTreeDict = gtk_tree_path_get_indices(path)[0];
+	gpAppFrame->oTreeDicts.load_children(iter, iTreeDict);
+	return FALSE;
+}
+
 void TreeWin::on_selection_changed(GtkTreeSelection *selection, TreeWin *oTreeWin)
 {
 	GtkTreeModel *model;
@@ -1397,6 +1408,7 @@ void ResultWin::on_selection_changed(GtkTreeSelection *selection, ResultWin *oRe
 	{
 		gchar *markstr;
 		gtk_tree_model_get(model, &iter, 1, &markstr, -1);
+		gpAppFrame->oMidWin.oTextWin.FlushPending();
 		GtkTextView *textview = GTK_TEXT_VIEW(gpAppFrame->oMidWin.oTextWin.view->widget());
 		GtkTextBuffer *buffer = gtk_text_view_get_buffer(textview);
 		GtkTextMark *mark = gtk_text_buffer_get_mark(buffer, markstr);
@@ -1802,6 +1814,7 @@ void ToolWin::HideListCallback(GtkWidget *widget, gpointer data)
 #ifndef CONFIG_GPE
 void ToolWin::CopyCallback(GtkWidget *widget, ToolWin *oToolWin)
 {
+  gpAppFrame->oMidWin.oTextWin.FlushPending();
   std::string text = gpAppFrame->oMidWin.oTextWin.view->get_text();
 
   GtkClipboard* clipboard = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
@@ -1835,6 +1848,7 @@ void ToolWin::do_save()
 			}
 		}
 	} else {
+		oTextWin.FlushPending();
 		// check for selections in Text Area
 		GtkTextIter start, end;
 		gchar *str = NULL;
@@ -1996,6 +2010,7 @@ void TextWin::Create(GtkWidget *vbox)
 
 void TextWin::ShowInitFailed()
 {
+	CancelPending();
 	char *fmt = _("Warning! No dictionary is loaded.\n"
 		      "Please go to StarDict's website, download some dictionaries:\n"
 		      "%s%s%s and put them in %s.");
@@ -2032,6 +2047,7 @@ void TextWin::ShowInitFailed()
 
 void TextWin::ShowTips()
 {
+  CancelPending();
   query_result = TEXT_WIN_TIPS;
   view->set_text(
 	  _("        Welcome to StarDict!\n\n"
@@ -2049,6 +2065,7 @@ void TextWin::ShowTips()
 
 void TextWin::ShowInfo()
 {
+	CancelPending();
 	query_result = TEXT_WIN_INFO;
 	view->set_text(
 		_("       Welcome to StarDict\n"
@@ -2091,67 +2108,160 @@ void TextWin::ShowInfo()
 
 void TextWin::Show(const gchar *str)
 {
+  CancelPending();
   view->set_text(str);
   view->scroll_to(0);
 }
 
+/* Article data of the dictionaries rendered before the article is shown.
+ * Other dictionaries are rendered in idle time, one at a time. */
+static const size_t TEXT_WIN_FIRST_SCREEN_DATA_SIZE = 8*1024;
+
 void TextWin::Show(const gchar *orig_word, gchar ***Word, gchar ****WordData)
 {
+	CancelPending();
 	view->begin_update();
 	view->clear();
 	view->goto_begin();
 
-	int j,k;
+	size_t data_size = 0;
 	for (size_t i=0; i<gpAppFrame->query_dictmask.size(); i++) {
-		if (Word[i]) {
-			view->SetDictIndex(gpAppFrame->query_dictmask[i]);
-			if (gpAppFrame->query_dictmask[i].type == InstantDictType_LOCAL) {
-				const std::string &dicttype = gpAppFrame->oLibs.dict_type(gpAppFrame->query_dictmask[i].index);
-				if (!dicttype.empty()) {
-					size_t nPlugins = gpAppFrame->oStarDictPlugins->SpecialDictPlugins.nplugins();
-					GtkWidget *widget = NULL;
-					for (size_t iPlugin = 0; iPlugin < nPlugins; iPlugin++) {
-						if (dicttype == gpAppFrame->oStarDictPlugins->SpecialDictPlugins.dict_type(iPlugin)) {
-							gpAppFrame->oStarDictPlugins->SpecialDictPlugins.render_widget(iPlugin, true, gpAppFrame->query_dictmask[i].index, orig_word, Word[i], WordData[i], &widget);
-							break;
-						}
-					}
-					if (widget) {
-						view->AppendHeaderMark();
-						view->append_widget(widget);
-						view->AppendNewline();
-						continue;
-					}
+		if (!Word[i])
+			continue;
+		if (data_size < TEXT_WIN_FIRST_SCREEN_DATA_SIZE) {
+			data_size += AppendDict(gpAppFrame->query_dictmask[i], orig_word, Word[i], WordData[i]);
+			continue;
+		}
+		/* The caller frees the data after the article is shown. */
+		PendingDict pending;
+		pending.dict_index = gpAppFrame->query_dictmask[i];
+		pending.Word = g_strdupv(Word[i]);
+		size_t nwords = g_strv_length(Word[i]);
+		pending.WordData = (gchar ***)g_malloc(sizeof(gchar **) * nwords);
+		for (size_t j=0; j<nwords; j++) {
+			size_t ndata = 0;
+			while (WordData[i][j][ndata])
+				ndata++;
+			pending.WordData[j] = (gchar **)g_malloc(sizeof(gchar *) * (ndata+1));
+			for (size_t k=0; k<ndata; k++)
+				pending.WordData[j][k] = stardict_datadup(WordData[i][j][k]);
+			pending.WordData[j][ndata] = NULL;
+		}
+		pending_dicts.push_back(pending);
+	}
+	view->end_update();
+	if (!pending_dicts.empty()) {
+		pending_orig_word = orig_word;
+		pending_id = g_idle_add(on_pending_idle, this);
+	}
+}
+
+/* Return the size of the appended data. */
+size_t TextWin::AppendDict(const InstantDictIndex &dict_index, const gchar *orig_word, gchar **Word, gchar ***WordData)
+{
+	view->SetDictIndex(dict_index);
+	if (dict_index.type == InstantDictType_LOCAL) {
+		const std::string &dicttype = gpAppFrame->oLibs.dict_type(dict_index.index);
+		if (!dicttype.empty()) {
+			size_t nPlugins = gpAppFrame->oStarDictPlugins->SpecialDictPlugins.nplugins();
+			GtkWidget *widget = NULL;
+			for (size_t iPlugin = 0; iPlugin < nPlugins; iPlugin++) {
+				if (dicttype == gpAppFrame->oStarDictPlugins->SpecialDictPlugins.dict_type(iPlugin)) {
+					gpAppFrame->oStarDictPlugins->SpecialDictPlugins.render_widget(iPlugin, true, dict_index.index, orig_word, Word, WordData, &widget);
+					break;
 				}
-				view->AppendHeader(gpAppFrame->oLibs.dict_name(gpAppFrame->query_dictmask[i].index).c_str());
-			} else if (gpAppFrame->query_dictmask[i].type == InstantDictType_VIRTUAL) {
-				view->AppendHeader(gpAppFrame->oStarDictPlugins->VirtualDictPlugins.dict_name(gpAppFrame->query_dictmask[i].index));
-			} else if (gpAppFrame->query_dictmask[i].type == InstantDictType_NET) {
-				view->AppendHeader(gpAppFrame->oStarDictPlugins->NetDictPlugins.dict_name(gpAppFrame->query_dictmask[i].index), gpAppFrame->oStarDictPlugins->NetDictPlugins.dict_link(gpAppFrame->query_dictmask[i].index));
 			}
-			j=0;
-			do {
-				view->AppendWord(Word[i][j]);
-				view->AppendData(WordData[i][j][0], Word[i][j],
-						 orig_word);
+			if (widget) {
+				view->AppendHeaderMark();
+				view->append_widget(widget);
 				view->AppendNewline();
-				k=1;
-				while (WordData[i][j][k]) {
-					view->AppendDataSeparate();
-					view->AppendData(WordData[i][j][k],
-							 Word[i][j], orig_word);
-					view->AppendNewline();
-					k++;
-				}
-				j++;
-			} while (Word[i][j]);
+				return 0;
+			}
 		}
-	}
+		view->AppendHeader(gpAppFrame->oLibs.dict_name(dict_index.index).c_str());
+	} else if (dict_index.type == InstantDictType_VIRTUAL) {
+		view->AppendHeader(gpAppFrame->oStarDictPlugins->VirtualDictPlugins.dict_name(dict_index.index));
+	} else if (dict_index.type == InstantDictType_NET) {
+		view->AppendHeader(gpAppFrame->oStarDictPlugins->NetDictPlugins.dict_name(dict_index.index), gpAppFrame->oStarDictPlugins->NetDictPlugins.dict_link(dict_index.index));
+	}
+	size_t data_size = 0;
+	int j=0, k;
+	do {
+		view->AppendWord(Word[j]);
+		view->AppendData(WordData[j][0], Word[j],
+				 orig_word);
+		view->AppendNewline();
+		data_size += sizeof(guint32) + get_uint32(WordData[j][0]);
+		k=1;
+		while (WordData[j][k]) {
+			view->AppendDataSeparate();
+			view->AppendData(WordData[j][k],
+					 Word[j], orig_word);
+			view->AppendNewline();
+			data_size += sizeof(guint32) + get_uint32(WordData[j][k]);
+			k++;
+		}
+		j++;
+	} while (Word[j]);
+	return data_size;
+}
+
+/* Render the first pending dictionary. */
+void TextWin::AppendPending()
+{
+	PendingDict pending = pending_dicts.front();
+	pending_dicts.pop_front();
+	view->begin_update();
+	view->goto_end();
+	AppendDict(pending.dict_index, pending_orig_word.c_str(), pending.Word, pending.WordData);
 	view->end_update();
+	FreePending(pending);
+}
+
+void TextWin::FreePending(PendingDict &pending)
+{
+	for (size_t j=0; pending.Word[j]; j++)
+		g_strfreev(pending.WordData[j]);
+	g_free(pending.WordData);
+	g_strfreev(pending.Word);
+}
+
+gboolean TextWin::on_pending_idle(gpointer data)
+{
+	TextWin *oTextWin = static_cast<TextWin *>(data);
+	oTextWin->AppendPending();
+	if (!oTextWin->pending_dicts.empty())
+		return TRUE;
+	oTextWin->pending_id = 0;
+	return FALSE;
+}
+
+/* Forget the dictionaries that are not rendered yet. */
+void TextWin::CancelPending()
+{
+	if (pending_id) {
+		g_source_remove(pending_id);
+		pending_id = 0;
+	}
+	for (std::list<PendingDict>::iterator it = pending_dicts.begin(); it != pending_dicts.end(); ++it)
+		FreePending(*it);
+	pending_dicts.clear();
+}
+
+/* Render the whole article now, before it is searched or saved. */
+void TextWin::FlushPending()
+{
+	if (!pending_id)
+		return;
+	g_source_remove(pending_id);
+	pending_id = 0;
+	while (!pending_dicts.empty())
+		AppendPending();
 }
 
 void TextWin::Show(NetDictResponse *resp)
 {
+	FlushPending();
 	view->begin_update();
 	bool do_append;
 	if (query_result == TEXT_WIN_FOUND || query_result == TEXT_WIN_SHOW_FIRST || query_result == TEXT_WIN_NET_FOUND || query_result == TEXT_WIN_NET_SHOW_FIRST) {
@@ -2185,6 +2295,7 @@ void TextWin::Show(NetDictResponse *resp)
 
 void TextWin::Show(const struct STARDICT::LookupResponse::DictResponse *dict_response, STARDICT::LookupResponse::ListType list_type)
 {
+	FlushPending();
 	view->begin_update();
 	bool do_append;
 	if (query_result == TEXT_WIN_FOUND || query_result == TEXT_WIN_SHOW_FIRST || query_result == TEXT_WIN_NET_FOUND || query_result == TEXT_WIN_NET_SHOW_FIRST) {
@@ -2245,6 +2356,7 @@ void TextWin::Show(const struct STARDICT::LookupResponse::DictResponse *dict_res
 
 void TextWin::ShowTreeDictData(gchar *data)
 {
+	CancelPending();
 	view->begin_update();
 	view->clear();
 	view->goto_begin();
@@ -2257,6 +2369,7 @@ void TextWin::ShowTreeDictData(gchar *data)
 
 gboolean TextWin::Find (const gchar *text, gboolean start)
 {
+  FlushPending();
   GtkTextBuffer *buffer =
     gtk_text_view_get_buffer(GTK_TEXT_VIEW(view->widget()));
 
@@ -22,6 +22,7 @@
 
 #include <gtk/gtk.h>
 #include <string>
+#include <list>
 
 #include "articleview.h"
 #include "readword.h"
@@ -179,6 +180,7 @@ public:
 private:
 	static gboolean on_button_press(GtkWidget * widget, GdkEventButton * event, TreeWin *oTreeWin);
 	static void on_selection_changed(GtkTreeSelection *selection, TreeWin *oTreeWin);
+	static gboolean on_test_expand_row(GtkTreeView *treeview, GtkTreeIter *iter, GtkTreePath *path, TreeWin *oTreeWin);
 };
 
 class ResultWin {
@@ -258,7 +260,7 @@ public:
 	std::string find_text;
 	GtkEntry *eSearch;
 
-  TextWin() {}
+  TextWin() : pending_id(0) {}
   ~TextWin() {}
 
   void Create(GtkWidget *vbox);
@@ -271,6 +273,8 @@ public:
   void Show(const struct STARDICT::LookupResponse::DictResponse *dict_response, STARDICT::LookupResponse::ListType list_type);
   void Show(NetDictResponse *resp);
   gboolean Find (const gchar *text, gboolean start);
+	void CancelPending();
+	void FlushPending();
 	bool IsSearchPanelHasFocus() { return gtk_widget_has_focus(GTK_WIDGET(eSearch)); }
 	void set_bookname_style(BookNameStyle style);
 
@@ -282,6 +286,20 @@ private:
 	GtkButton *btFind;
 	GtkWidget *hbSearchPanel;
 	ReadWordType selection_readwordtype;
+	/* Dictionaries of the shown article that are rendered in idle time. */
+	struct PendingDict {
+		InstantDictIndex dict_index;
+		gchar **Word;
+		gchar ***WordData;
+	};
+	std::list<PendingDict> pending_dicts;
+	std::string pending_orig_word;
+	guint pending_id;
+
+	size_t AppendDict(const InstantDictIndex &dict_index, const gchar *orig_word, gchar **Word, gchar ***WordData);
+	void AppendPending();
+	static void FreePending(PendingDict &pending);
+	static gboolean on_pending_idle(gpointer data);
 	
 	static void SelectionCallback(GtkWidget* widget,GtkSelectionData *selection_data, guint time, TextWin *oTextWin);
 	static gboolean on_button_press(GtkWidget * widget, GdkEventButton * event, TextWin *oTextWin);
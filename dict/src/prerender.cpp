@@ -0,0 +1,368 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* stardict-prerender converts XDXF, HTML, MediaWiki and PowerWord fields of
+ * a dictionary into pre-rendered 'G' fields with the parse-data plug-ins
+ * of StarDict. The tool is part of this package, not of stardict-tools,
+ * because it needs the plug-ins and the code loading them. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+#include <iostream>
+#include <map>
+#include <string>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "ifo_file.h"
+#include "lib/iappdirs.h"
+#include "lib/plugin.h"
+#include "lib/pluginmanager.h"
+#include "lib/prerendered.h"
+#include "lib/stddict.h"
+#include "lib/utils.h"
+
+/* Directories of the application, so the plug-ins read the configuration
+ * of the user. See AppDirs in conf.cpp. */
+class PrerenderAppDirs : public IAppDirs
+{
+public:
+	std::string get_user_config_dir(void) const
+	{
+		const gchar *config_path_from_env = g_getenv("STARDICT_CONFIG_PATH");
+		if (config_path_from_env)
+			return config_path_from_env;
+		return build_path(g_get_user_config_dir(), "stardict");
+	}
+	std::string get_user_cache_dir(void) const
+	{
+		return build_path(g_get_user_cache_dir(), "stardict");
+	}
+	std::string get_data_dir(void) const
+	{
+		return STARDICT_DATA_DIR;
+	}
+	std::string get_plugin_dir(void) const
+	{
+		return build_path(STARDICT_LIB_DIR, "plugins");
+	}
+};
+
+static void append_uint32(std::string& data, guint32 val)
+{
+	guint32 val_be = g_htonl(val);
+	data.append(reinterpret_cast<const char *>(&val_be), sizeof(guint32));
+}
+
+static void append_uint64(std::string& data, guint64 val)
+{
+	guint64 val_be = GUINT64_TO_BE(val);
+	data.append(reinterpret_cast<const char *>(&val_be), sizeof(guint64));
+}
+
+class Prerenderer
+{
+public:
+	Prerenderer(StarDictParseDataPlugins& _plugins, bool _keep_original)
+	:
+		plugins(_plugins),
+		keep_original(_keep_original),
+		converted_fields(0),
+		skipped_fields(0)
+	{
+	}
+	int convert(const std::string& ifofilename, const std::string& outdir);
+private:
+	bool convert_index(Dict& dict, FILE *dictfile, guint32& wordcount);
+	void convert_synonyms(Dict& dict, guint32& synwordcount);
+	void convert_article(const gchar *data, const gchar *oword, std::string& article);
+
+	StarDictParseDataPlugins& plugins;
+	bool keep_original;
+	std::string out_basename;
+	std::string idx;
+	std::string syn;
+	guint32 idxoffsetbits;
+	/* fields converted and fields left as is, because plug-ins returned widgets */
+	glong converted_fields;
+	glong skipped_fields;
+};
+
+int Prerenderer::convert(const std::string& ifofilename, const std::string& outdir)
+{
+	DictInfo dict_info;
+	if (!dict_info.load_from_ifo_file(ifofilename, DictInfoType_NormDict))
+		return EXIT_FAILURE;
+	show_progress_t show_progress;
+	Dict dict;
+	if (!dict.load(ifofilename, false, CollationLevel_NONE, COLLATE_FUNC_NONE, &show_progress)) {
+		g_critical("Unable to load dictionary: '%s'.", ifofilename.c_str());
+		return EXIT_FAILURE;
+	}
+	std::string basename(ifofilename, 0, ifofilename.length() - (sizeof(".ifo") - 1));
+	glib::CharStr name(g_path_get_basename(basename.c_str()));
+	out_basename = build_path(outdir, get_impl(name));
+	const std::string out_ifofilename(out_basename + ".ifo");
+	if (g_file_test(out_ifofilename.c_str(), G_FILE_TEST_EXISTS)) {
+		g_critical("File exists, the dictionary is not overwritten: '%s'.", out_ifofilename.c_str());
+		return EXIT_FAILURE;
+	}
+	idxoffsetbits = dict_info.get_idxoffsetbits();
+
+	const std::string dictfilename(out_basename + ".dict");
+	FILE *dictfile = g_fopen(dictfilename.c_str(), "wb");
+	if (!dictfile) {
+		g_critical(open_write_file_err, dictfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	guint32 wordcount;
+	bool res = convert_index(dict, dictfile, wordcount);
+	if (fclose(dictfile) != 0 && res) {
+		g_critical(write_file_err, dictfilename.c_str());
+		res = false;
+	}
+	if (!res)
+		return EXIT_FAILURE;
+	guint32 synwordcount;
+	convert_synonyms(dict, synwordcount);
+
+	const std::string idxfilename(out_basename + ".idx");
+	if (!g_file_set_contents(idxfilename.c_str(), idx.c_str(), idx.length(), NULL)) {
+		g_critical(write_file_err, idxfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	if (synwordcount > 0) {
+		const std::string synfilename(out_basename + ".syn");
+		if (!g_file_set_contents(synfilename.c_str(), syn.c_str(), syn.length(), NULL)) {
+			g_critical(write_file_err, synfilename.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	/* fields of converted articles are not in the same order any more */
+	dict_info.ifo_file_name = out_ifofilename;
+	dict_info.unset_sametypesequence();
+	dict_info.set_wordcount(wordcount);
+	dict_info.set_index_file_size(idx.length());
+	if (synwordcount > 0)
+		dict_info.set_synwordcount(synwordcount);
+	else
+		dict_info.unset_synwordcount();
+	if (!dict_info.save_ifo_file())
+		return EXIT_FAILURE;
+	g_message("%ld fields converted, %ld fields left as is.", converted_fields, skipped_fields);
+	return EXIT_SUCCESS;
+}
+
+bool Prerenderer::convert_index(Dict& dict, FILE *dictfile, guint32& wordcount)
+{
+	/* articles shared by several index entries are converted once,
+	 * key: offset in the source dictionary */
+	typedef std::map<guint64, std::pair<guint64, guint32> > ArticleMap;
+	ArticleMap articles;
+	guint64 dictfile_size = 0;
+	std::string article;
+	wordcount = dict.narticles();
+	for (glong i = 0; i < dict.narticles(); ++i) {
+		const gchar *pkey;
+		guint64 offset;
+		guint32 size;
+		dict.get_key_and_data(i, &pkey, &offset, &size);
+		const std::string key(pkey);
+		ArticleMap::iterator it = articles.find(offset);
+		if (it == articles.end()) {
+			const gchar *data = dict.get_data(i);
+			if (!data) {
+				g_critical("Unable to read the article of the word '%s'.", key.c_str());
+				return false;
+			}
+			article.clear();
+			convert_article(data, key.c_str(), article);
+			if (fwrite(article.c_str(), 1, article.length(), dictfile) != article.length()) {
+				g_critical(write_file_err, (out_basename + ".dict").c_str());
+				return false;
+			}
+			it = articles.insert(std::make_pair(offset,
+				std::make_pair(dictfile_size, guint32(article.length())))).first;
+			dictfile_size += article.length();
+			if (idxoffsetbits == 32 && dictfile_size > G_MAXUINT32) {
+				/* offsets of the entries already added need 64 bits as well */
+				g_critical("The converted dictionary is larger than 4GB, "
+					"the source dictionary must have idxoffsetbits=64.");
+				return false;
+			}
+		}
+		idx.append(key.c_str(), key.length() + 1);
+		if (idxoffsetbits == 64)
+			append_uint64(idx, it->second.first);
+		else
+			append_uint32(idx, it->second.first);
+		append_uint32(idx, it->second.second);
+	}
+	return true;
+}
+
+/* Synonyms are written again rather than copied, because a delta layer
+ * of the source dictionary may change the positions of the index entries. */
+void Prerenderer::convert_synonyms(Dict& dict, guint32& synwordcount)
+{
+	synwordcount = 0;
+	for (glong i = 0; i < dict.nsynarticles(); ++i) {
+		const gchar *key = dict.syn_file->getWord(i, CollationLevel_NONE, 0);
+		const glong target = dict.idx_file->get_synonym_target(dict.syn_file->wordentry_index);
+		if (target == INVALID_INDEX)
+			continue;
+		syn.append(key, strlen(key) + 1);
+		append_uint32(syn, target);
+		++synwordcount;
+	}
+}
+
+/* data - article as returned by Dict::get_data, the result is in the format
+ * of the .dict file without sametypesequence. */
+void Prerenderer::convert_article(const gchar *data, const gchar *oword, std::string& article)
+{
+	const guint32 data_size = get_uint32(data);
+	data += sizeof(guint32);
+	const gchar *p = data;
+	std::string prerendered;
+	unsigned int parsed_size;
+	ParseResult parse_result;
+	while (guint32(p - data) < data_size) {
+		size_t field_size;
+		if (g_ascii_isupper(*p))
+			field_size = 1 + sizeof(guint32) + g_ntohl(get_uint32(p + 1));
+		else
+			field_size = 1 + strlen(p + 1) + 1;
+		if (is_prerendered_data_type(*p)) {
+			size_t iPlugin;
+			for (iPlugin = 0; iPlugin < plugins.nplugins(); ++iPlugin) {
+				parse_result.clear();
+				if (plugins.parse(iPlugin, p, &parsed_size, parse_result, oword))
+					break;
+			}
+			prerendered.clear();
+			if (iPlugin != plugins.nplugins()
+				&& serialize_parse_result(parse_result, prerendered)) {
+				article += 'G';
+				append_uint32(article, prerendered.length());
+				article += prerendered;
+				++converted_fields;
+				if (!keep_original) {
+					p += field_size;
+					continue;
+				}
+			} else if (iPlugin != plugins.nplugins()) {
+				++skipped_fields;
+			}
+		}
+		article.append(p, field_size);
+		p += field_size;
+	}
+}
+
+struct Main
+{
+	int main(int argc, char * argv [])
+	{
+		gboolean keep_original = FALSE;
+		gchar *plugin_dir = NULL;
+		static GOptionEntry entries[] = {
+			{ "keep-original", 'k', 0, G_OPTION_ARG_NONE, &keep_original, "keep the original fields after the pre-rendered ones", NULL },
+			{ "plugin-dir", 'p', 0, G_OPTION_ARG_FILENAME, &plugin_dir, "load parse-data plug-ins from DIR", "DIR" },
+			{ NULL },
+		};
+		glib::OptionContext opt_cnt(g_option_context_new(" DICTIONARY.ifo OUTDIR"));
+		g_option_context_add_main_entries(get_impl(opt_cnt), entries, NULL);
+		g_option_context_set_help_enabled(get_impl(opt_cnt), TRUE);
+		g_option_context_set_summary(get_impl(opt_cnt),
+				"Pre-renders XDXF, HTML, MediaWiki and PowerWord articles of a StarDict dictionary\n"
+				"\n"
+				"The fields of these types are converted with the parse-data plug-ins of StarDict "
+				"into Pango markup with links and resource references, the 'G' field type. "
+				"StarDict shows such fields without parsing them. "
+				"The plug-ins use the configuration of the current user, "
+				"for example, the colors of the XDXF parser.\n"
+				"\n"
+				"The converted dictionary is written to OUTDIR with the same name as the source one. "
+				"Its .dict file is not compressed, use dictzip to compress it. "
+				"Copy the res directory or res.rifo files of the source dictionary yourself. "
+				"With --keep-original the original fields are kept, "
+				"so the dictionary can be still used with other programs and searched in the full text.\n"
+				"\n"
+				"EXIT STATUS\n"
+				"The utility exits with status 0 if the conversion succeeds, with non-zero status otherwise."
+			);
+		glib::Error err;
+		if (!g_option_context_parse(get_impl(opt_cnt), &argc, &argv, get_addr(err))) {
+			std::cerr << "Option parsing failed: " <<  err->message << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(argc != 3) {
+			std::cerr << "Specify the dictionary and the output directory." << std::endl;
+			return EXIT_FAILURE;
+		}
+		ifofilename = argv[1];
+		outdir = argv[2];
+		this->keep_original = keep_original;
+		if (plugin_dir) {
+			plugindir = plugin_dir;
+			g_free(plugin_dir);
+		}
+		if (!g_str_has_suffix(ifofilename.c_str(), ".ifo")) {
+			std::cerr << "The dictionary must be specified with its .ifo file." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if (!g_file_test(outdir.c_str(), G_FILE_TEST_IS_DIR)) {
+			std::cerr << "Output directory does not exist: " << outdir << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	std::string ifofilename;
+	std::string outdir;
+	std::string plugindir;
+	bool keep_original;
+};
+
+int main(int argc,char * argv [])
+{
+	setlocale(LC_ALL, "");
+	Main oMain;
+	if(oMain.main(argc, argv))
+		return EXIT_FAILURE;
+	PrerenderAppDirs dirs;
+	app_dirs = &dirs;
+	oStarDictPluginSystemInfo.datadir = dirs.get_data_dir();
+	if (oMain.plugindir.empty())
+		oMain.plugindir = dirs.get_plugin_dir();
+	std::list<std::string> order_list, disable_list;
+	StarDictPlugins plugins(oMain.plugindir, order_list, disable_list,
+		StarDictPlugInType_PARSEDATA);
+	if (plugins.ParseDataPlugins.nplugins() == 0) {
+		g_critical("No parse-data plug-ins found in '%s'.", oMain.plugindir.c_str());
+		return EXIT_FAILURE;
+	}
+	Prerenderer prerenderer(plugins.ParseDataPlugins, oMain.keep_original);
+	return prerenderer.convert(oMain.ifofilename, oMain.outdir);
+}
@@ -35,29 +35,39 @@
 
 
 /* 
- Is there any way to know that selection is changed?
- So we don't need to get selection text every interval milliseconds
- and compare the text to know whether selection changed.
- I tried the "selection_notify_event", but it means that some one is requesting the selection.
- if you use the "selection-clear-event", so when selection is changed,you will get this event,
- but it need you do a gtk_selection_owner_set,this make the old selection be cleared :(
-
- OK, there is no way the know the selection is changed...
  Is there any way to only get the selection's text with a limit length,
- but not the whole text? Stardict only need the first 256 chars....it seems no way too :(
+ but not the whole text? Stardict only need the first 256 chars....it seems no way :(
 */
 
+/* "selection_received" signal is not received for 8 seconds.
+	there encounter some error, and i find that this often take a long time 
+	(several minutes) to get the signal at last,
+	during this period, if you call gtk_selection_convert(),
+	the "selection_received" signal will not be received also,
+	and at last these signals are received at almost the same time...BAD.
+
+	so here create a new selection_widget, then call gtk_selection_convert()...
+	this should can throw that error selection.
+	!!!:
+	But it seems (i am not sure) it will make the widgets in StarDict 
+	become unselectable! see BUGS.
+ */
+static const gint64 SELECTION_RECEIVE_TIMEOUT = 8 * G_TIME_SPAN_SECOND;
+
 /*
 GdkAtom Selection::TARGETS_Atom;
 GdkAtom Selection::UTF8_STRING_Atom;
 */
 
 Selection::Selection()
+:
+	notifier(SelectionChangedCallback, this)
 {
 	UTF8_STRING_Atom = COMPOUND_TEXT_Atom = GDK_NONE;
-	IsBusy = 0;
+	IsBusy = false;
+	busy_since = 0;
+	recheck = false;
 	selection_widget = NULL;
-	timeout = 0;
 }
 
 /********************************************************************/
@@ -92,57 +102,64 @@ void Selection::End()
 
 void Selection::start()
 {
-	if (!timeout)
-		timeout = g_timeout_add(SELECTION_INTERVAL,TimeOutCallback,this);
+	/* The modifier key may be pressed after the text is selected,
+	 * the selection owner does not change in that case. */
+	notifier.start(conf->get_bool_at("dictionary/only_scan_while_modifier_key"));
 }
 
 void Selection::stop()
 {
-	if (timeout) {
-		g_source_remove(timeout);
-		timeout = 0;
-	}
+	notifier.stop();
+	recheck = false;
 	LastClipWord.clear();
 }
 
-gint Selection::TimeOutCallback(gpointer data)
+void Selection::restart()
 {
-	Selection *oSelection = (Selection *)data;
-	if (oSelection->Enable()) {
+	if (notifier.is_started()) {
+		stop();
+		start();
+	}
+}
 
-		if (conf->get_bool_at("dictionary/only_scan_while_modifier_key")) {
-			bool do_scan = gpAppFrame->unlock_keys->is_pressed();
-			if (!do_scan)
-				return true;
-		}
+void Selection::SelectionChangedCallback(gpointer data)
+{
+	static_cast<Selection *>(data)->CheckSelection();
+}
 
-		if (oSelection->IsBusy) {
-			oSelection->IsBusy++;
-			if (oSelection->IsBusy*SELECTION_INTERVAL > 8000 ) {
-				/* "selection_received" signal is not received for 8 seconds.
-					there encounter some error, and i find that this often take a long time 
-					(several minutes) to get the signal at last,
-					during this period, if you call gtk_selection_convert(),
-					the "selection_received" signal will not be received also,
-					and at last these signals are received at almost the same time...BAD.
-				
-					so here create a new selection_widget, then call gtk_selection_convert()...
-					this should can throw that error selection.
-					!!!:
-					But it seems (i am not sure) it will make the widgets in StarDict 
-					become unselectable! see BUGS.
-				 */
-				g_warning("Error, selection data didn't received, retrying!");
-				oSelection->create_selection_widget();
-				oSelection->IsBusy = 0;
-			}
-		} else {
-			oSelection->IsBusy = 1;
-			gtk_selection_convert (oSelection->selection_widget, GDK_SELECTION_PRIMARY, oSelection->UTF8_STRING_Atom, GDK_CURRENT_TIME);
+void Selection::CheckSelection()
+{
+	if (!Enable())
+		return;
+
+	if (conf->get_bool_at("dictionary/only_scan_while_modifier_key")) {
+		bool do_scan = gpAppFrame->unlock_keys->is_pressed();
+		if (!do_scan)
+			return;
+	}
+
+	if (IsBusy) {
+		if (g_get_monotonic_time() - busy_since <= SELECTION_RECEIVE_TIMEOUT) {
+			recheck = true;
+			return;
 		}
+		g_warning("Error, selection data didn't received, retrying!");
+		create_selection_widget();
 	}
+	IsBusy = true;
+	busy_since = g_get_monotonic_time();
+	recheck = false;
+	gtk_selection_convert (selection_widget, GDK_SELECTION_PRIMARY, UTF8_STRING_Atom, GDK_CURRENT_TIME);
+}
 
-	return true;
+/* The selection request is complete. */
+void Selection::SelectionDone()
+{
+	IsBusy = false;
+	if (recheck) {
+		recheck = false;
+		CheckSelection();
+	}
 }
 
 void Selection::SelectionReceivedCallback(GtkWidget* widget,GtkSelectionData *selection_data, guint time, Selection *oSelection)
@@ -159,15 +176,15 @@ void Selection::SelectionReceivedCallback(GtkWidget* widget,GtkSelectionData *se
 		} else if (gtk_selection_data_get_target(selection_data) == oSelection->COMPOUND_TEXT_Atom) {
 			gtk_selection_convert (widget, GDK_SELECTION_PRIMARY, GDK_TARGET_STRING, GDK_CURRENT_TIME);
 		} else {
-			oSelection->IsBusy = 0;
 			oSelection->LastClipWord.clear();
+			oSelection->SelectionDone();
 		}
 		return;
 	}
-	oSelection->IsBusy = 0;
 
 	oSelection->SelectionReceived(result);
 	g_free (result);
+	oSelection->SelectionDone();
 }
 
 /********************************************************************/
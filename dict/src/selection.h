@@ -23,16 +23,22 @@
 #include <gtk/gtk.h>
 #include <string>
 
-const int SELECTION_INTERVAL=300; 		    // check selection interval.
+#include "selection_notifier.h"
 
 class Selection {
 private:
-	gint IsBusy;
-	gint timeout;
+	bool IsBusy;
+	/* when the selection was requested */
+	gint64 busy_since;
+	/* the selection changed while it was being received */
+	bool recheck;
+	SelectionNotifier notifier;
 
 	void create_selection_widget();
 
-	static gint TimeOutCallback(gpointer data);
+	static void SelectionChangedCallback(gpointer data);
+	void CheckSelection();
+	void SelectionDone();
 	static void SelectionReceivedCallback(GtkWidget* widget,GtkSelectionData *selection_data, guint time, Selection *oSelection);
 	void SelectionReceived(gchar* sValue);
 	gboolean Enable();
@@ -46,6 +52,7 @@ public:
 	void End();
 	void start();
 	void stop();
+	void restart();
 };
 
 #endif
@@ -0,0 +1,92 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "selection_notifier.h"
+
+SelectionNotifier::SelectionNotifier(changed_func_t changed_func_, gpointer data_)
+:
+	changed_func(changed_func_),
+	data(data_),
+	timeout(0),
+	settle_timeout(0),
+	clipboard(NULL),
+	owner_change_handler(0)
+{
+}
+
+SelectionNotifier::~SelectionNotifier()
+{
+	stop();
+}
+
+void SelectionNotifier::start(bool force_poll)
+{
+	if (is_started())
+		return;
+	GdkDisplay *display = gdk_display_get_default();
+	if (!force_poll && display && gdk_display_supports_selection_notification(display)) {
+		clipboard = gtk_clipboard_get_for_display(display, GDK_SELECTION_PRIMARY);
+		owner_change_handler = g_signal_connect(G_OBJECT(clipboard), "owner-change",
+			G_CALLBACK(on_owner_change), this);
+	} else {
+		timeout = g_timeout_add(SELECTION_INTERVAL, on_timeout, this);
+	}
+}
+
+void SelectionNotifier::stop()
+{
+	if (timeout) {
+		g_source_remove(timeout);
+		timeout = 0;
+	}
+	if (settle_timeout) {
+		g_source_remove(settle_timeout);
+		settle_timeout = 0;
+	}
+	if (owner_change_handler) {
+		g_signal_handler_disconnect(G_OBJECT(clipboard), owner_change_handler);
+		owner_change_handler = 0;
+		clipboard = NULL;
+	}
+}
+
+gboolean SelectionNotifier::on_timeout(gpointer data)
+{
+	SelectionNotifier *notifier = static_cast<SelectionNotifier *>(data);
+	notifier->changed_func(notifier->data);
+	return TRUE;
+}
+
+gboolean SelectionNotifier::on_settle_timeout(gpointer data)
+{
+	SelectionNotifier *notifier = static_cast<SelectionNotifier *>(data);
+	notifier->settle_timeout = 0;
+	notifier->changed_func(notifier->data);
+	return FALSE;
+}
+
+void SelectionNotifier::on_owner_change(GtkClipboard *clipboard, GdkEvent *event,
+	SelectionNotifier *notifier)
+{
+	if (notifier->settle_timeout)
+		g_source_remove(notifier->settle_timeout);
+	notifier->settle_timeout = g_timeout_add(SELECTION_SETTLE_TIME, on_settle_timeout, notifier);
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SD_SELECTION_NOTIFIER_H__
+#define __SD_SELECTION_NOTIFIER_H__
+
+#include <gtk/gtk.h>
+
+const int SELECTION_INTERVAL=300; 		    // check selection interval.
+/* Owner changes come in bursts while the user drags the mouse to select
+ * text. Wait till the burst is over before checking the selection. */
+const int SELECTION_SETTLE_TIME=100;
+
+/* Tells when the primary selection may have changed.
+ * If the display supports selection owner change notifications (the XFixes
+ * extension on X11), the callback is invoked after the owner of the
+ * selection changes. Otherwise, the callback is invoked every
+ * SELECTION_INTERVAL milliseconds. */
+class SelectionNotifier {
+public:
+	typedef void (*changed_func_t)(gpointer data);
+
+	SelectionNotifier(changed_func_t changed_func, gpointer data);
+	~SelectionNotifier();
+	/* force_poll - poll the selection even if notifications are supported */
+	void start(bool force_poll = false);
+	void stop();
+	bool is_started() const { return timeout || owner_change_handler; }
+	bool is_polling() const { return timeout; }
+private:
+	changed_func_t changed_func;
+	gpointer data;
+	guint timeout;
+	guint settle_timeout;
+	GtkClipboard *clipboard;
+	gulong owner_change_handler;
+
+	static gboolean on_timeout(gpointer data);
+	static gboolean on_settle_timeout(gpointer data);
+	static void on_owner_change(GtkClipboard *clipboard, GdkEvent *event,
+		SelectionNotifier *notifier);
+};
+
+#endif
@@ -129,10 +129,19 @@ AppCore::AppCore() :
 	oLibs(&gtk_show_progress,
 	      conf->get_bool_at("dictionary/create_cache_file"),
 	      conf->get_bool_at("dictionary/enable_collation") ? CollationLevel_SINGLE : CollationLevel_NONE,
-	      int_to_colate_func(conf->get_int_at("dictionary/collate_function")))
+	      int_to_colate_func(conf->get_int_at("dictionary/collate_function"))),
+	async_lookup(&oLibs)
 {
 	iCurrentIndex = NULL;
 	word_change_timeout_id = 0;
+	word_prefetch_id = 0;
+	word_prefetch_lib_ = 0;
+	dict_change_check_timeout_id = 0;
+	query_stats_timeout_id = 0;
+	fulltext_search_window = NULL;
+	fulltext_search_progress_bar = NULL;
+	fulltext_search_progress_timeout_id = 0;
+	virtual_dict_mainwin_seq = 0;
 	window = NULL; //need by save_yourself_cb().
 	dict_manage_dlg = NULL;
 	plugin_manage_dlg = NULL;
@@ -143,6 +152,7 @@ AppCore::AppCore() :
 AppCore::~AppCore()
 {
 	stop_word_change_timer();
+	stop_word_prefetch();
 	delete dict_manage_dlg;
 	delete plugin_manage_dlg;
 	delete prefs_dlg;
@@ -225,6 +235,65 @@ void AppCore::show_netdict_resp(const char *dict, NetDictResponse *resp, bool is
 	}
 }
 
+/* user_data is the sequence number of the main window lookup, 0 for the floating window. */
+void AppCore::on_virtual_dict_lookup_end(size_t iPlugin, const char *word,
+	char **ppWord, char ***pppWordData, gpointer user_data)
+{
+	guint seq = GPOINTER_TO_UINT(user_data);
+	const char *dict_id = gpAppFrame->oStarDictPlugins->VirtualDictPlugins.dict_id(iPlugin);
+	if (seq) {
+		if (seq != gpAppFrame->virtual_dict_mainwin_seq || !ppWord)
+			return;
+		TextWin &oTextWin = gpAppFrame->oMidWin.oTextWin;
+		bool replace;
+		if (oTextWin.queryWord == word) {
+			replace = oTextWin.query_result == TEXT_WIN_NOT_FOUND
+				|| oTextWin.query_result == TEXT_WIN_NET_NOT_FOUND
+				|| oTextWin.query_result == TEXT_WIN_FUZZY_NOT_FOUND
+				|| oTextWin.query_result == TEXT_WIN_PATTERN_NOT_FOUND;
+		} else {
+			// A suggestion is shown in place of the word asked, the word is found now.
+			if ((oTextWin.query_result != TEXT_WIN_SHOW_FIRST
+				&& oTextWin.query_result != TEXT_WIN_NET_SHOW_FIRST)
+				|| gpAppFrame->virtual_dict_mainwin_word != word)
+				return;
+			replace = true;
+		}
+		if (replace) {
+			// TextWin::Show clears the view unless something was found
+			oTextWin.query_result = TEXT_WIN_NOT_FOUND;
+			oTextWin.queryWord = word;
+			gpAppFrame->oMidWin.oIndexWin.oResultWin.Clear();
+			oTextWin.readwordtype = gpAppFrame->oReadWord.canRead(word);
+			if (oTextWin.readwordtype != READWORD_CANNOT)
+				oTextWin.pronounceWord = word;
+			gtk_widget_set_sensitive(GTK_WIDGET(gpAppFrame->oMidWin.oToolWin.PronounceWordMenuButton),
+				oTextWin.readwordtype != READWORD_CANNOT);
+		}
+	} else {
+		if (!gpAppFrame->composite_lookup_float_win.got_net_dict_responce(dict_id, word))
+			return;
+	}
+	NetDictResponse resp;
+	resp.bookname = gpAppFrame->oStarDictPlugins->VirtualDictPlugins.dict_name(iPlugin);
+	resp.booklink = NULL;
+	for (size_t i=0; ppWord && ppWord[i]; i++) {
+		for (size_t j=0; pppWordData[i][j]; j++) {
+			resp.word = ppWord[i];
+			resp.data = pppWordData[i][j];
+			if (seq)
+				gpAppFrame->oMidWin.oTextWin.Show(&resp);
+			else
+				gpAppFrame->oFloatWin.AppendTextNetDict(&resp);
+		}
+	}
+	// the result is freed by the caller
+	resp.word = NULL;
+	resp.data = NULL;
+	if (!seq && gpAppFrame->composite_lookup_float_win.is_got_all_responses())
+		gpAppFrame->oFloatWin.EndLookup();
+}
+
 void AppCore::lookup_dict(size_t dictid, const char *sWord, char ****Word, char *****WordData)
 {
 	InstantDictIndex instance_dict_index;
@@ -326,6 +395,16 @@ void AppCore::Create(const gchar *queryword)
 		oLibs.load(s_load_list);
 	}
 	oLibs.set_show_progress(&gtk_show_progress);
+	dict_change_check_timeout_id = g_timeout_add_seconds(DICT_CHANGE_CHECK_INTERVAL,
+		on_dict_change_check_timeout, this);
+	/* STARDICT_QUERY_STATS=N logs lookup metrics every N seconds */
+	const gchar *query_stats_env = g_getenv("STARDICT_QUERY_STATS");
+	const int query_stats_interval = query_stats_env ? atoi(query_stats_env) : 0;
+	if (query_stats_interval > 0) {
+		query_stats_set_enabled(true);
+		query_stats_timeout_id = g_timeout_add_seconds(query_stats_interval,
+			on_query_stats_timeout, this);
+	}
 
 	oStarDictClient.set_server(conf->get_string_at("network/server").c_str(), conf->get_int_at("network/port"));
 	const std::string &user = conf->get_string_at("network/user");
@@ -659,6 +738,7 @@ gboolean AppCore::vKeyPressReleaseCallback(GtkWidget * window, GdkEventKey *even
 
 void AppCore::SimpleLookupToFloat(const char* sWord, bool IgnoreScanModifierKey)
 {
+	AsyncLookupPause pause(async_lookup);
 	oFloatWin.StartLookup(sWord, IgnoreScanModifierKey);
 	composite_lookup_float_win.new_lookup();
 	if (IsASCII(sWord)) {
@@ -691,6 +771,7 @@ void AppCore::SimpleLookupToFloat(const char* sWord, bool IgnoreScanModifierKey)
 		}
 	}
 	LookupNetDict(sWord, false);
+	LookupVirtualDict(sWord, false);
 	composite_lookup_float_win.done_lookup();
 	if(composite_lookup_float_win.is_got_all_responses())
 		oFloatWin.EndLookup();
@@ -718,8 +799,7 @@ bool AppCore::SimpleLookupToFloatLocal(const char* sWord)
 		bool bFound = false;
 		for (size_t iLib=0;iLib<scan_dictmask.size();iLib++)
 			BuildResultData(scan_dictmask, SearchWord, iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 2);
-		for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
-			BuildVirtualDictData(scan_dictmask, SearchWord, iLib, pppWord, ppppWordData, bFound);
+		BuildVirtualDictData(scan_dictmask, SearchWord, pppWord, ppppWordData, bFound);
 		if (bFound) {
 			oFloatWin.AppendTextLocalDict(pppWord, ppppWordData, SearchWord);
 			oTopWin.InsertHisList(SearchWord);
@@ -743,9 +823,16 @@ bool AppCore::SimpleLookupToFloatLocal(const char* sWord)
 #ifdef _WIN32
 void AppCore::SmartLookupToFloat(const gchar* sWord, int BeginPos, bool IgnoreScanModifierKey)
 {
+	AsyncLookupPause pause(async_lookup);
 	oFloatWin.StartLookup(sWord, IgnoreScanModifierKey);
 	composite_lookup_float_win.new_lookup();
 	LocalSmartLookupToFloat(sWord, BeginPos);
+	// virtual dictionaries get the word under the cursor
+	gchar *word = (gchar *)g_malloc(strlen(sWord)+1);
+	extract_word(word, sWord, BeginPos, is_space_or_punct);
+	if (word[0])
+		LookupVirtualDict(word, false);
+	g_free(word);
 	/* sWord is not a candidate to search in net dictionaries */
 	composite_lookup_float_win.done_lookup();
 	if(composite_lookup_float_win.is_got_all_responses())
@@ -824,8 +911,7 @@ bool AppCore::LocalSmartLookupToFloat(const gchar* sWord, int BeginPos)
 		bool bFound = false;
 		for (size_t iLib=0;iLib<scan_dictmask.size();iLib++)
 			BuildResultData(scan_dictmask, SearchWord, iIndex, false, iLib, pppWord, ppppWordData, bFound, 2);
-		for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
-			BuildVirtualDictData(scan_dictmask, SearchWord, iLib, pppWord, ppppWordData, bFound);
+		BuildVirtualDictData(scan_dictmask, SearchWord, pppWord, ppppWordData, bFound);
 		
 		if (bFound) {
 			oFloatWin.AppendTextLocalDict(pppWord, ppppWordData, SearchWord);
@@ -844,27 +930,29 @@ loop_end:
 }
 #endif
 
-void AppCore::BuildVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord, int iLib, gchar ***pppWord, gchar ****ppppWordData, bool &bFound)
-{
-	if (dictmask[iLib].type == InstantDictType_NET) {
-		const char *dict_cacheid = oStarDictPlugins->NetDictPlugins.dict_cacheid(dictmask[iLib].index);
-		NetDictResponse *resp = netdict_get_cache_resp(dict_cacheid, sWord);
-		if (resp && resp->data) {
-			pppWord[iLib] = (gchar **)g_malloc(sizeof(gchar *)*2);
-			pppWord[iLib][0] = g_strdup(resp->word);
-			pppWord[iLib][1] = NULL;
-			ppppWordData[iLib] = (gchar ***)g_malloc(sizeof(gchar **)*(1));
-			ppppWordData[iLib][0] = (gchar **)g_malloc(sizeof(gchar *)*2);
-			ppppWordData[iLib][0][0] =  stardict_datadup(resp->data);
-			ppppWordData[iLib][0][1] = NULL;
-			bFound = true;
-		} else {
+/* Virtual dictionaries are looked up asynchronously by LookupVirtualDict,
+ * only the cached results of net dictionaries are taken here. */
+void AppCore::BuildVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord, gchar ***pppWord, gchar ****ppppWordData, bool &bFound)
+{
+	for (size_t iLib=0; iLib<dictmask.size(); iLib++) {
+		if (dictmask[iLib].type == InstantDictType_NET) {
+			const char *dict_cacheid = oStarDictPlugins->NetDictPlugins.dict_cacheid(dictmask[iLib].index);
+			NetDictResponse *resp = netdict_get_cache_resp(dict_cacheid, sWord);
+			if (resp && resp->data) {
+				pppWord[iLib] = (gchar **)g_malloc(sizeof(gchar *)*2);
+				pppWord[iLib][0] = g_strdup(resp->word);
+				pppWord[iLib][1] = NULL;
+				ppppWordData[iLib] = (gchar ***)g_malloc(sizeof(gchar **)*(1));
+				ppppWordData[iLib][0] = (gchar **)g_malloc(sizeof(gchar *)*2);
+				ppppWordData[iLib][0][0] =  stardict_datadup(resp->data);
+				ppppWordData[iLib][0][1] = NULL;
+				bFound = true;
+			} else {
+				pppWord[iLib] = NULL;
+			}
+		} else if (dictmask[iLib].type == InstantDictType_VIRTUAL) {
 			pppWord[iLib] = NULL;
 		}
-	} else if (dictmask[iLib].type == InstantDictType_VIRTUAL) {
-		oStarDictPlugins->VirtualDictPlugins.lookup(dictmask[iLib].index, sWord, &(pppWord[iLib]), &(ppppWordData[iLib]));
-		if (pppWord[iLib])
-			bFound = true;
 	}
 }
 
@@ -929,6 +1017,11 @@ void AppCore::BuildResultData(std::vector<InstantDictIndex> &dictmask, const cha
 		}
 		for (j=0;i<nWord;i++,j++) {
 			iWordIdx = oLibs.poGetOrigSynonymWordIdx(orig_synidx+j, iRealLib);
+			if (iWordIdx == INVALID_INDEX) {
+				nWord--;
+				i--;
+				continue;
+			}
 			if (bLookupWord) {
 				if (iWordIdx>=orig_idx && (iWordIdx<orig_idx+count)) {
 					nWord--;
@@ -982,6 +1075,14 @@ void AppCore::FreeResultData(size_t dictmask_size, gchar ***pppWord, gchar ****p
  */
 bool AppCore::SimpleLookupToTextWin(const char* sWord, CurrentIndex *piIndex, const gchar *piIndexValidStr, bool bTryMoreIfNotFound, bool bShowNotfound, bool isShowFirst)
 {
+	/* Callers replacing the query of the main window cancel the async lookup. */
+	AsyncLookupPause pause(async_lookup);
+	if (!isShowFirst) {
+		// the virtual dictionary results of the previous query are not shown any more
+		if (!++virtual_dict_mainwin_seq)
+			++virtual_dict_mainwin_seq;
+		virtual_dict_mainwin_word = piIndexValidStr?piIndexValidStr:sWord;
+	}
 	bool bFound = false;
 	gchar ***pppWord = (gchar ***)g_malloc(sizeof(gchar **) * query_dictmask.size());
 	gchar ****ppppWordData = (gchar ****)g_malloc(sizeof(gchar ***) * query_dictmask.size());
@@ -997,8 +1098,7 @@ bool AppCore::SimpleLookupToTextWin(const char* sWord, CurrentIndex *piIndex, co
 		for (size_t iLib=0; iLib<query_dictmask.size(); iLib++)
 			BuildResultData(query_dictmask, sWord, iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 1);
 	}
-	for (size_t iLib=0; iLib<query_dictmask.size(); iLib++)
-		BuildVirtualDictData(query_dictmask, piIndexValidStr?piIndexValidStr:sWord, iLib, pppWord, ppppWordData, bFound);
+	BuildVirtualDictData(query_dictmask, piIndexValidStr?piIndexValidStr:sWord, pppWord, ppppWordData, bFound);
 	if (bFound) {
 		ShowDataToTextWin(pppWord, ppppWordData, sWord, isShowFirst);
 	} else {
@@ -1017,8 +1117,7 @@ bool AppCore::SimpleLookupToTextWin(const char* sWord, CurrentIndex *piIndex, co
 						for (size_t iLib=0; iLib<query_dictmask.size(); iLib++)
 							BuildResultData(query_dictmask, hword, iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 1);
 					}
-					for (size_t iLib=0; iLib<query_dictmask.size(); iLib++)
-						BuildVirtualDictData(query_dictmask, hword, iLib, pppWord, ppppWordData, bFound);
+					BuildVirtualDictData(query_dictmask, hword, pppWord, ppppWordData, bFound);
 					if (bFound) {
 						ShowDataToTextWin(pppWord, ppppWordData, sWord, isShowFirst);
 					} else {
@@ -1042,30 +1141,49 @@ bool AppCore::SimpleLookupToTextWin(const char* sWord, CurrentIndex *piIndex, co
 
 	FreeResultData(query_dictmask.size(), pppWord, ppppWordData);
 
+	// the results are shown when they arrive, see on_virtual_dict_lookup_end
+	LookupVirtualDict(piIndexValidStr?piIndexValidStr:sWord, true);
+
 	return bFound;
 }
 
-struct FullTextSearchDialog {
-	GtkWidget *progress_bar;
-};
+void AppCore::on_fulltext_search_cancel_clicked(GtkButton *button, AppCore *app)
+{
+	app->CancelAsyncLookup();
+	app->CloseFullTextSearchWindow();
+}
 
-static void updateSearchDialog(gpointer data, gdouble fraction)
+gboolean AppCore::on_fulltext_search_window_delete_event(GtkWidget * window, GdkEvent *event , AppCore *app)
 {
-	FullTextSearchDialog *Dialog = (FullTextSearchDialog *)data;
-	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(Dialog->progress_bar), fraction);
-	while (gtk_events_pending())
-		gtk_main_iteration();
+	app->CancelAsyncLookup();
+	app->CloseFullTextSearchWindow();
+	return true;
 }
 
-static void on_fulltext_search_cancel_clicked(GtkButton *button, bool *cancel)
+gboolean AppCore::on_fulltext_search_progress_timeout(gpointer data)
 {
-	*cancel = true;
+	AppCore *app = static_cast<AppCore *>(data);
+	if (!app->async_lookup.is_running()) {
+		// superseded by another lookup
+		app->fulltext_search_progress_timeout_id = 0;
+		app->CloseFullTextSearchWindow();
+		return FALSE;
+	}
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->fulltext_search_progress_bar), app->async_lookup.get_progress());
+	return TRUE;
 }
 
-static gboolean on_fulltext_search_window_delete_event(GtkWidget * window, GdkEvent *event , bool *cancel)
+void AppCore::CloseFullTextSearchWindow()
 {
-	*cancel = true;
-	return true;
+	if (fulltext_search_progress_timeout_id) {
+		g_source_remove(fulltext_search_progress_timeout_id);
+		fulltext_search_progress_timeout_id = 0;
+	}
+	if (fulltext_search_window) {
+		gtk_widget_destroy(fulltext_search_window);
+		fulltext_search_window = NULL;
+		fulltext_search_progress_bar = NULL;
+	}
 }
 
 class LookupDataDialog {
@@ -1207,12 +1325,9 @@ void AppCore::LookupDataWithDictMask(const gchar *sWord, std::vector<InstantDict
 {
 	if (!sWord || !*sWord)
 		return;
-	change_cursor busy(gtk_widget_get_window(window),
-			   get_impl(oAppSkin.watch_cursor),
-			   get_impl(oAppSkin.normal_cursor));
+	CancelAsyncLookup();
+	CloseFullTextSearchWindow();
 
-	bool cancel = false;
-	FullTextSearchDialog Dialog;
 	GtkWidget *search_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 	gtk_window_set_title (GTK_WINDOW(search_window), _("Full-text search..."));
 	gtk_window_set_transient_for(GTK_WINDOW(search_window), GTK_WINDOW(window));
@@ -1223,70 +1338,101 @@ void AppCore::LookupDataWithDictMask(const gchar *sWord, std::vector<InstantDict
 	GtkWidget *vbox = gtk_vbox_new(false, 6);
 #endif
 	gtk_container_add(GTK_CONTAINER(search_window),vbox);
-	Dialog.progress_bar = gtk_progress_bar_new();
-	gtk_box_pack_start(GTK_BOX(vbox),Dialog.progress_bar,false,false,0);
+	fulltext_search_progress_bar = gtk_progress_bar_new();
+	gtk_box_pack_start(GTK_BOX(vbox),fulltext_search_progress_bar,false,false,0);
 	GtkWidget *button = gtk_button_new_from_stock(GTK_STOCK_CANCEL);
 	gtk_box_pack_start(GTK_BOX(vbox),button,false,false,0);
-	g_signal_connect(G_OBJECT(button),"clicked", G_CALLBACK(on_fulltext_search_cancel_clicked), &cancel);
-	g_signal_connect (G_OBJECT (search_window), "delete_event", G_CALLBACK (on_fulltext_search_window_delete_event), &cancel);
+	g_signal_connect(G_OBJECT(button),"clicked", G_CALLBACK(on_fulltext_search_cancel_clicked), this);
+	g_signal_connect (G_OBJECT (search_window), "delete_event", G_CALLBACK (on_fulltext_search_window_delete_event), this);
 	gtk_widget_show_all(search_window);
+	fulltext_search_window = search_window;
 
-	//clock_t t=clock();
-	std::vector< std::vector<gchar *> > reslist(dictmask.size());
-	if (oLibs.LookupData(sWord, &reslist[0], updateSearchDialog, &Dialog, &cancel, dictmask)) {
-		for (size_t i=0; i<dictmask.size(); i++) {
-			if (!reslist[i].empty()) {
-				SimpleLookupToTextWin(reslist[i][0], iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
-				break;
+	StartAsyncLookup(AsyncLookupType_DATA, sWord, 0, dictmask);
+	fulltext_search_progress_timeout_id = g_timeout_add(100, on_fulltext_search_progress_timeout, this);
+}
+
+void AppCore::CancelAsyncLookup()
+{
+	if (!async_lookup.is_running())
+		return;
+	async_lookup.cancel();
+	gdk_window_set_cursor(gtk_widget_get_window(window), get_impl(oAppSkin.normal_cursor));
+}
+
+void AppCore::StartAsyncLookup(AsyncLookupType type, const gchar *sWord, gint max_results, const std::vector<InstantDictIndex> &dictmask)
+{
+	gdk_window_set_cursor(gtk_widget_get_window(window), get_impl(oAppSkin.watch_cursor));
+	async_lookup.start(type, sWord, max_results, dictmask, on_async_lookup_end, this);
+}
+
+/* Show results of a lookup started with StartAsyncLookup.
+ * Net responses may have been merged into the list already. */
+void AppCore::on_async_lookup_end(AsyncLookupResult *result, gpointer data)
+{
+	AppCore *app = static_cast<AppCore *>(data);
+	gdk_window_set_cursor(gtk_widget_get_window(app->window), get_impl(app->oAppSkin.normal_cursor));
+	const gchar *sWord = result->word.c_str();
+	std::list<char *> wordlist(result->words.begin(), result->words.end());
+	switch (result->type) {
+	case AsyncLookupType_FUZZY:
+		if (result->found) {
+			app->SimpleLookupToTextWin(result->words[0], app->iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
+			app->oMidWin.oIndexWin.oListWin.MergeFuzzyList(&wordlist);
+			app->oMidWin.oIndexWin.oListWin.ReScroll();
+		} else {
+			app->ShowNotFoundToTextWin(sWord,_("There are too many spelling errors :-("), TEXT_WIN_FUZZY_NOT_FOUND);
+		}
+		break;
+	case AsyncLookupType_RULE:
+	case AsyncLookupType_REGEX:
+		if (result->found) {
+			app->oMidWin.oIndexWin.oListWin.MergeWordList(&wordlist);
+			// show the first word.
+			app->SimpleLookupToTextWin(result->words[0], app->iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
+			app->oMidWin.oIndexWin.oListWin.ReScroll();
+		} else if (result->type == AsyncLookupType_RULE) {
+			app->ShowNotFoundToTextWin(sWord,_("Found no words matching this pattern!"), TEXT_WIN_PATTERN_NOT_FOUND);
+		} else {
+			app->ShowNotFoundToTextWin(sWord,_("Found no words matching this regular expression!"), TEXT_WIN_PATTERN_NOT_FOUND);
+		}
+		break;
+	case AsyncLookupType_DATA:
+		app->CloseFullTextSearchWindow();
+		if (result->found) {
+			for (size_t i=0; i<result->dictmask.size(); i++) {
+				if (!result->data_reslist[i].empty()) {
+					app->SimpleLookupToTextWin(result->data_reslist[i][0], app->iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
+					break;
+				}
 			}
+			// SetTreeModel frees the words
+			app->oMidWin.oIndexWin.oListWin.SetTreeModel(&result->data_reslist[0], result->dictmask);
+			result->data_reslist.clear();
+			app->oMidWin.oIndexWin.oListWin.ReScroll();
+		} else {
+			app->ShowNotFoundToTextWin(sWord, _("There are no dictionary articles containing this word. :-("), TEXT_WIN_FUZZY_NOT_FOUND);
 		}
-		oMidWin.oIndexWin.oListWin.SetTreeModel(&reslist[0], dictmask);
-		oMidWin.oIndexWin.oListWin.ReScroll();
-	} else {
-		ShowNotFoundToTextWin(sWord, _("There are no dictionary articles containing this word. :-("), TEXT_WIN_FUZZY_NOT_FOUND);
+		break;
 	}
-	//t=clock()-t;
-	//g_message("Time: %.3lf sec\n", double(t)/CLOCKS_PER_SEC);
-	gtk_widget_destroy(search_window);
 }
 
 void AppCore::LookupWithFuzzyToMainWin(const gchar *sWord)
 {
 	if (sWord[0] == '\0')
 		return;
-	change_cursor busy(gtk_widget_get_window(window),
-			   get_impl(oAppSkin.watch_cursor),
-			   get_impl(oAppSkin.normal_cursor));
-
-	gchar *fuzzy_reslist[MAX_FUZZY_MATCH_ITEM];
-	bool Found=
-		oLibs.LookupWithFuzzy(sWord, fuzzy_reslist, MAX_FUZZY_MATCH_ITEM, query_dictmask);
-
-	// show
 	oMidWin.oIndexWin.oListWin.Clear();
 	oMidWin.oIndexWin.oListWin.SetModel(true);
 	oMidWin.oIndexWin.oListWin.fuzzyWord = sWord;
 	oMidWin.oIndexWin.oListWin.list_word_type = LIST_WIN_FUZZY_LIST;
-
-	if (Found) {
-		//SimpleLookupToTextWin(oFuzzystruct[0].pMatchWord,NULL);
-		SimpleLookupToTextWin(fuzzy_reslist[0], iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
-
-		for (int i=0; i<MAX_FUZZY_MATCH_ITEM && fuzzy_reslist[i]; i++) {
-			oMidWin.oIndexWin.oListWin.InsertLast(fuzzy_reslist[i]);
-			g_free(fuzzy_reslist[i]);
-			//g_print("fuzzy %s,%d\n",oFuzzystruct[i].pMatchWord,oFuzzystruct[i].iMatchWordDistance);
-		}
-		oMidWin.oIndexWin.oListWin.ReScroll();
-	} else {
-		ShowNotFoundToTextWin(sWord,_("There are too many spelling errors :-("), TEXT_WIN_FUZZY_NOT_FOUND);
-	}
+	// The result is shown in on_async_lookup_end.
+	StartAsyncLookup(AsyncLookupType_FUZZY, sWord, MAX_FUZZY_MATCH_ITEM, query_dictmask);
 }
 
 void AppCore::LookupWithFuzzyToFloatWin(const gchar *sWord)
 {
 	if (sWord[0] == '\0')
 		return;
+	AsyncLookupPause pause(async_lookup);
 
 	oFloatWin.StartLookup(sWord);
 	composite_lookup_float_win.new_lookup();
@@ -1315,8 +1461,7 @@ void AppCore::LookupWithFuzzyToFloatWin(const gchar *sWord)
 			ppOriginWord[i] = fuzzy_reslist[i];
 			for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
 				BuildResultData(scan_dictmask, fuzzy_reslist[i], iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 2);
-			for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
-				BuildVirtualDictData(scan_dictmask, fuzzy_reslist[i], iLib, pppWord, ppppWordData, bFound);
+			BuildVirtualDictData(scan_dictmask, fuzzy_reslist[i], pppWord, ppppWordData, bFound);
 			if (bFound) {// it is certainly be true.
 				ppppWord[i]=pppWord;
 				pppppWordData[i]=ppppWordData;
@@ -1338,6 +1483,7 @@ void AppCore::LookupWithFuzzyToFloatWin(const gchar *sWord)
 		for (i=0;i<count;i++)
 			g_free(fuzzy_reslist[i]);
 	}
+	LookupVirtualDict(sWord, false);
 	composite_lookup_float_win.done_lookup();
 	if(composite_lookup_float_win.is_got_all_responses())
 		oFloatWin.EndLookup();
@@ -1345,56 +1491,20 @@ void AppCore::LookupWithFuzzyToFloatWin(const gchar *sWord)
 
 void AppCore::LookupWithRuleToMainWin(const gchar *word)
 {
-	change_cursor busy(gtk_widget_get_window(window),
-			   get_impl(oAppSkin.watch_cursor),
-			   get_impl(oAppSkin.normal_cursor));
-
-	gchar **ppMatchWord = (gchar **)g_malloc(sizeof(gchar *) * (MAX_MATCH_ITEM_PER_LIB*2) * query_dictmask.size()); //Need to be MAX_MATCH_ITEM_PER_LIB*2 as oLibs.LookupWithRule will call LookupWithRule() and LookupWithRuleSynonym().
-	gint iMatchCount=oLibs.LookupWithRule(word, ppMatchWord, query_dictmask);
 	oMidWin.oIndexWin.oListWin.Clear();
 	oMidWin.oIndexWin.oListWin.SetModel(true);
 	oMidWin.oIndexWin.oListWin.list_word_type = LIST_WIN_PATTERN_LIST;
-
-	if (iMatchCount) {
-		for (gint i=0; i<iMatchCount; i++)
-			oMidWin.oIndexWin.oListWin.InsertLast(ppMatchWord[i]);
-		//memset(iCurrentIndex,'\0',sizeof(iCurrentIndex));    // iCurrentIndex is ineffective now.
-
-		// show the first word.
-		//SimpleLookupToTextWin(ppMatchWord[0],NULL);
-		SimpleLookupToTextWin(ppMatchWord[0], iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
-		oMidWin.oIndexWin.oListWin.ReScroll();
-		for(gint i=0; i<iMatchCount; i++)
-			g_free(ppMatchWord[i]);
-	} else {
-		ShowNotFoundToTextWin(word,_("Found no words matching this pattern!"), TEXT_WIN_PATTERN_NOT_FOUND);
-	}
-	g_free(ppMatchWord);
+	// The result is shown in on_async_lookup_end.
+	StartAsyncLookup(AsyncLookupType_RULE, word, 0, query_dictmask);
 }
 
 void AppCore::LookupWithRegexToMainWin(const gchar *word)
 {
-	change_cursor busy(gtk_widget_get_window(window),
-			   get_impl(oAppSkin.watch_cursor),
-			   get_impl(oAppSkin.normal_cursor));
-
-	gchar **ppMatchWord = (gchar **)g_malloc(sizeof(gchar *) * (MAX_MATCH_ITEM_PER_LIB*2) * query_dictmask.size()); //Need to be MAX_MATCH_ITEM_PER_LIB*2 as oLibs.LookupWithRegex will call LookupWithRegex() and LookupWithRegexSynonym().
-	gint iMatchCount=oLibs.LookupWithRegex(word, ppMatchWord, query_dictmask);
 	oMidWin.oIndexWin.oListWin.Clear();
 	oMidWin.oIndexWin.oListWin.SetModel(true);
 	oMidWin.oIndexWin.oListWin.list_word_type = LIST_WIN_PATTERN_LIST;
-
-	if (iMatchCount) {
-		for (gint i=0; i<iMatchCount; i++)
-			oMidWin.oIndexWin.oListWin.InsertLast(ppMatchWord[i]);
-		SimpleLookupToTextWin(ppMatchWord[0], iCurrentIndex, NULL); // so iCurrentIndex is refreshed.
-		oMidWin.oIndexWin.oListWin.ReScroll();
-		for(gint i=0; i<iMatchCount; i++)
-			g_free(ppMatchWord[i]);
-	} else {
-		ShowNotFoundToTextWin(word,_("Found no words matching this regular expression!"), TEXT_WIN_PATTERN_NOT_FOUND);
-	}
-	g_free(ppMatchWord);
+	// The result is shown in on_async_lookup_end.
+	StartAsyncLookup(AsyncLookupType_REGEX, word, 0, query_dictmask);
 }
 
 void AppCore::LookupNetDict(const char *sWord, bool ismainwin)
@@ -1420,6 +1530,33 @@ void AppCore::LookupNetDict(const char *sWord, bool ismainwin)
 	}
 }
 
+/* The results are shown like those of net dictionaries, after the local ones.
+ * The main window is looked up by SimpleLookupToTextWin, which starts a new
+ * sequence of its results. */
+void AppCore::LookupVirtualDict(const char *sWord, bool ismainwin)
+{
+	std::vector<InstantDictIndex> *dictmask;
+	guint seq = 0;
+	if (ismainwin) {
+		dictmask = &query_dictmask;
+		seq = virtual_dict_mainwin_seq;
+	} else {
+		dictmask = &scan_dictmask;
+	}
+	bool has_virtual = false;
+	for (size_t iLib=0; iLib<dictmask->size(); iLib++) {
+		if ((*dictmask)[iLib].type == InstantDictType_VIRTUAL) {
+			has_virtual = true;
+			if (!ismainwin)
+				composite_lookup_float_win.send_net_dict_request(
+					oStarDictPlugins->VirtualDictPlugins.dict_id((*dictmask)[iLib].index), sWord);
+		}
+	}
+	if (has_virtual)
+		oStarDictPlugins->VirtualDictPlugins.lookup_async(*dictmask, sWord,
+			on_virtual_dict_lookup_end, GUINT_TO_POINTER(seq));
+}
+
 void AppCore::ShowDataToTextWin(gchar ***pppWord, gchar ****ppppWordData,
 				const gchar *sOriginWord, bool isShowFirst)
 {
@@ -1519,6 +1656,7 @@ void AppCore::TopWinEnterWord()
 		LookupDataToMainWin(res.c_str());
 		return;
 	default:
+		CancelAsyncLookup();
 		if (!conf->get_bool_at("main_window/search_while_typing")) {
 			if (oMidWin.oTextWin.queryWord != res) {
 				bool showfirst = conf->get_bool_at("main_window/showfirst_when_notfound");
@@ -1638,9 +1776,16 @@ void AppCore::TopWinWordChange(const gchar* sWord)
 		break;
 	default:
 		stop_word_change_timer();
+		stop_word_prefetch();
+		CancelAsyncLookup();
 		delayed_word_ = res;
 		int word_change_timeout = conf->get_int_at("main_window/word_change_timeout");
 		if(word_change_timeout > 0) {
+			/* While the user is still typing, warm up index pages and article
+			 * data of the most likely candidates, so the lookup done after
+			 * the timeout is served from the caches. */
+			word_prefetch_lib_ = 0;
+			word_prefetch_id = g_idle_add_full(G_PRIORITY_LOW, on_word_prefetch_idle, this, NULL);
 			word_change_timeout_id = g_timeout_add(word_change_timeout, on_word_change_timeout, this);
 		} else {
 			//Allow word_change_timeout to be 0, so do an immediate search.
@@ -1652,6 +1797,7 @@ void AppCore::TopWinWordChange(const gchar* sWord)
 gboolean AppCore::on_word_change_timeout(gpointer data)
 {
 	AppCore *app = static_cast<AppCore *>(data);
+	app->stop_word_prefetch();
 	bool showfirst = conf->get_bool_at("main_window/showfirst_when_notfound");
 	bool find = app->SimpleLookupToTextWin(app->delayed_word_.c_str(),
 					       app->iCurrentIndex, NULL, true,
@@ -1682,8 +1828,54 @@ gboolean AppCore::on_word_change_timeout(gpointer data)
 	return FALSE;
 }
 
+/* Prefetch one dictionary per idle call, so a key press never waits for
+ * more than one dictionary and stale work is dropped as soon as the input
+ * changes. */
+gboolean AppCore::on_word_prefetch_idle(gpointer data)
+{
+	AppCore *app = static_cast<AppCore *>(data);
+	while (app->word_prefetch_lib_ < app->query_dictmask.size()) {
+		size_t iLib = app->word_prefetch_lib_++;
+		if (app->query_dictmask[iLib].type != InstantDictType_LOCAL)
+			continue;
+		app->PrefetchWordData(app->delayed_word_.c_str(), app->query_dictmask[iLib].index);
+		return TRUE;
+	}
+	app->word_prefetch_id = 0;
+	return FALSE;
+}
+
+void AppCore::stop_word_prefetch()
+{
+	if (word_prefetch_id) {
+		g_source_remove(word_prefetch_id);
+		word_prefetch_id = 0;
+	}
+}
+
+/* Look up sWord in the dictionary iRealLib and read the articles of the first
+ * few words starting with sWord. The index page stays loaded and the articles
+ * land in the DictBase data cache. */
+void AppCore::PrefetchWordData(const gchar *sWord, size_t iRealLib)
+{
+	if (!sWord || !*sWord || async_lookup.is_running())
+		return;
+	glong idx, idx_suggest;
+	oLibs.LookupWord(sWord, idx, idx_suggest, iRealLib, 0);
+	if (idx == INVALID_INDEX)
+		return;
+	const size_t len = strlen(sWord);
+	const glong nwords = oLibs.narticles(iRealLib);
+	for (int i = 0; i < WORD_PREFETCH_CANDIDATES && idx < nwords; ++i, ++idx) {
+		if (strncmp(oLibs.poGetWord(idx, iRealLib, 0), sWord, len) != 0)
+			break;
+		oLibs.poGetOrigWordData(oLibs.CltIndexToOrig(idx, iRealLib, 0), iRealLib);
+	}
+}
+
 void AppCore::ListWords(CurrentIndex* iIndex)
 {
+	CancelAsyncLookup();
 	CurrentIndex *iCurrent = (CurrentIndex*)g_memdup(iIndex, sizeof(CurrentIndex)*query_dictmask.size());
 
 	oMidWin.oIndexWin.oListWin.Clear();
@@ -1708,6 +1900,7 @@ void AppCore::ListWords(CurrentIndex* iIndex)
 
 void AppCore::ListPreWords(const char*sWord)
 {
+	CancelAsyncLookup();
 	oMidWin.oIndexWin.oListWin.Clear();
 	CurrentIndex *iPreIndex = (CurrentIndex *)g_malloc(sizeof(CurrentIndex) * query_dictmask.size());
 	const gchar *preword = oLibs.poGetPreWord(sWord, iPreIndex, query_dictmask, 0);
@@ -1725,6 +1918,7 @@ void AppCore::ListPreWords(const char*sWord)
 
 void AppCore::ListNextWords(const char*sWord)
 {
+	CancelAsyncLookup();
 	oMidWin.oIndexWin.oListWin.Clear();
 	CurrentIndex *iNextIndex = (CurrentIndex *)g_malloc(sizeof(CurrentIndex) * query_dictmask.size());
 	const gchar *nextword = oLibs.poGetNextWord(sWord, iNextIndex, query_dictmask, 0);
@@ -1932,6 +2126,7 @@ void AppCore::PopupPrefsDlg()
 		if (enbcol == conf->get_bool_at("dictionary/enable_collation") &&
 		    colf == conf->get_int_at("dictionary/collate_function"))
 			return;
+		CancelAsyncLookup();
 		progress_win pw(GTK_WINDOW(gpAppFrame->window));
 		reload_show_progress_t rsp(pw);
 		show_progress_t *old_progress = oLibs.get_show_progress();
@@ -1943,6 +2138,7 @@ void AppCore::PopupPrefsDlg()
 
 void AppCore::reload_dicts()
 {
+	CancelAsyncLookup();
 	std::list<DictItemId> load_list;
 	GetUsedDictList(load_list);
 	std::list<std::string> s_load_list;
@@ -1950,6 +2146,14 @@ void AppCore::reload_dicts()
 	oLibs.reload(s_load_list,
 		conf->get_bool_at("dictionary/enable_collation") ? CollationLevel_SINGLE : CollationLevel_NONE,
 		int_to_colate_func(conf->get_int_at("dictionary/collate_function")));
+	on_dicts_reloaded();
+}
+
+/* Dictionary indexes changed, refresh everything that refers to them. */
+void AppCore::on_dicts_reloaded()
+{
+	stop_word_prefetch();
+	oMidWin.oTextWin.CancelPending();
 	UpdateDictMask();
 
 	const gchar *sWord = oTopWin.get_text();
@@ -1958,6 +2162,39 @@ void AppCore::reload_dicts()
 		TopWinWordChange(sWord);
 }
 
+/* Dictionaries updated on disk are loaded in the background, lookups are
+ * served from the old versions meanwhile. */
+gboolean AppCore::on_dict_change_check_timeout(gpointer data)
+{
+	AppCore *app = static_cast<AppCore *>(data);
+	if (app->oLibs.is_reloading() || !app->oLibs.has_changed_dicts())
+		return TRUE;
+	std::list<DictItemId> load_list;
+	GetUsedDictList(load_list);
+	std::list<std::string> s_load_list;
+	DictItemId::convert(s_load_list, load_list);
+	app->oLibs.start_reload(s_load_list, app->oLibs.get_CollationLevel(),
+		app->oLibs.get_CollateFunction(), on_background_reload_end, app);
+	return TRUE;
+}
+
+gboolean AppCore::on_query_stats_timeout(gpointer data)
+{
+	AppCore *app = static_cast<AppCore *>(data);
+	QueryStatsSnapshot snapshot;
+	app->oLibs.get_query_stats(snapshot);
+	g_message("%s", snapshot.to_string().c_str());
+	return TRUE;
+}
+
+void AppCore::on_background_reload_end(gpointer data)
+{
+	AppCore *app = static_cast<AppCore *>(data);
+	app->CancelAsyncLookup();
+	app->oLibs.finish_reload();
+	app->on_dicts_reloaded();
+}
+
 void AppCore::PopupDictManageDlg()
 {
 
@@ -1967,6 +2204,7 @@ void AppCore::PopupDictManageDlg()
 	if (dict_manage_dlg->Show(dictmanage_config_changed))
 		return;
 	if (dictmanage_config_changed) {
+		CancelAsyncLookup();
 		progress_win pw(GTK_WINDOW(gpAppFrame->window));
 		reload_show_progress_t rsp(pw);
 		show_progress_t *old_progress = oLibs.get_show_progress();
@@ -2024,6 +2262,19 @@ void AppCore::stop_word_change_timer()
 void AppCore::End()
 {
 	stop_word_change_timer();
+	stop_word_prefetch();
+	CancelAsyncLookup();
+	oMidWin.oTextWin.CancelPending();
+	if (dict_change_check_timeout_id) {
+		g_source_remove(dict_change_check_timeout_id);
+		dict_change_check_timeout_id = 0;
+	}
+	if (query_stats_timeout_id) {
+		g_source_remove(query_stats_timeout_id);
+		query_stats_timeout_id = 0;
+	}
+	oLibs.cancel_reload();
+	CloseFullTextSearchWindow();
 	oSelection.End();
 #ifdef _WIN32
 	oClipboard.End();
@@ -2056,6 +2307,8 @@ void AppCore::Init(const gchar *queryword)
 			 sigc::mem_fun(this, &AppCore::on_dict_scan_select_changed));
 	conf->notify_add("/apps/stardict/preferences/dictionary/scan_modifier_key",
 			 sigc::mem_fun(this, &AppCore::on_scan_modifier_key_changed));
+	conf->notify_add("/apps/stardict/preferences/dictionary/only_scan_while_modifier_key",
+			 sigc::mem_fun(this, &AppCore::on_only_scan_while_modifier_key_changed));
 
 	g_debug(_("Loading skin..."));
 #ifdef _WIN32
@@ -2157,6 +2410,11 @@ void AppCore::on_scan_modifier_key_changed(const baseconfval* keyval)
 	unlock_keys->set_comb(combnum2str(key));
 }
 
+void AppCore::on_only_scan_while_modifier_key_changed(const baseconfval*)
+{
+	oSelection.restart();
+}
+
 gchar* GetPureEnglishAlpha(gchar *str)
 {
 	while (*str && (!((*str >= 'a' && *str <='z')||(*str >= 'A' && *str <='Z'))))
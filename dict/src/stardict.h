@@ -56,6 +56,7 @@ class AppCore;
 #include "lib/compositelookup.h"
 #include "lib/full_text_trans.h"
 #include "lib/stddict.h"
+#include "lib/asynclookup.h"
 #include "lib/treedict.h"
 
 extern AppCore *gpAppFrame;
@@ -66,6 +67,8 @@ const int MAX_FUZZY_MATCH_ITEM=100;
 const int MAX_FLOAT_WINDOW_FUZZY_MATCH_ITEM=5;
 
 const int LIST_WIN_ROW_NUM = 30; //how many words show in the list win.
+const int WORD_PREFETCH_CANDIDATES = 3; //how many articles per dict to prefetch while typing.
+const guint DICT_CHANGE_CHECK_INTERVAL = 60; //seconds between checks whether dictionary files changed.
 
 class DictManageDlg;
 class PluginManageDlg;
@@ -78,7 +81,19 @@ private:
 	PrefsDlg *prefs_dlg;
 	guint word_change_timeout_id;
 	std::string delayed_word_;
+	guint word_prefetch_id;
+	size_t word_prefetch_lib_;
+	guint dict_change_check_timeout_id;
+	guint query_stats_timeout_id;
+	GtkWidget *fulltext_search_window;
+	GtkWidget *fulltext_search_progress_bar;
+	guint fulltext_search_progress_timeout_id;
 	CompositeLookup composite_lookup_float_win;
+	/* results of older virtual dictionary lookups to the main window are dropped */
+	guint virtual_dict_mainwin_seq;
+	/* The word asked in the main window. Its virtual dictionary results
+	 * replace the suggestion shown when it was not found. */
+	std::string virtual_dict_mainwin_word;
 
 	static int MatchWordCompare(const void * s1, const void * s2);
 	static void on_mainwin_show_event(GtkWidget * window, AppCore *app);
@@ -86,11 +101,26 @@ private:
 	static gboolean on_window_state_event(GtkWidget * window, GdkEventWindowState *event , AppCore *oAppCore);
 	static gboolean vKeyPressReleaseCallback(GtkWidget * window, GdkEventKey *event , AppCore *oAppCore);
 	void reload_dicts();
+	void on_dicts_reloaded();
+	static gboolean on_dict_change_check_timeout(gpointer data);
+	static gboolean on_query_stats_timeout(gpointer data);
+	static void on_background_reload_end(gpointer data);
 	void on_main_win_hide_list_changed(const baseconfval*);
 	void on_dict_scan_select_changed(const baseconfval*);
 	void on_scan_modifier_key_changed(const baseconfval*);
+	void on_only_scan_while_modifier_key_changed(const baseconfval*);
 	static gboolean on_word_change_timeout(gpointer data);
 	void stop_word_change_timer();
+	static gboolean on_word_prefetch_idle(gpointer data);
+	void stop_word_prefetch();
+	void PrefetchWordData(const gchar *sWord, size_t iRealLib);
+	void StartAsyncLookup(AsyncLookupType type, const gchar *sWord, gint max_results, const std::vector<InstantDictIndex> &dictmask);
+	void CancelAsyncLookup();
+	static void on_async_lookup_end(AsyncLookupResult *result, gpointer data);
+	static void on_fulltext_search_cancel_clicked(GtkButton *button, AppCore *app);
+	static gboolean on_fulltext_search_window_delete_event(GtkWidget * window, GdkEvent *event , AppCore *app);
+	static gboolean on_fulltext_search_progress_timeout(gpointer data);
+	void CloseFullTextSearchWindow();
 	void on_change_scan(bool val);
 	void on_maximize();
 	void on_docklet_middle_button_click();
@@ -119,6 +149,7 @@ public:
 	std::auto_ptr<TrayBase> oDockLet;
 
 	Libs oLibs;
+	AsyncLookup async_lookup;
 	TreeDicts oTreeDicts;
 	StarDictClient oStarDictClient;
 	StarDictPlugins *oStarDictPlugins;
@@ -144,7 +175,7 @@ public:
 	void End();
 	void Query(const gchar *word);
 	void BuildResultData(std::vector<InstantDictIndex> &dictmask, const char* sWord, CurrentIndex *iIndex, const gchar *piIndexValidStr, int iLib, gchar ***pppWord, gchar ****ppppWordData, bool &bFound, gint Method);
-	void BuildVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord, int iLib, gchar ***pppWord, gchar ****ppppWordData, bool &bFound);
+	void BuildVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord, gchar ***pppWord, gchar ****ppppWordData, bool &bFound);
 	static void FreeResultData(size_t dictmask_size, gchar ***pppWord, gchar ****ppppWordData);
 	void SimpleLookupToFloat(const char* sToken, bool IgnoreScanModifierKey = false);
 #ifdef _WIN32
@@ -158,6 +189,7 @@ public:
 	void LookupWithRuleToMainWin(const gchar* word);
 	void LookupWithRegexToMainWin(const gchar* word);
 	void LookupNetDict(const char *word, bool ismainwin);
+	void LookupVirtualDict(const char *word, bool ismainwin);
 	void ShowDataToTextWin(gchar ***pppWord, gchar ****ppppWordData,const gchar * sOriginWord, bool isShowFirst);
 	void ShowTreeDictDataToTextWin(guint32 offset, guint32 size, gint iTreeDict);
 	void ShowNotFoundToTextWin(const char* sWord,const char* sReason, TextWinQueryResult query_result);
@@ -191,6 +223,8 @@ public:
 	static void do_send_http_request(const char* shost, const char* sfile, get_http_response_func_t callback_func, gpointer userdata);
 	static void set_news(const char *news, const char *links);
 	static void show_netdict_resp(const char *dict, NetDictResponse *resp, bool ismainwin);
+	static void on_virtual_dict_lookup_end(size_t iPlugin, const char *word,
+		char **ppWord, char ***pppWordData, gpointer user_data);
 	static void lookup_dict(size_t dictid, const char *sWord, char ****Word, char *****WordData);
 	static void ShowPangoTips(const char *word, const char *text);
 };
@@ -27,7 +27,10 @@
 #include <cstring>
 #include <cstdlib>
 #include <stdlib.h>
+#include <list>
+#include <map>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -69,72 +72,149 @@ static char *build_dictdata(char type, const char *definition)
 #define REDIRECT_MODE_1 0x01
 #define REDIRECT_MODE_2 0x02
 
-static unsigned long getValue(FILE *fp, unsigned long start, int length)
+/* QQWry.Dat is mapped in memory, its index is decoded once into
+ * qqwry_starts and qqwry_offsets: the first IP of each range and the
+ * offset of the range record, sorted by IP. */
+static GMappedFile *qqwry_file = NULL;
+static const guchar *qqwry_data = NULL;
+static gsize qqwry_size = 0;
+static std::vector<guint32> qqwry_starts;
+static std::vector<guint32> qqwry_offsets;
+/* The file may be updated while StarDict runs, check it at most once
+ * in QQWRY_CHECK_INTERVAL. */
+static const gint64 QQWRY_CHECK_INTERVAL = G_TIME_SPAN_SECOND;
+static gint64 qqwry_check_time = 0;
+static gint64 qqwry_mtime = 0;
+static goffset qqwry_file_size = 0;
+
+/* Addresses of recently found ranges, by record offset. */
+static const size_t QQWRY_CACHE_SIZE = 256;
+typedef std::list<std::pair<guint32, std::string> > AddressList;
+/* most recently used ranges first */
+static AddressList address_list;
+static std::map<guint32, AddressList::iterator> address_map;
+
+static GRegex *ip_regex = NULL;
+/* QQWry.Dat strings are in GB18030 */
+static GIConv gb18030_conv = (GIConv)-1;
+
+static guint32 getValue(gsize start, int length)
 {
-	unsigned long variable=0;
-	long *val = (long *)malloc(sizeof(long) *length);
-	long i;
-	fseek(fp,start,SEEK_SET);
-	for(i=0;i<length;i++) {
-		val[i]=fgetc(fp)&0x000000FF;
-	}
-	for(i=length-1;i>=0;i--) {
-		variable=variable*0x100+val[i];
+	guint32 variable=0;
+	if (start + length > qqwry_size)
+		return 0;
+	for(int i=length-1;i>=0;i--) {
+		variable=variable*0x100+qqwry_data[start+i];
 	}
-	free(val);
 	return variable;
 }
 
-static int getString(FILE *fp, unsigned long start, std::string &string)
+static guchar getByte(gsize start)
 {
-	unsigned long i=0;
-	char val;
-	fseek(fp,start,SEEK_SET);
-	do {
-		val=fgetc(fp);
-		string += val;
-		i++;
-	} while(val!=0x00);
-	return i;
+	return start < qqwry_size ? qqwry_data[start] : 0;
 }
 
-static void getAddress(FILE *fp, unsigned long start, std::string &country, std::string &location)
+/* Return the length of the string including the terminating null. */
+static gsize getString(gsize start, std::string &string)
 {
-	unsigned long redirect_address,counrty_address,location_address;
-	char val;
+	if (start >= qqwry_size)
+		return 1;
+	const guchar *p = qqwry_data + start;
+	const guchar *e = static_cast<const guchar *>(memchr(p, 0, qqwry_size - start));
+	if (!e)
+		e = qqwry_data + qqwry_size;
+	string.assign(reinterpret_cast<const char *>(p), e - p);
+	return e - p + 1;
+}
+
+static void getAddress(gsize start, std::string &country, std::string &location)
+{
+	gsize redirect_address,counrty_address,location_address;
+	guchar val;
 	start+=4;
-	fseek(fp,start,SEEK_SET);
-	val=(fgetc(fp)&0x000000FF);
+	val=getByte(start);
 	if(val==REDIRECT_MODE_1) {
-		redirect_address=getValue(fp,start+1,3);
-		fseek(fp,redirect_address,SEEK_SET);
-		if((fgetc(fp)&0x000000FF)==REDIRECT_MODE_2) {
-			counrty_address=getValue(fp,redirect_address+1,3);
+		redirect_address=getValue(start+1,3);
+		if(getByte(redirect_address)==REDIRECT_MODE_2) {
+			counrty_address=getValue(redirect_address+1,3);
 			location_address=redirect_address+4;
-			getString(fp,counrty_address,country);
+			getString(counrty_address,country);
 		} else {
 			counrty_address=redirect_address;
-			location_address=redirect_address+getString(fp,counrty_address,country);
+			location_address=redirect_address+getString(counrty_address,country);
 		}
 	} else if (val==REDIRECT_MODE_2) {
-		counrty_address=getValue(fp,start+1,3);
+		counrty_address=getValue(start+1,3);
 		location_address=start+4;
-		getString(fp,counrty_address,country);
+		getString(counrty_address,country);
 	} else {
 		counrty_address=start;
-		location_address=counrty_address+getString(fp,counrty_address,country);
+		location_address=counrty_address+getString(counrty_address,country);
+	}
+	val=getByte(location_address);
+	if(val==REDIRECT_MODE_2||val==REDIRECT_MODE_1) {
+		location_address=getValue(location_address+1,3);
+	}
+	getString(location_address,location);
+}
+
+static void unload_qqwry()
+{
+	if (qqwry_file) {
+		g_mapped_file_unref(qqwry_file);
+		qqwry_file = NULL;
 	}
-	fseek(fp,location_address,SEEK_SET);
-	if((fgetc(fp)&0x000000FF)==REDIRECT_MODE_2||(fgetc(fp)&0x000000FF)==REDIRECT_MODE_1) {
-		location_address=getValue(fp,location_address+1,3);
+	qqwry_data = NULL;
+	qqwry_size = 0;
+	qqwry_starts.clear();
+	qqwry_offsets.clear();
+	address_list.clear();
+	address_map.clear();
+}
+
+static bool load_qqwry(const std::string &filename)
+{
+	unload_qqwry();
+	qqwry_file = g_mapped_file_new(filename.c_str(), FALSE, NULL);
+	if (!qqwry_file)
+		return false;
+	qqwry_data = reinterpret_cast<const guchar *>(g_mapped_file_get_contents(qqwry_file));
+	qqwry_size = g_mapped_file_get_length(qqwry_file);
+	/* the header holds the offsets of the first and the last index records */
+	guint32 index_start = getValue(0, 4);
+	guint32 index_end = getValue(4, 4);
+	if (qqwry_size < 8 || index_end < index_start || index_end + 7 > qqwry_size
+		|| (index_end - index_start) % 7 != 0) {
+		unload_qqwry();
+		return false;
 	}
-	getString(fp,location_address,location);
+	const size_t n = (index_end - index_start) / 7 + 1;
+	qqwry_starts.resize(n);
+	qqwry_offsets.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		qqwry_starts[i] = getValue(index_start + 7*i, 4);
+		qqwry_offsets[i] = getValue(index_start + 7*i + 4, 3);
+	}
+	return true;
 }
 
-static void getHead(FILE *fp,unsigned long *start,unsigned long *end)
+/* Map the file if it is not mapped yet or it has changed. */
+static bool open_qqwry(const std::string &filename)
 {
-	*start=getValue(fp,0L,4);
-	*end=getValue(fp,4L,4);
+	const gint64 now = g_get_monotonic_time();
+	if (qqwry_file && now - qqwry_check_time < QQWRY_CHECK_INTERVAL)
+		return true;
+	qqwry_check_time = now;
+	GStatBuf st;
+	if (g_stat(filename.c_str(), &st) != 0) {
+		unload_qqwry();
+		return false;
+	}
+	if (qqwry_file && st.st_mtime == qqwry_mtime && st.st_size == qqwry_file_size)
+		return true;
+	qqwry_mtime = st.st_mtime;
+	qqwry_file_size = st.st_size;
+	return load_qqwry(filename);
 }
 
 static int beNumber(char c)
@@ -145,12 +225,12 @@ static int beNumber(char c)
 		return 1;
 }
 
-static unsigned long getIP(const char *ip_addr)
+static guint32 getIP(const char *ip_addr)
 {
-	unsigned long ip=0;
+	guint32 ip=0;
 	size_t i;
 	int j=0;
-	for(i=0;i<strlen(ip_addr);i++) {
+	for(i=0;ip_addr[i];i++) {
 		if (*(ip_addr+i)=='.') {
 			ip=ip*0x100+j;
 			j=0;
@@ -166,65 +246,71 @@ static unsigned long getIP(const char *ip_addr)
 	return ip;
 }
 
-static unsigned long searchIP(FILE *fp, unsigned long index_start, unsigned long index_end, unsigned long ip)
+/* Return the index of the last range starting at or below ip. */
+static size_t searchIP(guint32 ip)
 {
-	unsigned long index_current,index_top,index_bottom;
-	unsigned long record;
-	index_bottom=index_start;
-	index_top=index_end;
-	index_current=((index_top-index_bottom)/7/2)*7+index_bottom;
-	do {
-		record=getValue(fp,index_current,4);
-		if(record>ip) {
-			index_top=index_current;
-		} else {
-			index_bottom=index_current;
-		}
-		index_current=((index_top-index_bottom)/14)*7+index_bottom;
-	} while(index_bottom<index_current);
-	return index_current;
+	const guint32 *base = &qqwry_starts[0];
+	size_t n = qqwry_starts.size();
+	while (n > 1) {
+		const size_t half = n / 2;
+		base = (base[half] <= ip) ? base + half : base;
+		n -= half;
+	}
+	return base - &qqwry_starts[0];
+}
+
+static void get_address_by_offset(guint32 offset, std::string &address)
+{
+	std::map<guint32, AddressList::iterator>::iterator it = address_map.find(offset);
+	if (it != address_map.end()) {
+		address_list.splice(address_list.begin(), address_list, it->second);
+		address = it->second->second;
+		return;
+	}
+	std::string country,location;
+	getAddress(offset,country,location);
+	if (gb18030_conv == (GIConv)-1)
+		gb18030_conv = g_iconv_open("UTF-8", "GB18030");
+	gchar *c = g_convert_with_iconv(country.c_str(), -1, gb18030_conv, NULL, NULL, NULL);
+	if (c) {
+		address += c;
+		address += ' ';
+		g_free(c);
+	}
+	gchar *l = g_convert_with_iconv(location.c_str(), -1, gb18030_conv, NULL, NULL, NULL);
+	if (l) {
+		address += l;
+		g_free(l);
+	}
+	if (address_list.size() >= QQWRY_CACHE_SIZE) {
+		address_map.erase(address_list.back().first);
+		address_list.pop_back();
+	}
+	address_list.push_front(std::make_pair(offset, address));
+	address_map[offset] = address_list.begin();
 }
 
 static void get_address_from_ip(const char *text, std::string &ipstr, std::string &address)
 {
 	GMatchInfo *match_info;
-	GRegex *regex = g_regex_new ("(((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))\\.){3}((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))", (GRegexCompileFlags)0, (GRegexMatchFlags)0, NULL);
-	g_regex_match (regex, text, (GRegexMatchFlags)0, &match_info);
+	g_regex_match (ip_regex, text, (GRegexMatchFlags)0, &match_info);
 	if (g_match_info_matches(match_info)) {
 		gchar *word = g_match_info_fetch (match_info, 0);
 		ipstr = word;
 		g_free (word);
 	}
 	g_match_info_free (match_info);
-	g_regex_unref (regex);
 	if (ipstr.empty())
 		return;
 	std::string datafilename = build_path(plugin_info->datadir, "data" G_DIR_SEPARATOR_S "QQWry.Dat");
-	FILE *fp = g_fopen(datafilename.c_str(), "rb");
-	if (!fp) {
+	if (!open_qqwry(datafilename)) {
 		gchar *msg = g_strdup_printf(_("Error: Open file %s failed!"), datafilename.c_str());
 		address = msg;
 		g_free(msg);
 		return;
 	}
-	unsigned long index_start,index_end;
-	getHead(fp,&index_start,&index_end);
-	unsigned long ip = getIP(ipstr.c_str());
-	unsigned long current=searchIP(fp,index_start,index_end,ip);
-	std::string country,location;
-	getAddress(fp,getValue(fp,current+4,3),country,location);
-	gchar *c = g_convert(country.c_str(), -1, "UTF-8", "GB18030", NULL, NULL, NULL);
-	if (c) {
-		address += c;
-		address += ' ';
-		g_free(c);
-	}
-	gchar *l = g_convert(location.c_str(), -1, "UTF-8", "GB18030", NULL, NULL, NULL);
-	if (l) {
-		address += l;
-		g_free(l);
-	}
-	fclose(fp);
+	guint32 ip = getIP(ipstr.c_str());
+	get_address_by_offset(qqwry_offsets[searchIP(ip)], address);
 }
 
 static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
@@ -289,12 +375,22 @@ DLLIMPORT bool stardict_plugin_init(StarDictPlugInObject *obj, IAppDirs* appDirs
 
 DLLIMPORT void stardict_plugin_exit(void)
 {
+	unload_qqwry();
+	if (gb18030_conv != (GIConv)-1) {
+		g_iconv_close(gb18030_conv);
+		gb18030_conv = (GIConv)-1;
+	}
+	if (ip_regex) {
+		g_regex_unref(ip_regex);
+		ip_regex = NULL;
+	}
 }
 
 DLLIMPORT bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
 {
 	obj->lookup_func = lookup;
 	obj->dict_name = _("QQWry");
+	ip_regex = g_regex_new ("(((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))\\.){3}((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))", G_REGEX_OPTIMIZE, (GRegexMatchFlags)0, NULL);
 	g_print(_("QQWry plug-in loaded.\n"));
 	return false;
 }
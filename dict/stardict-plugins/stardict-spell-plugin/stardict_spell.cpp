@@ -22,7 +22,12 @@
 #include <glib/gi18n.h>
 #include <enchant.h>
 #include <pango/pango.h>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <list>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <string.h>
@@ -30,10 +35,35 @@
 static const StarDictPluginSystemInfo *plugin_info = NULL;
 static EnchantBroker *broker = NULL;
 static std::list<EnchantDict *> dictlist;
-static PangoLayout *layout = NULL;
 static gboolean use_custom;
 static std::string custom_langs;
 static IAppDirs* gpAppDirs = NULL;
+/* Lookups run in a separate thread. Guards the dictionaries and the caches. */
+static GMutex spell_mutex;
+
+/* Spell check results of a word against all dictionaries of dictlist. */
+struct SpellResult {
+	bool misspelled;
+	/* suggestions is filled */
+	bool suggested;
+	/* the definition of the suggestion article, empty if there are
+	 * no suggestions */
+	std::string suggestions;
+};
+/* Results of recently checked words. Scan mode checks the same words
+ * over and over. Cleared when the dictionaries change. */
+static const size_t SPELL_CACHE_SIZE = 4096;
+typedef std::list<std::pair<std::string, SpellResult> > SpellCacheList;
+/* most recently used words first */
+static SpellCacheList spell_cache_list;
+static std::map<std::string, SpellCacheList::iterator> spell_cache_map;
+
+/* How many times each misspelled word was looked up. Suggestions of the
+ * most frequent misspellings are computed in the background at startup. */
+static const size_t TOP_MISSPELLINGS = 100;
+static std::map<std::string, guint32> misspelling_counts;
+static GThread *precompute_thread = NULL;
+static gint precompute_cancel = 0;
 
 /* concatenate path1 and path2 inserting a path separator in between if needed. */
 static std::string build_path(const std::string& path1, const std::string& path2)
@@ -55,6 +85,11 @@ static std::string get_cfg_filename()
 	return build_path(gpAppDirs->get_user_config_dir(), "spell.cfg");
 }
 
+static std::string get_misspellings_filename()
+{
+	return build_path(gpAppDirs->get_user_cache_dir(), "spell_misspellings");
+}
+
 static char *build_dictdata(char type, const char *definition)
 {
 	size_t len = strlen(definition);
@@ -70,96 +105,266 @@ static char *build_dictdata(char type, const char *definition)
 	return data;
 }
 
-static void stardict_strsplit_utf8(const gchar *text, gchar ***set, gint **starts, gint **ends)
+/* Find the words of the text, len is its length in bytes.
+ * Return the byte offsets of the word beginnings and ends.
+ * Called in the lookup thread, so no PangoContext is used, its font map
+ * belongs to the GTK thread. */
+static void stardict_split_words_utf8(const gchar *text, gint len, std::vector<std::pair<gint, gint> > &words)
 {
 	PangoLogAttr  *log_attrs;
-	gint           n_attrs, n_strings, i, j;
+	gint           n_attrs, i, cend;
 
-	pango_layout_get_log_attrs(layout, &log_attrs, &n_attrs);
+	n_attrs = g_utf8_strlen(text, len) + 1;
+	log_attrs = g_new(PangoLogAttr, n_attrs);
+	pango_get_log_attrs(text, len, -1, pango_language_get_default(), log_attrs, n_attrs);
 
-	/* Find how many words we have */
-	n_strings = 0;
-	for (i = 0; i < n_attrs; i++)
-		if (log_attrs[i].is_word_start)
-			n_strings++;
-
-	*set    = g_new0(gchar *, n_strings + 1);
-	*starts = g_new0(gint, n_strings);
-	*ends   = g_new0(gint, n_strings);
-
-	/* Copy out strings */
-	for (i = 0, j = 0; i < n_attrs; i++) {
+	/* p points to the character i */
+	const gchar *p = text;
+	for (i = 0; i < n_attrs; i++) {
 		if (log_attrs[i].is_word_start) {
-			gint cend, bytes;
-			gchar *start;
-
 			/* Find the end of this string */
 			cend = i;
 			while (!(log_attrs[cend].is_word_end))
 				cend++;
+			const gchar *end = g_utf8_offset_to_pointer(p, cend - i);
+			words.push_back(std::make_pair(gint(p - text), gint(end - text)));
+		}
+		if (*p)
+			p = g_utf8_next_char(p);
+	}
+
+	g_free (log_attrs);
+}
+
+static SpellResult *spell_cache_find(const std::string &word)
+{
+	std::map<std::string, SpellCacheList::iterator>::iterator it = spell_cache_map.find(word);
+	if (it == spell_cache_map.end())
+		return NULL;
+	spell_cache_list.splice(spell_cache_list.begin(), spell_cache_list, it->second);
+	return &it->second->second;
+}
+
+static SpellResult &spell_cache_insert(const std::string &word, bool misspelled)
+{
+	if (spell_cache_list.size() >= SPELL_CACHE_SIZE) {
+		spell_cache_map.erase(spell_cache_list.back().first);
+		spell_cache_list.pop_back();
+	}
+	SpellResult res;
+	res.misspelled = misspelled;
+	res.suggested = false;
+	spell_cache_list.push_front(std::make_pair(word, res));
+	spell_cache_map[word] = spell_cache_list.begin();
+	return spell_cache_list.front().second;
+}
+
+static void spell_cache_clear()
+{
+	spell_cache_list.clear();
+	spell_cache_map.clear();
+}
 
-			/* Copy sub-string */
-			start = g_utf8_offset_to_pointer(text, i);
-			bytes = (gint) (g_utf8_offset_to_pointer(text, cend) - start);
-			(*set)[j]    = g_new0(gchar, bytes + 1);
-			(*starts)[j] = (gint) (start - text);
-			(*ends)[j]   = (gint) (start - text + bytes);
-			g_utf8_strncpy((*set)[j], start, cend - i);
+/* Check the words, set misspelled[word] for each of them.
+ * Words that are not cached are checked with one dictionary after another,
+ * a word accepted by a dictionary is not checked any more. */
+static void check_words(const std::vector<std::string> &words, std::map<std::string, bool> &misspelled)
+{
+	std::vector<std::string> unknown;
+	for (std::vector<std::string>::const_iterator it = words.begin(); it != words.end(); ++it) {
+		if (const SpellResult *res = spell_cache_find(*it))
+			misspelled[*it] = res->misspelled;
+		else
+			unknown.push_back(*it);
+	}
+	if (unknown.empty())
+		return;
+	std::vector<bool> correct(unknown.size(), false);
+	for (std::list<EnchantDict *>::iterator iter = dictlist.begin(); iter != dictlist.end(); ++iter) {
+		for (size_t i = 0; i < unknown.size(); i++) {
+			if (!correct[i] && enchant_dict_check(*iter, unknown[i].c_str(), unknown[i].length()) <= 0)
+				correct[i] = true;
+		}
+	}
+	for (size_t i = 0; i < unknown.size(); i++) {
+		misspelled[unknown[i]] = !correct[i];
+		spell_cache_insert(unknown[i], !correct[i]);
+	}
+}
 
-			/* Move on to the next word */
-			j++;
+static std::string build_suggestions(const std::string &word)
+{
+	std::list<std::pair<EnchantDict *, char **> > suggestions;
+	char **suggestion;
+	for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
+		suggestion = enchant_dict_suggest(*i, word.c_str(), -1, NULL);
+		if (suggestion)
+			suggestions.push_back(std::make_pair(*i, suggestion));
+	}
+	std::string definition;
+	for (std::list<std::pair<EnchantDict *, char **> >::iterator it = suggestions.begin(); it != suggestions.end(); ++it) {
+		if (it != suggestions.begin()) {
+			definition += "\n\n";
+		}
+		suggestion = it->second;
+		definition += "<kref>";
+		definition += suggestion[0];
+		definition += "</kref>";
+		int i = 1;
+		while (suggestion[i]) {
+			definition += "\t<kref>";
+			definition += suggestion[i];
+			definition += "</kref>";
+			i++;
 		}
 	}
+	for (std::list<std::pair<EnchantDict *, char **> >::iterator it = suggestions.begin(); it != suggestions.end(); ++it)
+		enchant_dict_free_string_list(it->first, it->second);
+	return definition;
+}
 
-	g_free (log_attrs);
+/* Return the definition of the suggestion article of a misspelled word. */
+static std::string get_suggestions(const std::string &word)
+{
+	SpellResult *res = spell_cache_find(word);
+	if (!res)
+		res = &spell_cache_insert(word, true);
+	if (!res->suggested) {
+		res->suggestions = build_suggestions(word);
+		res->suggested = true;
+	}
+	return res->suggestions;
+}
+
+static void count_misspelling(const std::string &word)
+{
+	++misspelling_counts[word];
+	if (misspelling_counts.size() <= 4 * TOP_MISSPELLINGS)
+		return;
+	/* forget the rare misspellings */
+	std::vector<guint32> counts;
+	for (std::map<std::string, guint32>::iterator it = misspelling_counts.begin(); it != misspelling_counts.end(); ++it)
+		counts.push_back(it->second);
+	std::nth_element(counts.begin(), counts.begin() + TOP_MISSPELLINGS, counts.end(), std::greater<guint32>());
+	const guint32 min_count = counts[TOP_MISSPELLINGS];
+	for (std::map<std::string, guint32>::iterator it = misspelling_counts.begin(); it != misspelling_counts.end(); ) {
+		if (it->second <= min_count && it->first != word)
+			misspelling_counts.erase(it++);
+		else
+			++it;
+	}
+}
+
+static bool compare_counts(const std::pair<guint32, std::string> &a, const std::pair<guint32, std::string> &b)
+{
+	return a.first > b.first;
+}
+
+/* The most frequent misspellings, most frequent first. */
+static void get_top_misspellings(std::vector<std::pair<guint32, std::string> > &top)
+{
+	for (std::map<std::string, guint32>::iterator it = misspelling_counts.begin(); it != misspelling_counts.end(); ++it)
+		top.push_back(std::make_pair(it->second, it->first));
+	std::stable_sort(top.begin(), top.end(), compare_counts);
+	if (top.size() > TOP_MISSPELLINGS)
+		top.resize(TOP_MISSPELLINGS);
+}
+
+static void save_misspellings()
+{
+	std::vector<std::pair<guint32, std::string> > top;
+	get_top_misspellings(top);
+	std::string data;
+	for (size_t i = 0; i < top.size(); i++) {
+		gchar *line = g_strdup_printf("%u\t%s\n", top[i].first, top[i].second.c_str());
+		data += line;
+		g_free(line);
+	}
+	std::string filename = get_misspellings_filename();
+	g_file_set_contents(filename.c_str(), data.c_str(), data.length(), NULL);
+}
+
+/* Read the lines "count\tword" written by save_misspellings. */
+static void load_misspellings(std::vector<std::string> &words)
+{
+	std::string filename = get_misspellings_filename();
+	gchar *contents;
+	if (!g_file_get_contents(filename.c_str(), &contents, NULL, NULL))
+		return;
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	for (gchar **line = lines; *line; ++line) {
+		gchar *tab = strchr(*line, '\t');
+		if (!tab || tab[1] == '\0' || !g_utf8_validate(tab + 1, -1, NULL))
+			continue;
+		guint32 count = strtoul(*line, NULL, 10);
+		if (count == 0)
+			continue;
+		misspelling_counts[tab + 1] = count;
+		words.push_back(tab + 1);
+	}
+	g_strfreev(lines);
+}
+
+static gpointer precompute_thread_func(gpointer data)
+{
+	std::vector<std::string> *words = static_cast<std::vector<std::string> *>(data);
+	std::map<std::string, bool> misspelled;
+	for (size_t i = 0; i < words->size(); i++) {
+		if (g_atomic_int_get(&precompute_cancel))
+			break;
+		g_mutex_lock(&spell_mutex);
+		std::vector<std::string> word(1, (*words)[i]);
+		check_words(word, misspelled);
+		if (misspelled[(*words)[i]])
+			get_suggestions((*words)[i]);
+		g_mutex_unlock(&spell_mutex);
+	}
+	delete words;
+	return NULL;
 }
 
 static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 {
 	size_t len = strlen(text);
-	pango_layout_set_text(layout, text, len);
-	gchar **words;
-	gint *word_starts;
-	gint *word_ends;
-	stardict_strsplit_utf8(text, &words, &word_starts, &word_ends);
-	std::list<std::string> misspelled_wordlist;
-	gchar *spellword;
-	int start, end;
-	bool misspelled;
-	int *insert_tags = (int *)g_malloc0(sizeof(int)*(len +1));
-	int n_words;
-	for (n_words = 0; words[n_words]; n_words++) {
-		if (words[n_words][0] == '\0')
-			continue;
-		start = word_starts[n_words];
-		end = word_ends[n_words];
+	std::vector<std::pair<gint, gint> > words;
+	stardict_split_words_utf8(text, len, words);
+	g_mutex_lock(&spell_mutex);
+	/* Check all the words in one go, each distinct word once. */
+	std::vector<std::string> spellwords;
+	std::set<std::string> seen;
+	for (size_t i = 0; i < words.size(); i++) {
+		const gint start = words[i].first, end = words[i].second;
 		if (start == end)
 			continue;
-		spellword = g_new0(gchar, end - start + 2);
-		g_strlcpy(spellword, text + start, end - start + 1);
-		if (g_unichar_isalpha(*spellword) == FALSE) {
-			/* We only want to check words */
-			misspelled = false;
-		} else {
-			misspelled = true;
-			size_t wordlen = strlen(spellword);
-			for (std::list<EnchantDict *>::iterator iter = dictlist.begin(); iter != dictlist.end(); ++iter) {
-				if (enchant_dict_check(*iter, spellword, wordlen) <= 0) {
-					misspelled = false;
-					break;
-				}
-			}
-		}
-		if (misspelled) {
-			misspelled_wordlist.push_back(spellword);
-			insert_tags[start] = 1;
-			insert_tags[end] = 2;
-		}
-		g_free(spellword);
+		/* We only want to check words */
+		if (g_unichar_isalpha(g_utf8_get_char(text + start)) == FALSE)
+			continue;
+		std::string spellword(text + start, end - start);
+		if (seen.insert(spellword).second)
+			spellwords.push_back(spellword);
 	}
+	std::map<std::string, bool> misspelled;
+	check_words(spellwords, misspelled);
+	std::vector<std::string> misspelled_wordlist;
+	for (size_t i = 0; i < spellwords.size(); i++)
+		if (misspelled[spellwords[i]])
+			misspelled_wordlist.push_back(spellwords[i]);
 	std::string underline_str;
-	int n_misspelled = misspelled_wordlist.size();
-	if (n_misspelled !=0 && n_words != 1) {
+	int n_words = words.size();
+	if (!misspelled_wordlist.empty() && n_words != 1) {
+		int *insert_tags = (int *)g_malloc0(sizeof(int)*(len +1));
+		for (size_t i = 0; i < words.size(); i++) {
+			const gint start = words[i].first, end = words[i].second;
+			if (start == end)
+				continue;
+			std::map<std::string, bool>::const_iterator it
+				= misspelled.find(std::string(text + start, end - start));
+			if (it != misspelled.end() && it->second) {
+				insert_tags[start] = 1;
+				insert_tags[end] = 2;
+			}
+		}
 		underline_str += "<big>";
 		for (size_t i = 0; i < len; i++) {
 			if (insert_tags[i] == 1) {
@@ -190,42 +395,18 @@ static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 		if (insert_tags[len] == 2)
 			underline_str += "</span>";
 		underline_str += "</big>";
+		g_free(insert_tags);
 	}
-	g_free(insert_tags);
-	g_strfreev(words);
-	g_free(word_starts);
-	g_free(word_ends);
 
 	std::vector< std::pair<char *, char *> > result;
-	char **suggestion;
-	for (std::list<std::string>::iterator iter = misspelled_wordlist.begin(); iter != misspelled_wordlist.end(); ++iter) {
-		std::list<char **> suggestions;
-		for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
-			suggestion = enchant_dict_suggest(*i, (*iter).c_str(), -1, NULL);
-			if (suggestion)
-				suggestions.push_back(suggestion);
-		}
-		if (suggestions.empty())
+	for (std::vector<std::string>::iterator iter = misspelled_wordlist.begin(); iter != misspelled_wordlist.end(); ++iter) {
+		count_misspelling(*iter);
+		const std::string definition = get_suggestions(*iter);
+		if (definition.empty())
 			continue;
-		std::string definition;
-		for (std::list<char **>::iterator it = suggestions.begin(); it != suggestions.end(); ++it) {
-			if (it != suggestions.begin()) {
-				definition += "\n\n";
-			}
-			suggestion = *it;
-			definition += "<kref>";
-			definition += suggestion[0];
-			definition += "</kref>";
-			int i = 1;
-			while (suggestion[i]) {
-				definition += "\t<kref>";
-				definition += suggestion[i];
-				definition += "</kref>";
-				i++;
-			}
-		}
 		result.push_back(std::pair<char *, char *>(g_strdup((*iter).c_str()), build_dictdata('x', definition.c_str())));
 	}
+	g_mutex_unlock(&spell_mutex);
 	if (result.empty()) {
 		*pppWord = NULL;
 	} else {
@@ -258,6 +439,7 @@ static bool load_custom_langs()
 		enchant_broker_free_dict(broker, *i);
 	}
 	dictlist.clear();
+	spell_cache_clear();
 	std::list<std::string> langlist;
 	std::string lang;
 	const gchar *p = custom_langs.c_str();
@@ -297,6 +479,7 @@ static bool load_auto_lang()
 		enchant_broker_free_dict(broker, *i);
 	}
 	dictlist.clear();
+	spell_cache_clear();
 	bool no_dict = false;
 	const gchar* const *languages = g_get_language_names();
 	int i = 0;
@@ -371,6 +554,7 @@ static void configure()
 	gtk_dialog_run(GTK_DIALOG(window));
 	gboolean new_use_custom = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check_button));
 	bool cfgchanged = false;
+	g_mutex_lock(&spell_mutex);
 	if (new_use_custom != use_custom) {
 		cfgchanged = true;
 		use_custom = new_use_custom;
@@ -390,6 +574,7 @@ static void configure()
 			}
 		}
 	}
+	g_mutex_unlock(&spell_mutex);
 	if (cfgchanged) {
 		const char *tmp;
 		if (use_custom)
@@ -422,15 +607,20 @@ bool stardict_plugin_init(StarDictPlugInObject *obj, IAppDirs* appDirs)
 
 void stardict_plugin_exit(void)
 {
+	if (precompute_thread) {
+		g_atomic_int_set(&precompute_cancel, 1);
+		g_thread_join(precompute_thread);
+		precompute_thread = NULL;
+	}
+	g_mutex_lock(&spell_mutex);
 	if (broker) {
+		save_misspellings();
 		for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
 			enchant_broker_free_dict(broker, *i);
 		}
 		enchant_broker_free(broker);
 	}
-	if (layout) {
-		g_object_unref(layout);
-	}
+	g_mutex_unlock(&spell_mutex);
 	gpAppDirs = NULL;
 }
 
@@ -439,7 +629,6 @@ bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
 	obj->lookup_func = lookup;
 	obj->dict_name = _("Spelling Suggestion");
 	broker = enchant_broker_init();
-	layout = pango_layout_new(gtk_widget_get_pango_context(plugin_info->mainwin));
 
 	std::string res = get_cfg_filename();
 	if (!g_file_test(res.c_str(), G_FILE_TEST_EXISTS)) {
@@ -467,6 +656,12 @@ bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
 	}
 	if (failed)
 		return true;
+	std::vector<std::string> *words = new std::vector<std::string>;
+	load_misspellings(*words);
+	if (words->empty())
+		delete words;
+	else
+		precompute_thread = g_thread_new("spell_precompute", precompute_thread_func, words);
 	g_print(_("Spelling plugin loaded.\n"));
 	return false;
 }
@@ -46,7 +46,7 @@ string TTableInfo::new_row ()
 	return ret ;
 	}    
 
-string TTableInfo::new_cell ( string type )
+string TTableInfo::new_cell ( const string &type )
 	{
 	string ret ;
 	if ( !tr_open ) ret += new_row () ;
@@ -57,6 +57,64 @@ string TTableInfo::new_cell ( string type )
 	return ret ;
 	}    
 
+// *****************************************************************************
+// *****************************************************************************
+//
+// TLineBuffer
+//
+// *****************************************************************************
+// *****************************************************************************
+
+TLineBuffer::TLineBuffer ( const string &l ) : ahead ( l.rbegin() , l.rend() )
+	{
+	done.reserve ( l.length() ) ;
+	}
+
+bool TLineBuffer::submatch ( const string &sub , size_t i ) const
+	{
+	if ( i + sub.length() > ahead.length() ) return false ;
+	size_t a ;
+	for ( a = 0 ; a < sub.length() ; a++ )
+		{
+		if ( sub[a] != at ( i + a ) ) return false ;
+		}
+	return true ;
+	}
+
+string TLineBuffer::substr ( size_t i , size_t n ) const
+	{
+	return string ( ahead.rbegin() + i , ahead.rbegin() + i + n ) ;
+	}
+
+// Number of characters at the cursor not in stop
+size_t TLineBuffer::span ( const char *stop ) const
+	{
+	size_t pos = ahead.find_last_of ( stop ) ;
+	if ( pos == string::npos ) return ahead.length() ;
+	return ahead.length() - 1 - pos ;
+	}
+
+// Move n characters from the text ahead to the done text
+void TLineBuffer::advance ( size_t n )
+	{
+	done.append ( ahead.rbegin() , ahead.rbegin() + n ) ;
+	ahead.resize ( ahead.length() - n ) ;
+	}
+
+// Move the cursor back to pos, the done text after it is parsed again
+void TLineBuffer::rewind ( size_t pos )
+	{
+	ahead.append ( done.rbegin() , done.rend() - pos ) ;
+	done.resize ( pos ) ;
+	}
+
+// Insert s at the cursor, the cursor stays on the last character of s
+void TLineBuffer::put ( const string &s )
+	{
+	done.append ( s , 0 , s.length() - 1 ) ;
+	ahead += s[s.length()-1] ;
+	}
+
 // *****************************************************************************
 // *****************************************************************************
 //
@@ -65,46 +123,60 @@ string TTableInfo::new_cell ( string type )
 // *****************************************************************************
 // *****************************************************************************
 
-void WIKI2XML::parse_symmetric ( string &l , size_t &from , 
-         							string s1 , string s2 ,
-         							string r1 , string r2 ,
+void WIKI2XML::parse_symmetric ( TLineBuffer &l ,
+         							const string &s1 , const string &s2 ,
+         							const string &r1 , const string &r2 ,
                                     bool extend )
 	{
-	int a , b ;
-	if ( !submatch ( l , s1 , from ) ) return ; // Left does not match
-	for ( a = from + s1.length() ; a + s2.length() <= l.length() ; a++ )
+	size_t a , b ;
+	if ( !l.submatch ( s1 , 0 ) ) return ; // Left does not match
+	for ( a = s1.length() ; a + s2.length() <= l.left() ; a++ )
 		{
-		if ( !submatch ( l , s2 , a ) ) continue ;
-		for ( b = a+1 ; extend && submatch ( l , s2 , b ) ; b++ ) ;
+		if ( !l.submatch ( s2 , a ) ) continue ;
+		for ( b = a+1 ; extend && l.submatch ( s2 , b ) ; b++ ) ;
 		b-- ;
-		l = l.substr ( 0 , from ) +
-			r1 +
-			l.substr ( from + s1.length() , b - from - s1.length() )  +
-			r2 +
-			l.substr ( b + s2.length() , l.length() ) ;
-		if ( debug ) cout << "newl : " << l << endl ;
+		string middle = l.substr ( s1.length() , b - s1.length() ) ;
+		l.skip ( b + s2.length() ) ;
+		l.unread ( r2 ) ;
+		l.unread ( middle ) ;
+		l.unread ( r1 ) ;
 		break ;
 		}    
 	}
      
-void WIKI2XML::parse_link ( string &l , size_t &from , char mode )
+// The cursor is on the first bracket. Inner links are replaced while
+// looking for the closing brackets, so they are parsed only once.
+void WIKI2XML::parse_link ( TLineBuffer &l , char mode )
 	{
-    from += 1 ;
+    size_t start = l.done.length() ;
+    l.advance () ;
     size_t a , cnt = 1 ;
     chart par_open = '[' ; // mode 'L'
     chart par_close = ']' ; // mode 'L'
     if ( mode == 'T' ) { par_open = '{' ; par_close = '}' ; }
-    for ( a = from ; cnt > 0 && a+1 < l.length() ; a++ )
+    const char stop[] = { par_open , par_close , 0 } ;
+    while ( cnt > 0 && l.left() > 1 )
     	{
-	    if ( l[a] == par_open && l[a+1] == par_open )
-	    	parse_link ( l , a ) ;
-    	else if ( l[a] == par_close && l[a+1] == par_close )
+    	size_t n = l.span ( stop ) ;
+    	if ( n > 0 )
+    		{
+    		l.advance ( n ) ;
+    		continue ;
+    		}
+	    if ( l.at ( 0 ) == par_open && l.at ( 1 ) == par_open )
+	    	parse_link ( l ) ;
+    	else if ( l.at ( 0 ) == par_close && l.at ( 1 ) == par_close )
     		cnt-- ;
+    	l.advance () ;
     	}    
-   	if ( cnt > 0 ) return ; // Not a valid link
+   	if ( cnt > 0 ) // Not a valid link
+   		{
+   		l.rewind ( start + 1 ) ;
+   		return ;
+   		}
    	
-   	int to = a-1 ; // Without "]]"
-   	string link = l.substr ( from+1 , to-from-1 ) ;
+   	// Without "]]", the second bracket is at the cursor
+   	string link = l.done.substr ( start + 2 , l.done.length() - start - 3 ) ;
    	
    	TXML x ;
    	vector <string> parts ;
@@ -119,7 +191,7 @@ void WIKI2XML::parse_link ( string &l , size_t &from , char mode )
    	for ( a = 0 ; a < parts.size() ; a++ )
    	    {
    	    bool last = ( a + 1 == parts.size() ) ;
-   	    string p = parts[a] ;
+   	    string &p = parts[a] ;
    	    parse_line_sub ( p ) ;
 
    	    if ( a > 0 && ( mode != 'L' || !last ) )
@@ -155,12 +227,12 @@ void WIKI2XML::parse_link ( string &l , size_t &from , char mode )
    	    x.text += xml_embed ( p , "wikiparameter" , param ) ;
    	    }
 
+	size_t to = 1 ; // The closing bracket and the link trail
 	if ( mode == 'L' ) // Try link trail
 	   {
 	   string trail ;
-	   for ( a = to+2 ; a < l.length() && is_text_char ( l[a] ) ; a++ )
-	       trail += l[a] ;
-       to = a-2 ;
+	   for ( ; to < l.left() && is_text_char ( l.at ( to ) ) ; to++ )
+	       trail += l.at ( to ) ;
        if ( trail != "" ) x.text += xml_embed ( trail , "trail" ) ;
        }
    	
@@ -168,11 +240,10 @@ void WIKI2XML::parse_link ( string &l , size_t &from , char mode )
 	string replacement = x.get_string () ;
 	parse_line_sub ( replacement ) ;
 	
-   	l.erase ( from-1 , to-from+3 ) ;
-   	l.insert ( from-1 , replacement ) ;
+	l.skip ( to ) ;
+	l.done.resize ( start ) ;
+	l.put ( replacement ) ;
    	if ( debug ) cout << "Link : " << link << endl << "Replacement : " << replacement << endl ;
-   	if ( debug ) cout << "Result : " << l << endl << endl ;
-   	from = from + replacement.length() - 2 ;
 	}    
 	
 bool WIKI2XML::is_list_char ( chart c ) // For now...
@@ -277,7 +348,7 @@ void WIKI2XML::parse_line ( string &l )
             l = "" ;
             }    
     	}
-   	else if ( left ( l , 2 ) == "{|" || (left ( l , 2 ) == "|}" && l[2] != '}' ) ||
+   	else if ( left ( l , 2 ) == "{|" || (left ( l , 2 ) == "|}" && l[2] != '}' && tables.size() > 0 ) ||
    				( tables.size() > 0 && l != "" && ( l[0] == '|' || l[0] == '!' ) ) )
         {
         pre += table_markup ( l ) ;
@@ -290,7 +361,7 @@ void WIKI2XML::parse_line ( string &l )
     if ( pre != "" ) l = pre + l ;   
     }    
 
-bool WIKI2XML::is_external_link_protocol ( string protocol )
+bool WIKI2XML::is_external_link_protocol ( const string &protocol )
     {
     if ( protocol == "HTTP" ) return true ;
     if ( protocol == "FTP" ) return true ;
@@ -298,45 +369,52 @@ bool WIKI2XML::is_external_link_protocol ( string protocol )
     return false ;
     }
     
-int WIKI2XML::scan_url ( string &l , size_t from )
+// Length of the URL continuing at the cursor
+size_t WIKI2XML::scan_url ( TLineBuffer &l )
     {
     size_t a ;
-    for ( a = from ; a < l.length() ; a++ )
+    for ( a = 0 ; a < l.left() ; a++ )
         {
-        if ( l[a] == ':' || l[a] == '/' || l[a] == '.' ) continue ;
-        if ( l[a] >= '0' && l[a] <= '9' ) continue ;
-        if ( is_text_char ( l[a] ) ) continue ;
+        chart c = l.at ( a ) ;
+        if ( c == ':' || c == '/' || c == '.' ) continue ;
+        if ( c >= '0' && c <= '9' ) continue ;
+        if ( is_text_char ( c ) ) continue ;
         break ; // End of URL
         }
     return a ;
     }
 	
-void WIKI2XML::parse_external_freelink ( string &l , size_t &from )
+// The cursor is on ':' of "://", the protocol is done already
+void WIKI2XML::parse_external_freelink ( TLineBuffer &l )
 	{
 	int a ;
-	for ( a = from - 1 ; a >= 0 && is_text_char ( l[a] ) ; a-- ) ;
+	for ( a = l.done.length() - 1 ; a >= 0 && is_text_char ( l.done[a] ) ; a-- ) ;
 	if ( a == -1 ) return ;
 	a++ ;
-	string protocol = upper ( l.substr ( a , from - a ) ) ;
+	string protocol = upper ( l.done.substr ( a ) ) ;
 	if ( debug ) cout << "protocol : " << protocol << endl ;
 	if ( !is_external_link_protocol ( protocol ) ) return ;	
-	int to = scan_url ( l , a ) ;
-	string url = l.substr ( a , to - a ) ;
+	size_t to = scan_url ( l ) ;
+	string url = l.done.substr ( a ) + l.substr ( 0 , to ) ;
 	string replacement ;
     replacement += xml_embed ( url , "url" ) ;
     replacement += xml_embed ( url , "title" ) ;
-	l = left ( l , a ) + replacement + l.substr ( to , l.length() - to ) ;
-	from = a + replacement.length() - 1 ;
+	l.skip ( to ) ;
+	l.done.resize ( a ) ;
+	l.put ( replacement ) ;
 	}
 	
-void WIKI2XML::parse_external_link ( string &l , size_t &from )
+void WIKI2XML::parse_external_link ( TLineBuffer &l )
 	{
-	string protocol = upper ( before_first ( ':' , l.substr ( from + 1 , l.length() - from ) ) ) ;
-	if ( !is_external_link_protocol ( protocol ) ) return ;
-    size_t to ;
-    for ( to = from + 1 ; to < l.length() && l[to] != ']' ; to++ ) ;
-    if ( to == l.length() ) return ;
-    string url = l.substr ( from + 1 , to - from - 1 ) ;
+	// No supported protocol is longer than 6 characters
+	string protocol ;
+	size_t to ;
+	for ( to = 1 ; to < l.left() && l.at ( to ) != ':' && protocol.length() < 7 ; to++ )
+		protocol += l.at ( to ) ;
+	if ( !is_external_link_protocol ( upper ( protocol ) ) ) return ;
+    for ( to = 1 ; to < l.left() && l.at ( to ) != ']' ; to++ ) ;
+    if ( to == l.left() ) return ;
+    string url = l.substr ( 1 , to - 1 ) ;
     string title = after_first ( ' ' , url ) ;
     url = before_first ( ' ' , url ) ;
     string replacement ;
@@ -344,45 +422,60 @@ void WIKI2XML::parse_external_link ( string &l , size_t &from )
     if ( title == "" )
         replacement += xml_embed ( "<wikiurlcounter action=\"add\"/>" , "title" ) ;
     else replacement += xml_embed ( title , "title" ) ;
-    replacement = xml_embed ( replacement , "wikilink" , "type='external' protocol='" + protocol + "'" ) ;
-    l = left ( l , from ) + replacement + l.substr ( to + 1 , l.length() - to ) ;
-    from = from + replacement.length() - 1 ;
+    replacement = xml_embed ( replacement , "wikilink" , "type='external' protocol='" + upper ( protocol ) + "'" ) ;
+    l.skip ( to + 1 ) ;
+    l.put ( replacement ) ;
 	}
 	
 void WIKI2XML::parse_line_sub ( string &l )
 	{
-	size_t a ;
-    for ( a = 0 ; a < l.length() ; a++ )
+	TLineBuffer b ( l ) ;
+    while ( !b.at_end() )
         {
-        if ( l[a] == '[' && a+1 < l.length() && l[a+1] == '[' ) // [[Link]]
-        	parse_link ( l , a , 'L' ) ;
-        else if ( l[a] == '{' && a+1 < l.length() && l[a+1] == '{' ) // {{Template}}
-        	parse_link ( l , a , 'T' ) ;
-       	else if ( l[a] == '[' ) // External link
-            parse_external_link ( l , a ) ;
-        else if ( a+2 < l.length() && l[a] == ':' && l[a+1] == '/' && l[a+2] == '/' ) // External freelink
-            parse_external_freelink ( l , a ) ;
-      	else if ( l[a] == SINGLE_QUOTE ) // Bold and italics
+        size_t n = b.span ( "[{:'" ) ;
+        if ( n > 0 )
+        	{
+        	b.advance ( n ) ;
+        	continue ;
+        	}
+        chart c = b.at ( 0 ) ;
+        if ( c == '[' && b.left() > 1 && b.at ( 1 ) == '[' ) // [[Link]]
+        	parse_link ( b , 'L' ) ;
+        else if ( c == '{' && b.left() > 1 && b.at ( 1 ) == '{' ) // {{Template}}
+        	parse_link ( b , 'T' ) ;
+       	else if ( c == '[' ) // External link
+            parse_external_link ( b ) ;
+        else if ( b.left() > 2 && c == ':' && b.at ( 1 ) == '/' && b.at ( 2 ) == '/' ) // External freelink
+            parse_external_freelink ( b ) ;
+      	else if ( c == SINGLE_QUOTE ) // Bold and italics
        		{
-        	parse_symmetric ( l , a , "'''" , "'''" , "<b>" , "</b>" , true ) ; 
-        	parse_symmetric ( l , a , "''" , "''" , "<i>" , "</i>" ) ; 
+        	parse_symmetric ( b , "'''" , "'''" , "<b>" , "</b>" , true ) ; 
+        	parse_symmetric ( b , "''" , "''" , "<i>" , "</i>" ) ; 
          	}
+        b.advance () ;
         } 
+    l.swap ( b.done ) ;
 	}
      
-void WIKI2XML::parse_lines ( vector <string> &lines )
+void WIKI2XML::parse ()
     {
-    size_t a ;
-    for ( a = 0 ; a < lines.size() ; a++ )
+    size_t a , b ;
+    xml.reserve ( text.length() + text.length() / 2 ) ;
+    for ( a = 0 ; ; a = b + 1 )
         {
-        parse_line ( lines[a] ) ;
+        b = text.find ( '\n' , a ) ;
+        string l = text.substr ( a , b == string::npos ? string::npos : b - a ) ;
+        parse_line ( l ) ;
+        if ( a > 0 ) xml += '\n' ;
+        xml += l ;
+        if ( b == string::npos ) break ;
         }
         
     string end ;
     
     // Cleanup lists
     end = fix_list ( end ) ;
-    if ( end != "" ) lines.push_back ( end ) ;
+    if ( end != "" ) xml += "\n" + end ;
     
     // Cleanup tables
     end = "" ;
@@ -391,13 +484,15 @@ void WIKI2XML::parse_lines ( vector <string> &lines )
 	    end += tables[tables.size()-1].close () ;
 	    tables.pop_back () ;
     	}    
-   	if ( end != "" ) lines.push_back ( end ) ;
+   	if ( end != "" ) xml += "\n" + end ;
     }    
 
-void WIKI2XML::init ( string s )
+void WIKI2XML::init ( const string &s )
 	{
 	list = "" ;
-	lines.clear () ;
+	text.clear () ;
+	xml.clear () ;
+	tables.clear () ;
 	
 	// Now we remove evil HTML
 	allowed_html.clear () ;
@@ -441,85 +536,68 @@ void WIKI2XML::init ( string s )
 	for ( a = 0 ; a < allowed_html.size() ; a++ )
 		allowed_html[a] = upper ( allowed_html[a] ) ;
 	
-	vector <TXML> taglist ;
-	make_tag_list ( s , taglist ) ;
-	remove_evil_html ( s , taglist ) ;
-	
-	// Now evaluate each line
-	explode ( '\n' , s , lines ) ;
+	remove_evil_html ( s ) ;
 	}    
 
 string WIKI2XML::get_xml ()
 	{
-	string ret = "<text>";
-	ret += implode ( "\n" , lines );
-	ret += "</text>";
-	
-	// Invalidating mdash
-	/*size_t a = ret.find ( "&mdash;" ) ;
-	while ( a >= 0 && a < ret.length() )
-		{
-		ret[a] = '!' ;
-		a = ret.find ( "&mdash;" , a ) ;
-		}*/
-		
+	string ret ;
+	ret.reserve ( xml.length() + 13 ) ;
+	ret = "<text>" ;
+	ret += xml ;
+	ret += "</text>" ;
 	return ret ;
 	}
 	
-void WIKI2XML::replace_part ( string &s , size_t from , size_t to , string with )
-	{
-	s = s.substr ( 0 , from ) + with + s.substr ( to + 1 , s.length() - to - 1 ) ;
-	}    
-    
-void WIKI2XML::replace_part_sync ( string &s , size_t from , size_t to , string with , vector <TXML> &list )
-	{
-	size_t a , b ;
-	replace_part ( s , from , to , with ) ;
-	for ( a = 0 ; a < list.size() ; a++ )
-		{
-		for ( b = 0 ; b < with.length() ; b++ ) list[a].insert_at ( from ) ;
-		for ( b = from ; b <= to ; b++ ) list[a].remove_at ( from ) ;
-		}    
-	}    
-    
+// Copy s to text escaping rogue < and > and the brackets of tags that are
+// not allowed.
 // ATTENTION : this doesn't handle all HTML comments correctly!
-void WIKI2XML::make_tag_list ( string &s , vector <TXML> &list )
+void WIKI2XML::remove_evil_html ( const string &s )
 	{
-	list.clear () ;
-	size_t a;
-	int b;
+	size_t a , b ;
+	text.reserve ( s.length() + s.length() / 8 ) ;
 	for ( a = 0 ; a < s.length() ; a++ )
 		{
+		b = s.find_first_of ( "<>" , a ) ;
+		if ( b == string::npos ) b = s.length() ;
+		text.append ( s , a , b - a ) ;
+		a = b ;
+		if ( a == s.length() ) break ;
 		if ( s[a] == '>' ) // Rouge >
 			{
-	    	s[a] = ';' ;
-	    	s.insert ( a , "&gt" ) ;
+			text += "&gt;" ;
 			continue ;
 			}
-		else if ( s[a] != '<' ) continue ;
-		b = find_next_unquoted ( '>' , s , a ) ;
-		if ( b == -1 ) // Rouge <
+		int to = find_next_unquoted ( '>' , s , a ) ;
+		if ( to == -1 ) // Rouge <
   			{
-	    	s[a] = ';' ;
-	    	s.insert ( a , "&lt" ) ;
+			text += "&lt;" ;
          	continue ;
          	}   	
-		list.push_back ( TXML ( a , b , s ) ) ;
-		a = list[list.size()-1].to ;
-		}    
-	}
- 
-void WIKI2XML::remove_evil_html ( string &s , vector <TXML> &taglist )
-	{
-	size_t a , b ;
-	for ( a = 0 ; a < taglist.size() ; a++ )
-		{
-		string tag = upper ( taglist[a].name ) ;
+		string name = s.substr ( a + 1 , to - (a+1) ) ;
+		name = trim ( name ) ;
+		name = before_first ( ' ' , name ) ;
+		if ( left ( name , 1 ) == "/" ) name = name.substr ( 1 , name.length()-1 ) ;
+		if ( right ( name , 1 ) == "/" ) name = name.substr ( 0 , name.length()-1 ) ;
+		name = trim ( name ) ;
+		string tag = upper ( name ) ;
 		for ( b = 0 ; b < allowed_html.size() && tag != allowed_html[b] ; b++ ) ;
-		if ( b < allowed_html.size() ) continue ;
-		replace_part_sync ( s , taglist[a].from , taglist[a].from , "&lt;" , taglist ) ;
-		replace_part_sync ( s , taglist[a].to , taglist[a].to , "&gt;" , taglist ) ;
-		}    
+		bool allowed = b < allowed_html.size() ;
+		text += allowed ? "<" : "&lt;" ;
+		// This will replace < and > within a comment with the appropriate HTML entities
+		if ( left ( name , 1 ) == "!" )
+			{
+			for ( b = a + 1 ; b < (size_t) to ; b++ )
+				{
+				if ( s[b] == '>' ) text += "&gt;" ;
+				else if ( s[b] == '<' ) text += "&lt;" ;
+				else text += s[b] ;
+				}
+			}
+		else text.append ( s , a + 1 , to - (a+1) ) ;
+		text += allowed ? ">" : "&gt;" ;
+		a = to ;
+		}
 	}
 
 string WIKI2XML::table_markup ( string &l )
@@ -562,16 +640,17 @@ string WIKI2XML::table_markup ( string &l )
  			l = l.substr ( 1 , l.length() - 1 ) ;
 			}
 		vector <string> sublines ;
+		size_t from = 0 ;
 		for ( a = 0 ; a + 1 < l.length() ; a++ )
 			{
  			if ( l[a] == '|' && l[a+1] == '|' )
  			   {
- 			   sublines.push_back ( left ( l , a ) ) ;
- 			   l = l.substr ( a + 2 , l.length() - a ) ;
- 			   a = (size_t)(-1) ;
+ 			   sublines.push_back ( l.substr ( from , a - from ) ) ;
+ 			   from = a + 2 ;
+ 			   a = from - 1 ;
  			   }    
 			}    
-		if ( l != "" ) sublines.push_back ( l ) ;
+		if ( from < l.length() ) sublines.push_back ( l.substr ( from ) ) ;
 		for ( a = 0 ; a < sublines.size() ; a++ )
 			{
 			l = sublines[a] ;
@@ -28,48 +28,70 @@ class TTableInfo
 	public :
 	TTableInfo () ;
 	virtual ~TTableInfo () {};
-	virtual string new_cell ( string type ) ;
+	virtual string new_cell ( const string &type ) ;
 	virtual string new_row () ;
 	virtual string close () ;
 	bool tr_open , td_open ;
 	string td_type ;
 	} ;    
 
+// A line being parsed. The text before the cursor is done, the text after
+// it is stored reversed, so markup may be replaced at the cursor without
+// moving the rest of the line.
+class TLineBuffer
+	{
+	public :
+	TLineBuffer ( const string &l ) ;
+	bool at_end () const { return ahead.empty () ; }
+	size_t left () const { return ahead.length () ; }
+	chart at ( size_t i ) const { return ahead[ahead.length()-1-i] ; }
+	bool submatch ( const string &sub , size_t i ) const ;
+	string substr ( size_t i , size_t n ) const ;
+	size_t span ( const char *stop ) const ;
+	void advance ( size_t n = 1 ) ;
+	void skip ( size_t n ) { ahead.resize ( ahead.length() - n ) ; }
+	void unread ( const string &s ) { ahead.append ( s.rbegin() , s.rend() ) ; }
+	void rewind ( size_t pos ) ;
+	void put ( const string &s ) ;
+	
+	// Variables
+	string done ;
+	private :
+	string ahead ;
+	} ;
+
 class WIKI2XML
 	{
 	public :
 	WIKI2XML () {} ;
 	virtual ~WIKI2XML () {};
-	WIKI2XML ( string &s ) { init ( s ) ; }
+	WIKI2XML ( const string &s ) { init ( s ) ; }
 	WIKI2XML ( vector <string> &l ) { init ( l ) ; }
-	virtual void init ( string s ) ;
+	virtual void init ( const string &s ) ;
 	virtual void init ( vector <string> &l ) { init ( implode ( "\n" , l ) ) ; }
-	virtual void parse () { parse_lines ( lines ) ; }
+	virtual void parse () ;
 	virtual string get_xml () ;
 	
 	private :
-	virtual void make_tag_list ( string &s , vector <TXML> &list ) ;
-	virtual void parse_symmetric ( string &l , size_t &from , 
- 						string s1 , string s2 , 
-                        string r1 , string r2 , bool extend = false ) ;
-	virtual void parse_link ( string &l , size_t &from , char mode = 'L' ) ;
+	virtual void parse_symmetric ( TLineBuffer &l ,
+						const string &s1 , const string &s2 ,
+						const string &r1 , const string &r2 , bool extend = false ) ;
+	virtual void parse_link ( TLineBuffer &l , char mode = 'L' ) ;
 	virtual void parse_line_sub ( string &l ) ;
 	virtual void parse_line ( string &l ) ;
-	virtual void parse_lines ( vector <string> &lines ) ;
 	virtual string fix_list ( string &l ) ;
 	virtual string get_list_tag ( chart c , bool open ) ;
 	virtual bool is_list_char ( chart c ) ;
-	virtual void remove_evil_html ( string &s , vector <TXML> &taglist ) ;
-	virtual void replace_part ( string &s , size_t from , size_t to , string with ) ;
-	virtual void replace_part_sync ( string &s , size_t from , size_t to , string with , vector <TXML> &list ) ;
-	virtual void parse_external_freelink ( string &l , size_t &from ) ;
-	virtual void parse_external_link ( string &l , size_t &from ) ;
-	virtual bool is_external_link_protocol ( string protocol ) ;
-	virtual int scan_url ( string &l , size_t from ) ;
+	virtual void remove_evil_html ( const string &s ) ;
+	virtual void parse_external_freelink ( TLineBuffer &l ) ;
+	virtual void parse_external_link ( TLineBuffer &l ) ;
+	virtual bool is_external_link_protocol ( const string &protocol ) ;
+	virtual size_t scan_url ( TLineBuffer &l ) ;
 	virtual string table_markup ( string &l ) ;
 		
 	// Variables
-	vector <string> lines , allowed_html ;
+	string text , xml ;
+	vector <string> allowed_html ;
 	vector <TTableInfo> tables ;
 	string list ;
     } ;             
@@ -167,7 +167,7 @@ string after_last ( chart c , string s )
 	return s.substr ( pos+1 , s.length() ) ;
 	}
      
-string trim ( string &s )
+string trim ( const string &s )
 	{
 	if ( s.length() == 0 ) return s ;
 	if ( s[0] != ' ' && s[s.length()-1] != ' ' ) return s ;
@@ -178,7 +178,7 @@ string trim ( string &s )
 	return s.substr ( a , b - a + 1 ) ;
 	}
 
-int find_next_unquoted ( chart c , string &s , int start )
+int find_next_unquoted ( chart c , const string &s , int start )
 	{
 	size_t a ;
 	chart lastquote = ' ' ;
@@ -200,7 +200,7 @@ string val ( int a )
     return string ( t ) ;
     }
 
-string xml_embed ( string inside , string tag , string param )
+string xml_embed ( const string &inside , const string &tag , const string &param )
     {
     string ret ;
     ret = "<" + tag ;
@@ -47,10 +47,10 @@ string before_first ( chart c , string s ) ;
 string before_last ( chart c , string s ) ;
 string after_first ( chart c , string s ) ;
 string after_last ( chart c , string s ) ;
-string trim ( string &s ) ;
+string trim ( const string &s ) ;
 string val ( int a ) ;
-int find_next_unquoted ( chart c , string &s , int start = 0 ) ;
-string xml_embed ( string inside , string tag , string param = "" ) ;
+int find_next_unquoted ( chart c , const string &s , int start = 0 ) ;
+string xml_embed ( const string &inside , const string &tag , const string &param = "" ) ;
 string xml_params ( string l ) ;
 
 #endif
@@ -22,6 +22,13 @@
 #include <list>
 #include <cstring>
 
+/* The springs and the friction were tuned for one step of t=1.0 every
+ * 1/16 second, so the scene is stepped at that rate however often it is
+ * drawn. */
+static const gint64 PHYSICS_STEP_TIME = G_USEC_PER_SEC/16;
+// Steps done at most to catch up after a stall, the rest is dropped.
+static const int PHYSICS_MAX_STEPS = 4;
+
 
 wnobj::wnobj(partic_t & p, unsigned int t) : _p(p), _t(t), highlight(false)
 {
@@ -247,6 +254,7 @@ gboolean WnCourt::expose_event_callback (GtkWidget *widget, GdkEventExpose *even
 #else
 	cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
 #endif
+	g_mutex_lock(&wncourt->physics_mutex);
 	if (wncourt->_secourt && wncourt->_secourt->get_alpha() != 0) {
 		wncourt->_secourt->updte_alpha(16);
 		if (wncourt->_secourt->get_alpha() != 0) {
@@ -254,6 +262,7 @@ gboolean WnCourt::expose_event_callback (GtkWidget *widget, GdkEventExpose *even
 		}
 	}
 	wncourt->draw_wnobjs(cr, wncourt->_court);
+	g_mutex_unlock(&wncourt->physics_mutex);
 	wncourt->draw_dragbar(cr);
 #if GTK_MAJOR_VERSION >= 3
 #else
@@ -304,12 +313,11 @@ void WnCourt::on_realize_callback(GtkWidget *widget, WnCourt *wncourt)
 
 gboolean WnCourt::on_button_press_event_callback(GtkWidget * widget, GdkEventButton *event, WnCourt *wncourt)
 {
-	if (wncourt->timeout == 0) {
-		wncourt->timeout = g_timeout_add(int(1000/16), do_render_scene, wncourt);
-	}
+	wncourt->StartAnimation();
 	if (event->type == GDK_BUTTON_PRESS) {
 		if (event->button == 1) {
 			wnobj * b;
+			g_mutex_lock(&wncourt->physics_mutex);
 			if (event->x > wncourt->widget_width - 15 && event->y > wncourt->widget_height - 15) {
 				wncourt->resizing = true;
 				GdkCursor* cursor = gdk_cursor_new(GDK_SIZING);
@@ -325,6 +333,7 @@ gboolean WnCourt::on_button_press_event_callback(GtkWidget * widget, GdkEventBut
 			} else {
 				wncourt->panning = true;
 			}
+			g_mutex_unlock(&wncourt->physics_mutex);
 			wncourt->oldX = (int)(event->x);
 			wncourt->oldY = (int)(event->y);
 		} else if (event->button == 2) {
@@ -333,19 +342,23 @@ gboolean WnCourt::on_button_press_event_callback(GtkWidget * widget, GdkEventBut
 	} else if (event->type == GDK_2BUTTON_PRESS) {
 		if (event->button == 1) {
 			wnobj * b;
+			char *sWord = NULL;
+			g_mutex_lock(&wncourt->physics_mutex);
 			if (wncourt->_court->hit((int)(event->x), (int)(event->y), &b)) {
-				if (b->getT() & wnobj::et_word) {
-					char *sWord = g_strdup(b->get_text());
-					char ***Word;
-					char ****WordData;
-					wncourt->lookup_dict(wncourt->_dictid, sWord, &Word, &WordData);
-					wncourt->set_word(sWord, Word[0], WordData[0]);
-					wncourt->FreeResultData(1, Word, WordData);
-					g_free(sWord);
-				}
+				if (b->getT() & wnobj::et_word)
+					sWord = g_strdup(b->get_text());
 			} else {
 				wncourt->CenterScene();
 			}
+			g_mutex_unlock(&wncourt->physics_mutex);
+			if (sWord) {
+				char ***Word;
+				char ****WordData;
+				wncourt->lookup_dict(wncourt->_dictid, sWord, &Word, &WordData);
+				wncourt->set_word(sWord, Word[0], WordData[0]);
+				wncourt->FreeResultData(1, Word, WordData);
+				g_free(sWord);
+			}
 		}
 	}
 	return TRUE;
@@ -354,11 +367,14 @@ gboolean WnCourt::on_button_press_event_callback(GtkWidget * widget, GdkEventBut
 gboolean WnCourt::on_button_release_event_callback(GtkWidget * widget, GdkEventButton *event, WnCourt *wncourt)
 {
 	if (event->button == 1) {
+		g_mutex_lock(&wncourt->physics_mutex);
 		if (wncourt->dragball) {
 			wncourt->dragball->set_anchor(false);
 			wncourt->_court->get_env().reset();
 			wncourt->dragball = NULL;
 		}
+		wncourt->panning = false;
+		g_mutex_unlock(&wncourt->physics_mutex);
 		if (wncourt->resizing) {
 			GdkCursor* cursor = gdk_cursor_new(GDK_LEFT_PTR);
 			gdk_window_set_cursor(gtk_widget_get_window(widget), cursor);
@@ -369,7 +385,6 @@ gboolean WnCourt::on_button_release_event_callback(GtkWidget * widget, GdkEventB
 #endif
 			wncourt->resizing = false;
 		}
-		wncourt->panning = false;
 	} else if (event->button == 2) {
 		return FALSE;
 	}
@@ -378,6 +393,7 @@ gboolean WnCourt::on_button_release_event_callback(GtkWidget * widget, GdkEventB
 
 gboolean WnCourt::on_motion_notify_event_callback(GtkWidget * widget, GdkEventMotion * event , WnCourt *wncourt)
 {
+	g_mutex_lock(&wncourt->physics_mutex);
 	if (event->state & GDK_BUTTON1_MASK) {
 		if (wncourt->dragball) {
 			vector_t dv((single)(event->x - wncourt->oldX), (single)(event->y - wncourt->oldY), 0);
@@ -423,14 +439,19 @@ gboolean WnCourt::on_motion_notify_event_callback(GtkWidget * widget, GdkEventMo
 			}
 		}
 	}
+	g_mutex_unlock(&wncourt->physics_mutex);
 	return TRUE;
 }
 
 gint WnCourt::do_render_scene(gpointer data)
 {
 	WnCourt *wncourt = static_cast<WnCourt *>(data);
-	wncourt->_court->update(1.0f);
-	if (wncourt->need_draw()) {
+	g_mutex_lock(&wncourt->physics_mutex);
+	bool draw = wncourt->need_draw();
+	if (!draw)
+		wncourt->physics_running = false;
+	g_mutex_unlock(&wncourt->physics_mutex);
+	if (draw) {
 		gtk_widget_queue_draw(wncourt->drawing_area);
 		return TRUE;
 	} else {
@@ -439,13 +460,51 @@ gint WnCourt::do_render_scene(gpointer data)
 	}
 }
 
+gpointer WnCourt::physics_thread_func(gpointer data)
+{
+	WnCourt *wncourt = static_cast<WnCourt *>(data);
+	gint64 last_time = g_get_monotonic_time();
+	gint64 lag = 0;
+	g_mutex_lock(&wncourt->physics_mutex);
+	while (!wncourt->physics_quit) {
+		if (!wncourt->physics_running) {
+			g_cond_wait(&wncourt->physics_cond, &wncourt->physics_mutex);
+			last_time = g_get_monotonic_time();
+			lag = 0;
+			continue;
+		}
+		gint64 now = g_get_monotonic_time();
+		lag += now - last_time;
+		last_time = now;
+		for (int i = 0; lag >= PHYSICS_STEP_TIME && i < PHYSICS_MAX_STEPS; i++) {
+			wncourt->_court->update(1.0f);
+			lag -= PHYSICS_STEP_TIME;
+		}
+		if (lag >= PHYSICS_STEP_TIME)
+			lag = 0;
+		g_cond_wait_until(&wncourt->physics_cond, &wncourt->physics_mutex, now + PHYSICS_STEP_TIME - lag);
+	}
+	g_mutex_unlock(&wncourt->physics_mutex);
+	return NULL;
+}
+
+void WnCourt::StartAnimation()
+{
+	g_mutex_lock(&physics_mutex);
+	physics_running = true;
+	g_cond_signal(&physics_cond);
+	g_mutex_unlock(&physics_mutex);
+	if (timeout == 0)
+		timeout = g_timeout_add(int(1000/16), do_render_scene, this);
+}
+
 bool WnCourt::need_draw()
 {
 	return (_secourt && _secourt->get_alpha() != 0) ||
 			dragball || panning || _court->need_draw();
 }
 
-WnCourt::WnCourt(size_t dictid, lookup_dict_func_t lookup_dict_, FreeResultData_func_t FreeResultData_, ShowPangoTips_func_t ShowPangoTips_, gint *widget_width_, gint *widget_height_) : _dictid(dictid), lookup_dict(lookup_dict_), FreeResultData(FreeResultData_), ShowPangoTips(ShowPangoTips_), global_widget_width(widget_width_), global_widget_height(widget_height_), _secourt(NULL), _init_angle(0), init_spring_length(81), resizing(false), panning(false), dragball(NULL), overball(NULL)
+WnCourt::WnCourt(size_t dictid, lookup_dict_func_t lookup_dict_, FreeResultData_func_t FreeResultData_, ShowPangoTips_func_t ShowPangoTips_, gint *widget_width_, gint *widget_height_) : _dictid(dictid), lookup_dict(lookup_dict_), FreeResultData(FreeResultData_), ShowPangoTips(ShowPangoTips_), global_widget_width(widget_width_), global_widget_height(widget_height_), physics_running(true), physics_quit(false), _secourt(NULL), _init_angle(0), init_spring_length(81), resizing(false), panning(false), dragball(NULL), overball(NULL)
 {
 	_court = new wncourt_t();
 	widget_width = *widget_width_;
@@ -479,6 +538,9 @@ WnCourt::WnCourt(size_t dictid, lookup_dict_func_t lookup_dict_, FreeResultData_
 	g_signal_connect (G_OBJECT (drawing_area), "button_release_event", G_CALLBACK (on_button_release_event_callback), this);
 	g_signal_connect (G_OBJECT (drawing_area), "motion_notify_event", G_CALLBACK (on_motion_notify_event_callback), this);
 	gtk_widget_show(drawing_area);
+	g_mutex_init(&physics_mutex);
+	g_cond_init(&physics_cond);
+	physics_thread = g_thread_new("wordnet_physics", physics_thread_func, this);
 	timeout = g_timeout_add(int(1000/16), do_render_scene, this);
 }
 
@@ -486,6 +548,13 @@ WnCourt::~WnCourt()
 {
 	if (timeout)
 		g_source_remove(timeout);
+	g_mutex_lock(&physics_mutex);
+	physics_quit = true;
+	g_cond_signal(&physics_cond);
+	g_mutex_unlock(&physics_mutex);
+	g_thread_join(physics_thread);
+	g_cond_clear(&physics_cond);
+	g_mutex_clear(&physics_mutex);
 	delete _court;
 	delete _secourt;
 	*global_widget_width = widget_width;
@@ -539,11 +608,18 @@ static void wordnet2result(const gchar *Word, gchar *WordData, std::string &type
 
 void WnCourt::set_word(const gchar *orig_word, gchar **Word, gchar ***WordData)
 {
+	g_mutex_lock(&physics_mutex);
 	ClearScene();
 	CurrentWord = orig_word;
 	CreateWord(orig_word);
-	if (Word == NULL)
-		return;
+	if (Word != NULL)
+		CreateNodes(orig_word, Word, WordData);
+	g_mutex_unlock(&physics_mutex);
+	StartAnimation();
+}
+
+void WnCourt::CreateNodes(const gchar *orig_word, gchar **Word, gchar ***WordData)
+{
 	Push();
 	std::string type;
 	std::list<std::string> wordlist;
@@ -138,6 +138,13 @@ private:
 	gint *global_widget_width, *global_widget_height;
 	gint widget_width, widget_height;
 	int timeout;
+	/* The scene is stepped in physics_thread. physics_mutex guards the
+	 * scenes, everything that moves partics and the fields below. */
+	GThread *physics_thread;
+	GMutex physics_mutex;
+	GCond physics_cond;
+	bool physics_running;
+	bool physics_quit;
 	wnobj * newobj;
 	wncourt_t * _court;
 	wncourt_t * _secourt;
@@ -160,10 +167,13 @@ private:
 	static gboolean on_button_release_event_callback(GtkWidget * widget, GdkEventButton *event, WnCourt *wncourt);
 	static gboolean on_motion_notify_event_callback(GtkWidget * widget, GdkEventMotion * event , WnCourt *wncourt);
 	static gint do_render_scene(gpointer data);
+	static gpointer physics_thread_func(gpointer data);
+	void StartAnimation();
 	void ClearScene();
 	void CenterScene();
 	void CreateWord(const char *text);
 	void CreateNode(const char *text, const char *type);
+	void CreateNodes(const gchar *orig_word, gchar **Word, gchar ***WordData);
 	void Push();
 	void Pop();
 	wnobj *get_top();
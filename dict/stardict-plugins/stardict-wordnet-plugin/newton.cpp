@@ -19,6 +19,8 @@
 
 #include "newton.h"
 
+#include <algorithm>
+
 
 void newton_t::update(single t) {
 	init_newton_calculate();
@@ -76,20 +78,13 @@ void newton_t::init_newton_calculate() {
 // 万有斥力的计算，让整个场景有一个较好的分布
 //--------------------------------------------------
 void newton_t::calculate_repulsion_factor() {
-	for(size_t i = 0; i < _scene.get_partics().size(); ++i) {
-		partic_t * a = _scene.get_partics()[i];//outloop.cur();
-		for(size_t j = 0; j < _scene.get_partics().size(); ++j ) {
-			partic_t * b = _scene.get_partics()[j]; // innerloop.cur();
-			// 每次都需要把两个球都算好, 分别计算
-			vector_t f = a->getP() - b->getP();
-			single dd = f.powerlength();
-			dd = dd > _env.min_repulsion_distance ? dd : _env.min_repulsion_distance;
-			single g = _env.G * a->getM()*b->getM()/dd;
-			f.set_length(g);
-			a->getF().add(f);
-			f.mul(-1);
-			b->getF().add(f);
-		}
+	vector<partic_t *> & partics = _scene.get_partics();
+	_tree.build(partics);
+	for(size_t i = 0; i < partics.size(); ++i) {
+		single fx, fy;
+		_tree.repulsion(i, _env.G, _env.min_repulsion_distance, fx, fy);
+		// 以前两两计算时每一对都算了两遍, 保持原来的斥力大小
+		partics[i]->getF().add(vector_t(2*fx, 2*fy, 0));
 	}
 }
 
@@ -111,39 +106,26 @@ void newton_t::calculate_friction_factor() {
 // 还是不用碰撞了，虚拟一个力出来，弹开即可，不过不能制造出新的能量来啊
 // 否则的话，就不能收敛下来了
 void newton_t::calculate_collide_factor() {
-	for(size_t i = 0; i < _scene.get_partics().size(); ++i) {
-		partic_t * a = _scene.get_partics()[i]; // outloop.cur();
-		for(size_t j = i+1; j < _scene.get_partics().size(); ++j) {
-			partic_t * b = _scene.get_partics()[j];// innerloop.cur();
-			// 碰撞了, 需要在坐标系里面交换速度
+	// 按左边界排序, 只和左边界落在自己盒子里的球比较
+	vector<partic_t *> & partics = _scene.get_partics();
+	_sweep.resize(partics.size());
+	for(size_t i = 0; i < partics.size(); ++i)
+		_sweep[i] = make_pair(partics[i]->getP().x - partics[i]->get_size().w/2, i);
+	sort(_sweep.begin(), _sweep.end());
+	for(size_t i = 0; i < _sweep.size(); ++i) {
+		single right = partics[_sweep[i].second]->getP().x + partics[_sweep[i].second]->get_size().w/2;
+		for(size_t j = i+1; j < _sweep.size() && _sweep[j].first < right; ++j) {
+			// 速度相同的时候弹开的方向和先后有关, 保持原来的顺序
+			partic_t * a = partics[min(_sweep[i].second, _sweep[j].second)];
+			partic_t * b = partics[max(_sweep[i].second, _sweep[j].second)];
 			if(a->get_box().overlay(b->get_box())) {
+				// 碰撞了, 做成斥力弹开, 不直接交换速度
 				vector_t d = a->getV() - b->getV();
-				vector_t t = d;
-				t.rot(M_PI_2);
-
-				//single area = a->get_box().overlayarea(b->get_box());
 				vector_t f = d;
 				f.norm();
-
-				//////////////////////////////////////////////////////////////////////////
-				// 这段代码，直接弹开的效果过于激烈了，做成斥力好了
-				///// method 1
-				//if (b->getV().proj(d) > 0)
-				//	b->getV().mirror(t);
-				//else
-				//	b->getF().add(f*b->getM()); // 在这里计算斥力
-
-				//if (a->getV().proj(d) < 0)
-				//	a->getV().mirror(t);
-				//else
-				//	a->getF().add(f.mul(-a->getM()));
-
-				// method 2
 				b->getF().add(f*(-b->getM()));
 				a->getF().add(f.mul(a->getM()));
-
-				/////
 			}
 		}
-	}	
+	}
 }
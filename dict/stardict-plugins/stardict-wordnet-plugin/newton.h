@@ -32,12 +32,17 @@
 #include "scene.h"
 #include "vector_t.h"
 #include "newton_env.h"
+#include "quadtree.h"
+
+#include <utility>
 
 class newton_t {
 private:
 	scene_t & _scene;
 	newton_env_t & _env;
 	bool _statchanged;
+	quadtree_t _tree;
+	vector<pair<single, size_t> > _sweep;	// left side of the box and index, sorted
 private:
 	void init_newton_calculate();
 	void calculate_spring_factor();	
@@ -46,7 +51,7 @@ private:
 	void calculate_collide_factor();
 	void calculate_new_position(single t);
 public:
-	newton_t(scene_t & s, newton_env_t & env): _scene(s), _env(env) { }
+	newton_t(scene_t & s, newton_env_t & env): _scene(s), _env(env), _statchanged(true) { }
 	void set_scene(scene_t & s) { _scene = s; }
 	void update(single t);
 	newton_env_t & get_env() { return _env; }
@@ -0,0 +1,132 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "quadtree.h"
+
+const single quadtree_t::theta = 0.5f;
+
+int quadtree_t::new_node(single cx, single cy, single half) {
+	node_t n;
+	n.cx = cx;
+	n.cy = cy;
+	n.half = half;
+	n.m = n.mx = n.my = 0;
+	n.child[0] = n.child[1] = n.child[2] = n.child[3] = -1;
+	n.first = -1;
+	n.leaf = true;
+	_nodes.push_back(n);
+	return (int)_nodes.size() - 1;
+}
+
+int quadtree_t::get_child(int n, single x, single y) {
+	int q = (x < _nodes[n].cx ? 0 : 1) | (y < _nodes[n].cy ? 0 : 2);
+	if (_nodes[n].child[q] < 0) {
+		single h = _nodes[n].half / 2;
+		int c = new_node(_nodes[n].cx + (q & 1 ? h : -h),
+			_nodes[n].cy + (q & 2 ? h : -h), h);
+		// new_node() may have moved _nodes
+		_nodes[n].child[q] = c;
+	}
+	return _nodes[n].child[q];
+}
+
+void quadtree_t::insert(int n, int i, int depth) {
+	const item_t & it = _items[i];
+	_nodes[n].m += it.m;
+	_nodes[n].mx += it.m*it.x;
+	_nodes[n].my += it.m*it.y;
+	if (_nodes[n].leaf) {
+		if (_nodes[n].first < 0 || depth >= max_depth) {
+			// empty cell, or partics sitting on top of each other
+			_next[i] = _nodes[n].first;
+			_nodes[n].first = i;
+			return;
+		}
+		int j = _nodes[n].first;
+		_nodes[n].first = -1;
+		_nodes[n].leaf = false;
+		insert(get_child(n, _items[j].x, _items[j].y), j, depth+1);
+	}
+	insert(get_child(n, it.x, it.y), i, depth+1);
+}
+
+void quadtree_t::build(std::vector<partic_t *> & partics) {
+	_nodes.clear();
+	_items.resize(partics.size());
+	_next.resize(partics.size());
+	if (partics.empty())
+		return;
+	single minx = partics[0]->getP().x, maxx = minx;
+	single miny = partics[0]->getP().y, maxy = miny;
+	for (size_t i = 0; i < partics.size(); ++i) {
+		item_t & it = _items[i];
+		it.x = partics[i]->getP().x;
+		it.y = partics[i]->getP().y;
+		it.m = partics[i]->getM();
+		if (it.x < minx) minx = it.x;
+		if (it.x > maxx) maxx = it.x;
+		if (it.y < miny) miny = it.y;
+		if (it.y > maxy) maxy = it.y;
+	}
+	single half = (maxx-minx > maxy-miny ? maxx-minx : maxy-miny)/2 + 1;
+	new_node((minx+maxx)/2, (miny+maxy)/2, half);
+	for (size_t i = 0; i < _items.size(); ++i)
+		insert(0, (int)i, 0);
+}
+
+void quadtree_t::repulsion(size_t i, single G, single min_dd, single & fx, single & fy) {
+	const item_t & a = _items[i];
+	fx = fy = 0;
+	if (_nodes.empty())
+		return;
+	_stack.clear();
+	_stack.push_back(0);
+	while (!_stack.empty()) {
+		const node_t & n = _nodes[_stack.back()];
+		_stack.pop_back();
+		if (n.leaf) {
+			for (int j = n.first; j >= 0; j = _next[j]) {
+				single dx = a.x - _items[j].x;
+				single dy = a.y - _items[j].y;
+				// the partic itself, or one at the same place: no direction
+				if (tabs(dx) + tabs(dy) < con_tol)
+					continue;
+				single dd = dx*dx + dy*dy;
+				single g = G * a.m * _items[j].m / (dd > min_dd ? dd : min_dd);
+				single d = sqrt(dd);
+				fx += dx/d*g;
+				fy += dy/d*g;
+			}
+			continue;
+		}
+		if (n.m <= 0)
+			continue;
+		single dx = a.x - n.mx/n.m;
+		single dy = a.y - n.my/n.m;
+		single dd = dx*dx + dy*dy;
+		if (4*n.half*n.half < theta*theta*dd) {
+			single g = G * a.m * n.m / (dd > min_dd ? dd : min_dd);
+			single d = sqrt(dd);
+			fx += dx/d*g;
+			fy += dy/d*g;
+		} else {
+			for (int q = 0; q < 4; ++q)
+				if (n.child[q] >= 0)
+					_stack.push_back(n.child[q]);
+		}
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __QUADTREE_H__
+#define __QUADTREE_H__
+
+#include "utils.h"
+#include "partic.h"
+
+#include <vector>
+
+/* Barnes-Hut quad tree over the plane positions of the partics.
+ * A cell far enough from a partic acts on it as one mass placed at the
+ * cell's center of mass, so the repulsion of the whole scene costs
+ * O(n log n) instead of O(n^2). */
+class quadtree_t {
+public:
+	/* A cell is treated as a single mass when its size divided by the
+	 * distance to its center of mass is below this value. */
+	static const single theta;
+
+	quadtree_t() {}
+	void build(std::vector<partic_t *> & partics);
+	/* Sum of G*m*mi/max(d^2, min_dd) over all partics, pointing away
+	 * from them. Returns the x and y components. */
+	void repulsion(size_t i, single G, single min_dd, single & fx, single & fy);
+private:
+	static const int max_depth = 24;
+	struct node_t {
+		single cx, cy;	// center of the cell
+		single half;	// half of the cell size
+		single m;		// total mass
+		single mx, my;	// mass weighted sum of the positions
+		int child[4];
+		int first;		// partics of a leaf, linked through _next
+		bool leaf;
+	};
+	struct item_t {
+		single x, y, m;
+	};
+	std::vector<node_t> _nodes;
+	std::vector<item_t> _items;
+	std::vector<int> _next;
+	std::vector<int> _stack;
+
+	int new_node(single cx, single cy, single half);
+	int get_child(int n, single x, single y);
+	void insert(int n, int i, int depth);
+};
+
+#endif //__QUADTREE_H__
@@ -0,0 +1,549 @@
+/*
+ * Copyright 2011 kubtek <kubtek@mail.com>
+ *
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stardict_xdxf2pango.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+static const char* const xml_entrs[] = {
+	"lt;", "gt;", "amp;", "apos;", "quot;", 0
+};
+static const int xml_ent_len[] = {
+	3,     3,     4,      5,       5
+};
+static const char raw_entrs[] = {
+	'<',   '>',   '&',    '\'',    '\"',    0
+};
+
+/* q points to '&'. Return the index of the entity in xml_entrs,
+ * -1 if the sequence is not recognized. */
+static inline int xml_entity(const char *q)
+{
+	switch (q[1]) {
+	case 'l':
+		return q[2] == 't' && q[3] == ';' ? 0 : -1;
+	case 'g':
+		return q[2] == 't' && q[3] == ';' ? 1 : -1;
+	case 'a':
+		if (strncmp(q + 1, xml_entrs[2], xml_ent_len[2]) == 0)
+			return 2;
+		return strncmp(q + 1, xml_entrs[3], xml_ent_len[3]) == 0 ? 3 : -1;
+	case 'q':
+		return strncmp(q + 1, xml_entrs[4], xml_ent_len[4]) == 0 ? 4 : -1;
+	default:
+		return -1;
+	}
+}
+
+/* Skip one character of the text, an entity is one character as well.
+ * Unlike g_utf8_next_char, it never skips the terminating '\0'. */
+static inline const char *xml_next_char(const char *q)
+{
+	if (*q == '&') {
+		const int ient = xml_entity(q);
+		return q + (ient < 0 ? 1 : xml_ent_len[ient] + 1);
+	}
+	++q;
+	while ((*q & 0xC0) == 0x80)
+		++q;
+	return q;
+}
+
+/* for the checks of eight bytes at a time */
+static const guint64 ONES = G_GUINT64_CONSTANT(0x0101010101010101);
+static const guint64 HIGHS = G_GUINT64_CONSTANT(0x8080808080808080);
+
+/* Whether one of the bytes of w is c. */
+static inline bool has_byte(guint64 w, char c)
+{
+	const guint64 v = w ^ (ONES * guchar(c));
+	return ((v - ONES) & ~v & HIGHS) != 0;
+}
+
+/* Skip the text up to the first '<' or '&' in [q, e), add the number of
+ * utf-8 characters skipped to n. Eight bytes are checked at a time,
+ * the continuation bytes 10xxxxxx are not counted. */
+static inline const char *skip_text(const char *q, const char *e, size_t& n)
+{
+	while (e - q >= 8) {
+		guint64 w;
+		memcpy(&w, q, sizeof(w));
+		if (has_byte(w, '<') || has_byte(w, '&'))
+			break;
+		const guint64 cont = w & ~(w << 1) & HIGHS;
+		n += 8 - (((cont >> 7) * ONES) >> 56);
+		q += 8;
+	}
+	for (; q < e && *q != '<' && *q != '&'; ++q)
+		n += (*q & 0xC0) != 0x80;
+	return q;
+}
+
+/* Number of characters of the markup in [b, e), tags are not counted. */
+static size_t xml_strlen(const char *b, const char *e)
+{
+	size_t cur_pos = 0;
+	for (const char *q = b; q < e; ) {
+		if (*q == '<') {
+			const char *t = static_cast<const char *>(memchr(q + 1, '>', e - q - 1));
+			q = t ? t + 1 : q + 1;
+		} else {
+			q = xml_next_char(q);
+			++cur_pos;
+		}
+	}
+	return cur_pos;
+}
+
+/* Append [b, e) to decoded replacing entities with characters. */
+static void xml_decode(const char *b, const char *e, std::string& decoded)
+{
+	for (const char *amp; b < e; b = amp) {
+		amp = static_cast<const char *>(memchr(b, '&', e - b));
+		if (!amp) {
+			decoded.append(b, e);
+			return;
+		}
+		decoded.append(b, amp);
+		const int ient = xml_entity(amp);
+		if (ient < 0) {
+			// unrecognized sequence
+			decoded += *amp++;
+		} else {
+			decoded += raw_entrs[ient];
+			amp += xml_ent_len[ient] + 1;
+		}
+	}
+}
+
+static std::string print_pango_color(guint32 c)
+{
+	char buf[8]; // #001122
+	gint n = g_snprintf(buf, sizeof(buf), "#%06x", c & 0xffffff);
+	if(n != sizeof(buf)-1)
+		return "";
+	else
+		return buf;
+}
+
+
+/* Tags the parser handles, see lookup_tag. */
+enum XDXFTag {
+	TAG_UNKNOWN,
+	TAG_ABR,
+	TAG_B,
+	TAG_I,
+	TAG_SUB,
+	TAG_SUP,
+	TAG_TT,
+	TAG_BIG,
+	TAG_SMALL,
+	TAG_TR,
+	TAG_EX,
+	TAG_C,
+	TAG_K,
+	TAG_RREF,
+	TAG_KREF,
+	TAG_IREF,
+	TAG_BLOCKQUOTE,
+	TAG_COUNT
+};
+
+/* name, len - the tag name without '<', '/' and attributes.
+ * The name length and its first character select a single candidate,
+ * so at most one comparison is done. */
+static XDXFTag lookup_tag(const char *name, size_t len)
+{
+	switch (len) {
+	case 1:
+		switch (name[0]) {
+		case 'b': return TAG_B;
+		case 'i': return TAG_I;
+		case 'c': return TAG_C;
+		case 'k': return TAG_K;
+		}
+		break;
+	case 2:
+		if (name[0] == 't') {
+			if (name[1] == 'r') return TAG_TR;
+			if (name[1] == 't') return TAG_TT;
+		} else if (name[0] == 'e' && name[1] == 'x')
+			return TAG_EX;
+		break;
+	case 3:
+		switch (name[0]) {
+		case 'a': return strncmp(name, "abr", 3) == 0 ? TAG_ABR : TAG_UNKNOWN;
+		case 'b': return strncmp(name, "big", 3) == 0 ? TAG_BIG : TAG_UNKNOWN;
+		case 's':
+			if (name[1] == 'u') {
+				if (name[2] == 'b') return TAG_SUB;
+				if (name[2] == 'p') return TAG_SUP;
+			}
+			break;
+		}
+		break;
+	case 4:
+		if (strncmp(name + 1, "ref", 3) == 0) {
+			switch (name[0]) {
+			case 'r': return TAG_RREF;
+			case 'k': return TAG_KREF;
+			case 'i': return TAG_IREF;
+			}
+		}
+		break;
+	case 5:
+		return strncmp(name, "small", 5) == 0 ? TAG_SMALL : TAG_UNKNOWN;
+	case 10:
+		return strncmp(name, "blockquote", 10) == 0 ? TAG_BLOCKQUOTE : TAG_UNKNOWN;
+	}
+	return TAG_UNKNOWN;
+}
+
+/* Pango markup replacing a tag. Tags with empty replacement are handled
+ * by the parser. */
+struct ReplaceTag {
+	std::string open_;
+	std::string close_;
+	/* characters the replacement adds to the text */
+	int char_len_;
+};
+
+/* Find the attribute attr (including ="), in the tag [b, e).
+ * The value ends with '"' or at the end of the tag. */
+static bool find_attr(const char *b, const char *e, const char *attr,
+	const char *&value_beg, const char *&value_end)
+{
+	const char *attr_end = attr + strlen(attr);
+	const char *a = std::search(b, e, attr, attr_end);
+	if (a == e)
+		return false;
+	value_beg = a + (attr_end - attr);
+	value_end = std::find(value_beg, e, '"');
+	return true;
+}
+
+static bool has_suffix(const char *b, const char *e, const char *suffix)
+{
+	const size_t len = strlen(suffix);
+	return size_t(e - b) >= len && strncmp(e - len, suffix, len) == 0;
+}
+
+/* The type of the resource [b, e) without the type attribute. */
+static const char *resource_type(const char *b, const char *e)
+{
+	if (has_suffix(b, e, ".jpg")
+		|| has_suffix(b, e, ".png")
+		|| has_suffix(b, e, ".bmp"))
+		return "image";
+	if (has_suffix(b, e, ".wav")
+		|| has_suffix(b, e, ".mp3")
+		|| has_suffix(b, e, ".ogg"))
+		return "sound";
+	if (has_suffix(b, e, ".avi")
+		|| has_suffix(b, e, ".mpeg")
+		|| has_suffix(b, e, ".mpg"))
+		return "video";
+	return "attach";
+}
+
+class XDXFParser {
+public:
+	XDXFParser(const char *p, ParseResult &result);
+	static void fill_replace_arr(const ColorScheme& cs);
+private:
+	const char *parse_tag(const char *p);
+	void parse_c(const char *p, const char *next);
+	const char *parse_rref(const char *p, const char *next);
+	const char *parse_ref(const char *p, const char *next, bool is_k_or_i);
+	void add_format(ParseResultItemType type);
+	void flush(bool last = false);
+private:
+	ParseResult& result_;
+	LinksPosList links_list_;
+	std::string res_;
+	std::string::size_type cur_pos_;
+	bool is_first_k_;
+
+	static ReplaceTag replace_arr_[TAG_COUNT];
+	static std::string k_open_;
+	static std::string c_open_;
+	static std::string ref_open_;
+};
+
+ReplaceTag XDXFParser::replace_arr_[TAG_COUNT];
+std::string XDXFParser::k_open_;
+std::string XDXFParser::c_open_;
+std::string XDXFParser::ref_open_;
+
+void XDXFParser::fill_replace_arr(const ColorScheme& cs)
+{
+	for (int i = 0; i < TAG_COUNT; ++i) {
+		replace_arr_[i].open_.clear();
+		replace_arr_[i].close_.clear();
+		replace_arr_[i].char_len_ = 0;
+	}
+	replace_arr_[TAG_ABR].open_ = std::string("<span foreground=\"") + print_pango_color(cs.abr) + "\" style=\"italic\">";
+	replace_arr_[TAG_ABR].close_ = "</span>";
+	replace_arr_[TAG_B].open_ = "<b>";
+	replace_arr_[TAG_B].close_ = "</b>";
+	replace_arr_[TAG_I].open_ = "<i>";
+	replace_arr_[TAG_I].close_ = "</i>";
+	replace_arr_[TAG_SUB].open_ = "<sub>";
+	replace_arr_[TAG_SUB].close_ = "</sub>";
+	replace_arr_[TAG_SUP].open_ = "<sup>";
+	replace_arr_[TAG_SUP].close_ = "</sup>";
+	replace_arr_[TAG_TT].open_ = "<tt>";
+	replace_arr_[TAG_TT].close_ = "</tt>";
+	replace_arr_[TAG_BIG].open_ = "<big>";
+	replace_arr_[TAG_BIG].close_ = "</big>";
+	replace_arr_[TAG_SMALL].open_ = "<small>";
+	replace_arr_[TAG_SMALL].close_ = "</small>";
+	replace_arr_[TAG_TR].open_ = "<b>[";
+	replace_arr_[TAG_TR].close_ = "]</b>";
+	replace_arr_[TAG_TR].char_len_ = 1;
+	replace_arr_[TAG_EX].open_ = std::string("<span foreground=\"") + print_pango_color(cs.ex) + "\">";
+	replace_arr_[TAG_EX].close_ = "</span>";
+	replace_arr_[TAG_C].close_ = "</span>";
+	k_open_ = std::string("<span foreground=\"") + print_pango_color(cs.k) + "\">";
+	c_open_ = std::string("<span foreground=\"") + print_pango_color(cs.c) + "\">";
+	ref_open_ = std::string("<span foreground=\"") + print_pango_color(cs.ref) + "\" underline=\"single\">";
+}
+
+/* The markup is copied to res_ in one pass, text runs are appended
+ * directly from the article. */
+XDXFParser::XDXFParser(const char *p, ParseResult &result) :
+	result_(result),
+	cur_pos_(0),
+	is_first_k_(true)
+{
+	const size_t len = strlen(p);
+	const char *const end = p + len;
+	res_.reserve(len + len / 2);
+	while (p < end) {
+		const char *q = p;
+		while (true) {
+			q = skip_text(q, end, cur_pos_);
+			if (*q != '&')
+				break;
+			/* an entity is one character */
+			const int ient = xml_entity(q);
+			q += ient < 0 ? 1 : xml_ent_len[ient] + 1;
+			++cur_pos_;
+		}
+		res_.append(p, q - p);
+		p = q < end ? parse_tag(q) : q;
+	}
+	flush(true);
+}
+
+/* p points to '<', return the position after the tag */
+const char *XDXFParser::parse_tag(const char *p)
+{
+	const char *name = p + 1;
+	const bool closing = (*name == '/');
+	if (closing)
+		++name;
+	const char *name_end = name;
+	while (g_ascii_isalnum(*name_end))
+		++name_end;
+	const XDXFTag tag = lookup_tag(name, name_end - name);
+	const char delim = *name_end;
+	const ReplaceTag& replace = replace_arr_[tag];
+	if (closing) {
+		if (delim == '>' && !replace.close_.empty()) {
+			res_ += replace.close_;
+			cur_pos_ += replace.char_len_;
+			return name_end + 1;
+		}
+		if (delim == '>' && tag == TAG_BLOCKQUOTE) {
+			add_format(ParseResultItemType_FormatEnd);
+			return name_end + 1;
+		}
+	} else if (delim == '>' && !replace.open_.empty()) {
+		res_ += replace.open_;
+		cur_pos_ += replace.char_len_;
+		return name_end + 1;
+	} else if (delim == '>' && tag == TAG_K) {
+		const char *next = strstr(name_end + 1, "</k>");
+		if (!next)
+			return name_end + 1;
+		if (is_first_k_) {
+			is_first_k_ = false;
+			if (*(next + 4) == '\n')
+				next++;
+		} else {
+			res_ += k_open_;
+			res_.append(name_end + 1, next);
+			cur_pos_ += xml_strlen(name_end + 1, next);
+			res_ += "</span>";
+		}
+		return next + sizeof("</k>") - 1;
+	} else if ((delim == ' ' || delim == '>')
+		&& (tag == TAG_C || tag == TAG_RREF || tag == TAG_KREF
+			|| tag == TAG_IREF || tag == TAG_BLOCKQUOTE)) {
+		const char *next = delim == '>' ? name_end : strchr(name_end, '>');
+		if (!next)
+			return p + 1;
+		switch (tag) {
+		case TAG_C:
+			parse_c(p, next);
+			return next + 1;
+		case TAG_RREF:
+			return parse_rref(p, next);
+		case TAG_KREF:
+		case TAG_IREF:
+			return parse_ref(p, next, tag == TAG_KREF);
+		default:
+			add_format(ParseResultItemType_FormatBeg);
+			return next + 1;
+		}
+	}
+	/* unknown tags are skipped */
+	const char *next = strchr(p + 1, '>');
+	if (!next) {
+		res_ += "&lt;";
+		cur_pos_++;
+		return p + 1;
+	}
+	return next + 1;
+}
+
+/* [p, next) - the tag without '>' */
+void XDXFParser::parse_c(const char *p, const char *next)
+{
+	const char *b, *e;
+	if (find_attr(p + 1, next, "c=\"", b, e)) {
+		char color[64];
+		if (size_t(e - b) < sizeof(color)) {
+			memcpy(color, b, e - b);
+			color[e - b] = '\0';
+		} else
+			color[0] = '\0';
+		if (color[0] && pango_color_parse(NULL, color)) {
+			res_ += "<span foreground=\"";
+			res_.append(b, e);
+			res_ += "\">";
+		} else
+			res_ += "<span>";
+	} else
+		res_ += c_open_;
+}
+
+const char *XDXFParser::parse_rref(const char *p, const char *next)
+{
+	const char *type_b = NULL, *type_e = NULL;
+	find_attr(p + 1, next, "type=\"", type_b, type_e);
+	p = next + 1;
+	next = strstr(p, "</rref>");
+	if (!next)
+		return p;
+	flush();
+	ParseResultItem item;
+	item.type = ParseResultItemType_res;
+	item.res = new ParseResultResItem;
+	if (type_b != type_e)
+		item.res->type.assign(type_b, type_e);
+	else
+		item.res->type = resource_type(p, next);
+	item.res->key.assign(p, next);
+	result_.item_list.push_back(item);
+	return next + sizeof("</rref>") - 1;
+}
+
+/* kref and iref */
+const char *XDXFParser::parse_ref(const char *p, const char *next, bool is_k_or_i)
+{
+	const char *key_b = NULL, *key_e = NULL;
+	find_attr(p + 1, next, is_k_or_i ? "k=\"" : "href=\"", key_b, key_e);
+	p = next + 1;
+	next = strstr(p, is_k_or_i ? "</kref>" : "</iref>");
+	if (!next)
+		return p;
+
+	res_ += ref_open_;
+	const size_t xml_len = xml_strlen(p, next);
+	/* the link is decoded in place, not copied */
+	links_list_.push_back(LinkDesc(cur_pos_, xml_len, is_k_or_i ? "query://" : ""));
+	std::string& link = links_list_.back().link_;
+	if (key_b == key_e)
+		xml_decode(p, next, link);
+	else
+		xml_decode(key_b, key_e, link);
+	res_.append(p, next);
+	cur_pos_ += xml_len;
+	res_ += "</span>";
+	return next + sizeof("</kref>") - 1;
+}
+
+void XDXFParser::add_format(ParseResultItemType type)
+{
+	flush();
+	ParseResultItem item;
+	item.type = type;
+	if (type == ParseResultItemType_FormatBeg) {
+		item.format_beg = new ParseResultFormatBegItem;
+		item.format_beg->type = ParseResultItemFormatType_Indent;
+	} else {
+		item.format_end = new ParseResultFormatEndItem;
+		item.format_end->type = ParseResultItemFormatType_Indent;
+	}
+	result_.item_list.push_back(item);
+}
+
+/* last - the article ends, the buffer is handed over instead of copied */
+void XDXFParser::flush(bool last)
+{
+	if (res_.empty()) {
+		g_assert(cur_pos_ == 0);
+		g_assert(links_list_.empty());
+		return;
+	}
+	ParseResultItem item;
+	if(links_list_.empty()) {
+		item.type = ParseResultItemType_mark;
+		item.mark = new ParseResultMarkItem;
+		if (last)
+			item.mark->pango.swap(res_);
+		else
+			item.mark->pango = res_;
+	} else {
+		item.type = ParseResultItemType_link;
+		item.link = new ParseResultLinkItem;
+		if (last)
+			item.link->pango.swap(res_);
+		else
+			item.link->pango = res_;
+		item.link->links_list.swap(links_list_);
+	}
+	result_.item_list.push_back(item);
+	res_.clear();
+	cur_pos_ = 0;
+	links_list_.clear();
+}
+
+void xdxf_set_color_scheme(const ColorScheme& cs)
+{
+	XDXFParser::fill_replace_arr(cs);
+}
+
+void xdxf2result(const char *p, ParseResult &result)
+{
+	XDXFParser(p, result);
+}
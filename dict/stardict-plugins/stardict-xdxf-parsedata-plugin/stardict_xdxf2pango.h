@@ -0,0 +1,40 @@
+/*
+ * Copyright 2011 kubtek <kubtek@mail.com>
+ *
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_XDXF2PANGO_H_
+#define _STARDICT_XDXF2PANGO_H_
+
+#include <glib.h>
+#include "../../src/lib/parsedata_plugin.h"
+
+struct ColorScheme {
+	guint32 abr;
+	guint32 ex;
+	guint32 k;
+	guint32 c;
+	guint32 ref;
+};
+
+/* Build the pango markup of the colored tags, call it before xdxf2result
+ * and every time the colors change. */
+extern void xdxf_set_color_scheme(const ColorScheme& cs);
+/* Append the items of the XDXF article p, without the leading 'x', to result. */
+extern void xdxf2result(const char *p, ParseResult &result);
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <zlib.h>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "synth_dict.h"
+
+/* the chunk length dictzip uses, a compressed chunk always fits in 16 bits */
+static const size_t DICTZIP_CHUNK_LENGTH = 58315;
+
+static bool stardict_less(const std::string& a, const std::string& b)
+{
+	return stardict_strcmp(a.c_str(), b.c_str()) < 0;
+}
+
+static bool synonym_less(const std::pair<std::string, guint32>& a,
+	const std::pair<std::string, guint32>& b)
+{
+	return stardict_less(a.first, b.first);
+}
+
+static void append_uint32(std::string& str, guint32 val)
+{
+	guint32 val_be = g_htonl(val);
+	str.append(reinterpret_cast<const char *>(&val_be), sizeof(guint32));
+}
+
+static void append_uint16_le(std::string& str, guint16 val)
+{
+	str += char(val & 0xff);
+	str += char(val >> 8);
+}
+
+static void append_uint32_le(std::string& str, guint32 val)
+{
+	append_uint16_le(str, guint16(val & 0xffff));
+	append_uint16_le(str, guint16(val >> 16));
+}
+
+static std::string random_latin(GRand *rand, gint minlen, gint maxlen)
+{
+	std::string word;
+	gint len = g_rand_int_range(rand, minlen, maxlen+1);
+	for (gint i=0; i<len; ++i)
+		word += char('a' + g_rand_int_range(rand, 0, 26));
+	return word;
+}
+
+static std::string random_utf8(GRand *rand, gint minlen, gint maxlen)
+{
+	std::string word;
+	gint len = g_rand_int_range(rand, minlen, maxlen+1);
+	/* one script per word, like in real dictionaries */
+	bool cjk = g_rand_int_range(rand, 0, 4) == 0;
+	for (gint i=0; i<len; ++i) {
+		gunichar ch;
+		if (cjk)
+			ch = 0x4E00 + g_rand_int_range(rand, 0, 0x500);
+		else
+			ch = 0x0430 + g_rand_int_range(rand, 0, 32);
+		gchar buf[6];
+		word.append(buf, g_unichar_to_utf8(ch, buf));
+	}
+	return word;
+}
+
+static std::string random_key(GRand *rand, SynthKeyType keys,
+	const std::vector<std::string>& stems)
+{
+	switch (keys) {
+	case SynthKeyType_PREFIX:
+		return stems[g_rand_int_range(rand, 0, stems.size())]
+			+ random_latin(rand, 1, 6);
+	case SynthKeyType_UTF8:
+		return random_utf8(rand, 2, 8);
+	case SynthKeyType_RANDOM:
+	default:
+		if (g_rand_int_range(rand, 0, 10) == 0)
+			return random_latin(rand, 2, 8) + " " + random_latin(rand, 2, 8);
+		return random_latin(rand, 3, 12);
+	}
+}
+
+static void make_words(GRand *rand, const SynthDictOptions& options,
+	std::vector<std::string>& words)
+{
+	std::vector<std::string> stems;
+	if (options.keys == SynthKeyType_PREFIX) {
+		glong nstems = 1;
+		while (nstems * nstems < options.wordcount)
+			++nstems;
+		for (glong i=0; i<nstems; ++i)
+			stems.push_back(random_latin(rand, 3, 6));
+	}
+	std::set<std::string> unique;
+	/* the key space may be too small for the requested count */
+	glong attempts = options.wordcount * 20 + 100;
+	while (glong(unique.size()) < options.wordcount && attempts-- > 0)
+		unique.insert(random_key(rand, options.keys, stems));
+	words.assign(unique.begin(), unique.end());
+	std::sort(words.begin(), words.end(), stardict_less);
+}
+
+/* Articles are made of the words of the dictionary so that full-text
+ * search finds something. */
+static std::string make_article(GRand *rand, const SynthDictOptions& options,
+	const std::vector<std::string>& words, const std::vector<std::string>& resources)
+{
+	std::string article;
+	glong len = g_rand_int_range(rand, options.article_length/2,
+		options.article_length*3/2 + 1);
+	if (!resources.empty() && g_rand_int_range(rand, 0, 8) == 0)
+		article += resources[g_rand_int_range(rand, 0, resources.size())] + '\n';
+	while (glong(article.length()) < len) {
+		if (!article.empty())
+			article += g_rand_int_range(rand, 0, 12) == 0 ? ".\n" : " ";
+		article += words[g_rand_int_range(rand, 0, words.size())];
+	}
+	return article;
+}
+
+static bool write_file(SynthDict& dict, const std::string& filename, const std::string& data)
+{
+	dict.files.push_back(filename);
+	if (!g_file_set_contents(filename.c_str(), data.data(), data.length(), NULL)) {
+		std::cerr << "unable to write " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool write_gzip_file(SynthDict& dict, const std::string& filename, const std::string& data)
+{
+	dict.files.push_back(filename);
+	gzFile out = gzopen(filename.c_str(), "wb9");
+	if (!out) {
+		std::cerr << "unable to write " << filename << std::endl;
+		return false;
+	}
+	bool ok = data.empty() || gzwrite(out, data.data(), data.length()) == int(data.length());
+	if (gzclose(out) != Z_OK)
+		ok = false;
+	if (!ok)
+		std::cerr << "unable to write " << filename << std::endl;
+	return ok;
+}
+
+/* Every chunk ends with a full flush, so it can be inflated on its own,
+ * its compressed size goes to the random access table of the header. */
+static bool write_dictzip_file(SynthDict& dict, const std::string& filename, const std::string& data)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+		Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	std::vector<Bytef> buffer(deflateBound(&zs, DICTZIP_CHUNK_LENGTH) + 64);
+	std::vector<guint16> chunk_sizes;
+	std::string body;
+	size_t pos = 0;
+	bool ok = true;
+	do {
+		size_t size = std::min(DICTZIP_CHUNK_LENGTH, data.length() - pos);
+		bool last = pos + size == data.length();
+		zs.next_in = (Bytef *)(data.data() + pos);
+		zs.avail_in = size;
+		zs.next_out = &buffer[0];
+		zs.avail_out = buffer.size();
+		int res = deflate(&zs, last ? Z_FINISH : Z_FULL_FLUSH);
+		size_t out_size = buffer.size() - zs.avail_out;
+		if ((last ? res != Z_STREAM_END : res != Z_OK) || zs.avail_in != 0 || out_size > 0xffff) {
+			ok = false;
+			break;
+		}
+		chunk_sizes.push_back(guint16(out_size));
+		body.append(reinterpret_cast<const char *>(&buffer[0]), out_size);
+		pos += size;
+	} while (pos < data.length());
+	deflateEnd(&zs);
+	/* the extra field must fit in 16 bits */
+	if (!ok || 10 + 2*chunk_sizes.size() > 0xffff) {
+		std::cerr << "unable to compress " << filename << std::endl;
+		return false;
+	}
+	std::string out;
+	out += char(0x1f);
+	out += char(0x8b);
+	out += char(Z_DEFLATED);
+	out += char(0x04); // FEXTRA
+	append_uint32_le(out, 0); // mtime, 0 keeps the output reproducible
+	out += char(2); // maximum compression
+	out += char(3); // unix
+	append_uint16_le(out, guint16(10 + 2*chunk_sizes.size()));
+	out += 'R';
+	out += 'A';
+	append_uint16_le(out, guint16(6 + 2*chunk_sizes.size()));
+	append_uint16_le(out, 1); // version
+	append_uint16_le(out, guint16(DICTZIP_CHUNK_LENGTH));
+	append_uint16_le(out, guint16(chunk_sizes.size()));
+	for (size_t i=0; i<chunk_sizes.size(); ++i)
+		append_uint16_le(out, chunk_sizes[i]);
+	out += body;
+	append_uint32_le(out, crc32(crc32(0, NULL, 0), (const Bytef *)data.data(), data.length()));
+	append_uint32_le(out, guint32(data.length()));
+	return write_file(dict, filename, out);
+}
+
+static bool write_resources(GRand *rand, const std::string& dirname,
+	const SynthDictOptions& options, SynthDict& dict)
+{
+	std::vector<std::string> keys(dict.resources);
+	std::sort(keys.begin(), keys.end());
+	std::string ridx, rdic;
+	for (size_t i=0; i<keys.size(); ++i) {
+		gint size = g_rand_int_range(rand, 256, 4096+1);
+		ridx.append(keys[i].c_str(), keys[i].length()+1);
+		append_uint32(ridx, rdic.length());
+		append_uint32(ridx, size);
+		for (gint j=0; j<size; ++j)
+			rdic += char(g_rand_int_range(rand, 0, 256));
+	}
+	std::stringstream rifo;
+	rifo << "StarDict's storage ifo file\n"
+		<< "version=3.0.0\n"
+		<< "filecount=" << keys.size() << '\n'
+		<< "ridxfilesize=" << ridx.length() << '\n';
+	const std::string basename = build_path(dirname, "res");
+	if (!write_file(dict, basename + ".rifo", rifo.str())
+		|| !write_file(dict, basename + ".ridx", ridx))
+		return false;
+	if (options.dictzip)
+		return write_dictzip_file(dict, basename + ".rdic.dz", rdic);
+	return write_file(dict, basename + ".rdic", rdic);
+}
+
+bool synth_dict_create(const std::string& dirname, const std::string& bookname,
+	const SynthDictOptions& options, SynthDict& dict)
+{
+	GRand *rand = g_rand_new_with_seed(options.seed);
+	make_words(rand, options, dict.words);
+	if (dict.words.empty()) {
+		g_rand_free(rand);
+		return false;
+	}
+	for (glong i=0; i<options.resources; ++i) {
+		gchar *key = g_strdup_printf("img/%06ld.png", i);
+		dict.resources.push_back(key);
+		g_free(key);
+	}
+
+	std::string idx, data;
+	for (size_t i=0; i<dict.words.size(); ++i) {
+		const std::string& word = dict.words[i];
+		const std::string article = make_article(rand, options, dict.words, dict.resources);
+		idx.append(word.c_str(), word.length()+1);
+		append_uint32(idx, data.length());
+		append_uint32(idx, article.length());
+		data += article;
+	}
+
+	/* a synonym refers to the index of its word */
+	std::vector<std::pair<std::string, guint32> > syns;
+	if (options.synonyms) {
+		for (size_t i=0; i<dict.words.size(); i+=4)
+			syns.push_back(std::make_pair(dict.words[i] + "-" + random_latin(rand, 2, 4), guint32(i)));
+		std::sort(syns.begin(), syns.end(), synonym_less);
+	}
+	std::string syn;
+	for (size_t i=0; i<syns.size(); ++i) {
+		dict.synonyms.push_back(syns[i].first);
+		syn.append(syns[i].first.c_str(), syns[i].first.length()+1);
+		append_uint32(syn, syns[i].second);
+	}
+
+	std::stringstream ifo;
+	ifo << "StarDict's dict ifo file\n"
+		<< "version=2.4.2\n"
+		<< "wordcount=" << dict.words.size() << '\n';
+	if (!syns.empty())
+		ifo << "synwordcount=" << syns.size() << '\n';
+	ifo << "idxfilesize=" << idx.length() << '\n'
+		<< "bookname=" << bookname << '\n'
+		<< "sametypesequence=m\n";
+
+	const std::string basename = build_path(dirname, bookname);
+	dict.ifofilename = basename + ".ifo";
+	bool ok = write_file(dict, dict.ifofilename, ifo.str());
+	if (ok)
+		ok = options.idx_gz ? write_gzip_file(dict, basename + ".idx.gz", idx)
+			: write_file(dict, basename + ".idx", idx);
+	if (ok)
+		ok = options.dictzip ? write_dictzip_file(dict, basename + ".dict.dz", data)
+			: write_file(dict, basename + ".dict", data);
+	if (ok && !syns.empty())
+		ok = write_file(dict, basename + ".syn", syn);
+	if (ok && !dict.resources.empty())
+		ok = write_resources(rand, dirname, options, dict);
+	g_rand_free(rand);
+	return ok;
+}
+
+void synth_dict_remove(SynthDict& dict)
+{
+	for (size_t i=0; i<dict.files.size(); ++i)
+		g_remove(dict.files[i].c_str());
+	dict.files.clear();
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Generator of synthetic dictionaries for tests and benchmarks.
+ * The output depends only on the options, the same seed gives the same
+ * files on every platform. */
+
+#ifndef _SYNTH_DICT_H_
+#define _SYNTH_DICT_H_
+
+#include <string>
+#include <vector>
+#include <glib.h>
+
+enum SynthKeyType {
+	/* random latin words, a few of them are two words phrases */
+	SynthKeyType_RANDOM,
+	/* few stems with many suffixes, long common prefixes */
+	SynthKeyType_PREFIX,
+	/* cyrillic and CJK words */
+	SynthKeyType_UTF8,
+};
+
+struct SynthDictOptions {
+	guint32 seed;
+	glong wordcount;
+	SynthKeyType keys;
+	/* average length of an article in bytes, articles are 1/2 to 3/2 of it */
+	glong article_length;
+	/* write .dict.dz instead of .dict, and .rdic.dz instead of .rdic */
+	bool dictzip;
+	/* write .idx.gz instead of .idx */
+	bool idx_gz;
+	/* write .syn with a synonym for every 4th word */
+	bool synonyms;
+	/* number of files in the resource database, 0 - no resources */
+	glong resources;
+
+	SynthDictOptions()
+	:
+		seed(1),
+		wordcount(10000),
+		keys(SynthKeyType_RANDOM),
+		article_length(200),
+		dictzip(false),
+		idx_gz(false),
+		synonyms(false),
+		resources(0)
+	{
+	}
+};
+
+struct SynthDict {
+	std::string ifofilename;
+	/* in the order of the index */
+	std::vector<std::string> words;
+	std::vector<std::string> synonyms;
+	std::vector<std::string> resources;
+	/* all created files */
+	std::vector<std::string> files;
+};
+
+/* Create dictionary bookname in dirname. */
+bool synth_dict_create(const std::string& dirname, const std::string& bookname,
+	const SynthDictOptions& options, SynthDict& dict);
+void synth_dict_remove(SynthDict& dict);
+
+#endif
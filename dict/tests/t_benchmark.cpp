@@ -0,0 +1,471 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Lookup benchmark over a generated dictionary.
+ *
+ * The dictionary and the queries depend only on the options, so runs with
+ * the same options are comparable. Every benchmark prints one JSON object
+ * per line to stdout:
+ * {"benchmark":"exact","ops":10000,"found":10000,"seconds":0.0123,
+ *  "ops_per_sec":813008.1,"p50_us":1.1,"p99_us":3.4,"max_us":20.1}
+ * The first line describes the dictionary. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "stddict.h"
+#include "synth_dict.h"
+#include "test_dict.h"
+
+static TestAppDirs g_test_app_dirs;
+
+/* as many words as the main window lists */
+static const int LIST_WORD_COUNT = 30;
+static const gint FUZZY_RESULT_COUNT = 100;
+
+struct BenchContext {
+	Libs *libs;
+	std::vector<InstantDictIndex> dictmask;
+};
+
+typedef bool (*bench_func_t)(BenchContext& ctx, const std::string& query);
+typedef std::string (*query_func_t)(GRand *rand, const SynthDict& dict, size_t iword);
+
+struct BenchInfo {
+	const char *name;
+	bench_func_t func;
+	query_func_t query;
+	/* uses --slow-iterations */
+	bool slow;
+};
+
+static gint64 get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return gint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/* first nchars characters of an UTF-8 string */
+static std::string utf8_head(const std::string& str, glong nchars)
+{
+	if (g_utf8_strlen(str.c_str(), -1) <= nchars)
+		return str;
+	const gchar *end = g_utf8_offset_to_pointer(str.c_str(), nchars);
+	return std::string(str.c_str(), end);
+}
+
+static std::string utf8_last(const std::string& str)
+{
+	if (str.empty())
+		return str;
+	return g_utf8_find_prev_char(str.c_str(), str.c_str() + str.length());
+}
+
+static std::string query_word(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	return dict.words[iword];
+}
+
+static std::string query_synonym(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	return dict.synonyms[iword % dict.synonyms.size()];
+}
+
+/* what the user has typed so far */
+static std::string query_prefix(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	return utf8_head(dict.words[iword], g_rand_int_range(rand, 1, 4));
+}
+
+/* a typo: one character replaced */
+static std::string query_typo(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	const std::string& word = dict.words[iword];
+	glong len = g_utf8_strlen(word.c_str(), -1);
+	glong pos = g_rand_int_range(rand, 0, len);
+	const gchar *begin = g_utf8_offset_to_pointer(word.c_str(), pos);
+	const gchar *end = g_utf8_next_char(begin);
+	std::string typo(word.c_str(), begin);
+	typo += *begin == 'q' ? 'x' : 'q';
+	typo += end;
+	return typo;
+}
+
+/* the first two characters and the last one, the middle is left to the
+ * wildcard; short words keep at least their last character apart */
+static void split_pattern(const std::string& word, std::string& head, std::string& last)
+{
+	last = utf8_last(word);
+	head = utf8_head(word.substr(0, word.length() - last.length()), 2);
+}
+
+static std::string query_glob(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	std::string head, last;
+	split_pattern(dict.words[iword], head, last);
+	return head + "*" + last;
+}
+
+static std::string query_regex(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	std::string head, last;
+	split_pattern(dict.words[iword], head, last);
+	gchar *ehead = g_regex_escape_string(head.c_str(), -1);
+	gchar *elast = g_regex_escape_string(last.c_str(), -1);
+	std::string regex = std::string("^") + ehead + ".*" + elast + "$";
+	g_free(ehead);
+	g_free(elast);
+	return regex;
+}
+
+static std::string query_resource(GRand *rand, const SynthDict& dict, size_t iword)
+{
+	return dict.resources[iword % dict.resources.size()];
+}
+
+static bool bench_exact(BenchContext& ctx, const std::string& query)
+{
+	glong idx, idx_suggest;
+	if (!ctx.libs->LookupWord(query.c_str(), idx, idx_suggest, 0, 0))
+		return false;
+	return ctx.libs->poGetOrigWordData(idx, 0) != NULL;
+}
+
+static bool bench_synonym(BenchContext& ctx, const std::string& query)
+{
+	glong synidx, synidx_suggest;
+	if (!ctx.libs->LookupSynonymWord(query.c_str(), synidx, synidx_suggest, 0, 0))
+		return false;
+	return ctx.libs->poGetOrigWordData(ctx.libs->poGetOrigSynonymWordIdx(synidx, 0), 0) != NULL;
+}
+
+/* the word list of the main window while the user is typing */
+static bool bench_prefix(BenchContext& ctx, const std::string& query)
+{
+	std::vector<CurrentIndex> current(ctx.dictmask.size());
+	for (size_t i=0; i<ctx.dictmask.size(); ++i) {
+		size_t iLib = ctx.dictmask[i].index;
+		ctx.libs->LookupWord(query.c_str(), current[i].idx, current[i].idx_suggest, iLib, 0);
+		ctx.libs->LookupSynonymWord(query.c_str(), current[i].synidx, current[i].synidx_suggest, iLib, 0);
+	}
+	if (!ctx.libs->GetSuggestWord(query.c_str(), &current[0], ctx.dictmask, 0))
+		return false;
+	const gchar *word = ctx.libs->poGetCurrentWord(&current[0], ctx.dictmask, 0);
+	for (int i=1; word && i<LIST_WORD_COUNT; ++i)
+		word = ctx.libs->poGetNextWord(NULL, &current[0], ctx.dictmask, 0);
+	return true;
+}
+
+static bool bench_fuzzy(BenchContext& ctx, const std::string& query)
+{
+	gchar *reslist[FUZZY_RESULT_COUNT];
+	bool found = ctx.libs->LookupWithFuzzy(query.c_str(), reslist, FUZZY_RESULT_COUNT, ctx.dictmask);
+	std::for_each(reslist, reslist+FUZZY_RESULT_COUNT, g_free);
+	return found;
+}
+
+static bool bench_glob(BenchContext& ctx, const std::string& query)
+{
+	std::vector<gchar *> reslist(MAX_MATCH_ITEM_PER_LIB*2 * (ctx.dictmask.size()+1));
+	gint count = ctx.libs->LookupWithRule(query.c_str(), &reslist[0], ctx.dictmask);
+	std::for_each(reslist.begin(), reslist.begin()+count, g_free);
+	return count > 0;
+}
+
+static bool bench_regex(BenchContext& ctx, const std::string& query)
+{
+	std::vector<gchar *> reslist(MAX_MATCH_ITEM_PER_LIB*2 * (ctx.dictmask.size()+1));
+	gint count = ctx.libs->LookupWithRegex(query.c_str(), &reslist[0], ctx.dictmask);
+	std::for_each(reslist.begin(), reslist.begin()+count, g_free);
+	return count > 0;
+}
+
+static bool bench_fulltext(BenchContext& ctx, const std::string& query)
+{
+	std::vector<std::vector<gchar *> > reslist(ctx.dictmask.size());
+	bool found = ctx.libs->LookupData(query.c_str(), &reslist[0], NULL, NULL, NULL, ctx.dictmask);
+	for (size_t i=0; i<reslist.size(); ++i)
+		std::for_each(reslist[i].begin(), reslist[i].end(), g_free);
+	return found;
+}
+
+static bool bench_resource(BenchContext& ctx, const std::string& query)
+{
+	return ctx.libs->GetStorageFileContent(0, query) != NULL;
+}
+
+static const BenchInfo benchmarks[] = {
+	{ "exact", bench_exact, query_word, false },
+	{ "synonym", bench_synonym, query_synonym, false },
+	{ "prefix", bench_prefix, query_prefix, false },
+	{ "fuzzy", bench_fuzzy, query_typo, true },
+	{ "glob", bench_glob, query_glob, true },
+	{ "regex", bench_regex, query_regex, true },
+	{ "fulltext", bench_fulltext, query_word, true },
+	{ "resource", bench_resource, query_resource, false },
+};
+
+/* Index of the word to query. Zipf distribution makes a few words much
+ * more popular than the others, like in real use. */
+class WordPicker {
+public:
+	WordPicker(size_t nwords, bool zipf)
+	{
+		if (!zipf)
+			return;
+		cdf.resize(nwords);
+		double sum = 0;
+		for (size_t i=0; i<nwords; ++i)
+			cdf[i] = (sum += 1.0 / (i + 1));
+		for (size_t i=0; i<nwords; ++i)
+			cdf[i] /= sum;
+	}
+	size_t pick(GRand *rand, size_t nwords) const
+	{
+		if (cdf.empty())
+			return g_rand_int_range(rand, 0, nwords);
+		size_t i = std::lower_bound(cdf.begin(), cdf.end(), g_rand_double(rand)) - cdf.begin();
+		/* the popular words are spread over the index */
+		return (i * 2654435761U) % nwords;
+	}
+private:
+	std::vector<double> cdf;
+};
+
+static double percentile(const std::vector<double>& sorted, int p)
+{
+	if (sorted.empty())
+		return 0;
+	return sorted[(sorted.size() - 1) * p / 100];
+}
+
+static void print_result(const char *name, glong found, std::vector<double>& times_us)
+{
+	std::sort(times_us.begin(), times_us.end());
+	double total_us = 0;
+	for (size_t i=0; i<times_us.size(); ++i)
+		total_us += times_us[i];
+	std::stringstream line;
+	line << "{\"benchmark\":\"" << name << "\""
+		<< ",\"ops\":" << times_us.size()
+		<< ",\"found\":" << found
+		<< ",\"seconds\":" << total_us / 1e6
+		<< ",\"ops_per_sec\":" << (total_us > 0 ? times_us.size() * 1e6 / total_us : 0)
+		<< ",\"p50_us\":" << percentile(times_us, 50)
+		<< ",\"p99_us\":" << percentile(times_us, 99)
+		<< ",\"max_us\":" << (times_us.empty() ? 0 : times_us.back())
+		<< "}";
+	std::cout << line.str() << std::endl;
+}
+
+static void run_benchmark(BenchContext& ctx, const BenchInfo& info, const SynthDict& dict,
+	const WordPicker& picker, guint32 seed, gint iterations)
+{
+	/* the same queries whatever benchmarks are selected */
+	GRand *rand = g_rand_new_with_seed(seed ^ g_str_hash(info.name));
+	std::vector<std::string> queries(iterations);
+	for (gint i=0; i<iterations; ++i)
+		queries[i] = info.query(rand, dict, picker.pick(rand, dict.words.size()));
+	g_rand_free(rand);
+
+	/* warm up the caches */
+	for (gint i=0; i<iterations/10 && i<100; ++i)
+		info.func(ctx, queries[i]);
+
+	std::vector<double> times_us(iterations);
+	glong found = 0;
+	for (gint i=0; i<iterations; ++i) {
+		gint64 start = get_time_ns();
+		if (info.func(ctx, queries[i]))
+			++found;
+		times_us[i] = (get_time_ns() - start) / 1e3;
+	}
+	print_result(info.name, found, times_us);
+}
+
+static bool parse_key_type(const gchar *str, SynthKeyType& keys)
+{
+	if (strcmp(str, "random") == 0)
+		keys = SynthKeyType_RANDOM;
+	else if (strcmp(str, "prefix") == 0)
+		keys = SynthKeyType_PREFIX;
+	else if (strcmp(str, "utf8") == 0)
+		keys = SynthKeyType_UTF8;
+	else
+		return false;
+	return true;
+}
+
+static bool is_selected(const gchar *list, const char *name)
+{
+	if (!list)
+		return true;
+	gchar **names = g_strsplit(list, ",", -1);
+	bool found = false;
+	for (gchar **p = names; *p && !found; ++p)
+		found = strcmp(*p, name) == 0;
+	g_strfreev(names);
+	return found;
+}
+
+int main(int argc, char *argv[])
+{
+	gint seed = 1;
+	gint words = 100000;
+	gchar *keys = NULL;
+	gint article_length = 200;
+	gboolean dictzip = FALSE;
+	gboolean idx_gz = FALSE;
+	gboolean synonyms = FALSE;
+	gint resources = 1000;
+	gboolean zipf = FALSE;
+	gint iterations = 10000;
+	gint slow_iterations = 20;
+	gchar *bench_list = NULL;
+	gchar *keep_dir = NULL;
+	gboolean generate_only = FALSE;
+	const GOptionEntry entries[] = {
+		{ "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed of the dictionary and the queries", "N" },
+		{ "words", 0, 0, G_OPTION_ARG_INT, &words, "Number of words", "N" },
+		{ "keys", 0, 0, G_OPTION_ARG_STRING, &keys, "Kind of words: random, prefix or utf8", "KIND" },
+		{ "article-length", 0, 0, G_OPTION_ARG_INT, &article_length, "Average article length in bytes", "N" },
+		{ "dictzip", 0, 0, G_OPTION_ARG_NONE, &dictzip, "Compress the data with dictzip", NULL },
+		{ "idx-gz", 0, 0, G_OPTION_ARG_NONE, &idx_gz, "Compress the index with gzip", NULL },
+		{ "synonyms", 0, 0, G_OPTION_ARG_NONE, &synonyms, "Add a synonym file", NULL },
+		{ "resources", 0, 0, G_OPTION_ARG_INT, &resources, "Number of files in the resource database", "N" },
+		{ "zipf", 0, 0, G_OPTION_ARG_NONE, &zipf, "Query popular words more often", NULL },
+		{ "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Queries of the fast benchmarks", "N" },
+		{ "slow-iterations", 0, 0, G_OPTION_ARG_INT, &slow_iterations, "Queries of fuzzy, glob, regex and full-text benchmarks", "N" },
+		{ "bench", 0, 0, G_OPTION_ARG_STRING, &bench_list, "Comma separated benchmarks to run, all by default", "LIST" },
+		{ "keep", 0, 0, G_OPTION_ARG_FILENAME, &keep_dir, "Create the dictionary in DIR and keep it", "DIR" },
+		{ "generate-only", 0, 0, G_OPTION_ARG_NONE, &generate_only, "Only create the dictionary, use with --keep", NULL },
+		{ NULL },
+	};
+	GOptionContext *context = g_option_context_new("- benchmark dictionary lookups");
+	g_option_context_add_main_entries(context, entries, NULL);
+	GError *error = NULL;
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		std::cerr << error->message << std::endl;
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	SynthDictOptions options;
+	options.seed = seed;
+	options.wordcount = words;
+	options.article_length = article_length;
+	options.dictzip = dictzip;
+	options.idx_gz = idx_gz;
+	options.synonyms = synonyms;
+	options.resources = resources;
+	if (keys && !parse_key_type(keys, options.keys)) {
+		std::cerr << "unknown kind of words: " << keys << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (words <= 0 || article_length <= 0 || resources < 0 || iterations <= 0 || slow_iterations <= 0) {
+		std::cerr << "counts must be positive" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	gchar *dirname;
+	if (keep_dir) {
+		g_mkdir_with_parents(keep_dir, 0755);
+		dirname = g_strdup(keep_dir);
+	} else {
+		dirname = g_dir_make_tmp("t_benchmark_XXXXXX", NULL);
+		if (!dirname) {
+			std::cerr << "unable to create temporary directory" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	SynthDict dict;
+	gint64 start = get_time_ns();
+	bool created = synth_dict_create(dirname, "synth", options, dict);
+	double generate_seconds = (get_time_ns() - start) / 1e9;
+	int ret = EXIT_SUCCESS;
+	if (!created) {
+		std::cerr << "unable to create dictionary" << std::endl;
+		ret = EXIT_FAILURE;
+	} else if (!generate_only) {
+		Libs libs(NULL, false, CollationLevel_NONE, COLLATE_FUNC_NONE);
+		std::list<std::string> load_list;
+		load_list.push_back(dict.ifofilename);
+		start = get_time_ns();
+		libs.load(load_list);
+		double load_seconds = (get_time_ns() - start) / 1e9;
+		if (!libs.has_dict()) {
+			std::cerr << "unable to load dictionary" << std::endl;
+			ret = EXIT_FAILURE;
+		} else {
+			std::cout << "{\"dictionary\":{\"seed\":" << seed
+				<< ",\"words\":" << dict.words.size()
+				<< ",\"keys\":\"" << (keys ? keys : "random") << "\""
+				<< ",\"article_length\":" << article_length
+				<< ",\"dictzip\":" << (dictzip ? "true" : "false")
+				<< ",\"idx_gz\":" << (idx_gz ? "true" : "false")
+				<< ",\"synonyms\":" << dict.synonyms.size()
+				<< ",\"resources\":" << dict.resources.size()
+				<< ",\"queries\":\"" << (zipf ? "zipf" : "uniform") << "\""
+				<< ",\"generate_seconds\":" << generate_seconds
+				<< ",\"load_seconds\":" << load_seconds
+				<< "}}" << std::endl;
+			BenchContext ctx;
+			ctx.libs = &libs;
+			InstantDictIndex instance_dict_index;
+			instance_dict_index.type = InstantDictType_LOCAL;
+			instance_dict_index.index = 0;
+			ctx.dictmask.push_back(instance_dict_index);
+			WordPicker picker(dict.words.size(), zipf);
+			for (size_t i=0; i<G_N_ELEMENTS(benchmarks); ++i) {
+				const BenchInfo& info = benchmarks[i];
+				if (!is_selected(bench_list, info.name))
+					continue;
+				if ((info.query == query_synonym && dict.synonyms.empty())
+					|| (info.query == query_resource && dict.resources.empty()))
+					continue;
+				run_benchmark(ctx, info, dict, picker, seed,
+					info.slow ? slow_iterations : iterations);
+			}
+		}
+	}
+	if (!keep_dir) {
+		synth_dict_remove(dict);
+		g_rmdir(dirname);
+	}
+	g_free(dirname);
+	g_free(keys);
+	g_free(bench_list);
+	g_free(keep_dir);
+	return ret;
+}
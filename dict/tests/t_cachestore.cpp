@@ -0,0 +1,235 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "cachestore.h"
+
+static guint64 file_size(const std::string& filename)
+{
+	stardict_stat_t st;
+	if (g_stat(filename.c_str(), &st) != 0)
+		return 0;
+	return st.st_size;
+}
+
+static bool store_clear(const std::string& storefile)
+{
+	CacheStore store(storefile);
+	return store.clear();
+}
+
+static bool check_data(const guint32 *data, const std::vector<guint32>& expected)
+{
+	return data && memcmp(data, &expected[0], expected.size() * sizeof(guint32)) == 0;
+}
+
+static bool check_store(const std::string& storefile, const std::string& idxfile)
+{
+	CacheStamp stamp;
+	if (!stamp.get(idxfile)) {
+		std::cerr << "unable to stat index" << std::endl;
+		return false;
+	}
+	std::vector<guint32> data(1000);
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = i * 7;
+	const std::string key = "oft:0:" + idxfile;
+	{
+		CacheStore store(storefile);
+		if (store.find(key, stamp, data.size())) {
+			std::cerr << "an entry is found in an empty store" << std::endl;
+			return false;
+		}
+		if (!store.add(key, stamp, &data[0], data.size())) {
+			std::cerr << "unable to add an entry" << std::endl;
+			return false;
+		}
+		/* own records are seen after reopen only */
+		if (store.find(key, stamp, data.size()) || store.get_map_count() != 0) {
+			std::cerr << "the store is mapped again after own record" << std::endl;
+			return false;
+		}
+	}
+	{
+		CacheStore store(storefile);
+		if (!check_data(store.find(key, stamp, data.size()), data)) {
+			std::cerr << "the entry is not found after reopen" << std::endl;
+			return false;
+		}
+		if (store.find(key, stamp, data.size() + 1) || store.find(key + "x", stamp, data.size())) {
+			std::cerr << "an entry with another size or key is found" << std::endl;
+			return false;
+		}
+		CacheStamp newstamp = stamp;
+		++newstamp.size;
+		if (store.find(key, newstamp, data.size())) {
+			std::cerr << "the entry of a changed file is found" << std::endl;
+			return false;
+		}
+		/* A newer entry supersedes the old one, the old data stays valid. */
+		const guint32 *olddata = store.find(key, stamp, data.size());
+		std::vector<guint32> newdata(data.size(), 42);
+		CacheStore other(storefile);
+		other.add(key, newstamp, &newdata[0], newdata.size());
+		if (!check_data(store.find(key, newstamp, newdata.size()), newdata)
+			|| !check_data(olddata, data)) {
+			std::cerr << "the superseding entry is not found" << std::endl;
+			return false;
+		}
+	}
+	/* a record cut short is dropped when the store is opened */
+	const guint64 size = file_size(storefile);
+	FILE *out = g_fopen(storefile.c_str(), "ab");
+	fwrite(&data[0], sizeof(guint32), 10, out);
+	fclose(out);
+	{
+		CacheStore store(storefile);
+		CacheStamp newstamp = stamp;
+		++newstamp.size;
+		if (!store.find(key, newstamp, data.size()) || file_size(storefile) >= size) {
+			std::cerr << "the store is not compacted" << std::endl;
+			return false;
+		}
+		/* superseded records are dropped when they take most of the file */
+		for (int i = 0; i < 100; ++i)
+			store.add(key, stamp, &data[0], data.size());
+	}
+	{
+		CacheStore store(storefile);
+		if (!check_data(store.find(key, stamp, data.size()), data)
+			|| file_size(storefile) > 2 * data.size() * sizeof(guint32)) {
+			std::cerr << "superseded entries are not dropped" << std::endl;
+			return false;
+		}
+		if (!store.clear() || store.find(key, stamp, data.size())) {
+			std::cerr << "the store is not cleared" << std::endl;
+			return false;
+		}
+		if (!store.add(key, stamp, &data[0], data.size())) {
+			std::cerr << "unable to add an entry to the cleared store" << std::endl;
+			return false;
+		}
+	}
+	{
+		CacheStore store(storefile);
+		if (!check_data(store.find(key, stamp, data.size()), data)) {
+			std::cerr << "the entry added to the cleared store is not found" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/* A record whose values were overwritten, for example by a record appended
+ * by another instance at the same time, is dropped. */
+static bool check_data_checksum(const std::string& storefile, const std::string& idxfile)
+{
+	CacheStamp stamp;
+	if (!stamp.get(idxfile))
+		return false;
+	std::vector<guint32> data(2000, 7);
+	const std::string key = "rht:" + idxfile;
+	{
+		CacheStore store(storefile);
+		if (!store.add(key, stamp, &data[0], data.size()))
+			return false;
+	}
+	const guint64 size = file_size(storefile);
+	FILE *out = g_fopen(storefile.c_str(), "r+b");
+	fseek(out, long(size - 100 * sizeof(guint32)), SEEK_SET);
+	const guint32 garbage = 8;
+	fwrite(&garbage, sizeof(garbage), 1, out);
+	fclose(out);
+	CacheStore store(storefile);
+	if (store.find(key, stamp, data.size())) {
+		std::cerr << "an entry with broken data is found" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/* Entries added by another instance are found while the number of mappings
+ * stays bounded, however many times the file grows. */
+static bool check_map_count(const std::string& storefile, const std::string& idxfile)
+{
+	CacheStamp stamp;
+	if (!stamp.get(idxfile))
+		return false;
+	std::vector<guint32> data(100, 1);
+	CacheStore reader(storefile), writer(storefile);
+	size_t found = 0;
+	for (int i = 0; i < 200; ++i) {
+		gchar *key = g_strdup_printf("oft:0:%s.%d", idxfile.c_str(), i);
+		if (reader.find(key, stamp, data.size())) {
+			std::cerr << "an entry is found before it is added" << std::endl;
+			g_free(key);
+			return false;
+		}
+		writer.add(key, stamp, &data[0], data.size());
+		if (reader.find(key, stamp, data.size()))
+			++found;
+		g_free(key);
+		if (reader.get_map_count() > 10 || writer.get_map_count() > 1) {
+			std::cerr << "too many mappings: " << reader.get_map_count() << std::endl;
+			return false;
+		}
+	}
+	if (found < 8) {
+		std::cerr << "entries of another instance are not found" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	gchar *dirname = g_dir_make_tmp("t_cachestore_XXXXXX", NULL);
+	if (!dirname) {
+		std::cerr << "unable to create temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const std::string storefile = build_path(dirname, "cache.db");
+	const std::string idxfile = build_path(dirname, "dict.idx");
+	int ret = EXIT_SUCCESS;
+	if (!g_file_set_contents(idxfile.c_str(), "index", -1, NULL)) {
+		std::cerr << "unable to create index" << std::endl;
+		ret = EXIT_FAILURE;
+	} else if (!check_store(storefile, idxfile)) {
+		ret = EXIT_FAILURE;
+	} else if (!store_clear(storefile) || !check_map_count(storefile, idxfile)) {
+		ret = EXIT_FAILURE;
+	} else if (!store_clear(storefile) || !check_data_checksum(storefile, idxfile)) {
+		ret = EXIT_FAILURE;
+	}
+	g_remove(storefile.c_str());
+	g_remove(idxfile.c_str());
+	g_rmdir(dirname);
+	g_free(dirname);
+	return ret;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Load a dictionary with idxoffsetbits=64 and read its articles.
+ * The second article is stored above 4GB in a sparse .dict file. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "stddict.h"
+#include "test_dict.h"
+
+static TestAppDirs g_test_app_dirs;
+
+static const char *words[] = { "alpha", "beta", NULL };
+static const char *articles[] = { "first article", "second article", NULL };
+static const guint64 offsets[] = { 0, G_GUINT64_CONSTANT(0x100000000) + 16 };
+
+static bool create_dict(const std::string& basename)
+{
+	std::string idx;
+	FILE *dict = g_fopen((basename + ".dict").c_str(), "wb");
+	if (!dict)
+		return false;
+	bool written = true;
+	for (int i=0; words[i]; ++i) {
+		append_index_item(idx, words[i], offsets[i], strlen(articles[i]), true);
+		/* the file has a hole below the second article */
+		if (stardict_fseek(dict, offsets[i], SEEK_SET) != 0
+			|| fwrite(articles[i], strlen(articles[i]), 1, dict) != 1)
+			written = false;
+	}
+	if (fclose(dict) != 0 || !written)
+		return false;
+	std::stringstream ifo;
+	ifo << "StarDict's dict ifo file\n"
+		<< "version=3.0.0\n"
+		<< "wordcount=2\n"
+		<< "idxfilesize=" << idx.length() << '\n'
+		<< "idxoffsetbits=64\n"
+		<< "bookname=offset64\n"
+		<< "sametypesequence=m\n";
+	return g_file_set_contents((basename + ".ifo").c_str(), ifo.str().c_str(), -1, NULL)
+		&& g_file_set_contents((basename + ".idx").c_str(), idx.c_str(), idx.length(), NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	gchar *dirname = g_dir_make_tmp("t_offset64_XXXXXX", NULL);
+	if (!dirname) {
+		std::cerr << "unable to create temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const std::string basename = build_path(dirname, "offset64");
+	int ret = EXIT_SUCCESS;
+	if (!create_dict(basename)) {
+		std::cerr << "unable to create dictionary" << std::endl;
+		ret = EXIT_FAILURE;
+	} else {
+		show_progress_t show_progress;
+		Dict dict;
+		if (!dict.load(basename + ".ifo", false, CollationLevel_NONE,
+			COLLATE_FUNC_NONE, &show_progress)) {
+			std::cerr << "unable to load dictionary" << std::endl;
+			ret = EXIT_FAILURE;
+		} else {
+			for (int i=0; words[i]; ++i) {
+				glong idx, idx_suggest;
+				if (!dict.Lookup(words[i], idx, idx_suggest, CollationLevel_NONE, 0)) {
+					std::cerr << "lookup failed: " << words[i] << std::endl;
+					ret = EXIT_FAILURE;
+					break;
+				}
+				/* data: size, type 'm', '\0'-terminated string */
+				const gchar *data = dict.get_data(idx);
+				if (strcmp(data + sizeof(guint32) + 1, articles[i]) != 0) {
+					std::cerr << "wrong article for " << words[i] << ": "
+						<< data + sizeof(guint32) + 1 << std::endl;
+					ret = EXIT_FAILURE;
+					break;
+				}
+			}
+		}
+	}
+	remove_dict(basename);
+	g_rmdir(dirname);
+	g_free(dirname);
+	return ret;
+}
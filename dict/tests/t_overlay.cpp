@@ -0,0 +1,154 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Load a dictionary with a delta layer and check the merged index. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "stddict.h"
+#include "test_dict.h"
+
+static TestAppDirs g_test_app_dirs;
+
+/* NULL article - tombstone */
+static const char *base_words[] = { "alpha", "beta", "delta", "epsilon", "zeta", NULL };
+static const char *base_articles[] = { "alpha base", "beta base", "delta base", "epsilon base", "zeta base", NULL };
+static const char *delta_words[] = { "aardvark", "beta", "delta", "gamma", "zeta", NULL };
+static const char *delta_articles[] = { "aardvark delta", "beta delta", NULL, "gamma delta", NULL, NULL };
+/* the expected merged index */
+static const char *merged_words[] = { "aardvark", "alpha", "beta", "epsilon", "gamma", NULL };
+static const char *merged_articles[] = { "aardvark delta", "alpha base", "beta delta", "epsilon base", "gamma delta", NULL };
+/* a delta deleting every base word */
+static const char *empty_articles[] = { NULL, NULL, NULL, NULL, NULL, NULL };
+
+static bool check_article(Dict& dict, glong idx, const char *article)
+{
+	/* data: size, type 'm', '\0'-terminated string */
+	const gchar *data = dict.get_data(idx);
+	if (strcmp(data + sizeof(guint32) + 1, article) != 0) {
+		std::cerr << "wrong article " << idx << ": " << data + sizeof(guint32) + 1 << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool check_dict(Dict& dict)
+{
+	glong count = 0;
+	while (merged_words[count])
+		++count;
+	if (dict.narticles() != count) {
+		std::cerr << "wrong word count: " << dict.narticles() << std::endl;
+		return false;
+	}
+	for (glong i=0; i<count; ++i) {
+		const gchar *word = dict.idx_file->getWord(i, CollationLevel_NONE, 0);
+		if (strcmp(word, merged_words[i]) != 0) {
+			std::cerr << "wrong word " << i << ": " << word << std::endl;
+			return false;
+		}
+		if (!check_article(dict, i, merged_articles[i]))
+			return false;
+		glong idx, idx_suggest;
+		if (!dict.Lookup(merged_words[i], idx, idx_suggest, CollationLevel_NONE, 0)
+			|| idx != i) {
+			std::cerr << "lookup failed: " << merged_words[i] << std::endl;
+			return false;
+		}
+	}
+	/* deleted and missing words: position of the next word */
+	const struct {
+		const char *word;
+		glong idx;
+	} missing[] = { { "a", 0 }, { "delta", 3 }, { "eta", 4 }, { "zeta", INVALID_INDEX },
+		{ "omega", INVALID_INDEX }, { NULL, 0 } };
+	for (int i=0; missing[i].word; ++i) {
+		glong idx, idx_suggest;
+		if (dict.Lookup(missing[i].word, idx, idx_suggest, CollationLevel_NONE, 0)
+			|| idx != missing[i].idx) {
+			std::cerr << "lookup of a missing word failed: " << missing[i].word << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/* The dictionary loads and has no words. */
+static bool check_empty_dict(Dict& dict)
+{
+	if (dict.narticles() != 0) {
+		std::cerr << "wrong word count of the empty dictionary: " << dict.narticles() << std::endl;
+		return false;
+	}
+	for (int i=0; base_words[i]; ++i) {
+		glong idx, idx_suggest;
+		if (dict.Lookup(base_words[i], idx, idx_suggest, CollationLevel_NONE, 0)
+			|| idx != INVALID_INDEX || idx_suggest != INVALID_INDEX) {
+			std::cerr << "lookup in the empty dictionary failed: " << base_words[i] << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool test_overlay(const std::string& basename, const char **words,
+	const char **articles, bool (*check)(Dict& dict))
+{
+	bool ret = true;
+	if (!create_dict(basename, "overlay", base_words, base_articles)
+		|| !create_delta(basename, words, articles)) {
+		std::cerr << "unable to create dictionary" << std::endl;
+		ret = false;
+	} else {
+		show_progress_t show_progress;
+		Dict dict;
+		if (!dict.load(basename + ".ifo", false, CollationLevel_NONE,
+			COLLATE_FUNC_NONE, &show_progress)) {
+			std::cerr << "unable to load dictionary " << basename << std::endl;
+			ret = false;
+		} else if (!check(dict)) {
+			ret = false;
+		}
+	}
+	remove_dict(basename);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	gchar *dirname = g_dir_make_tmp("t_overlay_XXXXXX", NULL);
+	if (!dirname) {
+		std::cerr << "unable to create temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int ret = EXIT_SUCCESS;
+	if (!test_overlay(build_path(dirname, "overlay"), delta_words, delta_articles, check_dict)
+		|| !test_overlay(build_path(dirname, "empty"), base_words, empty_articles, check_empty_dict))
+		ret = EXIT_FAILURE;
+	g_rmdir(dirname);
+	g_free(dirname);
+	return ret;
+}
@@ -0,0 +1,167 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Serialize parse results into 'G' fields and read them back. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include "prerendered.h"
+
+static void fill_result(ParseResult& result)
+{
+	ParseResultItem item;
+	item.type = ParseResultItemType_mark;
+	item.mark = new ParseResultMarkItem;
+	item.mark->pango = "<b>word</b>\n";
+	result.item_list.push_back(item);
+	item.type = ParseResultItemType_FormatBeg;
+	item.format_beg = new ParseResultFormatBegItem;
+	item.format_beg->type = ParseResultItemFormatType_Indent;
+	result.item_list.push_back(item);
+	item.type = ParseResultItemType_link;
+	item.link = new ParseResultLinkItem;
+	item.link->pango = "see <u>other</u> and <u>more</u>";
+	item.link->links_list.push_back(LinkDesc(4, 5, "query://other"));
+	item.link->links_list.push_back(LinkDesc(14, 4, "query://more"));
+	result.item_list.push_back(item);
+	item.type = ParseResultItemType_FormatEnd;
+	item.format_end = new ParseResultFormatEndItem;
+	item.format_end->type = ParseResultItemFormatType_Indent;
+	result.item_list.push_back(item);
+	item.type = ParseResultItemType_res;
+	item.res = new ParseResultResItem;
+	item.res->type = "img";
+	item.res->key = "pic/word.png";
+	result.item_list.push_back(item);
+	/* empty strings */
+	item.type = ParseResultItemType_mark;
+	item.mark = new ParseResultMarkItem;
+	result.item_list.push_back(item);
+}
+
+static bool equal_items(const ParseResultItem& a, const ParseResultItem& b)
+{
+	if (a.type != b.type)
+		return false;
+	switch (a.type) {
+	case ParseResultItemType_mark:
+		return a.mark->pango == b.mark->pango;
+	case ParseResultItemType_link:
+		{
+		if (a.link->pango != b.link->pango
+			|| a.link->links_list.size() != b.link->links_list.size())
+			return false;
+		LinksPosList::const_iterator i = a.link->links_list.begin();
+		LinksPosList::const_iterator j = b.link->links_list.begin();
+		for (; i != a.link->links_list.end(); ++i, ++j)
+			if (i->pos_ != j->pos_ || i->len_ != j->len_ || i->link_ != j->link_)
+				return false;
+		}
+		return true;
+	case ParseResultItemType_res:
+		return a.res->type == b.res->type && a.res->key == b.res->key;
+	case ParseResultItemType_FormatBeg:
+		return a.format_beg->type == b.format_beg->type;
+	case ParseResultItemType_FormatEnd:
+		return a.format_end->type == b.format_end->type;
+	default:
+		return false;
+	}
+}
+
+static bool check_round_trip(void)
+{
+	ParseResult result;
+	fill_result(result);
+	std::string data("prefix");
+	if (!serialize_parse_result(result, data)) {
+		std::cerr << "serialization failed" << std::endl;
+		return false;
+	}
+	if (data.compare(0, 6, "prefix") != 0) {
+		std::cerr << "serialization overwrote the data" << std::endl;
+		return false;
+	}
+	ParseResult result2;
+	if (!deserialize_parse_result(data.c_str() + 6, data.length() - 6, result2)) {
+		std::cerr << "deserialization failed" << std::endl;
+		return false;
+	}
+	if (result.item_list.size() != result2.item_list.size()) {
+		std::cerr << "wrong number of items: " << result2.item_list.size() << std::endl;
+		return false;
+	}
+	std::list<ParseResultItem>::const_iterator i = result.item_list.begin();
+	std::list<ParseResultItem>::const_iterator j = result2.item_list.begin();
+	for (int n = 0; i != result.item_list.end(); ++i, ++j, ++n) {
+		if (!equal_items(*i, *j)) {
+			std::cerr << "item " << n << " differs" << std::endl;
+			return false;
+		}
+	}
+	/* data truncated on an item boundary is valid, otherwise it is corrupt */
+	std::set<size_t> boundaries;
+	ParseResult prefix;
+	for (i = result2.item_list.begin(); ; ++i) {
+		std::string prefix_data;
+		serialize_parse_result(prefix, prefix_data);
+		boundaries.insert(prefix_data.length());
+		if (i == result2.item_list.end())
+			break;
+		prefix.item_list.push_back(*i);
+	}
+	/* result2 owns the items */
+	prefix.item_list.clear();
+	for (size_t len = 0; len < data.length() - 6; ++len) {
+		ParseResult result3;
+		if (deserialize_parse_result(data.c_str() + 6, len, result3) != (boundaries.count(len) > 0)) {
+			std::cerr << "wrong result for data truncated to " << len << " bytes" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_widget(void)
+{
+	ParseResult result;
+	ParseResultItem item;
+	item.type = ParseResultItemType_widget;
+	item.widget = new ParseResultWidgetItem;
+	item.widget->widget = NULL;
+	result.item_list.push_back(item);
+	std::string data;
+	if (serialize_parse_result(result, data) || !data.empty()) {
+		std::cerr << "a widget is serialized" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!check_round_trip() || !check_widget())
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
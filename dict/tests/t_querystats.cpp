@@ -0,0 +1,166 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <glib.h>
+
+#include "querystats.h"
+
+static QueryTypeStats get_stats(QueryType type)
+{
+	QueryStatsSnapshot snapshot;
+	query_stats_get(snapshot);
+	return snapshot.queries[type];
+}
+
+/* bucket 0 - below 1 us, bucket i - [2^(i-1), 2^i) us, the last one - the rest */
+static bool check_buckets(void)
+{
+	static const struct {
+		gint64 time;
+		int bucket;
+	} cases[] = {
+		{ 0, 0 },
+		{ -5, 0 },
+		{ 1, 1 },
+		{ 2, 2 },
+		{ 3, 2 },
+		{ 4, 3 },
+		{ 1000, 10 },
+		{ 1024, 11 },
+		{ G_GINT64_CONSTANT(1) << (QUERY_STATS_BUCKETS - 2), QUERY_STATS_BUCKETS - 1 },
+		{ G_GINT64_CONSTANT(1) << 40, QUERY_STATS_BUCKETS - 1 },
+	};
+	for (size_t i = 0; i < G_N_ELEMENTS(cases); ++i) {
+		query_stats_reset();
+		query_stats_add_query(QueryType_FUZZY, NULL, true, cases[i].time);
+		const QueryTypeStats stats = get_stats(QueryType_FUZZY);
+		if (stats.count != 1 || stats.histogram[cases[i].bucket] != 1) {
+			std::cerr << "time " << cases[i].time << " is not in bucket "
+				<< cases[i].bucket << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_percentile(void)
+{
+	query_stats_reset();
+	if (get_stats(QueryType_WORD).percentile(0.5) != 0) {
+		std::cerr << "percentile of no queries is not 0" << std::endl;
+		return false;
+	}
+	/* 90 queries in [8, 16) us, 10 queries in [512, 1024) us */
+	for (int i = 0; i < 90; ++i)
+		query_stats_add_query(QueryType_WORD, NULL, true, 10);
+	for (int i = 0; i < 10; ++i)
+		query_stats_add_query(QueryType_WORD, NULL, true, 1000);
+	const QueryTypeStats stats = get_stats(QueryType_WORD);
+	if (stats.count != 100 || stats.total_time != 90 * 10 + 10 * 1000 || stats.max_time != 1000) {
+		std::cerr << "wrong count, total or max time" << std::endl;
+		return false;
+	}
+	if (stats.percentile(0) != 16 || stats.percentile(0.5) != 16
+		|| stats.percentile(0.89) != 16) {
+		std::cerr << "wrong low percentiles: " << stats.percentile(0.5) << std::endl;
+		return false;
+	}
+	/* the upper bound of the bucket, 1024, is limited by the max time */
+	if (stats.percentile(0.9) != 1000 || stats.percentile(0.99) != 1000
+		|| stats.percentile(1) != 1000) {
+		std::cerr << "wrong high percentiles: " << stats.percentile(0.99) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool check_counters(void)
+{
+	DictStats dict;
+	query_stats_reset();
+	/* a part of a query is counted for the dictionary only */
+	query_stats_add_query(QueryType_PATTERN, &dict, false, 70);
+	query_stats_add_query(QueryType_PATTERN, &dict, true, 30);
+	query_stats_count(&dict, DictCounter_BYTES_READ, 100);
+	query_stats_count(&dict, DictCounter_BYTES_READ, 20);
+	query_stats_count(&dict, DictCounter_INDEX_PAGE_LOADS);
+	query_stats_count(NULL, DictCounter_INDEX_PAGE_LOADS);
+	DictStats copy;
+	query_stats_get_dict(&dict, copy);
+	if (copy.lookups[QueryType_PATTERN] != 2 || copy.lookup_time[QueryType_PATTERN] != 100
+		|| get_stats(QueryType_PATTERN).count != 1) {
+		std::cerr << "wrong lookups of the dictionary" << std::endl;
+		return false;
+	}
+	if (copy.counters[DictCounter_BYTES_READ] != 120
+		|| copy.counters[DictCounter_INDEX_PAGE_LOADS] != 1) {
+		std::cerr << "wrong counters of the dictionary" << std::endl;
+		return false;
+	}
+	{
+		QueryTimer timer(QueryType_REGEX, &dict);
+	}
+	if (get_stats(QueryType_REGEX).count != 1) {
+		std::cerr << "QueryTimer is not counted" << std::endl;
+		return false;
+	}
+	QueryStatsSnapshot snapshot;
+	query_stats_get(snapshot);
+	if (snapshot.to_string().find("pattern   count 1,") == std::string::npos) {
+		std::cerr << "no pattern line in the report:\n" << snapshot.to_string();
+		return false;
+	}
+
+	/* nothing is counted while counting is off */
+	query_stats_set_enabled(false);
+	query_stats_count(&dict, DictCounter_BYTES_READ, 5);
+	{
+		QueryTimer timer(QueryType_REGEX, &dict);
+	}
+	query_stats_set_enabled(true);
+	query_stats_get_dict(&dict, copy);
+	if (copy.counters[DictCounter_BYTES_READ] != 120 || get_stats(QueryType_REGEX).count != 1) {
+		std::cerr << "counted while counting is off" << std::endl;
+		return false;
+	}
+
+	query_stats_clear_dict(&dict);
+	query_stats_reset();
+	query_stats_get_dict(&dict, copy);
+	if (copy.lookups[QueryType_PATTERN] != 0 || copy.counters[DictCounter_BYTES_READ] != 0
+		|| get_stats(QueryType_PATTERN).count != 0
+		|| get_stats(QueryType_PATTERN).histogram[QUERY_STATS_BUCKETS - 1] != 0) {
+		std::cerr << "counters are not cleared" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	query_stats_set_enabled(true);
+	if (!check_buckets() || !check_percentile() || !check_counters())
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Change a loaded dictionary on disk and reload it in the background. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "stddict.h"
+#include "test_dict.h"
+
+static TestAppDirs g_test_app_dirs;
+
+/* the articles are the words themselves */
+static const char *words[] = { "alpha", "beta", NULL };
+/* a word added with a delta layer */
+static const char *delta_words[] = { "gamma", NULL };
+
+struct ReloadState {
+	Libs *libs;
+	GMainLoop *loop;
+	/* word count of the dictionary when loading ended, before finish_reload */
+	glong old_count;
+};
+
+static void on_reload_end(gpointer data)
+{
+	ReloadState *state = static_cast<ReloadState *>(data);
+	state->old_count = state->libs->narticles(0);
+	state->libs->finish_reload();
+	g_main_loop_quit(state->loop);
+}
+
+static bool check_reload(Libs& libs, const std::string& ifofilename)
+{
+	if (libs.has_changed_dicts()) {
+		std::cerr << "the dictionary is changed before the update" << std::endl;
+		return false;
+	}
+	std::list<std::string> load_list;
+	load_list.push_back(ifofilename);
+	/* nothing changed, the loaded dictionary is kept */
+	libs.reload(load_list, CollationLevel_NONE, COLLATE_FUNC_NONE);
+	if (!libs.has_dict() || libs.narticles(0) != 2) {
+		std::cerr << "reload of an unchanged dictionary failed" << std::endl;
+		return false;
+	}
+	if (!create_delta(ifofilename.substr(0, ifofilename.length() - sizeof(".ifo") + 1), delta_words, delta_words)) {
+		std::cerr << "unable to update dictionary" << std::endl;
+		return false;
+	}
+	if (!libs.has_changed_dicts()) {
+		std::cerr << "the update is not detected" << std::endl;
+		return false;
+	}
+	ReloadState state;
+	state.libs = &libs;
+	state.loop = g_main_loop_new(NULL, FALSE);
+	state.old_count = 0;
+	libs.start_reload(load_list, CollationLevel_NONE, COLLATE_FUNC_NONE, on_reload_end, &state);
+	g_main_loop_run(state.loop);
+	g_main_loop_unref(state.loop);
+	if (libs.is_reloading() || state.old_count != 2) {
+		std::cerr << "the old dictionary is not used while reloading" << std::endl;
+		return false;
+	}
+	if (!libs.has_dict() || libs.narticles(0) != 3 || libs.has_changed_dicts()) {
+		std::cerr << "the changed dictionary is not reloaded" << std::endl;
+		return false;
+	}
+	glong idx, idx_suggest;
+	if (!libs.LookupWord("gamma", idx, idx_suggest, 0, 0)) {
+		std::cerr << "the added word is not found" << std::endl;
+		return false;
+	}
+	/* a changed dictionary that fails to load is kept and still seen as changed */
+	const std::string dictfilename = ifofilename.substr(0, ifofilename.length() - sizeof(".ifo") + 1) + ".dict";
+	if (g_rename(dictfilename.c_str(), (dictfilename + ".tmp").c_str()) != 0) {
+		std::cerr << "unable to break dictionary" << std::endl;
+		return false;
+	}
+	state.loop = g_main_loop_new(NULL, FALSE);
+	libs.start_reload(load_list, CollationLevel_NONE, COLLATE_FUNC_NONE, on_reload_end, &state);
+	g_main_loop_run(state.loop);
+	g_main_loop_unref(state.loop);
+	const bool kept = libs.has_dict() && libs.narticles(0) == 3 && libs.has_changed_dicts()
+		&& libs.LookupWord("gamma", idx, idx_suggest, 0, 0);
+	if (g_rename((dictfilename + ".tmp").c_str(), dictfilename.c_str()) != 0 || !kept) {
+		std::cerr << "the dictionary that failed to load is not kept" << std::endl;
+		return false;
+	}
+	/* a cancelled reload leaves the dictionaries alone */
+	libs.start_reload(load_list, CollationLevel_NONE, COLLATE_FUNC_NONE, on_reload_end, &state);
+	libs.cancel_reload();
+	if (libs.is_reloading() || !libs.has_dict() || libs.narticles(0) != 3) {
+		std::cerr << "cancel of the reload failed" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	gchar *dirname = g_dir_make_tmp("t_reload_XXXXXX", NULL);
+	if (!dirname) {
+		std::cerr << "unable to create temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const std::string basename = build_path(dirname, "reload");
+	int ret = EXIT_SUCCESS;
+	if (!create_dict(basename, "reload", words, words)) {
+		std::cerr << "unable to create dictionary" << std::endl;
+		ret = EXIT_FAILURE;
+	} else {
+		Libs libs(NULL, false, CollationLevel_NONE, COLLATE_FUNC_NONE);
+		std::list<std::string> load_list;
+		load_list.push_back(basename + ".ifo");
+		libs.load(load_list);
+		if (!libs.has_dict()) {
+			std::cerr << "unable to load dictionary" << std::endl;
+			ret = EXIT_FAILURE;
+		} else if (!check_reload(libs, basename + ".ifo")) {
+			ret = EXIT_FAILURE;
+		}
+	}
+	remove_dict(basename);
+	g_rmdir(dirname);
+	g_free(dirname);
+	return ret;
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Needs an X display, run it under Xvfb on headless machines:
+ * xvfb-run ./t_selection_notifier
+ * The test is skipped if there is no display. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <gtk/gtk.h>
+
+#include "selection_notifier.h"
+
+/* automake treats this exit status as a skipped test */
+static const int EXIT_SKIP = 77;
+
+static void on_changed(gpointer data)
+{
+	++*static_cast<int *>(data);
+}
+
+/* Run the main loop for msec milliseconds. */
+static void run_main_loop(guint msec)
+{
+	const gint64 end_time = g_get_monotonic_time() + msec * G_TIME_SPAN_MILLISECOND;
+	while (g_get_monotonic_time() < end_time)
+		g_main_context_iteration(NULL, g_main_context_pending(NULL));
+}
+
+static bool check_notification(void)
+{
+	int changed = 0;
+	SelectionNotifier notifier(on_changed, &changed);
+	notifier.start();
+	if (notifier.is_polling()) {
+		std::cerr << "selection notification is not used" << std::endl;
+		return false;
+	}
+	run_main_loop(3 * SELECTION_INTERVAL);
+	if (changed != 0) {
+		std::cerr << "callback invoked while the selection does not change" << std::endl;
+		return false;
+	}
+	GtkClipboard *clipboard = gtk_clipboard_get(GDK_SELECTION_PRIMARY);
+	gtk_clipboard_set_text(clipboard, "first", -1);
+	gtk_clipboard_set_text(clipboard, "second", -1);
+	run_main_loop(4 * SELECTION_SETTLE_TIME);
+	if (changed != 1) {
+		std::cerr << "a burst of owner changes invoked the callback "
+			<< changed << " times" << std::endl;
+		return false;
+	}
+	gtk_clipboard_set_text(clipboard, "third", -1);
+	run_main_loop(4 * SELECTION_SETTLE_TIME);
+	if (changed != 2) {
+		std::cerr << "the owner change is not detected" << std::endl;
+		return false;
+	}
+	notifier.stop();
+	gtk_clipboard_set_text(clipboard, "fourth", -1);
+	run_main_loop(4 * SELECTION_SETTLE_TIME);
+	if (changed != 2) {
+		std::cerr << "callback invoked after stop" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool check_polling(void)
+{
+	int changed = 0;
+	SelectionNotifier notifier(on_changed, &changed);
+	notifier.start(true);
+	if (!notifier.is_polling()) {
+		std::cerr << "the selection is not polled" << std::endl;
+		return false;
+	}
+	run_main_loop(3 * SELECTION_INTERVAL + SELECTION_INTERVAL / 2);
+	if (changed < 2) {
+		std::cerr << "the selection is polled " << changed << " times" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!gtk_init_check(&argc, &argv)) {
+		std::cerr << "no display, test skipped" << std::endl;
+		return EXIT_SKIP;
+	}
+	bool notification = gdk_display_supports_selection_notification(gdk_display_get_default());
+	if (!notification)
+		std::cerr << "the display does not support selection notification" << std::endl;
+	if ((notification && !check_notification()) || !check_polling())
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Render wiki articles with the wiki parse-data plugin.
+ * Run with --benchmark to print the throughput on growing articles. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <glib.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "stardict_wiki2xml.h"
+
+struct WikiCase {
+	const char *wiki;
+	const char *xml;
+	const char *pango;
+};
+
+static const WikiCase cases[] = {
+	{ "[[Link]]s and [[target|label]]",
+	  "<text><wikilink type=\"internal\" parameters=\"1\"><wikiparameter number=\"0\" last=\"1\"><value>Link</value></wikiparameter><trail>s</trail></wikilink> and <wikilink type=\"internal\" parameters=\"2\"><wikiparameter number=\"0\"><value>target</value></wikiparameter><wikiparameter number=\"1\" last=\"1\"><value>label</value></wikiparameter></wikilink></text>",
+	  "<span foreground=\"blue\" underline=\"single\">Links</span> and <span foreground=\"blue\" underline=\"single\">targetlabel</span>" },
+	{ "{{cite|title=Book|year=2000}}",
+	  "<text><wikitemplate parameters=\"3\"><wikiparameter number=\"0\"><value>cite</value></wikiparameter><wikiparameter number=\"1\"><key>title</key><value>Book</value></wikiparameter><wikiparameter number=\"2\" last=\"1\"><key>year</key><value>2000</value></wikiparameter></wikitemplate></text>",
+	  "citetitleBookyear2000" },
+	{ "''italic'' and '''bold''' and '''''both'''''",
+	  "<text><i>italic</i> and <b>bold</b> and <b><i>both</i></b></text>",
+	  "italic and bold and both" },
+	{ "[http://example.org Example] and [http://example.org/x]",
+	  "<text><wikilink type='external' protocol='HTTP'><url>http://example.org</url><title>Example</title></wikilink> and <wikilink type='external' protocol='HTTP'><url>http://example.org/x</url><title><wikiurlcounter action=\"add\"/></title></wikilink></text>",
+	  "<span foreground=\"blue\" underline=\"single\">http://example.orgExample</span> and <span foreground=\"blue\" underline=\"single\">http://example.org/x</span>" },
+	{ "visit http://www.example.org/a.html now",
+	  "<text>visit <url>http://www.example.org/a.html</url><title>http://www.example.org/a.html</title> now</text>",
+	  "visit http://www.example.org/a.htmlhttp://www.example.org/a.html now" },
+	{ "* one\n** two\n# three",
+	  "<text><ul><li>one\n<ul><li>two\n</li></ul></li></ul><ol><li>three\n</li></ol></text>",
+	  "one\ntwo\nthree\n" },
+	{ "== Heading ==\ntext",
+	  "<text><h2>Heading</h2>\ntext</text>",
+	  "Heading\ntext" },
+	{ "{|\n|-\n| a || b\n! head\n|}",
+	  "<text><wikitable><wikiparameter/>\n<wikitablerow>\n<wikitablecell type=\"CELL\"> a </wikitablecell><wikitablecell type=\"CELL\"> b\n</wikitablecell><wikitablecell type=\"HEADER\"> head\n</wikitablecell></wikitablerow></wikitable></text>",
+	  "\n\n a  b\n head\n" },
+	{ "x -> y <b>ok</b> <span>no</span> <!-- a < b -->",
+	  "<text>x -&gt; y <b>ok</b> &lt;span&gt;no&lt;/span&gt; &lt;!-- a &lt; b --&gt;</text>",
+	  "x -&gt; y ok &lt;span&gt;no&lt;/span&gt; &lt;!-- a &lt; b --&gt;" },
+	{ "|} not a table",
+	  "<text>|} not a table</text>",
+	  "|} not a table" },
+		{ NULL, NULL, NULL }
+};
+
+static bool check_case(const WikiCase& c)
+{
+	std::string wiki(c.wiki);
+	std::string xml = wiki2xml(wiki);
+	if (xml != c.xml) {
+		g_warning("wiki: %s\nwant: %s\ngot: %s", c.wiki, c.xml, xml.c_str());
+		return false;
+	}
+	std::string pango = wikixml2pango(xml);
+	if (pango != c.pango) {
+		g_warning("xml: %s\nwant: %s\ngot: %s", c.xml, c.pango, pango.c_str());
+		return false;
+	}
+	return true;
+}
+
+/* A paragraph of n chunks of typical wiki markup. */
+static std::string make_article(int n)
+{
+	static const char *chunks[] = {
+		"[[Link|some text]]s ", "a -> b ", "'''bold''' ", "[http://example.org/ site] ",
+		"plain words here ", "{{template|key=value}} ", "<ref>note</ref> ", "''italic'' ",
+	};
+	const int nchunks = sizeof(chunks) / sizeof(chunks[0]);
+	std::string article;
+	for (int i = 0; i < n; ++i)
+		article += chunks[i % nchunks];
+	return article;
+}
+
+static void benchmark(void)
+{
+	for (int n = 1000; n <= 16000; n *= 2) {
+		std::string article = make_article(n);
+		GTimer *timer = g_timer_new();
+		std::string xml = wiki2xml(article);
+		wikixml2pango(xml);
+		gdouble elapsed = g_timer_elapsed(timer, NULL);
+		g_timer_destroy(timer);
+		g_print("%lu bytes: %.3f s, %.1f MB/s\n", (unsigned long)article.length(),
+			elapsed, article.length() / elapsed / (1024 * 1024));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i = 0; cases[i].wiki; ++i)
+		if (!check_case(cases[i]))
+			return EXIT_FAILURE;
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+		benchmark();
+	return EXIT_SUCCESS;
+}
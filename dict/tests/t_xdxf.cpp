@@ -0,0 +1,320 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Render XDXF articles with the XDXF parse-data plugin. The expected output
+ * was produced by the parser before it was rewritten as a single-pass
+ * tokenizer, malformed and truncated markup included, and generated
+ * dictionary articles must render as with that parser, see xdxf_reference.h.
+ * Run with --benchmark to compare the speed of both parsers. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <glib.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "stardict_xdxf2pango.h"
+#include "xdxf_reference.h"
+
+struct XDXFCase {
+	const char *xdxf;
+	/* items of the result, one per line, see dump_result */
+	const char *result;
+};
+
+static const XDXFCase cases[] = {
+	{ "plain text",
+	  "M:plain text" },
+	{ "<k>word</k>\ntext after the first key",
+	  "M:text after the first key" },
+	{ "<k>first</k><k>second</k> and <k>third &amp; more</k>",
+	  "M:<span foreground=\"#000000\">second</span> and <span foreground=\"#000000\">third &amp; more</span>" },
+	{ "<abr>adj.</abr> <b>bold</b> <i>it</i> <sub>1</sub><sup>2</sup> <tt>mono</tt> <big>B</big> <small>s</small>",
+	  "M:<span foreground=\"#007f00\" style=\"italic\">adj.</span> <b>bold</b> <i>it</i> <sub>1</sub><sup>2</sup> <tt>mono</tt> <big>B</big> <small>s</small>" },
+	{ "<tr>trans</tr> <ex>example</ex> <c>default color</c>",
+	  "M:<b>[trans]</b> <span foreground=\"#7f7f7f\">example</span> <span foreground=\"#0066ff\">default color</span>" },
+	{ "<c c=\"red\">red</c> <c c=\"#00ff00\">green</c> <c c=\"notacolor\">none</c> <c c=\"\">empty</c> <c c=\"red>unterminated</c>",
+	  "M:<span foreground=\"red\">red</span> <span foreground=\"#00ff00\">green</span> <span>none</span> <span>empty</span> <span foreground=\"red\">unterminated</span>" },
+	{ "see <kref>target</kref> and <kref k=\"other &amp; key\">label</kref> and <iref href=\"http://example.org/?a=1&amp;b=2\">site</iref> <iref>http://x.org</iref>",
+	  "L:see <span foreground=\"#00007f\" underline=\"single\">target</span> and <span foreground=\"#00007f\" underline=\"single\">label</span> and <span foreground=\"#00007f\" underline=\"single\">site</span> <span foreground=\"#00007f\" underline=\"single\">http://x.org</span>[4,6,query://target][15,5,query://other & key][25,4,http://example.org/?a=1&b=2][30,12,http://x.org]" },
+	{ "\xd0\xbf\xd1\x80\xd0\xb8 <kref>\xd1\x81\xd0\xbb\xd0\xbe\xd0\xb2\xd0\xbe</kref> &lt;&gt; <tr>x</tr> <kref>a&amp;b</kref>",
+	  "L:\xd0\xbf\xd1\x80\xd0\xb8 <span foreground=\"#00007f\" underline=\"single\">\xd1\x81\xd0\xbb\xd0\xbe\xd0\xb2\xd0\xbe</span> &lt;&gt; <b>[x]</b> <span foreground=\"#00007f\" underline=\"single\">a&amp;b</span>[4,5,query://\xd1\x81\xd0\xbb\xd0\xbe\xd0\xb2\xd0\xbe][17,3,query://a&b]" },
+	{ "<rref>pic.jpg</rref><rref>snd.wav</rref><rref>movie.mpeg</rref><rref>file.txt</rref><rref type=\"image\">noext</rref> tail",
+	  "R:image:pic.jpg\nR:sound:snd.wav\nR:video:movie.mpeg\nR:attach:file.txt\nR:image:noext\nM: tail" },
+	{ "<blockquote>indented <b>text</b></blockquote> after <blockquote attr=\"1\">more</blockquote>",
+	  "B\nM:indented <b>text</b>\nE\nM: after \nB\nM:more\nE" },
+	{ "unknown <foo>tags</foo> <bar baz=\"1\"/> and <xdxf><def>def</def></xdxf>",
+	  "M:unknown tags  and def" },
+	{ "a < b and c > d",
+	  "M:a  d" },
+	{ "entities &lt; &gt; &amp; &apos; &quot; &unknown; & alone &am",
+	  "M:entities &lt; &gt; &amp; &apos; &quot; &unknown; & alone &am" },
+	{ "truncated <k>key without end",
+	  "M:truncated key without end" },
+	{ "truncated <kref>ref without end",
+	  "M:truncated ref without end" },
+	{ "truncated <rref>res without end",
+	  "M:truncated res without end" },
+	{ "truncated tag <b",
+	  "M:truncated tag &lt;b" },
+	{ "truncated <c c=\"red\"",
+	  "M:truncated c c=\"red\"" },
+	{ "</b></i></unknown></blockquote> <B>upper</B> <b >space</b>",
+	  "M:</b></i>\nE\nM: upper space</b>" },
+	{ "<kref>one</kref><kref>two</kref><rref>x.png</rref><kref>three</kref>",
+	  "L:<span foreground=\"#00007f\" underline=\"single\">one</span><span foreground=\"#00007f\" underline=\"single\">two</span>[0,3,query://one][3,3,query://two]\nR:image:x.png\nL:<span foreground=\"#00007f\" underline=\"single\">three</span>[0,5,query://three]" },
+	{ NULL, NULL }
+};
+
+static std::string dump_result(const ParseResult& result)
+{
+	std::string res;
+	for (std::list<ParseResultItem>::const_iterator i = result.item_list.begin();
+		i != result.item_list.end(); ++i) {
+		if (!res.empty())
+			res += '\n';
+		switch (i->type) {
+		case ParseResultItemType_mark:
+			res += "M:" + i->mark->pango;
+			break;
+		case ParseResultItemType_link:
+			res += "L:" + i->link->pango;
+			for (LinksPosList::const_iterator l = i->link->links_list.begin();
+				l != i->link->links_list.end(); ++l) {
+				gchar *link = g_strdup_printf("[%lu,%lu,%s]", (unsigned long)l->pos_,
+					(unsigned long)l->len_, l->link_.c_str());
+				res += link;
+				g_free(link);
+			}
+			break;
+		case ParseResultItemType_res:
+			res += "R:" + i->res->type + ":" + i->res->key;
+			break;
+		case ParseResultItemType_FormatBeg:
+			res += "B";
+			break;
+		case ParseResultItemType_FormatEnd:
+			res += "E";
+			break;
+		default:
+			res += "?";
+			break;
+		}
+	}
+	return res;
+}
+
+static bool check_case(const XDXFCase& c)
+{
+	ParseResult result;
+	xdxf2result(c.xdxf, result);
+	const std::string res = dump_result(result);
+	if (res != c.result) {
+		g_warning("xdxf: %s\nwant: %s\ngot: %s", c.xdxf, c.result, res.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::string random_word(GRand *rand, bool cyrillic)
+{
+	std::string word;
+	gint len = g_rand_int_range(rand, 2, 11);
+	for (gint i = 0; i < len; ++i) {
+		if (cyrillic) {
+			gchar buf[6];
+			word.append(buf, g_unichar_to_utf8(0x0430 + g_rand_int_range(rand, 0, 32), buf));
+		} else
+			word += char('a' + g_rand_int_range(rand, 0, 26));
+	}
+	return word;
+}
+
+static std::string random_phrase(GRand *rand, bool cyrillic, gint minlen, gint maxlen)
+{
+	std::string phrase;
+	gint len = g_rand_int_range(rand, minlen, maxlen + 1);
+	for (gint i = 0; i < len; ++i) {
+		if (i)
+			phrase += g_rand_int_range(rand, 0, 6) ? " " : ", ";
+		phrase += random_word(rand, cyrillic);
+	}
+	return phrase;
+}
+
+/* An article laid out like the ones of the XDXF dictionaries converted from
+ * Lingvo: key, transcription, numbered senses with abbreviations, examples,
+ * references and now and then a comment, a sound or an indented block. */
+static std::string make_corpus_article(GRand *rand)
+{
+	static const char *abrs[] = { "n.", "v.", "adj.", "adv.", "pl.",
+		"\xd1\x80\xd0\xb0\xd0\xb7\xd0\xb3.", "\xd1\x82\xd0\xb5\xd1\x85.", "\xd1\x8e\xd1\x80." };
+	static const char *ipa[] = { "\xc9\x99", "\xc3\xa6", "\xca\x83", "\xc5\x8b", "\xcb\x88", "\xce\xb8", "e", "i", "k", "t" };
+	std::string article = "<k>" + random_phrase(rand, false, 1, 2) + "</k>\n";
+	if (g_rand_int_range(rand, 0, 2)) {
+		article += "<tr>";
+		gint len = g_rand_int_range(rand, 3, 10);
+		for (gint i = 0; i < len; ++i)
+			article += ipa[g_rand_int_range(rand, 0, G_N_ELEMENTS(ipa))];
+		article += "</tr>\n";
+	}
+	const gint senses = g_rand_int_range(rand, 1, 7);
+	for (gint i = 1; i <= senses; ++i) {
+		if (senses > 1) {
+			gchar *num = g_strdup_printf("%d) ", i);
+			article += num;
+			g_free(num);
+		}
+		if (g_rand_int_range(rand, 0, 3) == 0)
+			article += std::string("<abr>") + abrs[g_rand_int_range(rand, 0, G_N_ELEMENTS(abrs))] + "</abr> ";
+		article += random_phrase(rand, true, 1, 6);
+		if (g_rand_int_range(rand, 0, 5) == 0)
+			article += " <i>(" + random_phrase(rand, true, 1, 3) + ")</i>";
+		for (gint n = g_rand_int_range(rand, 0, 3); n > 0; --n)
+			article += "\n<ex>" + random_phrase(rand, false, 2, 6) + " \xe2\x80\x94 "
+				+ random_phrase(rand, true, 2, 6) + "</ex>";
+		if (g_rand_int_range(rand, 0, 8) == 0)
+			article += " \xd1\x81\xd0\xbc. <kref>" + random_word(rand, false) + "</kref>";
+		if (g_rand_int_range(rand, 0, 20) == 0)
+			article += " <c>" + random_word(rand, false) + " &amp; " + random_word(rand, false) + "</c>";
+		article += '\n';
+	}
+	if (g_rand_int_range(rand, 0, 20) == 0)
+		article += "<blockquote>" + random_phrase(rand, true, 3, 12) + "</blockquote>\n";
+	if (g_rand_int_range(rand, 0, 30) == 0)
+		article += "<rref>" + random_word(rand, false) + ".wav</rref>\n";
+	return article;
+}
+
+static void make_corpus(guint32 seed, int count, std::vector<std::string>& corpus)
+{
+	GRand *rand = g_rand_new_with_seed(seed);
+	corpus.clear();
+	for (int i = 0; i < count; ++i)
+		corpus.push_back(make_corpus_article(rand));
+	g_rand_free(rand);
+}
+
+static bool check_corpus(void)
+{
+	std::vector<std::string> corpus;
+	make_corpus(1, 2000, corpus);
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		ParseResult result, reference;
+		xdxf2result(corpus[i].c_str(), result);
+		xdxf_reference2result(corpus[i].c_str(), reference);
+		const std::string res = dump_result(result), ref = dump_result(reference);
+		if (res != ref) {
+			g_warning("xdxf: %s\nwant: %s\ngot: %s", corpus[i].c_str(), ref.c_str(), res.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+/* An article of n chunks, dense - tags only. */
+static std::string make_article(int n, bool dense)
+{
+	static const char *chunks[] = {
+		"<k>key</k>\n", "<abr>n.</abr> ", "some plain words of the definition ",
+		"<tr>trans</tr> ", "<ex>an example &amp; more</ex> ", "<kref>reference</kref> ",
+		"<c c=\"red\">colored</c> ", "<blockquote>quoted</blockquote> ",
+	};
+	static const char *dense_chunks[] = {
+		"<b>", "</b>", "<i>x</i>", "<c>", "</c>", "<sub>1</sub>", "<foo>", "&lt;",
+	};
+	const int nchunks = sizeof(chunks) / sizeof(chunks[0]);
+	std::string article;
+	for (int i = 0; i < n; ++i)
+		article += dense ? dense_chunks[i % nchunks] : chunks[i % nchunks];
+	return article;
+}
+
+typedef void (*xdxf2result_func)(const char *p, ParseResult &result);
+
+/* Seconds to render the articles repeat times. */
+static gdouble time_parser(xdxf2result_func parse, const std::vector<std::string>& articles,
+	int repeat)
+{
+	GTimer *timer = g_timer_new();
+	for (int i = 0; i < repeat; ++i)
+		for (size_t j = 0; j < articles.size(); ++j) {
+			ParseResult result;
+			parse(articles[j].c_str(), result);
+		}
+	const gdouble elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+	return elapsed;
+}
+
+/* The parsers run in turn and the best of 5 runs is taken, so that a busy
+ * machine slows both of them alike. */
+static void benchmark_articles(const char *name, const std::vector<std::string>& articles,
+	int repeat)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < articles.size(); ++i)
+		size += articles[i].length();
+	gdouble t_ref = 0, t_new = 0;
+	for (int run = 0; run < 5; ++run) {
+		const gdouble t1 = time_parser(xdxf_reference2result, articles, repeat);
+		const gdouble t2 = time_parser(xdxf2result, articles, repeat);
+		if (run == 0 || t1 < t_ref)
+			t_ref = t1;
+		if (run == 0 || t2 < t_new)
+			t_new = t2;
+	}
+	const gdouble mb = gdouble(size) * repeat / (1024 * 1024);
+	g_print("%s, %lu articles, %lu bytes: reference %.1f MB/s, tokenizer %.1f MB/s, %.2fx\n",
+		name, (unsigned long)articles.size(), (unsigned long)size,
+		mb / t_ref, mb / t_new, t_ref / t_new);
+}
+
+static void benchmark(void)
+{
+	std::vector<std::string> corpus;
+	make_corpus(1, 50000, corpus);
+	benchmark_articles("corpus", corpus, 2);
+	for (int dense = 0; dense < 2; ++dense) {
+		const std::vector<std::string> article(1, make_article(64000, dense));
+		benchmark_articles(dense ? "tags" : "article", article, 20);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	/* the default colors of the plugin */
+	ColorScheme cs;
+	cs.abr = 0x007F00;
+	cs.ex = 0x7F7F7F;
+	cs.k = 0x000000;
+	cs.c = 0x0066FF;
+	cs.ref = 0x00007F;
+	xdxf_set_color_scheme(cs);
+	xdxf_reference_set_color_scheme(cs);
+	for (int i = 0; cases[i].xdxf; ++i)
+		if (!check_case(cases[i]))
+			return EXIT_FAILURE;
+	if (!check_corpus())
+		return EXIT_FAILURE;
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0)
+		benchmark();
+	return EXIT_SUCCESS;
+}
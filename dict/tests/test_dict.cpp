@@ -0,0 +1,108 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <sstream>
+#include <glib/gstdio.h>
+
+#include "test_dict.h"
+
+TestAppDirs::TestAppDirs()
+{
+	app_dirs = this;
+}
+
+std::string TestAppDirs::get_user_config_dir(void) const
+{
+	return g_get_tmp_dir();
+}
+
+std::string TestAppDirs::get_user_cache_dir(void) const
+{
+	return g_get_tmp_dir();
+}
+
+std::string TestAppDirs::get_data_dir(void) const
+{
+	return g_get_tmp_dir();
+}
+
+void append_index_item(std::string& idx, const char *word, guint64 offset, guint32 size,
+	bool offset64)
+{
+	idx.append(word, strlen(word)+1);
+	if (offset64) {
+		guint64 offset_be = GUINT64_TO_BE(offset);
+		idx.append(reinterpret_cast<const char *>(&offset_be), sizeof(guint64));
+	} else {
+		guint32 offset_be = g_htonl(static_cast<guint32>(offset));
+		idx.append(reinterpret_cast<const char *>(&offset_be), sizeof(guint32));
+	}
+	guint32 size_be = g_htonl(size);
+	idx.append(reinterpret_cast<const char *>(&size_be), sizeof(guint32));
+}
+
+static void build_index(const char **words, const char **articles,
+	std::string& idx, std::string& dict)
+{
+	for (int i=0; words[i]; ++i) {
+		const char *article = articles[i] ? articles[i] : "";
+		append_index_item(idx, words[i], dict.length(), strlen(article));
+		dict.append(article);
+	}
+}
+
+bool create_dict(const std::string& basename, const char *bookname,
+	const char **words, const char **articles)
+{
+	std::string idx, dict;
+	build_index(words, articles, idx, dict);
+	int wordcount = 0;
+	while (words[wordcount])
+		++wordcount;
+	std::stringstream ifo;
+	ifo << "StarDict's dict ifo file\n"
+		<< "version=2.4.2\n"
+		<< "wordcount=" << wordcount << '\n'
+		<< "idxfilesize=" << idx.length() << '\n'
+		<< "bookname=" << bookname << '\n'
+		<< "sametypesequence=m\n";
+	return g_file_set_contents((basename + ".ifo").c_str(), ifo.str().c_str(), -1, NULL)
+		&& g_file_set_contents((basename + ".idx").c_str(), idx.c_str(), idx.length(), NULL)
+		&& g_file_set_contents((basename + ".dict").c_str(), dict.c_str(), dict.length(), NULL);
+}
+
+bool create_delta(const std::string& basename, const char **words, const char **articles)
+{
+	std::string idx, dict;
+	build_index(words, articles, idx, dict);
+	return g_file_set_contents((basename + ".delta.idx").c_str(), idx.c_str(), idx.length(), NULL)
+		&& g_file_set_contents((basename + ".delta.dict").c_str(), dict.c_str(), dict.length(), NULL);
+}
+
+void remove_dict(const std::string& basename)
+{
+	g_remove((basename + ".ifo").c_str());
+	g_remove((basename + ".idx").c_str());
+	g_remove((basename + ".dict").c_str());
+	g_remove((basename + ".delta.idx").c_str());
+	g_remove((basename + ".delta.dict").c_str());
+}
@@ -0,0 +1,50 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Helpers shared by the tests that build small dictionaries by hand. */
+
+#ifndef _TEST_DICT_H_
+#define _TEST_DICT_H_
+
+#include <string>
+#include <glib.h>
+
+#include "iappdirs.h"
+
+/* Puts all application directories in the temporary directory.
+ * A test defines one static instance, it sets app_dirs. */
+class TestAppDirs : public IAppDirs {
+public:
+	TestAppDirs();
+	virtual std::string get_user_config_dir(void) const;
+	virtual std::string get_user_cache_dir(void) const;
+	virtual std::string get_data_dir(void) const;
+};
+
+/* Append an .idx entry, offset64 - idxoffsetbits=64. */
+void append_index_item(std::string& idx, const char *word, guint64 offset, guint32 size,
+	bool offset64 = false);
+/* Create basename.ifo, .idx and .dict with one article of type 'm' per word.
+ * words and articles are NULL-terminated, words are in the index order. */
+bool create_dict(const std::string& basename, const char *bookname,
+	const char **words, const char **articles);
+/* Create basename.delta.idx and .delta.dict, a NULL article is a tombstone. */
+bool create_delta(const std::string& basename, const char **words, const char **articles);
+/* Remove all files create_dict and create_delta may create. */
+void remove_dict(const std::string& basename);
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The XDXF parser as it was before the single-pass tokenizer. t_xdxf
+ * compares the output of the plugin with it and measures the speedup. */
+
+#ifndef _XDXF_REFERENCE_H_
+#define _XDXF_REFERENCE_H_
+
+#include "stardict_xdxf2pango.h"
+
+extern void xdxf_reference_set_color_scheme(const ColorScheme& cs);
+extern void xdxf_reference2result(const char *p, ParseResult &result);
+
+#endif
@@ -236,10 +236,18 @@ bool DictInfo::load_from_ifo_file(const std::string& ifofilename,
 		} else if(key == "idxoffsetbits") {
 			if(!check_option_duplicate(f_idxoffsetbits, "idxoffsetbits"))
 				continue;
-			if(value != "32") {
-				// TODO
-				g_critical("Load %s failed: idxoffsetbits != 32 not supported presently.",
-					ifo_file_name.c_str());
+			if(value == "32") {
+				set_idxoffsetbits(32);
+			} else if(value == "64" && infotype == DictInfoType_NormDict) {
+				if(version != "3.0.0") {
+					g_critical("Load %s failed: idxoffsetbits=64 requires version=3.0.0.",
+						ifo_file_name.c_str());
+					return false;
+				}
+				set_idxoffsetbits(64);
+			} else {
+				g_critical("Load %s failed: idxoffsetbits=%s is not supported.",
+					ifo_file_name.c_str(), value.c_str());
 				return false;
 			}
 		} else if(key == "wordcount" && (infotype == DictInfoType_NormDict
@@ -430,6 +438,8 @@ bool DictInfo::save_ifo_file(void) const
 	if(infotype == DictInfoType_NormDict) {
 		if(is_dicttype())
 			str << "dicttype=" << dicttype << '\n';
+		if(is_idxoffsetbits() && idxoffsetbits == 64)
+			str << "idxoffsetbits=" << idxoffsetbits << '\n';
 	}
 	if(!g_file_set_contents(ifo_file_name.c_str(), str.str().c_str(), -1, NULL)) {
 		g_critical("Fail to save ifo file." open_write_file_err, ifo_file_name.c_str());
@@ -454,6 +464,7 @@ void DictInfo::clear(void)
 	sametypesequence.clear();
 	dicttype.clear();
 	version.clear();
+	idxoffsetbits = 32;
 	lineno = -1;
 
 	f_wordcount = false;
@@ -506,8 +517,9 @@ DictInfo& DictInfo::operator=(const DictInfo& dict_info)
 		set_version(dict_info.get_version());
 	if(dict_info.is_infotype())
 		set_infotype(dict_info.get_infotype());
+	if(dict_info.is_idxoffsetbits())
+		set_idxoffsetbits(dict_info.get_idxoffsetbits());
 
-	f_idxoffsetbits = dict_info.f_idxoffsetbits;
 	return *this;
 }
 
@@ -89,6 +89,7 @@ struct DictInfo {
 	ALL_METHOD_TEMPL(const std::string&, sametypesequence, "")
 	ALL_METHOD_TEMPL(const std::string&, dicttype, "")
 	ALL_METHOD_TEMPL(const std::string&, version, "")
+	ALL_METHOD_TEMPL(guint32, idxoffsetbits, 32)
 	ALL_METHOD_TEMPL(DictInfoType, infotype, DictInfoType_NormDict)
 private:
 	const char* get_key_value(const char *p1, std::string& key, 
@@ -126,6 +127,8 @@ private:
 	std::string sametypesequence;
 	std::string dicttype;
 	std::string version;
+	/* size of data offset in index entries, 32 or 64 */
+	guint32 idxoffsetbits;
 	DictInfoType infotype;
 };
 
@@ -54,6 +54,33 @@
  * so we'd be out of memory if we try to allocate such amount. */
 const guint32 MAX_RESERVED_INDEX_SIZE = 200*1024;
 
+/* Data blocks separated by at most MAX_DATA_RUN_GAP bytes are read together.
+ * A run is not longer than MAX_DATA_RUN_SIZE bytes unless it consists of one block.
+ * Runs read but not yet verified take at most MAX_DATA_RUN_BUFFERED bytes
+ * plus the size of one run. */
+const guint64 MAX_DATA_RUN_GAP = 64*1024;
+const guint64 MAX_DATA_RUN_SIZE = 8*1024*1024;
+const guint64 MAX_DATA_RUN_BUFFERED = 64*1024*1024;
+
+struct binary_dict_parser_t::data_run_t {
+	guint64 offset;
+	std::vector<char> buffer;
+	/* indexes of the items in the run */
+	std::vector<size_t> items;
+};
+
+struct binary_dict_parser_t::data_block_verifier_t {
+	i_resource_storage* p_res_storage;
+	bool fix_errors;
+	std::string sametypesequence;
+	const worditem_t* index;
+	VerifResult* results;
+	/* protects buffered_size */
+	GMutex mutex;
+	GCond cond;
+	guint64 buffered_size;
+};
+
 static bool compare_worditem_by_offset(const worditem_t* left, const worditem_t* right)
 {
 	return left->offset < right->offset;
@@ -95,7 +122,7 @@ VerifResult binary_dict_parser_t::load(const std::string& ifofilename,
 	return result;
 }
 
-int binary_dict_parser_t::get_data_fields(guint32 offset, guint32 size, data_field_vect_t& fields) const
+int binary_dict_parser_t::get_data_fields(guint64 offset, guint32 size, data_field_vect_t& fields) const
 {
 	if(size == 0)
 		return EXIT_FAILURE;
@@ -108,7 +135,7 @@ int binary_dict_parser_t::get_data_fields(guint32 offset, guint32 size, data_fie
 		g_critical(dictionary_no_loaded_err);
 		return EXIT_FAILURE;
 	}
-	if(fseek(get_impl(dictfile), offset, SEEK_SET)) {
+	if(stardict_fseek(get_impl(dictfile), offset, SEEK_SET)) {
 		std::string error(g_strerror(errno));
 		g_critical(read_file_err, dictfilename.c_str(), error.c_str());
 		return EXIT_FAILURE;
@@ -217,31 +244,26 @@ VerifResult binary_dict_parser_t::load_idx_file(void)
 	index.clear();
 	index.reserve(std::min(MAX_RESERVED_INDEX_SIZE, dict_info.get_wordcount()));
 
-	std::vector<gchar> buf(idxfilesize+1);
-	gchar * const buffer_beg = &buf[0];
-	gchar * const buffer_end = buffer_beg+idxfilesize;
-	{
-		FILE *idxfile = g_fopen(idxfilename.c_str(),"rb");
-		if(!idxfile) {
-			std::string error(g_strerror(errno));
-			g_critical(open_read_file_err, idxfilename.c_str(), error.c_str());
-			return combine_result(result, VERIF_RESULT_FATAL);
-		}
-		if(idxfilesize != fread(buffer_beg, 1, idxfilesize, idxfile)) {
-			std::string error(g_strerror(errno));
-			g_critical(open_read_file_err, idxfilename.c_str(), error.c_str());
-			fclose(idxfile);
-			return combine_result(result, VERIF_RESULT_FATAL);
-		}
-		fclose(idxfile);
+	/* index items are parsed straight from the mapped file */
+	GError *err = NULL;
+	GMappedFile *idxmap = g_mapped_file_new(idxfilename.c_str(), FALSE, &err);
+	if(!idxmap) {
+		g_critical(open_read_file_err, idxfilename.c_str(), err->message);
+		g_error_free(err);
+		return combine_result(result, VERIF_RESULT_FATAL);
 	}
+	const gchar * const buffer_beg = g_mapped_file_get_contents(idxmap);
+	const gchar * const buffer_end = buffer_beg + std::min<size_t>(idxfilesize,
+		g_mapped_file_get_length(idxmap));
 
 	const char *p=buffer_beg;
 	int wordlen;
 	gint cmpvalue;
 	guint wordcount=0;
-	worditem_t worditem, preworditem;
+	worditem_t worditem;
 	size_t size_remain; // to the end of the index file
+	const bool offset64 = dict_info.get_idxoffsetbits() == 64;
+	const size_t entry_data_size = (offset64 ? sizeof(guint64) : sizeof(guint32)) + sizeof(guint32);
 
 	while (p < buffer_end) {
 		size_remain = buffer_end - p;
@@ -253,7 +275,7 @@ VerifResult binary_dict_parser_t::load_idx_file(void)
 				g_message(fixed_ignore_file_tail_msg);
 			break;
 		}
-		worditem.word = p;
+		worditem.word.assign(p, word_end - p);
 		wordlen = worditem.word.length();
 		if (!g_utf8_validate(worditem.word.c_str(), wordlen, NULL)) {
 			g_warning(word_invalid_utf8_err, worditem.word.c_str());
@@ -330,7 +352,8 @@ VerifResult binary_dict_parser_t::load_idx_file(void)
 			if(fix_errors)
 				g_message(fixed_ignore_word_msg);
 		}
-		if (!preworditem.word.empty() && !worditem.word.empty()) {
+		if (!index.empty() && !index.back().word.empty() && !worditem.word.empty()) {
+			const worditem_t& preworditem = index.back();
 			cmpvalue=stardict_strcmp(preworditem.word.c_str(), worditem.word.c_str());
 			if (cmpvalue>0) {
 				g_warning(wrong_word_order_err, preworditem.word.c_str(), worditem.word.c_str());
@@ -341,15 +364,22 @@ VerifResult binary_dict_parser_t::load_idx_file(void)
 		}
 		p = word_end + 1;
 		size_remain = buffer_end - p;
-		if(size_remain < 2 * sizeof(guint32)) {
+		if(size_remain < entry_data_size) {
 			g_warning(index_file_truncated_err);
 			result = combine_result(result, VERIF_RESULT_CRITICAL);
 			if(fix_errors)
 				g_message(fixed_ignore_file_tail_msg);
 			break;
 		}
-		worditem.offset = g_ntohl(*reinterpret_cast<const guint32 *>(p));
-		p += sizeof(guint32);
+		if(offset64) {
+			guint64 offset;
+			memcpy(&offset, p, sizeof(guint64));
+			worditem.offset = GUINT64_FROM_BE(offset);
+			p += sizeof(guint64);
+		} else {
+			worditem.offset = g_ntohl(*reinterpret_cast<const guint32 *>(p));
+			p += sizeof(guint32);
+		}
 		worditem.size = g_ntohl(*reinterpret_cast<const guint32 *>(p));
 		p += sizeof(guint32);
 		if (worditem.size==0) {
@@ -360,12 +390,15 @@ VerifResult binary_dict_parser_t::load_idx_file(void)
 				g_message(fixed_ignore_word_msg);
 			}
 		}
-		preworditem = worditem;
 		wordcount++;
-		index.push_back(worditem);
+		index.push_back(worditem_t());
+		index.back().word.swap(worditem.word);
+		index.back().offset = worditem.offset;
+		index.back().size = worditem.size;
 	} // while
 
 	g_assert(p <= buffer_end);
+	g_mapped_file_unref(idxmap);
 
 	if (dict_info.get_wordcount() != wordcount) {
 		g_warning(incorrect_word_cnt_err, dict_info.get_wordcount(), wordcount);
@@ -651,10 +684,8 @@ VerifResult binary_dict_parser_t::load_dict_file(void)
 		return combine_result(result, VERIF_RESULT_FATAL);
 	}
 
-	std::vector<char> buffer;
-	dictionary_data_block block_verifier;
-	block_verifier.set_resource_storage(p_res_storage);
-	block_verifier.set_fix_errors(fix_errors);
+	std::vector<const worditem_t*> sort_index;
+	sort_index.reserve(index.size());
 	for(size_t i=0; i<index.size(); ++i) {
 		if(index[i].word.empty())
 			continue;
@@ -676,33 +707,98 @@ VerifResult binary_dict_parser_t::load_dict_file(void)
 				continue;
 			}
 		}
-		buffer.resize(index[i].size);
-		if(fseek(get_impl(dictfile), index[i].offset, SEEK_SET)) {
-			std::string error(g_strerror(errno));
-			g_critical(read_file_err, dictfilename.c_str(), error.c_str());
-			return combine_result(result, VERIF_RESULT_FATAL);
-		}
-		if(1 != fread(&buffer[0], index[i].size, 1, get_impl(dictfile))) {
+		sort_index.push_back(&index[i]);
+	}
+	std::sort(sort_index.begin(), sort_index.end(), compare_worditem_by_offset);
+
+	/* Data blocks are verified in offset order on a thread pool.
+	 * Adjacent blocks are grouped into runs, every run is read with one call,
+	 * the main thread reads the next run while workers check the previous ones.
+	 * Workers only store per-item results, fixes are applied afterwards
+	 * in index order, so the index is not changed while workers use it. */
+	std::vector<VerifResult> block_results(index.size(), VERIF_RESULT_OK);
+	data_block_verifier_t verifier;
+	verifier.p_res_storage = p_res_storage;
+	verifier.fix_errors = fix_errors;
+	verifier.sametypesequence = dict_info.get_sametypesequence();
+	verifier.index = index.empty() ? NULL : &index[0];
+	verifier.results = index.empty() ? NULL : &block_results[0];
+	verifier.buffered_size = 0;
+	g_mutex_init(&verifier.mutex);
+	g_cond_init(&verifier.cond);
+	/* a non-exclusive pool cannot fail to be created */
+	GThreadPool *pool = g_thread_pool_new(verify_data_run, &verifier,
+		g_get_num_processors(), FALSE, NULL);
+	bool read_failed = false;
+	for(size_t i=0; i<sort_index.size(); ) {
+		data_run_t *run = new data_run_t;
+		run->offset = sort_index[i]->offset;
+		guint64 run_end = run->offset + sort_index[i]->size;
+		for(; i<sort_index.size(); ++i) {
+			const worditem_t& item = *sort_index[i];
+			if(item.offset > run_end + MAX_DATA_RUN_GAP
+				|| (!run->items.empty() && item.offset + item.size - run->offset > MAX_DATA_RUN_SIZE))
+				break;
+			run->items.push_back(&item - &index[0]);
+			run_end = std::max(run_end, item.offset + item.size);
+		}
+		g_mutex_lock(&verifier.mutex);
+		while(verifier.buffered_size > MAX_DATA_RUN_BUFFERED)
+			g_cond_wait(&verifier.cond, &verifier.mutex);
+		verifier.buffered_size += run_end - run->offset;
+		g_mutex_unlock(&verifier.mutex);
+		run->buffer.resize(run_end - run->offset);
+		if(stardict_fseek(get_impl(dictfile), run->offset, SEEK_SET)
+			|| 1 != fread(&run->buffer[0], run->buffer.size(), 1, get_impl(dictfile))) {
 			std::string error(g_strerror(errno));
 			g_critical(read_file_err, dictfilename.c_str(), error.c_str());
-			return combine_result(result, VERIF_RESULT_FATAL);
+			read_failed = true;
+			delete run;
+			break;
 		}
-		VerifResult result2 = block_verifier.load(&buffer[0], index[i].size,
-				dict_info.get_sametypesequence(), index[i].word.c_str());
-		if(VERIF_RESULT_FATAL <= result2) {
+		g_thread_pool_push(pool, run, NULL);
+	}
+	g_thread_pool_free(pool, FALSE, TRUE);
+	g_mutex_clear(&verifier.mutex);
+	g_cond_clear(&verifier.cond);
+	if(read_failed)
+		return combine_result(result, VERIF_RESULT_FATAL);
+
+	for(size_t i=0; i<index.size(); ++i) {
+		if(VERIF_RESULT_FATAL <= block_results[i]) {
 			result = combine_result(result, VERIF_RESULT_CRITICAL);
 			if(fix_errors) {
 				index[i].word.clear();
 				g_message(fixed_ignore_word_msg);
-				continue;
 			}
 		} else
-			result = combine_result(result, result2);
+			result = combine_result(result, block_results[i]);
 	}
 	result = combine_result(result, verify_data_blocks_overlapping());
 	return result;
 }
 
+/* runs in a worker thread */
+void binary_dict_parser_t::verify_data_run(gpointer data, gpointer user_data)
+{
+	data_run_t *run = static_cast<data_run_t*>(data);
+	data_block_verifier_t *verifier = static_cast<data_block_verifier_t*>(user_data);
+	dictionary_data_block block_verifier;
+	block_verifier.set_resource_storage(verifier->p_res_storage);
+	block_verifier.set_fix_errors(verifier->fix_errors);
+	for(size_t i=0; i<run->items.size(); ++i) {
+		const worditem_t& item = verifier->index[run->items[i]];
+		verifier->results[run->items[i]] = block_verifier.load(
+			&run->buffer[item.offset - run->offset], item.size,
+			verifier->sametypesequence, item.word.c_str());
+	}
+	g_mutex_lock(&verifier->mutex);
+	verifier->buffered_size -= run->buffer.size();
+	g_cond_signal(&verifier->cond);
+	g_mutex_unlock(&verifier->mutex);
+	delete run;
+}
+
 VerifResult binary_dict_parser_t::verify_data_blocks_overlapping(void)
 {
 	VerifResult result = VERIF_RESULT_OK;
@@ -728,7 +824,7 @@ VerifResult binary_dict_parser_t::verify_data_blocks_overlapping(void)
 		g_warning(unreferenced_data_blocks_msg);
 		result = combine_result(result, VERIF_RESULT_NOTE);
 		for(size_t i = 0; i<unused_regions.size(); ++i)
-			g_warning("\t(%u, %u)", unused_regions[i].offset, unused_regions[i].size);
+			g_warning("\t(%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")", unused_regions[i].offset, unused_regions[i].size);
 	}
 	return result;
 }
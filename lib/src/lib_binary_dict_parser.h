@@ -30,7 +30,7 @@
 
 struct worditem_t {
 	std::string word;
-	guint32 offset;
+	guint64 offset;
 	guint32 size;
 };
 
@@ -70,7 +70,7 @@ public:
 	{
 		return dict_info;
 	}
-	int get_data_fields(guint32 offset, guint32 size, data_field_vect_t& fields) const;
+	int get_data_fields(guint64 offset, guint32 size, data_field_vect_t& fields) const;
 
 private:
 	VerifResult prepare_idx_file(void);
@@ -80,6 +80,9 @@ private:
 	VerifResult load_syn_file(void);
 	VerifResult load_dict_file(void);
 	VerifResult verify_data_blocks_overlapping(void);
+	struct data_run_t;
+	struct data_block_verifier_t;
+	static void verify_data_run(gpointer data, gpointer user_data);
 
 	std::string basefilename;
 	std::string ifofilename;
@@ -92,7 +95,7 @@ private:
 	TempFile idxtemp;
 	TempFile dicttemp;
 	clib::File dictfile;
-	guint32 dictfilesize;
+	guint64 dictfilesize;
 	std::vector<worditem_t> index;
 	std::vector<synitem_t> synindex;
 	i_resource_storage* p_res_storage;
@@ -44,8 +44,8 @@ enum VerifResult {
 extern VerifResult stardict_verify(const char *ifofilename);
 
 struct region_t {
-	guint32 offset;
-	guint32 size;
+	guint64 offset;
+	guint64 size;
 };
 
 /* combine two verification results = the most serious error */
@@ -74,13 +74,13 @@ void verify_data_blocks_overlapping(std::vector<item_t*>& sort_index,
 
 template <class item_t>
 void verify_unused_regions(std::vector<item_t*>& sort_index,
-		std::vector<region_t>& unused_regions, guint32 filesize)
+		std::vector<region_t>& unused_regions, guint64 filesize)
 {
 	region_t region;
-	guint32 low_boundary=0;
+	guint64 low_boundary=0;
 	for(size_t i=0; i<sort_index.size(); ++i) {
-		const guint32 l_left = sort_index[i]->offset;
-		const guint32 l_right = sort_index[i]->offset + sort_index[i]->size;
+		const guint64 l_left = sort_index[i]->offset;
+		const guint64 l_right = guint64(sort_index[i]->offset) + sort_index[i]->size;
 		if(l_left < low_boundary) {
 			if(l_right > low_boundary)
 				low_boundary = l_right;
@@ -165,7 +165,7 @@ void verify_unused_regions(std::vector<item_t*>& sort_index,
 #define incorrect_syn_word_cnt_err \
 	"Incorrect number of words: in .ifo file, synwordcount=%d, while the real synwordcount is %d."
 #define duplicate_index_item_err \
-	"Multiple index items have the same key = '%s', offset = %d, size = %d."
+	"Multiple index items have the same key = '%s', offset = %" G_GUINT64_FORMAT ", size = %u."
 #define duplicate_syn_item_err \
 	"Multiple synonym items with the same key = '%s', index = %d."
 #define syn_file_exist_msg \
@@ -188,7 +188,7 @@ void verify_unused_regions(std::vector<item_t*>& sort_index,
 	"Index item '%s'. Incorrect size, offset parameters. Referenced data block is outside dictionary file."
 #define overlapping_data_blocks_msg \
 	"Index item '%s' and index item '%s' refer to overlapping but not equal regions (offset, size): " \
-	"(%u, %u) and (%u, %u)."
+	"(%" G_GUINT64_FORMAT ", %u) and (%" G_GUINT64_FORMAT ", %u)."
 #define unreferenced_data_blocks_msg \
 	"Dictionary contains unreferenced data blocks (offset, size):"
 #define rdb_unreferenced_data_blocks_msg \
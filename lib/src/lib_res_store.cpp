@@ -360,7 +360,7 @@ VerifResult resource_database::verify_data_blocks_overlapping(void)
 		const fileitem_t& second = *sort_index[overlapping_blocks[i].second];
 		g_warning(overlapping_data_blocks_msg,
 			first.filename.c_str(), second.filename.c_str(),
-			first.offset, first.size, second.offset, second.size);
+			guint64(first.offset), first.size, guint64(second.offset), second.size);
 		result = combine_result(result, VERIF_RESULT_WARNING);
 	}
 	// find not used regions
@@ -369,7 +369,7 @@ VerifResult resource_database::verify_data_blocks_overlapping(void)
 	if(!unused_regions.empty()) {
 		g_warning(rdb_unreferenced_data_blocks_msg);
 		for(size_t i = 0; i<unused_regions.size(); ++i)
-			g_warning("\t(%u, %u)\n", unused_regions[i].offset, unused_regions[i].size);
+			g_warning("\t(%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ")\n", unused_regions[i].offset, unused_regions[i].size);
 		result = combine_result(result, VERIF_RESULT_NOTE);
 	}
 	return result;
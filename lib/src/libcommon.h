@@ -86,6 +86,26 @@ enum TLoadResult { lrOK, lrError, lrNotFound };
 
 int unpack_zlib(const char* arch_file_name, const char* out_file_name);
 
+/* fseek and ftell with 64-bit offsets, needed for dictionaries with idxoffsetbits=64.
+ * On 32-bit POSIX systems this requires large file support, see AC_SYS_LARGEFILE. */
+inline int stardict_fseek(FILE *stream, gint64 offset, int whence)
+{
+#ifdef _WIN32
+	return _fseeki64(stream, offset, whence);
+#else
+	return fseeko(stream, offset, whence);
+#endif
+}
+
+inline gint64 stardict_ftell(FILE *stream)
+{
+#ifdef _WIN32
+	return _ftelli64(stream);
+#else
+	return ftello(stream);
+#endif
+}
+
 /* allows to create a temporary file, remove the temporary file when the object is destroyed. */
 class TempFile
 {
@@ -215,7 +235,7 @@ int remove_recursive(const std::string& path);
 #define UTF8_BOM "\xEF\xBB\xBF"
 
 #define known_type_ids \
-	"mtygxkwhnr"
+	"mtygxkwhnrG"
 
 #define file_not_found_err \
 	"File does not exist: '%s'"
@@ -23,23 +23,24 @@
 #include "stdlib.h"
 #include <locale.h>
 #include <string.h>
-#include <sys/stat.h>
+#include <errno.h>
+#include <iostream>
+#include <string>
+#include <vector>
 
 
 #include <gtk/gtk.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+
+#include "libcommon.h"
+#include "lib_external_sort.h"
+#include "lib_read_line.h"
 
 #define DICTD_WEBSITE "www.dict.org"
 //#define DICTD_WEBSITE "www.freedict.de"
 //#define DICTD_WEBSITE "www.mova.org"
 
-struct _worditem
-{
-	gchar *word;
-	gchar *definition;
-	glong size;
-};
-
 static unsigned char b64_list[] =
 "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
@@ -102,82 +103,37 @@ unsigned long b64_decode( const char *val )
    return v;
 }
 
-gint stardict_strcmp(const gchar *s1, const gchar *s2)
+static bool read_index(const std::string& indexfilename, const std::string& dictfilename,
+	external_sorter_t& sorter)
 {
-	gint a;
-	a = g_ascii_strcasecmp(s1, s2);
-	if (a == 0)
-		return strcmp(s1, s2);
-	else
-		return a;
-}
-
-gint comparefunc(gconstpointer a,gconstpointer b)
-{
-	return stardict_strcmp(((struct _worditem *)a)->word,((struct _worditem *)b)->word);
-}
-
-void convert(char *basefilename)
-{			
-	gchar indexfilename[256];
-	gchar dictfilename[256];
-	sprintf(indexfilename, "%s.index", basefilename);
-	sprintf(dictfilename, "%s.dict", basefilename);
-	
-	struct stat stats;
-	if (stat (indexfilename, &stats) == -1)
-	{
+	clib::File indexfile(g_fopen(indexfilename.c_str(), "rb"));
+	if (!indexfile) {
 		printf("index file not exist!\n");
-		return;
+		return false;
 	}
-	FILE *indexfile;
-	indexfile = fopen(indexfilename,"r");
-	gchar *buffer = (gchar *)g_malloc (stats.st_size + 1);
-	size_t fread_size;
-	fread_size = fread (buffer, 1, stats.st_size, indexfile);
-	if (fread_size != (size_t)stats.st_size) {
-		g_print("fread error!\n");
-	}
-	fclose (indexfile);
-	buffer[stats.st_size] = '\0';
-
-	if (stat (dictfilename, &stats) == -1)
-	{
+	clib::File dictfile(g_fopen(dictfilename.c_str(), "rb"));
+	if (!dictfile) {
 		printf("dict file not exist!\n");
-		return;
+		return false;
 	}
 
-	FILE *dictfile;
-	dictfile = fopen(dictfilename,"r");
-	gchar *buffer1 = (gchar *)g_malloc (stats.st_size + 1);
-	fread_size = fread (buffer1, 1, stats.st_size, dictfile);
-	if (fread_size != (size_t)stats.st_size) {
-		g_print("fread error!\n");
-	}
-	fclose (dictfile);
-	buffer1[stats.st_size] = '\0';
-
-	
-	GArray *array = g_array_sized_new(FALSE,FALSE, sizeof(struct _worditem),20000);
-		
-	gchar *p, *p1, *p2, *p3, *p4;
-	p = buffer;
-	struct _worditem worditem;
+	std::string line;
+	bool newline;
+	std::vector<gchar> definition;
+	gchar *p, *p1, *p2, *p4;
+	gchar *word;
 	glong linenum=1;
 	gulong d_start,d_size;
 	gint word_len;
-	while (1) {
-		if (*p == '\0') {
-			g_print("over\n");
-			break;
-		}
+	for (; read_line(get_impl(indexfile), line, newline); linenum++) {
+		p = &line[0];
 		p1 = strchr(p,'\t');
 		if (p1) {
 			*p1 = '\0';
 		}
 		else {
 			g_print("Error! No tab char 1 found! %ld\n", linenum);
-			return;
+			return false;
 		}
 		p2 = strchr(p1+1,'\t');
 		if (p2) {
@@ -185,11 +141,9 @@ void convert(char *basefilename)
 		}
 		else {
 			g_print("Error! No tab char 2 found! %ld\n", linenum);
-			return;
+			return false;
 		}
-		p3 = strchr(p2+1,'\n');
-		if (p3) {
-			*p3 = '\0';
+		if (newline) {
 			p4 = strchr(p2+1,'\t');
 			if (p4) {
 				//Maybe need to export it to .syn file!
@@ -198,137 +152,124 @@ void convert(char *basefilename)
 		}
 		else {
 			g_print("Error! No end up new line found %ld\n", linenum);
-			return;
+			return false;
 		}
-		worditem.word = p;
-		g_strstrip(worditem.word);
-		if (g_str_has_prefix(p, "00-database-")) {
-			p= p3+1;
-			linenum++;
+		word = p;
+		g_strstrip(word);
+		if (g_str_has_prefix(p, "00-database-"))
 			continue;
-		}
-		if (!g_utf8_validate(worditem.word, -1,NULL)) {
-			g_print("word %s convert to utf8 error!\n",worditem.word);			
-			p= p3+1;
-			linenum++;
+		if (!g_utf8_validate(word, -1,NULL)) {
+			g_print("word %s convert to utf8 error!\n",word);
 			continue;
 		}
 		d_start = b64_decode(p1+1);
 		d_size = b64_decode(p2+1);
-		
-		worditem.definition = buffer1 + d_start;
-		word_len = strlen(worditem.word);
-		if (strncmp(worditem.word, worditem.definition, word_len)==0 && worditem.definition[word_len]=='\n') {
-			worditem.definition = worditem.definition + word_len + 1;
+
+		definition.resize(d_size+1);
+		if (stardict_fseek(get_impl(dictfile), d_start, SEEK_SET)
+			|| (d_size && 1 != fread(&definition[0], d_size, 1, get_impl(dictfile)))) {
+			std::string err(g_strerror(errno));
+			g_critical(read_file_err, dictfilename.c_str(), err.c_str());
+			return false;
+		}
+		definition[d_size] = '\0';
+		const gchar *pdefinition = &definition[0];
+		word_len = strlen(word);
+		if (strncmp(word, pdefinition, word_len)==0 && pdefinition[word_len]=='\n') {
+			pdefinition = pdefinition + word_len + 1;
 			d_size = d_size - word_len - 1;
 		}
-		while (d_size && g_ascii_isspace(*(worditem.definition+d_size-1))) {
+		while (d_size && g_ascii_isspace(*(pdefinition+d_size-1))) {
 			d_size--; // remove end up new-line.
 		}
-		worditem.size = d_size;
-		if (!g_utf8_validate(worditem.definition, d_size,NULL)) {
-			g_print("word definition %s convert to utf8 error!\n",worditem.word);	
-			p= p3+1;
-                	linenum++;
+		if (!g_utf8_validate(pdefinition, d_size,NULL)) {
+			g_print("word definition %s convert to utf8 error!\n",word);
 			continue;
 		}
-		if ((!worditem.word[0]) || (d_size==0)) {
-			p= p3+1;
-                        linenum++;
-                        continue;
-		}
-		g_array_append_val(array, worditem);			
-		p= p3+1;				
-		linenum++;
-	}	
-	g_array_sort(array,comparefunc);
-	
-	gchar ifofilename[256];
-	sprintf(ifofilename, "dictd_" DICTD_WEBSITE "_%s.ifo", basefilename);
-	g_print("File: %s\n", ifofilename);
-	FILE *ifofile = fopen(ifofilename,"w");
-	gchar idxfilename[256];
-	sprintf(idxfilename, "dictd_" DICTD_WEBSITE "_%s.idx", basefilename);
-	g_print("File: %s\n", idxfilename);
-	FILE *idxfile = fopen(idxfilename,"w");
-	gchar dicfilename[256];
-	sprintf(dicfilename, "dictd_" DICTD_WEBSITE "_%s.dict", basefilename);
-	g_print("File: %s\n", dicfilename);
-	FILE *dicfile = fopen(dicfilename,"w");
+		if ((!word[0]) || (d_size==0))
+			continue;
+		if (!sorter.add(word, pdefinition, d_size))
+			return false;
+	}
+	if (ferror(get_impl(indexfile))) {
+		std::string err(g_strerror(errno));
+		g_critical(read_file_err, indexfilename.c_str(), err.c_str());
+		return false;
+	}
+	g_print("over\n");
+	return true;
+}
 
-	glong tmpglong = 0;
-#if 0
-	fwrite(&(tmpglong),sizeof(glong),1,idxfile);		
-#endif	
-	glong wordcount = array->len;
-	long offset_old;
-	const gchar *previous_word = "";
-	struct _worditem *pworditem;
-	gulong i=0;
-	glong thedatasize;
+/* Articles of equal words are merged into one article. */
+static bool write_dictionary(const std::string& basefilename, external_sorter_t& sorter,
+	sorted_dict_writer_t& writer)
+{
+	if (!writer.open(basefilename))
+		return false;
 	const gchar *insert_word = "\n\n";
-	gboolean flag;
-	pworditem = &g_array_index(array, struct _worditem, i);
-	while (i<array->len)
-	{
-		thedatasize = 0; 
-		offset_old = ftell(dicfile);
-		flag = true;
-		while (flag == true)
-		{	
-			fwrite(pworditem->definition, 1 ,pworditem->size,dicfile);
-			thedatasize += pworditem->size;
-			previous_word = pworditem->word;
-						
-			i++;
-			if (i<array->len)
-			{
-				pworditem = &g_array_index(array, struct _worditem, i);
-				if (strcmp(previous_word,pworditem->word)==0)
-				{
-					//g_print("D! %s\n",previous_word);
-					flag = true;
-					wordcount--;
-					fwrite(insert_word,sizeof(gchar),strlen(insert_word),dicfile);
-					thedatasize += strlen(insert_word);
-				}
-				else 
-				{
-					flag = false;
-				}
-			}
-			else
-				flag = false;
+	std::string previous_word;
+	std::string thedata;
+	bool have_previous = false;
+	const char *word, *definition;
+	guint32 size;
+	while (sorter.next(word, definition, size)) {
+		if (have_previous && previous_word == word) {
+			//g_print("D! %s\n",previous_word.c_str());
+			thedata += insert_word;
+			thedata.append(definition, size);
+			continue;
 		}
-		fwrite(previous_word,sizeof(gchar),strlen(previous_word)+1,idxfile);
-		tmpglong = g_htonl(offset_old);
-		fwrite(&(tmpglong),sizeof(glong),1,idxfile);
-		tmpglong = g_htonl(thedatasize);
-		//g_print("size: %ld\n", thedatasize);
-		fwrite(&(tmpglong),sizeof(glong),1,idxfile);	
+		if (have_previous && !writer.add(previous_word.c_str(), thedata.c_str(), thedata.length()))
+			return false;
+		previous_word = word;
+		thedata.assign(definition, size);
+		have_previous = true;
+	}
+	if (sorter.failed())
+		return false;
+	if (have_previous && !writer.add(previous_word.c_str(), thedata.c_str(), thedata.length()))
+		return false;
+	return writer.finish();
+}
+
+static void convert(const char *basefilename, size_t memory_limit, guint max_threads)
+{
+	const std::string indexfilename = std::string(basefilename) + ".index";
+	const std::string dictfilename = std::string(basefilename) + ".dict";
+
+	external_sorter_t sorter(memory_limit, max_threads);
+	if (!read_index(indexfilename, dictfilename, sorter) || !sorter.finish())
+		return;
+
+	const std::string outbasefilename = std::string("dictd_" DICTD_WEBSITE "_") + basefilename;
+	const std::string ifofilename = outbasefilename + ".ifo";
+	g_print("File: %s\n", ifofilename.c_str());
+	g_print("File: %s.idx\n", outbasefilename.c_str());
+	g_print("File: %s.dict\n", outbasefilename.c_str());
+	clib::File ifofile(g_fopen(ifofilename.c_str(),"wb"));
+	if (!ifofile) {
+		g_critical(open_write_file_err, ifofilename.c_str());
+		return;
 	}
-#if 0	
-	fseek(idxfile,0,SEEK_SET);
-	tmpglong = g_htonl(wordcount);
-	fwrite(&(tmpglong),sizeof(glong),1,idxfile);
-#endif	
-	g_print("wordcount: %ld\n",wordcount);
+	sorted_dict_writer_t writer;
+	if (!write_dictionary(outbasefilename, sorter, writer))
+		return;
+	g_print("wordcount: %" G_GUINT64_FORMAT "\n", writer.get_wordcount());
 
-	g_free(buffer);
-	g_free(buffer1);
-	g_array_free(array,TRUE);
-	
-	fclose(idxfile);
-	fclose(dicfile);	
-	
-	stat(idxfilename, &stats);
-	fprintf(ifofile, "StarDict's dict ifo file\nversion=2.4.2\nwordcount=%ld\nidxfilesize=%ld\nbookname=%s\nsametypesequence=m\n", wordcount, stats.st_size, basefilename);
-	fclose(ifofile);
+	fprintf(get_impl(ifofile), "StarDict's dict ifo file\nversion=%s\nwordcount=%" G_GUINT64_FORMAT "\n"
+		"idxfilesize=%" G_GUINT64_FORMAT "\n%sbookname=%s\nsametypesequence=m\n",
+		writer.get_offset64() ? "3.0.0" : "2.4.2",
+		writer.get_wordcount(), writer.get_idxfilesize(),
+		writer.get_offset64() ? "idxoffsetbits=64\n" : "",
+		basefilename);
 
-	gchar command[256];
-	sprintf(command, "dictzip dictd_" DICTD_WEBSITE "_%s.dict", basefilename);
+	if (writer.get_offset64()) {
+		g_message("Dictionary file is larger than 4GB, it is not compressed.");
+		return;
+	}
+	std::string command(std::string("dictzip ") + writer.get_dict_file_name());
 	int result;
-	result = system(command);
+	result = system(command.c_str());
 	if (result == -1) {
 		g_print("system() error!\n");
 	}
@@ -337,13 +278,34 @@ void convert(char *basefilename)
 int
 main(int argc,char * argv [])
 {
+	setlocale(LC_ALL, "");
+	gint memory_limit = EXTERNAL_SORT_MEMORY_LIMIT / (1024*1024);
+	gint max_threads = 0;
+	static GOptionEntry entries[] = {
+		{ "memory-limit", 'm', 0, G_OPTION_ARG_INT, &memory_limit, "memory used for sorting articles, in MB", "MB" },
+		{ "threads", 't', 0, G_OPTION_ARG_INT, &max_threads, "number of threads sorting articles, 0 - number of processors", "N" },
+		{ NULL },
+	};
+	glib::OptionContext opt_cnt(g_option_context_new("BASENAME"));
+	g_option_context_add_main_entries(get_impl(opt_cnt), entries, NULL);
+	g_option_context_set_help_enabled(get_impl(opt_cnt), TRUE);
+	g_option_context_set_summary(get_impl(opt_cnt),
+		"Convert dictd dictionary BASENAME.index, BASENAME.dict into StarDict format.\n"
+		"Articles that do not fit into the memory limit are sorted in temporary files.");
+	glib::Error err;
+	if (!g_option_context_parse(get_impl(opt_cnt), &argc, &argv, get_addr(err))) {
+		std::cerr << "Option parsing failed: " <<  err->message << std::endl;
+		return EXIT_FAILURE;
+	}
 	if (argc!=2) {
 		printf("please type this:\n./dictd2dic eng-fra\n");
 		return FALSE;
 	}
+	if (memory_limit <= 0 || max_threads < 0) {
+		std::cerr << "Invalid memory limit or number of threads." << std::endl;
+		return EXIT_FAILURE;
+	}
 
-	setlocale(LC_ALL, "");
-	convert (argv[1]);
+	convert (argv[1], size_t(memory_limit)*1024*1024, max_threads);
 	return FALSE;
-	
 }
@@ -20,32 +20,53 @@
 #endif
 
 #include <cstring>
+#include <memory>
 #include <algorithm>
+#include <glib/gstdio.h>
 #include "lib_binary_dict_generator.h"
 #include "lib_dict_verify.h"
+#include "lib_dictzip_writer.h"
 
-struct synitem_t {
-	synitem_t(const std::string& synonym, size_t index)
-	:
-		synonym(synonym),
-		index(index)
-	{
-
-	}
-	std::string synonym;
-	size_t index;
-};
+/* number of articles serialized in one job */
+const size_t ARTICLES_PER_JOB = 1024;
+/* number of serialized jobs waiting to be written */
+const size_t MAX_ARTICLE_JOBS = 16;
 
-static bool compare_synitems_by_synonym(const synitem_t& left, const synitem_t& right)
+bool binary_dict_gen_t::compare_synitems_by_synonym(const synitem_t& left, const synitem_t& right)
 {
 	return 0 > stardict_strcmp(left.synonym.c_str(), right.synonym.c_str());
 }
 
+struct binary_dict_gen_t::articles_job_t : public ordered_pool_t::job_t
+{
+	articles_job_t(binary_dict_gen_t *gen, size_t begin, size_t end)
+	:
+		gen(gen),
+		begin(begin),
+		end(end),
+		ok(true)
+	{
+	}
+	virtual void run(void)
+	{
+		ok = !gen->serialize_articles(begin, end, data, sizes);
+	}
+	binary_dict_gen_t *gen;
+	/* articles [begin, end) */
+	size_t begin;
+	size_t end;
+	/* data blocks of the articles, one after another */
+	std::vector<char> data;
+	std::vector<size_t> sizes;
+	bool ok;
+};
+
 binary_dict_gen_t::binary_dict_gen_t(void)
 :
 	norm_dict(NULL),
 	use_same_type_sequence(true),
-	compress_dict(true)
+	compress_dict(true),
+	offset64(false)
 {
 
 }
@@ -61,18 +82,12 @@ int binary_dict_gen_t::generate(const std::string& ifofilename, common_dict_t *n
 	}
 	basefilename.assign(ifofilename, 0, ifofilename.length() - (sizeof(".ifo")-1));
 	decide_on_same_type_sequence();
-	if(generate_dict_and_idx())
+	/* synonyms are sorted while the dictionary is written */
+	GThread *syn_thread = g_thread_new("sort_synonyms", sort_synonyms_thread, this);
+	const int res = generate_dict_and_idx();
+	g_thread_join(syn_thread);
+	if(res)
 		return EXIT_FAILURE;
-#ifndef _WIN32
-	if(compress_dict) {
-		std::string command(std::string("dictzip ") + dictfilename);
-		int result;
-		result = system(command.c_str());
-		if (result == -1) {
-			g_print("system() error!\n");
-		}
-	}
-#endif
 	if(generate_syn())
 		return EXIT_FAILURE;
 	norm_dict->dict_info.ifo_file_name = ifofilename;
@@ -82,6 +97,26 @@ int binary_dict_gen_t::generate(const std::string& ifofilename, common_dict_t *n
 	return EXIT_SUCCESS;
 }
 
+int binary_dict_gen_t::serialize_dict(common_dict_t *norm_dict, const std::string& same_type_sequence,
+	std::vector<char>& data, std::vector<size_t>& sizes)
+{
+	clear();
+	this->norm_dict = norm_dict;
+	this->same_type_sequence = same_type_sequence;
+	if(!same_type_sequence.empty()) {
+		for(size_t i=0; i<norm_dict->articles.size(); ++i) {
+			const std::string seq = build_type_sequence(norm_dict->articles[i]);
+			if(seq != same_type_sequence) {
+				g_critical("Article '%s' needs type sequence '%s', "
+					"while the dictionary uses same type sequence '%s'.",
+					norm_dict->articles[i].key.c_str(), seq.c_str(), same_type_sequence.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	return serialize_articles(0, norm_dict->articles.size(), data, sizes);
+}
+
 void binary_dict_gen_t::clear(void)
 {
 	norm_dict = NULL;
@@ -93,51 +128,133 @@ void binary_dict_gen_t::clear(void)
 	dictfile.reset(NULL);
 	idxfile.reset(NULL);
 	synfile.reset(NULL);
+	synonyms.clear();
+	offset64 = false;
 }
 
+/* Articles are serialized in batches on a worker thread, while this thread
+ * writes the previous batches into the .dict file and passes them to the dictzip writer,
+ * which compresses them on its own thread pool. */
 int binary_dict_gen_t::generate_dict_and_idx(void)
 {
 	if(prepare_dict())
 		return EXIT_FAILURE;
 	if(prepare_idx())
 		return EXIT_FAILURE;
-	for(size_t i=0; i<norm_dict->articles.size(); ++i) {
-		const article_data_t& article = norm_dict->articles[i];
-		const guint32 offset = ftell(get_impl(dictfile));
-		for(size_t j=0; j<article.definitions.size(); ++j) {
-			if(same_type_sequence.empty()) {
-				if(generate_dict_definition(article.definitions[j], article.key))
+	dictzip_writer_t dictzip;
+	bool compress = compress_dict && dictzip.open(dictfilename + ".dz");
+	/* Index items are written when the dictionary file is complete,
+	 * then we know whether 32-bit offsets are enough. */
+	std::vector<std::pair<guint64, guint32> > items(norm_dict->articles.size());
+	{
+		/* one thread, norm_dict->read_data is not thread-safe */
+		ordered_pool_t pool(1, MAX_ARTICLE_JOBS);
+		guint64 offset = 0;
+		size_t next = 0;
+		ordered_pool_t::job_t *done_job;
+		while(true) {
+			if(next < norm_dict->articles.size()) {
+				const size_t end = std::min(next + ARTICLES_PER_JOB, norm_dict->articles.size());
+				pool.push(new articles_job_t(this, next, end), done_job);
+				next = end;
+				if(!done_job)
+					continue;
+			} else if(!(done_job = pool.pop(true)))
+				break;
+			std::auto_ptr<articles_job_t> job(static_cast<articles_job_t *>(done_job));
+			if(!job->ok)
+				return EXIT_FAILURE;
+			if(!job->data.empty()) {
+				if(1 != fwrite(&job->data[0], job->data.size(), 1, get_impl(dictfile))) {
+					g_critical(write_file_err, dictfilename.c_str());
 					return EXIT_FAILURE;
-			} else {
-				if(generate_dict_definition_sts(article.definitions[j], article.key,
-						j+1 == article.definitions.size()))
+				}
+				if(compress && !dictzip.write(&job->data[0], job->data.size()))
+					compress = false;
+			}
+			for(size_t i=job->begin; i<job->end; ++i) {
+				const size_t size = job->sizes[i - job->begin];
+				if(size > G_MAXUINT32) {
+					g_critical("Index item '%s'. Data block is larger than 4GB.",
+						norm_dict->articles[i].key.c_str());
 					return EXIT_FAILURE;
+				}
+				items[i] = std::pair<guint64, guint32>(offset, size);
+				offset += size;
 			}
 		}
-		const guint32 size = ftell(get_impl(dictfile)) - offset;
-		if(generate_index_item(article.key, offset, size))
+		offset64 = offset > G_MAXUINT32;
+	}
+	if(offset64) {
+		norm_dict->dict_info.set_idxoffsetbits(64);
+		norm_dict->dict_info.set_version("3.0.0");
+	} else
+		norm_dict->dict_info.unset_idxoffsetbits();
+	for(size_t i=0; i<norm_dict->articles.size(); ++i) {
+		if(generate_index_item(norm_dict->articles[i].key, items[i].first, items[i].second))
 			return EXIT_FAILURE;
 	}
 	norm_dict->dict_info.set_wordcount(norm_dict->articles.size());
 	norm_dict->dict_info.set_index_file_size(ftell(get_impl(idxfile)));
 	dictfile.reset(NULL);
 	idxfile.reset(NULL);
+	if(compress_dict) {
+		if(compress && dictzip.finish())
+			g_remove(dictfilename.c_str());
+		else if(offset64)
+			// dictzip format cannot address more than 4GB of data
+			g_message("Dictionary file is larger than 4GB, it is not compressed.");
+		else if(dictzip.get_too_large())
+			g_message("Dictionary file is too large for dictzip, it is not compressed.");
+		else
+			g_warning("Dictionary file is not compressed.");
+	}
 	return EXIT_SUCCESS;
 }
 
-int binary_dict_gen_t::generate_syn(void)
+/* Serialize articles [begin, end) into data, sizes receives the size of each article.
+ * Runs in a worker thread. */
+int binary_dict_gen_t::serialize_articles(size_t begin, size_t end,
+		std::vector<char>& data, std::vector<size_t>& sizes)
 {
-	norm_dict->dict_info.unset_synwordcount();
-	std::vector<synitem_t> synonyms;
-	for(size_t i=0; i<norm_dict->articles.size(); ++i) {
+	for(size_t i=begin; i<end; ++i) {
 		const article_data_t& article = norm_dict->articles[i];
+		const size_t pos = data.size();
+		for(size_t j=0; j<article.definitions.size(); ++j) {
+			if(same_type_sequence.empty()) {
+				if(generate_dict_definition(article.definitions[j], article.key, data))
+					return EXIT_FAILURE;
+			} else {
+				if(generate_dict_definition_sts(article.definitions[j], article.key,
+						j+1 == article.definitions.size(), data))
+					return EXIT_FAILURE;
+			}
+		}
+		sizes.push_back(data.size() - pos);
+	}
+	return EXIT_SUCCESS;
+}
+
+gpointer binary_dict_gen_t::sort_synonyms_thread(gpointer data)
+{
+	binary_dict_gen_t *gen = static_cast<binary_dict_gen_t *>(data);
+	const std::vector<article_data_t>& articles = gen->norm_dict->articles;
+	for(size_t i=0; i<articles.size(); ++i) {
+		const article_data_t& article = articles[i];
 		for(size_t j=0; j<article.synonyms.size(); ++j) {
-			synonyms.push_back(synitem_t(article.synonyms[j], i));
+			gen->synonyms.push_back(synitem_t(article.synonyms[j], i));
 		}
 	}
+	std::sort(gen->synonyms.begin(), gen->synonyms.end(), compare_synitems_by_synonym);
+	return NULL;
+}
+
+/* synonyms must be sorted by sort_synonyms_thread */
+int binary_dict_gen_t::generate_syn(void)
+{
+	norm_dict->dict_info.unset_synwordcount();
 	if(synonyms.empty())
 		return EXIT_SUCCESS;
-	std::sort(synonyms.begin(), synonyms.end(), compare_synitems_by_synonym);
 	if(prepare_syn())
 		return EXIT_SUCCESS;
 	std::vector<char> buf;
@@ -189,36 +306,31 @@ int binary_dict_gen_t::prepare_syn(void)
 	return EXIT_SUCCESS;
 }
 
-int binary_dict_gen_t::generate_dict_definition(const article_def_t& def, const std::string& key)
+/* append the definition to data */
+int binary_dict_gen_t::generate_dict_definition(const article_def_t& def, const std::string& key,
+		std::vector<char>& data)
 {
 	const char type_id = def.type;
 	if(g_ascii_islower(type_id)) {
 		if(type_id == 'r') {
-			if(generate_dict_definition_r(def.resources, key))
+			if(generate_dict_definition_r(def.resources, key, data))
 				return EXIT_FAILURE;
 		} else {
-			std::vector<char> buf;
-			buf.resize(1 + def.size + 1);
-			buf[0] = type_id;
-			if(norm_dict->read_data(&buf[1], def.size, def.offset)) {
-				return EXIT_FAILURE;
-			}
-			buf.back() = '\0';
-			if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-				g_critical(write_file_err, dictfilename.c_str());
+			const size_t pos = data.size();
+			data.resize(pos + 1 + def.size + 1);
+			data[pos] = type_id;
+			if(norm_dict->read_data(&data[pos + 1], def.size, def.offset)) {
 				return EXIT_FAILURE;
 			}
+			data.back() = '\0';
 		}
 	} else if(g_ascii_isupper(type_id)) {
-		std::vector<char> buf;
-		buf.resize(1 + sizeof(guint32) + def.size);
-		buf[0] = type_id;
-		*reinterpret_cast<guint32*>(&buf[1]) = g_htonl(static_cast<guint32>(def.size));
-		if(norm_dict->read_data(&buf[1 + sizeof(guint32)], def.size, def.offset)) {
-			return EXIT_FAILURE;
-		}
-		if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-			g_critical(write_file_err, dictfilename.c_str());
+		const size_t pos = data.size();
+		data.resize(pos + 1 + sizeof(guint32) + def.size);
+		data[pos] = type_id;
+		const guint32 t = g_htonl(static_cast<guint32>(def.size));
+		memcpy(&data[pos + 1], &t, sizeof(guint32));
+		if(norm_dict->read_data(&data[pos + 1 + sizeof(guint32)], def.size, def.offset)) {
 			return EXIT_FAILURE;
 		}
 	} else {
@@ -231,36 +343,30 @@ int binary_dict_gen_t::generate_dict_definition(const article_def_t& def, const
 /* same as generate_dict_definition, but same type sequence is in effect
  * last is true if this is the last definition */
 int binary_dict_gen_t::generate_dict_definition_sts(const article_def_t& def,
-		const std::string& key, bool last)
+		const std::string& key, bool last, std::vector<char>& data)
 {
 	const char type_id = def.type;
 	if(g_ascii_islower(type_id)) {
 		if(type_id == 'r') {
-			if(generate_dict_definition_r_sts(def.resources, key, last))
+			if(generate_dict_definition_r_sts(def.resources, key, last, data))
 				return EXIT_FAILURE;
 		} else {
-			std::vector<char> buf;
-			buf.resize(def.size + (last ? 0 : 1));
-			if(norm_dict->read_data(&buf[0], def.size, def.offset)) {
+			const size_t pos = data.size();
+			data.resize(pos + def.size + (last ? 0 : 1));
+			if(norm_dict->read_data(&data[pos], def.size, def.offset)) {
 				return EXIT_FAILURE;
 			}
 			if(!last)
-				buf.back() = '\0';
-			if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-				g_critical(write_file_err, dictfilename.c_str());
-				return EXIT_FAILURE;
-			}
+				data.back() = '\0';
 		}
 	} else if(g_ascii_isupper(type_id)) {
-		std::vector<char> buf;
-		buf.resize((last ? 0 : sizeof(guint32)) + def.size);
-		if(!last)
-			*reinterpret_cast<guint32*>(&buf[0]) = g_htonl(static_cast<guint32>(def.size));
-		if(norm_dict->read_data(&buf[(last ? 0 : sizeof(guint32))], def.size, def.offset)) {
-			return EXIT_FAILURE;
+		const size_t pos = data.size();
+		data.resize(pos + (last ? 0 : sizeof(guint32)) + def.size);
+		if(!last) {
+			const guint32 t = g_htonl(static_cast<guint32>(def.size));
+			memcpy(&data[pos], &t, sizeof(guint32));
 		}
-		if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-			g_critical(write_file_err, dictfilename.c_str());
+		if(norm_dict->read_data(&data[pos + (last ? 0 : sizeof(guint32))], def.size, def.offset)) {
 			return EXIT_FAILURE;
 		}
 	} else {
@@ -270,7 +376,8 @@ int binary_dict_gen_t::generate_dict_definition_sts(const article_def_t& def,
 	return EXIT_SUCCESS;
 }
 
-int binary_dict_gen_t::generate_dict_definition_r(const resource_vect_t& resources, const std::string& key)
+int binary_dict_gen_t::generate_dict_definition_r(const resource_vect_t& resources, const std::string& key,
+		std::vector<char>& data)
 {
 	std::string str;
 	str += 'r';
@@ -282,17 +389,14 @@ int binary_dict_gen_t::generate_dict_definition_r(const resource_vect_t& resourc
 		str += ':';
 		str += resources[i].key;
 	}
-	if(1 != fwrite(str.c_str(), str.length() + 1, 1, get_impl(dictfile))) {
-		g_critical(write_file_err, dictfilename.c_str());
-		return EXIT_FAILURE;
-	}
+	data.insert(data.end(), str.c_str(), str.c_str() + str.length() + 1);
 	return EXIT_SUCCESS;
 }
 
 /* same as generate_dict_definition_r, but same type sequence is in effect
  * last is true if this is the last definition */
 int binary_dict_gen_t::generate_dict_definition_r_sts(const resource_vect_t& resources,
-		const std::string& key, bool last)
+		const std::string& key, bool last, std::vector<char>& data)
 {
 	std::string str;
 	for(size_t i=0; i<resources.size(); ++i) {
@@ -303,21 +407,23 @@ int binary_dict_gen_t::generate_dict_definition_r_sts(const resource_vect_t& res
 		str += ':';
 		str += resources[i].key;
 	}
-	if(1 != fwrite(str.c_str(), str.length() + (last ? 0 : 1), 1, get_impl(dictfile))) {
-		g_critical(write_file_err, dictfilename.c_str());
-		return EXIT_FAILURE;
-	}
+	data.insert(data.end(), str.c_str(), str.c_str() + str.length() + (last ? 0 : 1));
 	return EXIT_SUCCESS;
 }
 
-int binary_dict_gen_t::generate_index_item(const std::string& key, guint32 offset, guint32 size)
+int binary_dict_gen_t::generate_index_item(const std::string& key, guint64 offset, guint32 size)
 {
 	std::vector<char> buf;
 	const size_t len = key.length();
-	buf.resize(len + 1 + sizeof(guint32)*2);
+	const size_t offset_size = offset64 ? sizeof(guint64) : sizeof(guint32);
+	buf.resize(len + 1 + offset_size + sizeof(guint32));
 	memcpy(&buf[0], key.c_str(), len+1);
-	*reinterpret_cast<guint32*>(&buf[len+1]) = g_htonl(offset);
-	*reinterpret_cast<guint32*>(&buf[len+1+sizeof(guint32)]) = g_htonl(size);
+	if(offset64) {
+		const guint64 t = GUINT64_TO_BE(offset);
+		memcpy(&buf[len+1], &t, sizeof(guint64));
+	} else
+		*reinterpret_cast<guint32*>(&buf[len+1]) = g_htonl(static_cast<guint32>(offset));
+	*reinterpret_cast<guint32*>(&buf[len+1+offset_size]) = g_htonl(size);
 	if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(idxfile))) {
 		g_critical(write_file_err, idxfilename.c_str());
 		return EXIT_FAILURE;
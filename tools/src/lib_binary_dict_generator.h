@@ -19,9 +19,12 @@
 #define _LIB_BINARY_DICT_GENERATOR_H_
 
 #include <string>
+#include <vector>
 #include <glib.h>
 #include "lib_common_dict.h"
 #include "libcommon.h"
+#include "lib_ordered_pool.h"
+
 
 /* generate binary normal dictionary */
 class binary_dict_gen_t
@@ -29,6 +32,12 @@ class binary_dict_gen_t
 public:
 	binary_dict_gen_t(void);
 	int generate(const std::string& ifofilename, common_dict_t *norm_dict);
+	/* Serialize data blocks of all articles of norm_dict, one after another,
+	 * to be appended to an existing dictionary.
+	 * same_type_sequence - sametypesequence of that dictionary, may be empty.
+	 * sizes receives the size of each data block. */
+	int serialize_dict(common_dict_t *norm_dict, const std::string& same_type_sequence,
+		std::vector<char>& data, std::vector<size_t>& sizes);
 	void clear(void);
 	void set_use_same_type_sequence(bool b)
 	{
@@ -39,16 +48,36 @@ public:
 		compress_dict = b;
 	}
 private:
+	struct synitem_t {
+		synitem_t(const std::string& synonym, size_t index)
+		:
+			synonym(synonym),
+			index(index)
+		{
+
+		}
+		std::string synonym;
+		size_t index;
+	};
+	struct articles_job_t;
+	static bool compare_synitems_by_synonym(const synitem_t& left, const synitem_t& right);
 	int generate_dict_and_idx(void);
+	int serialize_articles(size_t begin, size_t end,
+		std::vector<char>& data, std::vector<size_t>& sizes);
+	static gpointer sort_synonyms_thread(gpointer data);
 	int generate_syn(void);
 	int prepare_dict(void);
 	int prepare_idx(void);
 	int prepare_syn(void);
-	int generate_dict_definition(const article_def_t& def, const std::string& key);
-	int generate_dict_definition_sts(const article_def_t& def, const std::string& key, bool last);
-	int generate_dict_definition_r(const resource_vect_t& resources, const std::string& key);
-	int generate_dict_definition_r_sts(const resource_vect_t& resources, const std::string& key, bool last);
-	int generate_index_item(const std::string& key, guint32 offset, guint32 size);
+	int generate_dict_definition(const article_def_t& def, const std::string& key,
+		std::vector<char>& data);
+	int generate_dict_definition_sts(const article_def_t& def, const std::string& key, bool last,
+		std::vector<char>& data);
+	int generate_dict_definition_r(const resource_vect_t& resources, const std::string& key,
+		std::vector<char>& data);
+	int generate_dict_definition_r_sts(const resource_vect_t& resources, const std::string& key, bool last,
+		std::vector<char>& data);
+	int generate_index_item(const std::string& key, guint64 offset, guint32 size);
 	void decide_on_same_type_sequence(void);
 	std::string build_type_sequence(const article_data_t& article) const;
 	common_dict_t *norm_dict;
@@ -60,14 +89,18 @@ private:
 	clib::File dictfile;
 	clib::File idxfile;
 	clib::File synfile;
+	/* synonyms sorted by sort_synonyms_thread */
+	std::vector<synitem_t> synonyms;
 	/* use same_type_sequence if possible */
 	bool use_same_type_sequence;
 	/* If use_same_type_sequence == true and all articles have the same sequence of types,
 	 * this string contains the sequence of types to use.
 	 * Otherwise this is an empty string. */
 	std::string same_type_sequence;
-	/* run dictzip on the generated file if enabled */
+	/* compress the generated file with dictzip if enabled */
 	bool compress_dict;
+	/* the dictionary file is larger than 4GB, index uses 64-bit offsets */
+	bool offset64;
 };
 
 #endif
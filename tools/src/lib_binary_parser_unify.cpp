@@ -29,7 +29,7 @@ struct article_t
 	std::string key;
 	std::vector<std::string> synonyms;
 	// data in dictionary
-	guint32 offset;
+	guint64 offset;
 	guint32 size;
 	int add_key(const std::string& new_key);
 	int add_synonym(const std::string& new_synonym);
@@ -29,6 +29,7 @@ void article_data_t::clear(void)
 	key.clear();
 	synonyms.clear();
 	definitions.clear();
+	line_number = 0;
 }
 
 /* Return value:
@@ -119,12 +120,12 @@ int common_dict_t::write_data(const char* data, size_t size, size_t& offset)
 		data_store.resize(data_store.size()+size);
 		memcpy(&data_store[offset], data, size);
 	} else {
-		if(fseek(get_impl(contents_file), 0, SEEK_END)) {
+		if(stardict_fseek(get_impl(contents_file), 0, SEEK_END)) {
 			std::string error(g_strerror(errno));
 			g_critical(read_file_err, contents_file_name.c_str(), error.c_str());
 			return EXIT_FAILURE;
 		}
-		offset = ftell(get_impl(contents_file));
+		offset = stardict_ftell(get_impl(contents_file));
 		if(1 != fwrite(data, size, 1, get_impl(contents_file))) {
 			g_critical(write_file_err, contents_file_name.c_str());
 			return EXIT_FAILURE;
@@ -148,7 +149,7 @@ int common_dict_t::read_data(char* data, size_t size, size_t offset)
 			return EXIT_FAILURE;
 		memcpy(data, &data_store[offset], size);
 	} else {
-		if(fseek(get_impl(contents_file), offset, SEEK_SET)) {
+		if(stardict_fseek(get_impl(contents_file), offset, SEEK_SET)) {
 			std::string error(g_strerror(errno));
 			g_critical(read_file_err, contents_file_name.c_str(), error.c_str());
 			return EXIT_FAILURE;
@@ -86,9 +86,17 @@ struct article_def_t
 
 struct article_data_t
 {
+	article_data_t(void)
+	:
+		line_number(0)
+	{
+
+	}
 	std::string key;
 	std::vector<std::string> synonyms;
 	std::vector<article_def_t> definitions;
+	/* line where the article starts in a textual dictionary, 0 - unknown */
+	unsigned int line_number;
 	void clear(void);
 	int add_key(const std::string& new_key);
 	int add_synonym(const std::string& new_synonym);
@@ -0,0 +1,432 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <algorithm>
+#include <zlib.h>
+#include <glib/gstdio.h>
+
+#include "lib_dictzip_writer.h"
+
+/* Uncompressed size of a chunk. dictData inflates a chunk into a buffer of this size. */
+const size_t DICTZIP_CHUNK_LENGTH = 58315;
+/* The chunk table is stored in the gzip extra field, its length is a 16-bit number. */
+const size_t DICTZIP_MAX_CHUNK_COUNT = (0xffff - 10) / 2;
+/* number of chunks compressed in one job */
+const size_t CHUNKS_PER_JOB = 32;
+const size_t JOB_DATA_SIZE = CHUNKS_PER_JOB * DICTZIP_CHUNK_LENGTH;
+/* number of jobs queued for compression */
+const size_t MAX_JOBS = 32;
+
+struct dictzip_writer_t::chunks_job_t : public ordered_pool_t::job_t
+{
+	chunks_job_t(bool last)
+	:
+		last(last),
+		data_size(0),
+		crc(0),
+		ok(true)
+	{
+	}
+	virtual void run(void);
+	std::vector<char> data;
+	/* the last job, the deflate stream is finished */
+	bool last;
+	/* data.size(), data is freed when compressed */
+	size_t data_size;
+	std::vector<char> compressed;
+	std::vector<guint16> chunk_sizes;
+	guint32 crc;
+	bool ok;
+};
+
+/* Each job starts a new raw deflate stream. Chunks end with a full flush,
+ * so the streams of all jobs concatenated make one valid deflate stream. */
+void dictzip_writer_t::chunks_job_t::run(void)
+{
+	data_size = data.size();
+	crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, reinterpret_cast<const Bytef *>(data.empty() ? "" : &data[0]), data.size());
+	z_stream zstream;
+	memset(&zstream, 0, sizeof(zstream));
+	if(Z_OK != deflateInit2(&zstream, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY)) {
+		ok = false;
+		return;
+	}
+	std::vector<char> out(deflateBound(&zstream, DICTZIP_CHUNK_LENGTH) + 16);
+	size_t pos = 0;
+	do {
+		const size_t size = std::min(DICTZIP_CHUNK_LENGTH, data.size() - pos);
+		const bool last_chunk = last && pos + size == data.size();
+		zstream.next_in = reinterpret_cast<Bytef *>(size ? &data[pos] : NULL);
+		zstream.avail_in = size;
+		zstream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+		zstream.avail_out = out.size();
+		const int ret = deflate(&zstream, last_chunk ? Z_FINISH : Z_FULL_FLUSH);
+		/* the output buffer is large enough for a chunk, if it is full, the flush is incomplete */
+		if(ret != (last_chunk ? Z_STREAM_END : Z_OK) || zstream.avail_in != 0
+			|| zstream.avail_out == 0) {
+			ok = false;
+			break;
+		}
+		const size_t out_size = out.size() - zstream.avail_out;
+		if(out_size > 0xffff) {
+			ok = false;
+			break;
+		}
+		chunk_sizes.push_back(out_size);
+		compressed.insert(compressed.end(), out.begin(), out.begin() + out_size);
+		pos += size;
+	} while(pos < data.size());
+	deflateEnd(&zstream);
+	std::vector<char>().swap(data);
+}
+
+dictzip_writer_t::dictzip_writer_t(guint max_threads)
+:
+	pool(max_threads, MAX_JOBS),
+	crc(crc32(0L, Z_NULL, 0)),
+	length(0),
+	too_large(false),
+	error(false)
+{
+}
+
+dictzip_writer_t::~dictzip_writer_t(void)
+{
+	if(tmpfile) {
+		tmpfile.reset(NULL);
+		g_remove(tmpfilename.c_str());
+	}
+}
+
+bool dictzip_writer_t::open(const std::string& filename)
+{
+	this->filename = filename;
+	tmpfilename = filename + ".tmp";
+	tmpfile.reset(g_fopen(tmpfilename.c_str(), "wb"));
+	if(!tmpfile) {
+		g_critical(open_write_file_err, tmpfilename.c_str());
+		error = true;
+		return false;
+	}
+	buffer.reserve(JOB_DATA_SIZE);
+	return true;
+}
+
+/* read a 16-bit little-endian number */
+static guint32 get_le16(const guint8 *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/* inflate one chunk of a dictzip file
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int inflate_chunk(const std::vector<char>& compressed, size_t chunk_length,
+	std::vector<char>& data)
+{
+	z_stream zstream;
+	memset(&zstream, 0, sizeof(zstream));
+	if(Z_OK != inflateInit2(&zstream, -15))
+		return EXIT_FAILURE;
+	/* one byte more to detect chunks longer than expected */
+	data.resize(chunk_length + 1);
+	zstream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(&compressed[0]));
+	zstream.avail_in = compressed.size();
+	zstream.next_out = reinterpret_cast<Bytef *>(&data[0]);
+	zstream.avail_out = data.size();
+	const int ret = inflate(&zstream, Z_SYNC_FLUSH);
+	inflateEnd(&zstream);
+	if((ret != Z_OK && ret != Z_STREAM_END) || zstream.avail_in != 0 || zstream.avail_out == 0)
+		return EXIT_FAILURE;
+	data.resize(data.size() - zstream.avail_out);
+	return EXIT_SUCCESS;
+}
+
+bool dictzip_writer_t::append_from(const std::string& srcfilename, guint64& src_length)
+{
+	g_assert(buffer.empty() && chunk_sizes.empty());
+	src_length = 0;
+	clib::File in(g_fopen(srcfilename.c_str(), "rb"));
+	if(!in) {
+		std::string err(g_strerror(errno));
+		g_critical(open_read_file_err, srcfilename.c_str(), err.c_str());
+		error = true;
+		return false;
+	}
+	guint8 header[12];
+	if(1 != fread(header, sizeof(header), 1, get_impl(in))
+		|| header[0] != 0x1f || header[1] != 0x8b || header[2] != Z_DEFLATED
+		|| !(header[3] & 0x04)) {
+		g_critical("%s is not a dictzip file.", srcfilename.c_str());
+		error = true;
+		return false;
+	}
+	std::vector<guint8> extra(get_le16(&header[10]));
+	if(!extra.empty() && 1 != fread(&extra[0], extra.size(), 1, get_impl(in))) {
+		std::string err(g_strerror(errno));
+		g_critical(read_file_err, srcfilename.c_str(), err.c_str());
+		error = true;
+		return false;
+	}
+	/* find the random access subfield */
+	size_t chunk_length = 0;
+	std::vector<guint16> src_chunk_sizes;
+	for(size_t pos = 0; pos + 4 <= extra.size(); ) {
+		const size_t len = get_le16(&extra[pos+2]);
+		if(pos + 4 + len > extra.size())
+			break;
+		if(extra[pos] == 'R' && extra[pos+1] == 'A' && len >= 6) {
+			chunk_length = get_le16(&extra[pos+6]);
+			const size_t cnt = get_le16(&extra[pos+8]);
+			if(10 + 2 * cnt <= 4 + len)
+				for(size_t i=0; i<cnt; ++i)
+					src_chunk_sizes.push_back(get_le16(&extra[pos+10+2*i]));
+			break;
+		}
+		pos += 4 + len;
+	}
+	if(src_chunk_sizes.empty()) {
+		g_critical("%s is not a dictzip file.", srcfilename.c_str());
+		error = true;
+		return false;
+	}
+	/* skip file name, comment and header crc */
+	for(guint8 flag = 0x08; flag <= 0x10; flag <<= 1) {
+		if(header[3] & flag) {
+			int c;
+			while((c = getc(get_impl(in))) != EOF && c != '\0')
+				;
+		}
+	}
+	if(header[3] & 0x02) {
+		getc(get_impl(in));
+		getc(get_impl(in));
+	}
+	/* Chunks of a different length cannot be mixed with ours, compress everything again. */
+	const size_t copy_cnt = chunk_length == DICTZIP_CHUNK_LENGTH ? src_chunk_sizes.size() - 1 : 0;
+	std::vector<char> compressed, data;
+	for(size_t i=0; i<src_chunk_sizes.size(); ++i) {
+		compressed.resize(src_chunk_sizes[i]);
+		if(compressed.empty() || 1 != fread(&compressed[0], compressed.size(), 1, get_impl(in))) {
+			std::string err(g_strerror(errno));
+			g_critical(read_file_err, srcfilename.c_str(), err.c_str());
+			error = true;
+			return false;
+		}
+		if(inflate_chunk(compressed, chunk_length, data)
+			|| (i + 1 < src_chunk_sizes.size() && data.size() != chunk_length)) {
+			g_critical("%s: chunk %u is corrupted.", srcfilename.c_str(), static_cast<guint>(i));
+			error = true;
+			return false;
+		}
+		src_length += data.size();
+		if(i < copy_cnt) {
+			const guint32 data_crc = crc32(crc32(0L, Z_NULL, 0),
+				reinterpret_cast<const Bytef *>(&data[0]), data.size());
+			crc = crc32_combine(crc, data_crc, data.size());
+			length += data.size();
+			chunk_sizes.push_back(compressed.size());
+			if(1 != fwrite(&compressed[0], compressed.size(), 1, get_impl(tmpfile))) {
+				g_critical(write_file_err, tmpfilename.c_str());
+				error = true;
+				return false;
+			}
+		} else if(!data.empty() && !write(&data[0], data.size()))
+			return false;
+	}
+	return true;
+}
+
+bool dictzip_writer_t::write(const char *data, size_t size)
+{
+	while(size > 0) {
+		/* a full buffer is passed on only when more data comes,
+		 * the last job must not be empty */
+		if(buffer.size() == JOB_DATA_SIZE && !push_chunks(false))
+			return false;
+		const size_t n = std::min(size, JOB_DATA_SIZE - buffer.size());
+		buffer.insert(buffer.end(), data, data + n);
+		data += n;
+		size -= n;
+	}
+	return !error;
+}
+
+bool dictzip_writer_t::push_chunks(bool last)
+{
+	chunks_job_t *job = new chunks_job_t(last);
+	job->data.swap(buffer);
+	buffer.reserve(JOB_DATA_SIZE);
+	ordered_pool_t::job_t *done_job;
+	pool.push(job, done_job);
+	if(done_job && !write_job(done_job))
+		return false;
+	while((done_job = pool.pop(false)))
+		if(!write_job(done_job))
+			return false;
+	return true;
+}
+
+bool dictzip_writer_t::write_job(ordered_pool_t::job_t *done_job)
+{
+	chunks_job_t *job = static_cast<chunks_job_t *>(done_job);
+	if(!error && !too_large) {
+		if(!job->ok) {
+			g_critical("Compression of %s failed.", filename.c_str());
+			error = true;
+		} else if(chunk_sizes.size() + job->chunk_sizes.size() > DICTZIP_MAX_CHUNK_COUNT) {
+			too_large = true;
+		} else {
+			crc = crc32_combine(crc, job->crc, job->data_size);
+			length += job->data_size;
+			chunk_sizes.insert(chunk_sizes.end(), job->chunk_sizes.begin(), job->chunk_sizes.end());
+			if(!job->compressed.empty()
+				&& 1 != fwrite(&job->compressed[0], job->compressed.size(), 1, get_impl(tmpfile))) {
+				g_critical(write_file_err, tmpfilename.c_str());
+				error = true;
+			}
+		}
+	}
+	delete job;
+	return !error;
+}
+
+bool dictzip_writer_t::finish(void)
+{
+	if(!error && !push_chunks(true))
+		error = true;
+	ordered_pool_t::job_t *done_job;
+	while((done_job = pool.pop(true)))
+		write_job(done_job);
+	if(!error && !too_large && close_file())
+		error = true;
+	if(!error && !too_large && !write_file())
+		return true;
+	remove_files();
+	return false;
+}
+
+/* close the temporary file
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int dictzip_writer_t::close_file(void)
+{
+	FILE *f = get_impl(tmpfile);
+	*get_addr(tmpfile) = NULL;
+	if(fclose(f)) {
+		g_critical(write_file_err, tmpfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static void put_le16(std::vector<guint8>& buf, guint32 value)
+{
+	buf.push_back(value & 0xff);
+	buf.push_back((value >> 8) & 0xff);
+}
+
+static void put_le32(std::vector<guint8>& buf, guint32 value)
+{
+	put_le16(buf, value & 0xffff);
+	put_le16(buf, value >> 16);
+}
+
+/* write the header, the compressed data and the trailer into the output file
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int dictzip_writer_t::write_file(void)
+{
+	std::vector<guint8> header;
+	header.push_back(0x1f); // gzip magic
+	header.push_back(0x8b);
+	header.push_back(Z_DEFLATED);
+	header.push_back(0x04); // FEXTRA
+	put_le32(header, static_cast<guint32>(time(NULL)));
+	header.push_back(2); // maximum compression
+	header.push_back(3); // Unix
+	put_le16(header, 10 + 2 * chunk_sizes.size()); // XLEN
+	header.push_back('R');
+	header.push_back('A');
+	put_le16(header, 6 + 2 * chunk_sizes.size()); // subfield length
+	put_le16(header, 1); // version
+	put_le16(header, DICTZIP_CHUNK_LENGTH);
+	put_le16(header, chunk_sizes.size());
+	for(size_t i=0; i<chunk_sizes.size(); ++i)
+		put_le16(header, chunk_sizes[i]);
+	std::vector<guint8> trailer;
+	put_le32(trailer, crc);
+	put_le32(trailer, static_cast<guint32>(length));
+
+	clib::File in(g_fopen(tmpfilename.c_str(), "rb"));
+	if(!in) {
+		std::string err(g_strerror(errno));
+		g_critical(open_read_file_err, tmpfilename.c_str(), err.c_str());
+		return EXIT_FAILURE;
+	}
+	clib::File out(g_fopen(filename.c_str(), "wb"));
+	if(!out) {
+		g_critical(open_write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	if(1 != fwrite(&header[0], header.size(), 1, get_impl(out))) {
+		g_critical(write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	std::vector<char> buf(1024*1024);
+	size_t size;
+	while((size = fread(&buf[0], 1, buf.size(), get_impl(in))) > 0) {
+		if(size != fwrite(&buf[0], 1, size, get_impl(out))) {
+			g_critical(write_file_err, filename.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	if(ferror(get_impl(in))) {
+		std::string err(g_strerror(errno));
+		g_critical(read_file_err, tmpfilename.c_str(), err.c_str());
+		return EXIT_FAILURE;
+	}
+	if(1 != fwrite(&trailer[0], trailer.size(), 1, get_impl(out))) {
+		g_critical(write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	FILE *f = get_impl(out);
+	*get_addr(out) = NULL;
+	if(fclose(f)) {
+		g_critical(write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	in.reset(NULL);
+	g_remove(tmpfilename.c_str());
+	return EXIT_SUCCESS;
+}
+
+void dictzip_writer_t::remove_files(void)
+{
+	tmpfile.reset(NULL);
+	g_remove(tmpfilename.c_str());
+	g_remove(filename.c_str());
+}
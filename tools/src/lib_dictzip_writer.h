@@ -0,0 +1,71 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIB_DICTZIP_WRITER_H_
+#define _LIB_DICTZIP_WRITER_H_
+
+#include <string>
+#include <vector>
+#include <glib.h>
+#include "libcommon.h"
+#include "lib_ordered_pool.h"
+
+/* Write a dictzip file (.dict.dz) while the data is produced.
+ * The data is cut into chunks of DICTZIP_CHUNK_LENGTH bytes, each chunk is
+ * compressed independently on a thread pool, so the result is readable
+ * by dictData, which inflates chunks one by one.
+ * Compressed chunks are written into a temporary file, finish() writes
+ * the header with the chunk table and appends the compressed data. */
+class dictzip_writer_t
+{
+public:
+	/* max_threads - 0 - number of processors */
+	explicit dictzip_writer_t(guint max_threads = 0);
+	~dictzip_writer_t(void);
+	bool open(const std::string& filename);
+	/* Start the output with the data of an existing dictzip file.
+	 * Compressed chunks are copied as is, only the last chunk is compressed again
+	 * together with the new data. Call after open(), before write().
+	 * src_length receives the size of the uncompressed data of the file. */
+	bool append_from(const std::string& srcfilename, guint64& src_length);
+	bool write(const char *data, size_t size);
+	/* Return false on error or if the data does not fit into the dictzip format,
+	 * see get_too_large(). The output file is removed in that case. */
+	bool finish(void);
+	/* the data is too large for the chunk table of the dictzip header */
+	bool get_too_large(void) const { return too_large; }
+private:
+	struct chunks_job_t;
+	bool push_chunks(bool last);
+	bool write_job(ordered_pool_t::job_t *job);
+	int close_file(void);
+	int write_file(void);
+	void remove_files(void);
+	ordered_pool_t pool;
+	std::string filename;
+	std::string tmpfilename;
+	clib::File tmpfile;
+	/* data not yet passed to the pool */
+	std::vector<char> buffer;
+	std::vector<guint16> chunk_sizes;
+	guint32 crc;
+	guint64 length;
+	bool too_large;
+	bool error;
+};
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <glib/gstdio.h>
+
+#include "lib_external_sort.h"
+
+/* size of stdio buffers of run files */
+const size_t RUN_FILE_BUFFER_SIZE = 1024*1024;
+
+/* close the file and report errors of buffered writes */
+static int close_file(clib::File& file)
+{
+	FILE *f = get_impl(file);
+	*get_addr(file) = NULL;
+	return fclose(f);
+}
+
+struct external_sorter_t::chunk_t
+{
+	struct item_t {
+		guint64 seq;
+		/* position of the article in data:
+		 * word, '\0', guint32 size in machine byte order, size bytes of data */
+		size_t pos;
+	};
+	std::vector<char> data;
+	std::vector<item_t> items;
+	/* run file, set when the chunk is written */
+	std::string filename;
+	size_t mem_size(void) const
+	{
+		return data.size() + items.size() * sizeof(item_t);
+	}
+};
+
+struct external_sorter_t::run_reader_t
+{
+	run_reader_t(void)
+	:
+		seq(0),
+		error(false),
+		buffer(RUN_FILE_BUFFER_SIZE)
+	{
+	}
+	bool open(const std::string& filename)
+	{
+		file.reset(g_fopen(filename.c_str(), "rb"));
+		if(!file) {
+			std::string err(g_strerror(errno));
+			g_critical(open_read_file_err, filename.c_str(), err.c_str());
+			error = true;
+			return false;
+		}
+		setvbuf(get_impl(file), &buffer[0], _IOFBF, buffer.size());
+		this->filename = filename;
+		return true;
+	}
+	/* read the next article of the run, false at the end of the run or on error */
+	bool read(void)
+	{
+		guint32 sizes[2];
+		if(1 != fread(&seq, sizeof(seq), 1, get_impl(file)))
+			return false;
+		if(1 != fread(sizes, sizeof(sizes), 1, get_impl(file))) {
+			set_error();
+			return false;
+		}
+		word.resize(sizes[0]);
+		data.resize(sizes[1]);
+		if((sizes[0] && 1 != fread(&word[0], sizes[0], 1, get_impl(file)))
+			|| (sizes[1] && 1 != fread(&data[0], sizes[1], 1, get_impl(file)))) {
+			set_error();
+			return false;
+		}
+		return true;
+	}
+	void set_error(void)
+	{
+		std::string err(g_strerror(errno));
+		g_critical(read_file_err, filename.c_str(), err.c_str());
+		error = true;
+	}
+	std::string filename;
+	clib::File file;
+	guint64 seq;
+	std::string word;
+	std::vector<char> data;
+	bool error;
+	/* stdio buffer of file, must outlive the file */
+	std::vector<char> buffer;
+};
+
+/* std::*_heap functions build a max-heap, so the order is reversed */
+struct external_sorter_t::compare_run_readers_t
+{
+	bool operator()(const run_reader_t *left, const run_reader_t *right) const
+	{
+		const gint cmp = stardict_strcmp(left->word.c_str(), right->word.c_str());
+		if(cmp)
+			return cmp > 0;
+		return left->seq > right->seq;
+	}
+};
+
+namespace {
+	struct compare_chunk_items_t
+	{
+		explicit compare_chunk_items_t(const char *data)
+		:
+			data(data)
+		{
+		}
+		template <class T>
+		bool operator()(const T& left, const T& right) const
+		{
+			const gint cmp = stardict_strcmp(data + left.pos, data + right.pos);
+			if(cmp)
+				return cmp < 0;
+			return left.seq < right.seq;
+		}
+		const char *data;
+	};
+}
+
+external_sorter_t::external_sorter_t(size_t memory_limit, guint max_threads)
+:
+	next_seq(0),
+	chunk(new chunk_t),
+	pool(NULL),
+	chunks_in_flight(0),
+	error(0),
+	cur_reader(NULL),
+	chunk_pos(0),
+	finished(false)
+{
+	if(max_threads == 0)
+		max_threads = g_get_num_processors();
+	/* one chunk is being filled while max_threads chunks are being sorted */
+	chunk_limit = memory_limit / (max_threads + 1);
+	max_chunks_in_flight = max_threads;
+	g_mutex_init(&mutex);
+	g_cond_init(&cond);
+	pool = g_thread_pool_new(write_run, this, max_threads, FALSE, NULL);
+}
+
+external_sorter_t::~external_sorter_t(void)
+{
+	if(pool)
+		g_thread_pool_free(pool, FALSE, TRUE);
+	g_mutex_clear(&mutex);
+	g_cond_clear(&cond);
+	delete chunk;
+	for(size_t i=0; i<readers.size(); ++i)
+		delete readers[i];
+	for(size_t i=0; i<runs.size(); ++i)
+		delete runs[i];
+}
+
+bool external_sorter_t::add(const char *word, const char *data, guint32 size)
+{
+	g_assert(!finished);
+	const size_t word_len = strlen(word);
+	const size_t need = word_len + 1 + sizeof(guint32) + size + sizeof(chunk_t::item_t);
+	if(!chunk->items.empty() && chunk->mem_size() + need > chunk_limit) {
+		spill_chunk();
+		if(failed())
+			return false;
+	}
+	chunk_t::item_t item;
+	item.seq = next_seq++;
+	item.pos = chunk->data.size();
+	chunk->items.push_back(item);
+	chunk->data.insert(chunk->data.end(), word, word + word_len + 1);
+	const char *psize = reinterpret_cast<const char *>(&size);
+	chunk->data.insert(chunk->data.end(), psize, psize + sizeof(guint32));
+	chunk->data.insert(chunk->data.end(), data, data + size);
+	return true;
+}
+
+void external_sorter_t::spill_chunk(void)
+{
+	TempFile *run = new TempFile;
+	runs.push_back(run);
+	chunk->filename = run->create_temp_file();
+	if(chunk->filename.empty()) {
+		g_atomic_int_set(&error, 1);
+		return;
+	}
+	g_mutex_lock(&mutex);
+	while(chunks_in_flight >= max_chunks_in_flight)
+		g_cond_wait(&cond, &mutex);
+	++chunks_in_flight;
+	g_mutex_unlock(&mutex);
+	g_thread_pool_push(pool, chunk, NULL);
+	chunk = new chunk_t;
+}
+
+void external_sorter_t::sort_chunk(chunk_t *chunk)
+{
+	if(chunk->items.empty())
+		return;
+	std::sort(chunk->items.begin(), chunk->items.end(),
+		compare_chunk_items_t(&chunk->data[0]));
+}
+
+/* runs in a worker thread */
+void external_sorter_t::write_run(gpointer data, gpointer user_data)
+{
+	chunk_t *chunk = static_cast<chunk_t *>(data);
+	external_sorter_t *sorter = static_cast<external_sorter_t *>(user_data);
+	sort_chunk(chunk);
+	std::vector<char> buffer(RUN_FILE_BUFFER_SIZE);
+	clib::File file(g_fopen(chunk->filename.c_str(), "wb"));
+	bool ok = false;
+	if(file) {
+		ok = true;
+		setvbuf(get_impl(file), &buffer[0], _IOFBF, buffer.size());
+		for(size_t i=0; ok && i<chunk->items.size(); ++i) {
+			const char *word = &chunk->data[chunk->items[i].pos];
+			guint32 sizes[2];
+			sizes[0] = strlen(word);
+			memcpy(&sizes[1], word + sizes[0] + 1, sizeof(guint32));
+			ok = 1 == fwrite(&chunk->items[i].seq, sizeof(guint64), 1, get_impl(file))
+				&& 1 == fwrite(sizes, sizeof(sizes), 1, get_impl(file))
+				&& sizes[0] == fwrite(word, 1, sizes[0], get_impl(file))
+				&& sizes[1] == fwrite(word + sizes[0] + 1 + sizeof(guint32), 1, sizes[1], get_impl(file));
+		}
+		ok = 0 == close_file(file) && ok;
+	}
+	if(!ok) {
+		g_critical(write_file_err, chunk->filename.c_str());
+		g_atomic_int_set(&sorter->error, 1);
+	}
+	delete chunk;
+	g_mutex_lock(&sorter->mutex);
+	--sorter->chunks_in_flight;
+	g_cond_signal(&sorter->cond);
+	g_mutex_unlock(&sorter->mutex);
+}
+
+bool external_sorter_t::finish(void)
+{
+	g_assert(!finished);
+	finished = true;
+	if(runs.empty()) {
+		sort_chunk(chunk);
+		return !failed();
+	}
+	if(!chunk->items.empty())
+		spill_chunk();
+	g_thread_pool_free(pool, FALSE, TRUE);
+	pool = NULL;
+	if(failed())
+		return false;
+	for(size_t i=0; i<runs.size(); ++i) {
+		run_reader_t *reader = new run_reader_t;
+		readers.push_back(reader);
+		if(!reader->open(runs[i]->get_file_name())) {
+			g_atomic_int_set(&error, 1);
+			return false;
+		}
+		if(reader->read())
+			heap.push_back(reader);
+		else if(reader->error) {
+			g_atomic_int_set(&error, 1);
+			return false;
+		}
+	}
+	std::make_heap(heap.begin(), heap.end(), compare_run_readers_t());
+	return true;
+}
+
+bool external_sorter_t::next(const char *&word, const char *&data, guint32 &size)
+{
+	g_assert(finished);
+	if(failed())
+		return false;
+	if(runs.empty()) {
+		if(chunk_pos >= chunk->items.size())
+			return false;
+		const char *p = &chunk->data[chunk->items[chunk_pos++].pos];
+		word = p;
+		p += strlen(p) + 1;
+		memcpy(&size, p, sizeof(guint32));
+		data = p + sizeof(guint32);
+		return true;
+	}
+	if(cur_reader) {
+		if(cur_reader->read()) {
+			heap.push_back(cur_reader);
+			std::push_heap(heap.begin(), heap.end(), compare_run_readers_t());
+		} else if(cur_reader->error) {
+			g_atomic_int_set(&error, 1);
+			return false;
+		}
+		cur_reader = NULL;
+	}
+	if(heap.empty())
+		return false;
+	std::pop_heap(heap.begin(), heap.end(), compare_run_readers_t());
+	cur_reader = heap.back();
+	heap.pop_back();
+	word = cur_reader->word.c_str();
+	size = cur_reader->data.size();
+	data = size ? &cur_reader->data[0] : "";
+	return true;
+}
+
+sorted_dict_writer_t::sorted_dict_writer_t(void)
+:
+	offset(0),
+	wordcount(0),
+	idxfilesize(0),
+	offset64(false)
+{
+}
+
+sorted_dict_writer_t::~sorted_dict_writer_t(void)
+{
+	if(idxtmpfile) {
+		idxtmpfile.reset(NULL);
+		g_remove(idxtmpfilename.c_str());
+	}
+}
+
+bool sorted_dict_writer_t::open(const std::string& basefilename)
+{
+	dictfilename = basefilename + ".dict";
+	idxfilename = basefilename + ".idx";
+	idxtmpfilename = idxfilename + ".tmp";
+	dictfile.reset(g_fopen(dictfilename.c_str(), "wb"));
+	if(!dictfile) {
+		g_critical(open_write_file_err, dictfilename.c_str());
+		return false;
+	}
+	idxtmpfile.reset(g_fopen(idxtmpfilename.c_str(), "wb"));
+	if(!idxtmpfile) {
+		g_critical(open_write_file_err, idxtmpfilename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool sorted_dict_writer_t::add(const char *word, const char *data, guint32 size)
+{
+	if(size != fwrite(data, 1, size, get_impl(dictfile))) {
+		g_critical(write_file_err, dictfilename.c_str());
+		return false;
+	}
+	const guint64 offset_be = GUINT64_TO_BE(offset);
+	const guint32 size_be = g_htonl(size);
+	if(1 != fwrite(word, strlen(word)+1, 1, get_impl(idxtmpfile))
+		|| 1 != fwrite(&offset_be, sizeof(guint64), 1, get_impl(idxtmpfile))
+		|| 1 != fwrite(&size_be, sizeof(guint32), 1, get_impl(idxtmpfile))) {
+		g_critical(write_file_err, idxtmpfilename.c_str());
+		return false;
+	}
+	offset += size;
+	++wordcount;
+	return true;
+}
+
+bool sorted_dict_writer_t::finish(void)
+{
+	if(close_file(dictfile)) {
+		g_critical(write_file_err, dictfilename.c_str());
+		return false;
+	}
+	if(close_file(idxtmpfile)) {
+		g_critical(write_file_err, idxtmpfilename.c_str());
+		g_remove(idxtmpfilename.c_str());
+		return false;
+	}
+	offset64 = offset > G_MAXUINT32;
+	if(offset64) {
+		g_remove(idxfilename.c_str());
+		if(g_rename(idxtmpfilename.c_str(), idxfilename.c_str())) {
+			g_critical(write_file_err, idxfilename.c_str());
+			g_remove(idxtmpfilename.c_str());
+			return false;
+		}
+	} else {
+		/* all offsets fit into 32 bits */
+		clib::File in(g_fopen(idxtmpfilename.c_str(), "rb"));
+		clib::File out(g_fopen(idxfilename.c_str(), "wb"));
+		bool ok = in && out;
+		std::string word;
+		int c;
+		while(ok && (c = getc(get_impl(in))) != EOF) {
+			word.clear();
+			for(; c != EOF && c != '\0'; c = getc(get_impl(in)))
+				word += static_cast<char>(c);
+			guint64 offset_be;
+			guint32 size_be;
+			ok = c != EOF
+				&& 1 == fread(&offset_be, sizeof(guint64), 1, get_impl(in))
+				&& 1 == fread(&size_be, sizeof(guint32), 1, get_impl(in));
+			const guint32 offset32_be = g_htonl(static_cast<guint32>(GUINT64_FROM_BE(offset_be)));
+			ok = ok
+				&& 1 == fwrite(word.c_str(), word.length()+1, 1, get_impl(out))
+				&& 1 == fwrite(&offset32_be, sizeof(guint32), 1, get_impl(out))
+				&& 1 == fwrite(&size_be, sizeof(guint32), 1, get_impl(out));
+		}
+		in.reset(NULL);
+		g_remove(idxtmpfilename.c_str());
+		if(!out || close_file(out) || !ok) {
+			g_critical(write_file_err, idxfilename.c_str());
+			return false;
+		}
+	}
+	stardict_stat_t stats;
+	if(g_stat(idxfilename.c_str(), &stats)) {
+		std::string err(g_strerror(errno));
+		g_critical(read_file_err, idxfilename.c_str(), err.c_str());
+		return false;
+	}
+	idxfilesize = stats.st_size;
+	return true;
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIB_EXTERNAL_SORT_H_
+#define _LIB_EXTERNAL_SORT_H_
+
+#include <string>
+#include <vector>
+#include <glib.h>
+#include "libcommon.h"
+
+/* default memory limit of external_sorter_t, in bytes */
+const size_t EXTERNAL_SORT_MEMORY_LIMIT = 512*1024*1024;
+
+/* Sort articles by word with bounded memory.
+ * Articles are collected in chunks. When a chunk is full, it is sorted and
+ * written into a temporary file (a run) on a thread pool, while the caller
+ * fills the next chunk. The runs are merged when reading the result.
+ * If all articles fit into one chunk, no temporary file is used. */
+class external_sorter_t
+{
+public:
+	/* memory_limit - approximate number of bytes used for articles,
+	 * max_threads - number of threads sorting chunks, 0 - number of processors */
+	explicit external_sorter_t(size_t memory_limit = EXTERNAL_SORT_MEMORY_LIMIT,
+		guint max_threads = 0);
+	~external_sorter_t(void);
+	bool add(const char *word, const char *data, guint32 size);
+	/* Call when all articles are added, before next(). */
+	bool finish(void);
+	/* Articles are returned in stardict_strcmp order of words,
+	 * articles with equal words in the order they were added.
+	 * word and data are valid till the next call.
+	 * Return false at the end or on error, see failed(). */
+	bool next(const char *&word, const char *&data, guint32 &size);
+	/* no articles were added */
+	bool empty(void) const { return next_seq == 0; }
+	bool failed(void) const
+	{
+		return g_atomic_int_get(&error) != 0;
+	}
+private:
+	struct chunk_t;
+	struct run_reader_t;
+	struct compare_run_readers_t;
+	void spill_chunk(void);
+	static void sort_chunk(chunk_t *chunk);
+	static void write_run(gpointer data, gpointer user_data);
+
+	size_t chunk_limit;
+	guint64 next_seq;
+	chunk_t *chunk;
+	GThreadPool *pool;
+	/* protects chunks_in_flight */
+	GMutex mutex;
+	GCond cond;
+	guint chunks_in_flight;
+	guint max_chunks_in_flight;
+	gint error;
+	std::vector<TempFile*> runs;
+	/* merge state */
+	std::vector<run_reader_t*> readers;
+	/* heap of readers, smallest article first */
+	std::vector<run_reader_t*> heap;
+	run_reader_t *cur_reader;
+	/* position in chunk when all articles fit into one chunk */
+	size_t chunk_pos;
+	bool finished;
+};
+
+/* Write a normal dictionary article by article, words must be sorted.
+ * The index is written into a temporary file with 64-bit offsets,
+ * finish() converts it to 32-bit offsets unless the .dict file exceeds 4GB. */
+class sorted_dict_writer_t
+{
+public:
+	sorted_dict_writer_t(void);
+	~sorted_dict_writer_t(void);
+	/* basefilename - file name without extension */
+	bool open(const std::string& basefilename);
+	bool add(const char *word, const char *data, guint32 size);
+	bool finish(void);
+	guint64 get_wordcount(void) const { return wordcount; }
+	guint64 get_idxfilesize(void) const { return idxfilesize; }
+	/* the index uses 64-bit offsets, the dictionary must be version 3.0.0 */
+	bool get_offset64(void) const { return offset64; }
+	const std::string& get_dict_file_name(void) const { return dictfilename; }
+private:
+	std::string dictfilename;
+	std::string idxfilename;
+	std::string idxtmpfilename;
+	clib::File dictfile;
+	clib::File idxtmpfile;
+	guint64 offset;
+	guint64 wordcount;
+	guint64 idxfilesize;
+	bool offset64;
+};
+
+#endif
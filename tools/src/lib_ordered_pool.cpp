@@ -0,0 +1,79 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "lib_ordered_pool.h"
+
+ordered_pool_t::ordered_pool_t(guint max_threads, size_t max_jobs)
+:
+	max_jobs(max_jobs)
+{
+	if(max_threads == 0)
+		max_threads = g_get_num_processors();
+	g_mutex_init(&mutex);
+	g_cond_init(&cond);
+	pool = g_thread_pool_new(run_job, this, max_threads, FALSE, NULL);
+}
+
+ordered_pool_t::~ordered_pool_t(void)
+{
+	g_thread_pool_free(pool, FALSE, TRUE);
+	g_mutex_clear(&mutex);
+	g_cond_clear(&cond);
+	for(size_t i=0; i<jobs.size(); ++i)
+		delete jobs[i];
+}
+
+void ordered_pool_t::push(job_t *job, job_t *&done_job)
+{
+	done_job = NULL;
+	if(jobs.size() >= max_jobs)
+		done_job = pop(true);
+	jobs.push_back(job);
+	g_thread_pool_push(pool, job, NULL);
+}
+
+ordered_pool_t::job_t *ordered_pool_t::pop(bool wait)
+{
+	if(jobs.empty())
+		return NULL;
+	job_t *job = jobs.front();
+	g_mutex_lock(&mutex);
+	while(wait && !job->done)
+		g_cond_wait(&cond, &mutex);
+	const bool done = job->done;
+	g_mutex_unlock(&mutex);
+	if(!done)
+		return NULL;
+	jobs.pop_front();
+	return job;
+}
+
+/* runs in a worker thread */
+void ordered_pool_t::run_job(gpointer data, gpointer user_data)
+{
+	job_t *job = static_cast<job_t *>(data);
+	ordered_pool_t *pool = static_cast<ordered_pool_t *>(user_data);
+	job->run();
+	g_mutex_lock(&pool->mutex);
+	job->done = true;
+	g_cond_broadcast(&pool->cond);
+	g_mutex_unlock(&pool->mutex);
+}
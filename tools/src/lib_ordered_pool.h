@@ -0,0 +1,65 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIB_ORDERED_POOL_H_
+#define _LIB_ORDERED_POOL_H_
+
+#include <deque>
+#include <glib.h>
+
+/* A bounded queue of jobs processed on a thread pool.
+ * Jobs are run in parallel, but completed jobs are taken in the order
+ * they were pushed. push() blocks while max_jobs jobs are queued,
+ * so a fast producer cannot get far ahead of the consumer.
+ * push() and pop() must be called from one thread. */
+class ordered_pool_t
+{
+public:
+	struct job_t
+	{
+		job_t(void) : done(false) { }
+		virtual ~job_t(void) { }
+		/* runs in a worker thread */
+		virtual void run(void) = 0;
+	private:
+		friend class ordered_pool_t;
+		bool done;
+	};
+	/* max_threads - 0 - number of processors */
+	ordered_pool_t(guint max_threads, size_t max_jobs);
+	~ordered_pool_t(void);
+	/* The pool takes ownership of the job.
+	 * If the queue is full, wait till the oldest job is done and return it in done_job,
+	 * the caller must delete it. Otherwise done_job is set to NULL. */
+	void push(job_t *job, job_t *&done_job);
+	/* Return the oldest job if it is done, or NULL.
+	 * If wait is true, wait till the oldest job is done,
+	 * NULL is returned only when the queue is empty.
+	 * The caller must delete the returned job. */
+	job_t *pop(bool wait);
+	bool empty(void) const { return jobs.empty(); }
+private:
+	static void run_job(gpointer data, gpointer user_data);
+	GThreadPool *pool;
+	/* protects job_t::done */
+	GMutex mutex;
+	GCond cond;
+	std::deque<job_t *> jobs;
+	size_t max_jobs;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+
+#include "lib_read_line.h"
+
+bool read_line(FILE *file, std::string& line, bool& newline)
+{
+	line.clear();
+	newline = false;
+	char buf[4096];
+	while (fgets(buf, sizeof(buf), file)) {
+		const size_t len = strlen(buf);
+		if (len > 0 && buf[len-1] == '\n') {
+			line.append(buf, len-1);
+			newline = true;
+			return true;
+		}
+		line.append(buf, len);
+	}
+	return !line.empty();
+}
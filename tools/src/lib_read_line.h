@@ -0,0 +1,29 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIB_READ_LINE_H_
+#define _LIB_READ_LINE_H_
+
+#include <cstdio>
+#include <string>
+
+/* Read a line of any length without the trailing '\n'.
+ * newline is false if the last line of the file has no '\n'.
+ * Return false at the end of the file. */
+bool read_line(FILE *file, std::string& line, bool& newline);
+
+#endif
@@ -0,0 +1,572 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <errno.h>
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#include "lib_stardict_patch.h"
+#include "libcommon.h"
+#include "lib_dict_verify.h"
+#include "lib_common_dict.h"
+#include "lib_textual_dict_parser.h"
+#include "lib_binary_dict_generator.h"
+#include "lib_dictzip_writer.h"
+#include "lib_dict_repair.h"
+
+namespace {
+	struct patch_worditem_t {
+		patch_worditem_t(const std::string& word, guint64 offset, guint32 size)
+		:
+			word(word),
+			offset(offset),
+			size(size)
+		{
+
+		}
+		std::string word;
+		guint64 offset;
+		guint32 size;
+	};
+
+	struct patch_synitem_t {
+		patch_synitem_t(const std::string& word, size_t index)
+		:
+			word(word),
+			index(index)
+		{
+
+		}
+		std::string word;
+		size_t index;
+	};
+}
+
+/* new index of a removed article */
+static const size_t removed_index = static_cast<size_t>(-1);
+
+static bool compare_synitems_by_word(const patch_synitem_t& left, const patch_synitem_t& right)
+{
+	return 0 > stardict_strcmp(left.word.c_str(), right.word.c_str());
+}
+
+/* Read a whole file, the file may be compressed with gzip.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int read_whole_file(const std::string& filename, std::vector<char>& data)
+{
+	data.clear();
+	zip::gzFile in(gzopen(filename.c_str(), "rb"));
+	if(!in) {
+		std::string err(g_strerror(errno));
+		g_critical(open_read_file_err, filename.c_str(), err.c_str());
+		return EXIT_FAILURE;
+	}
+	const size_t buf_size = 64 * 1024;
+	while(true) {
+		const size_t pos = data.size();
+		data.resize(pos + buf_size);
+		const int size = gzread(get_impl(in), &data[pos], buf_size);
+		if(size < 0) {
+			int errnum;
+			const char *err = gzerror(get_impl(in), &errnum);
+			g_critical(read_file_err, filename.c_str(), err);
+			return EXIT_FAILURE;
+		}
+		data.resize(pos + size);
+		if(size == 0)
+			break;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Write a whole file, compress it with gzip if compress is true.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int write_whole_file(const std::string& filename, const std::vector<char>& data, bool compress)
+{
+	if(compress) {
+		zip::gzFile out(gzopen(filename.c_str(), "wb9"));
+		bool ok = out;
+		if(ok && !data.empty())
+			ok = static_cast<int>(data.size()) == gzwrite(get_impl(out), &data[0], data.size());
+		if(out) {
+			gzFile f = get_impl(out);
+			*get_addr(out) = NULL;
+			ok = Z_OK == gzclose(f) && ok;
+		}
+		if(!ok) {
+			g_critical(write_file_err, filename.c_str());
+			return EXIT_FAILURE;
+		}
+	} else {
+		clib::File out(g_fopen(filename.c_str(), "wb"));
+		bool ok = out;
+		if(ok && !data.empty())
+			ok = 1 == fwrite(&data[0], data.size(), 1, get_impl(out));
+		if(out) {
+			FILE *f = get_impl(out);
+			*get_addr(out) = NULL;
+			ok = 0 == fclose(f) && ok;
+		}
+		if(!ok) {
+			g_critical(write_file_err, filename.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int parse_idx(const std::string& idxfilename, const std::vector<char>& data, bool offset64,
+	std::vector<patch_worditem_t>& index)
+{
+	const size_t offset_size = offset64 ? sizeof(guint64) : sizeof(guint32);
+	const char *p = data.empty() ? NULL : &data[0];
+	const char *end = p + data.size();
+	while(p < end) {
+		const char *word_end = static_cast<const char *>(memchr(p, '\0', end - p));
+		if(!word_end || static_cast<size_t>(end - word_end - 1) < offset_size + sizeof(guint32)) {
+			g_critical("%s: unexpected end of file.", idxfilename.c_str());
+			return EXIT_FAILURE;
+		}
+		const char *q = word_end + 1;
+		guint64 offset;
+		if(offset64) {
+			guint64 t;
+			memcpy(&t, q, sizeof(t));
+			offset = GUINT64_FROM_BE(t);
+		} else {
+			guint32 t;
+			memcpy(&t, q, sizeof(t));
+			offset = g_ntohl(t);
+		}
+		q += offset_size;
+		guint32 size;
+		memcpy(&size, q, sizeof(size));
+		index.push_back(patch_worditem_t(std::string(p, word_end), offset, g_ntohl(size)));
+		p = q + sizeof(guint32);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int parse_syn(const std::string& synfilename, const std::vector<char>& data, size_t wordcount,
+	std::vector<patch_synitem_t>& synindex)
+{
+	const char *p = data.empty() ? NULL : &data[0];
+	const char *end = p + data.size();
+	while(p < end) {
+		const char *word_end = static_cast<const char *>(memchr(p, '\0', end - p));
+		if(!word_end || static_cast<size_t>(end - word_end - 1) < sizeof(guint32)) {
+			g_critical("%s: unexpected end of file.", synfilename.c_str());
+			return EXIT_FAILURE;
+		}
+		guint32 index;
+		memcpy(&index, word_end + 1, sizeof(index));
+		index = g_ntohl(index);
+		if(index >= wordcount) {
+			g_critical("%s: synonym '%s' refers to a missing index item %u.",
+				synfilename.c_str(), std::string(p, word_end).c_str(), index);
+			return EXIT_FAILURE;
+		}
+		synindex.push_back(patch_synitem_t(std::string(p, word_end), index));
+		p = word_end + 1 + sizeof(guint32);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Read keys of articles to delete, one key per line.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int load_deleted_keys(const std::string& filename, std::set<std::string>& keys)
+{
+	glib::CharStr contents;
+	gsize length;
+	glib::Error error;
+	if(!g_file_get_contents(filename.c_str(), get_addr(contents), &length, get_addr(error))) {
+		g_critical(open_read_file_err, filename.c_str(), error->message);
+		return EXIT_FAILURE;
+	}
+	const char *p = get_impl(contents);
+	const char *end = p + length;
+	if(length >= 3 && !strncmp(p, UTF8_BOM, 3))
+		p += 3;
+	while(p < end) {
+		const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+		if(!line_end)
+			line_end = end;
+		const std::string line(p, line_end);
+		p = line_end + 1;
+		const char *key;
+		size_t key_len;
+		trim_spaces(line.c_str(), key, key_len);
+		if(key_len == 0)
+			continue;
+		if(!g_utf8_validate(key, key_len, NULL)) {
+			g_critical("%s: invalid utf-8 key '%s'.", filename.c_str(), line.c_str());
+			return EXIT_FAILURE;
+		}
+		keys.insert(std::string(key, key_len));
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Append data to a plain .dict file.
+ * dict_length receives the size of the file before the data is appended.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int append_to_dict(const std::string& dictfilename, const std::vector<char>& data,
+	guint64& dict_length)
+{
+	stardict_stat_t stats;
+	if(g_stat(dictfilename.c_str(), &stats)) {
+		std::string err(g_strerror(errno));
+		g_critical(open_read_file_err, dictfilename.c_str(), err.c_str());
+		return EXIT_FAILURE;
+	}
+	dict_length = stats.st_size;
+	if(data.empty())
+		return EXIT_SUCCESS;
+	clib::File out(g_fopen(dictfilename.c_str(), "ab"));
+	if(!out) {
+		g_critical(open_write_file_err, dictfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	bool ok = 1 == fwrite(&data[0], data.size(), 1, get_impl(out));
+	FILE *f = get_impl(out);
+	*get_addr(out) = NULL;
+	ok = 0 == fclose(f) && ok;
+	if(!ok) {
+		g_critical(write_file_err, dictfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Write a new .dict.dz file: the contents of the old file followed by data.
+ * Compressed chunks of the old file are reused.
+ * dict_length receives the size of the uncompressed old file.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int append_to_dictzip(const std::string& dictfilename, const std::string& newfilename,
+	const std::vector<char>& data, guint64& dict_length)
+{
+	dictzip_writer_t dictzip;
+	bool ok = dictzip.open(newfilename)
+		&& dictzip.append_from(dictfilename, dict_length)
+		&& (data.empty() || dictzip.write(&data[0], data.size()));
+	ok = dictzip.finish() && ok;
+	if(!ok) {
+		if(dictzip.get_too_large())
+			g_critical("Dictionary file '%s' is too large for dictzip. "
+				"Rebuild the dictionary with stardict-text2bin.", dictfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Replace filename with newfilename.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+static int replace_file(const std::string& newfilename, const std::string& filename)
+{
+#ifdef _WIN32
+	/* rename does not replace an existing file on Windows */
+	g_remove(filename.c_str());
+#endif
+	if(g_rename(newfilename.c_str(), filename.c_str())) {
+		std::string err(g_strerror(errno));
+		g_critical("Unable to rename '%s' to '%s'. Error: %s",
+			newfilename.c_str(), filename.c_str(), err.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Remove index cache files (.oft, .clt) older versions of StarDict saved
+ * next to the dictionary.
+ * StarDict keeps the caches in its cache store now. They are stamped with
+ * the modification time and the size of the index, so the caches of
+ * a patched index are rebuilt. */
+static void remove_cache_files(const std::string& basefilename)
+{
+	glib::CharStr dirname(g_path_get_dirname(basefilename.c_str()));
+	glib::CharStr basename(g_path_get_basename(basefilename.c_str()));
+	const std::string prefix = std::string(get_impl(basename)) + ".";
+	glib::Dir dir(g_dir_open(get_impl(dirname), 0, NULL));
+	if(!dir)
+		return;
+	const gchar *filename;
+	while((filename = g_dir_read_name(get_impl(dir)))!=NULL) {
+		const std::string name(filename);
+		if(name.compare(0, prefix.length(), prefix) != 0)
+			continue;
+		if(!g_str_has_suffix(filename, ".oft") && !g_str_has_suffix(filename, ".clt"))
+			continue;
+		const std::string path(build_path(get_impl(dirname), name));
+		if(g_remove(path.c_str()))
+			g_warning("Unable to remove cache file '%s'.", path.c_str());
+	}
+}
+
+int stardict_patch(const std::string& ifofilename, const std::string& xmlfilename,
+		const std::string& deletedfilename)
+{
+	if(!is_path_end_with(ifofilename, ".ifo")) {
+		g_critical(unsupported_file_type_err, ifofilename.c_str());
+		return EXIT_FAILURE;
+	}
+	DictInfo dict_info;
+	if(!dict_info.load_from_ifo_file(ifofilename, DictInfoType_NormDict))
+		return EXIT_FAILURE;
+	const std::string basefilename(ifofilename, 0, ifofilename.length() - (sizeof(".ifo")-1));
+
+	std::string idxfilename = basefilename + ".idx";
+	const bool idx_compressed = !g_file_test(idxfilename.c_str(), G_FILE_TEST_EXISTS);
+	if(idx_compressed)
+		idxfilename += ".gz";
+	std::string dictfilename = basefilename + ".dict";
+	const bool dict_compressed = !g_file_test(dictfilename.c_str(), G_FILE_TEST_EXISTS);
+	if(dict_compressed)
+		dictfilename += ".dz";
+	const std::string synfilename = basefilename + ".syn";
+	if(!g_file_test(idxfilename.c_str(), G_FILE_TEST_EXISTS)) {
+		g_critical(file_not_found_err, idxfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	if(!g_file_test(dictfilename.c_str(), G_FILE_TEST_EXISTS)) {
+		g_critical(file_not_found_err, dictfilename.c_str());
+		return EXIT_FAILURE;
+	}
+
+	g_message("Loading dictionary index...");
+	std::vector<patch_worditem_t> index;
+	std::vector<patch_synitem_t> synindex;
+	{
+		std::vector<char> data;
+		if(read_whole_file(idxfilename, data))
+			return EXIT_FAILURE;
+		if(parse_idx(idxfilename, data, dict_info.get_idxoffsetbits() == 64, index))
+			return EXIT_FAILURE;
+		if(index.size() != dict_info.get_wordcount()) {
+			g_critical("%s: wordcount = %u, while the index contains %u items.",
+				ifofilename.c_str(), dict_info.get_wordcount(), static_cast<guint>(index.size()));
+			return EXIT_FAILURE;
+		}
+		if(g_file_test(synfilename.c_str(), G_FILE_TEST_EXISTS)) {
+			if(read_whole_file(synfilename, data))
+				return EXIT_FAILURE;
+			if(parse_syn(synfilename, data, index.size(), synindex))
+				return EXIT_FAILURE;
+		}
+	}
+
+	common_dict_t delta;
+	if(!xmlfilename.empty()) {
+		if(parse_textual_dict(xmlfilename, &delta, false))
+			return EXIT_FAILURE;
+		if(repair_dict(delta))
+			return EXIT_FAILURE;
+	}
+	/* changed articles are removed and added anew */
+	std::set<std::string> removed_keys;
+	for(size_t i=0; i<delta.articles.size(); ++i)
+		removed_keys.insert(delta.articles[i].key);
+	std::set<std::string> deleted_keys;
+	if(!deletedfilename.empty() && load_deleted_keys(deletedfilename, deleted_keys))
+		return EXIT_FAILURE;
+	removed_keys.insert(deleted_keys.begin(), deleted_keys.end());
+	std::vector<bool> removed(index.size(), false);
+	size_t removed_cnt = 0;
+	for(size_t i=0; i<index.size(); ++i) {
+		if(removed_keys.find(index[i].word) != removed_keys.end()) {
+			removed[i] = true;
+			++removed_cnt;
+			deleted_keys.erase(index[i].word);
+		}
+	}
+	for(std::set<std::string>::const_iterator it = deleted_keys.begin(); it != deleted_keys.end(); ++it)
+		g_warning("Key '%s' is not found in the dictionary, nothing to delete.", it->c_str());
+
+	std::vector<char> data;
+	std::vector<size_t> sizes;
+	{
+		binary_dict_gen_t generator;
+		if(generator.serialize_dict(&delta, dict_info.get_sametypesequence(), data, sizes))
+			return EXIT_FAILURE;
+	}
+
+	/* All files except a plain .dict are written into new files first,
+	 * they replace the old files when everything is ready.
+	 * Data appended to a plain .dict is not referenced by the old index. */
+	g_message("Writing dictionary data...");
+	guint64 dict_length;
+	const std::string newdictfilename = dictfilename + ".new";
+	if(dict_compressed) {
+		if(append_to_dictzip(dictfilename, newdictfilename, data, dict_length))
+			return EXIT_FAILURE;
+	} else {
+		if(append_to_dict(dictfilename, data, dict_length))
+			return EXIT_FAILURE;
+	}
+	std::vector<char>().swap(data);
+
+	/* merge the index, both parts are sorted */
+	std::vector<patch_worditem_t> new_index;
+	new_index.reserve(index.size() - removed_cnt + delta.articles.size());
+	std::vector<size_t> index_map(index.size(), removed_index);
+	std::vector<size_t> delta_map(delta.articles.size());
+	guint64 offset = dict_length;
+	for(size_t i=0, j=0; i<index.size() || j<delta.articles.size(); ) {
+		if(i<index.size() && removed[i]) {
+			++i;
+			continue;
+		}
+		if(j == delta.articles.size() || (i<index.size()
+				&& 0 >= stardict_strcmp(index[i].word.c_str(), delta.articles[j].key.c_str()))) {
+			index_map[i] = new_index.size();
+			new_index.push_back(index[i]);
+			++i;
+		} else {
+			if(sizes[j] > G_MAXUINT32) {
+				g_critical("Index item '%s'. Data block is larger than 4GB.",
+					delta.articles[j].key.c_str());
+				g_remove(newdictfilename.c_str());
+				return EXIT_FAILURE;
+			}
+			delta_map[j] = new_index.size();
+			new_index.push_back(patch_worditem_t(delta.articles[j].key, offset, sizes[j]));
+			offset += sizes[j];
+			++j;
+		}
+	}
+	std::vector<patch_worditem_t>().swap(index);
+	const bool offset64 = dict_info.get_idxoffsetbits() == 64 || offset > G_MAXUINT32;
+
+	/* merge synonyms */
+	std::vector<patch_synitem_t> delta_synindex;
+	for(size_t j=0; j<delta.articles.size(); ++j) {
+		const article_data_t& article = delta.articles[j];
+		for(size_t k=0; k<article.synonyms.size(); ++k)
+			delta_synindex.push_back(patch_synitem_t(article.synonyms[k], delta_map[j]));
+	}
+	std::stable_sort(delta_synindex.begin(), delta_synindex.end(), compare_synitems_by_word);
+	std::vector<patch_synitem_t> new_synindex;
+	for(size_t i=0, j=0; i<synindex.size() || j<delta_synindex.size(); ) {
+		if(i<synindex.size() && index_map[synindex[i].index] == removed_index) {
+			++i;
+			continue;
+		}
+		if(j == delta_synindex.size() || (i<synindex.size()
+				&& !compare_synitems_by_word(delta_synindex[j], synindex[i]))) {
+			new_synindex.push_back(patch_synitem_t(synindex[i].word, index_map[synindex[i].index]));
+			++i;
+		} else {
+			new_synindex.push_back(delta_synindex[j]);
+			++j;
+		}
+	}
+
+	g_message("Writing index...");
+	{
+		std::vector<char> buf;
+		const size_t offset_size = offset64 ? sizeof(guint64) : sizeof(guint32);
+		for(size_t i=0; i<new_index.size(); ++i) {
+			const std::string& word = new_index[i].word;
+			const size_t pos = buf.size();
+			buf.resize(pos + word.length() + 1 + offset_size + sizeof(guint32));
+			memcpy(&buf[pos], word.c_str(), word.length() + 1);
+			char *p = &buf[pos + word.length() + 1];
+			if(offset64) {
+				const guint64 t = GUINT64_TO_BE(new_index[i].offset);
+				memcpy(p, &t, sizeof(t));
+			} else {
+				const guint32 t = g_htonl(static_cast<guint32>(new_index[i].offset));
+				memcpy(p, &t, sizeof(t));
+			}
+			const guint32 t = g_htonl(new_index[i].size);
+			memcpy(p + offset_size, &t, sizeof(t));
+		}
+		dict_info.set_wordcount(new_index.size());
+		dict_info.set_index_file_size(buf.size());
+		if(write_whole_file(idxfilename + ".new", buf, idx_compressed)) {
+			g_remove(newdictfilename.c_str());
+			return EXIT_FAILURE;
+		}
+		buf.clear();
+		for(size_t i=0; i<new_synindex.size(); ++i) {
+			const std::string& word = new_synindex[i].word;
+			const size_t pos = buf.size();
+			buf.resize(pos + word.length() + 1 + sizeof(guint32));
+			memcpy(&buf[pos], word.c_str(), word.length() + 1);
+			const guint32 t = g_htonl(static_cast<guint32>(new_synindex[i].index));
+			memcpy(&buf[pos + word.length() + 1], &t, sizeof(t));
+		}
+		if(!new_synindex.empty() && write_whole_file(synfilename + ".new", buf, false)) {
+			g_remove(newdictfilename.c_str());
+			g_remove((idxfilename + ".new").c_str());
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(new_synindex.empty())
+		dict_info.unset_synwordcount();
+	else
+		dict_info.set_synwordcount(new_synindex.size());
+	if(offset64) {
+		dict_info.set_idxoffsetbits(64);
+		dict_info.set_version("3.0.0");
+	}
+	dict_info.ifo_file_name = ifofilename + ".new";
+	if(!dict_info.save_ifo_file()) {
+		g_remove(newdictfilename.c_str());
+		g_remove((idxfilename + ".new").c_str());
+		g_remove((synfilename + ".new").c_str());
+		return EXIT_FAILURE;
+	}
+
+	/* All new files are complete, now they replace the old ones. The .ifo
+	 * goes last, so the old files are never described by the new .ifo. */
+	if(dict_compressed && replace_file(newdictfilename, dictfilename))
+		return EXIT_FAILURE;
+	if(replace_file(idxfilename + ".new", idxfilename))
+		return EXIT_FAILURE;
+	if(new_synindex.empty()) {
+		g_remove(synfilename.c_str());
+	} else {
+		if(replace_file(synfilename + ".new", synfilename))
+			return EXIT_FAILURE;
+	}
+	if(replace_file(ifofilename + ".new", ifofilename))
+		return EXIT_FAILURE;
+	remove_cache_files(basefilename);
+	g_message("Dictionary updated: %u articles removed, %u articles added.",
+		static_cast<guint>(removed_cnt), static_cast<guint>(delta.articles.size()));
+	return EXIT_SUCCESS;
+}
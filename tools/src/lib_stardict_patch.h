@@ -0,0 +1,34 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIB_STARDICT_PATCH_H_
+#define _LIB_STARDICT_PATCH_H_
+
+#include <string>
+
+/* Update a binary dictionary in place.
+ * xmlfilename - textual dictionary with new and changed articles, may be empty.
+ * An article of that file replaces all articles of the dictionary with the same key.
+ * deletedfilename - file with keys of articles to delete, one key per line, may be empty.
+ * Data blocks of new articles are appended to the .dict file, only the last chunk
+ * of a .dict.dz file is compressed again. The index and synonym files are merged.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int stardict_patch(const std::string& ifofilename, const std::string& xmlfilename,
+		const std::string& deletedfilename);
+
+#endif // _LIB_STARDICT_PATCH_H_
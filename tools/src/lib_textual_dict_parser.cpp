@@ -32,6 +32,7 @@
 #include "lib_common_dict.h"
 #include "lib_textual_dict_parser.h"
 #include "lib_dict_verify.h"
+#include "lib_ordered_pool.h"
 
 #define parser_err \
 	"Parser error."
@@ -212,6 +213,15 @@ private:
 	int read_xml_element(const char** exp_elems, const char* open_elem);
 	int read_xml_end_element(const char* open_elem);
 	int read_xml_text_item(const char* elem, std::string& value);
+	int read_xml_text_item_raw(const char* elem, std::string& text);
+	static int process_xml_text(const char* elem, line_number_t element_beg_line_number,
+		const std::string& text, std::string& value);
+	int add_definition_text(const char* elem, line_number_t line_number,
+		const std::string& text, size_t& seq);
+	int push_definitions_job(void);
+	int save_definitions(ordered_pool_t::job_t *done_job);
+	int flush_definitions(void);
+	void resolve_definitions(void);
 	int read_xml_text(const char* open_elem);
 	int read_xml_attribute(const char* att_name, std::string& value);
 	void check_blank_info_item(const char* elem, bool (DictInfo::* is_item)(void) const,
@@ -260,6 +270,50 @@ private:
 	 * must be = 0. */
 	std::vector<elem_data_t> elem_stack;
 	common_dict_t* norm_dict;
+	/* Text of definitions is checked and normalized on a thread pool while
+	 * parsing goes on. Definitions are saved in norm_dict in the order they were read.
+	 * Until then article_def_t::offset holds the sequence number of the definition. */
+	struct definitions_job_t;
+	struct definition_data_t
+	{
+		size_t offset;
+		size_t size;
+		line_number_t line_number;
+	};
+	ordered_pool_t* definitions_pool;
+	/* job being filled */
+	definitions_job_t* definitions_job;
+	size_t next_definition_seq;
+	/* saved definitions, indexed by the sequence number */
+	std::vector<definition_data_t> definitions;
+	/* a definition could not be processed */
+	bool definitions_failed;
+};
+
+/* number of definitions processed in one job */
+const size_t DEFINITIONS_PER_JOB = 256;
+/* number of jobs being processed, limits memory used by unsaved definitions */
+const size_t MAX_DEFINITIONS_JOBS = 64;
+
+struct textual_dict_parser_t::definitions_job_t : public ordered_pool_t::job_t
+{
+	struct item_t
+	{
+		const char* elem;
+		line_number_t line_number;
+		std::string text;
+		std::string value;
+		int result;
+	};
+	virtual void run(void)
+	{
+		for(size_t i=0; i<items.size(); ++i) {
+			items[i].result = process_xml_text(items[i].elem, items[i].line_number,
+				items[i].text, items[i].value);
+			std::string().swap(items[i].text);
+		}
+	}
+	std::vector<item_t> items;
 };
 
 textual_dict_parser_t::textual_dict_parser_t(void)
@@ -267,7 +321,11 @@ textual_dict_parser_t::textual_dict_parser_t(void)
 	xml_reader(NULL),
 	xincctxt(NULL),
 	reader_options(default_reader_options),
-	norm_dict(NULL)
+	norm_dict(NULL),
+	definitions_pool(NULL),
+	definitions_job(NULL),
+	next_definition_seq(0),
+	definitions_failed(false)
 {
 
 }
@@ -283,8 +341,19 @@ int textual_dict_parser_t::parse(const std::string& xmlfilename,
 	auto_executor_t<textual_dict_parser_t> auto_exec(*this, &textual_dict_parser_t::close_parser);
 	if(prepare_parser())
 		return EXIT_FAILURE;
+	ordered_pool_t pool(0, MAX_DEFINITIONS_JOBS);
+	definitions_pool = &pool;
+	next_definition_seq = 0;
+	definitions.clear();
+	definitions_failed = false;
 	g_message("processing %s...", xmlfilename.c_str());
-	if(read_all())
+	const int res = read_all();
+	if(res == EXIT_SUCCESS && flush_definitions() == EXIT_SUCCESS)
+		resolve_definitions();
+	delete definitions_job;
+	definitions_job = NULL;
+	definitions_pool = NULL;
+	if(res || definitions_failed)
 		return EXIT_FAILURE;
 #if 0
 	int ret = next_node();
@@ -639,6 +708,7 @@ int textual_dict_parser_t::read_article(void)
 		NULL
 	};
 	article_data_t article;
+	article.line_number = article_beg_line_number;
 	/* for simplicity we do not check the order of elements */
 	while(true) {
 		int ret = read_xml_element(exp_elems, elem_stack.back().name);
@@ -676,9 +746,20 @@ int textual_dict_parser_t::read_article(void)
 			}
 		}
 		switch(ret) {
+		case 2:
+		{
+			std::string text;
+			if(read_xml_text_item_raw(exp_elems[ret], text))
+				return EXIT_FAILURE;
+			size_t seq;
+			if(add_definition_text(exp_elems[ret], article_item_line_number, text, seq))
+				return EXIT_FAILURE;
+			if(article.add_definition(article_def_t(content_type, seq, 0)))
+				return EXIT_FAILURE;
+			break;
+		}
 		case 0:
 		case 1:
-		case 2:
 		{
 			std::string value;
 			if(read_xml_text_item(exp_elems[ret], value))
@@ -704,15 +785,6 @@ int textual_dict_parser_t::read_article(void)
 					return EXIT_FAILURE;
 				}
 			}
-			if(ret == 2) {
-				size_t size = value.length(), offset;
-				if(norm_dict->write_data(value.c_str(), size, offset)) {
-					g_critical(save_into_temp_file_err);
-					return EXIT_FAILURE;
-				}
-				if(article.add_definition(article_def_t(content_type, offset, size)))
-					return EXIT_FAILURE;
-			}
 			break;
 		}
 		case 3:
@@ -739,6 +811,7 @@ int textual_dict_parser_t::read_article(void)
 		g_message(fixed_ignore_msg);
 		return EXIT_SUCCESS;
 	}
+	/* articles whose definitions all turn out blank are removed in resolve_definitions */
 	if(norm_dict->add_article(article))
 		return EXIT_FAILURE;
 	return EXIT_SUCCESS;
@@ -1016,6 +1089,20 @@ int textual_dict_parser_t::read_xml_text_item(const char* elem, std::string& val
 {
 	value.clear();
 	const line_number_t element_beg_line_number = get_line_number();
+	std::string text;
+	if(read_xml_text_item_raw(elem, text))
+		return EXIT_FAILURE;
+	if(text.empty())
+		return EXIT_SUCCESS;
+	return process_xml_text(elem, element_beg_line_number, text, value);
+}
+
+/* read text of the element as is, text is empty if the element has no text
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int textual_dict_parser_t::read_xml_text_item_raw(const char* elem, std::string& text)
+{
+	text.clear();
 	int ret = read_xml_text(elem);
 	if(ret == rrEOF) {
 		unexpected_eof();
@@ -1025,16 +1112,39 @@ int textual_dict_parser_t::read_xml_text_item(const char* elem, std::string& val
 		return EXIT_FAILURE;
 	if(ret == rrEndElement)
 		return EXIT_SUCCESS;
-	xml::CharStr tvalue(xmlTextReaderValue(xml_reader));
-	if(!g_utf8_validate((const char*)get_impl(tvalue), -1, NULL)) {
+	{
+		xml::CharStr tvalue(xmlTextReaderValue(xml_reader));
+		if(tvalue)
+			text.assign((const char*)get_impl(tvalue));
+	}
+	// read end element
+	ret = read_xml_end_element(elem);
+	if(ret == rrEOF) {
+		unexpected_eof();
+		return EXIT_FAILURE;
+	}
+	if(ret == rrError)
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+/* Validate and normalize text of an element, drop invalid chars, trim spaces.
+ * Does not use the parser state, may be called in a worker thread.
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int textual_dict_parser_t::process_xml_text(const char* elem, line_number_t element_beg_line_number,
+	const std::string& text, std::string& value)
+{
+	value.clear();
+	if(!g_utf8_validate(text.c_str(), -1, NULL)) {
 		g_critical(element_invalid_utf8_value_err,
-			element_beg_line_number, elem, get_impl(tvalue));
+			element_beg_line_number, elem, text.c_str());
 		return EXIT_FAILURE;
 	}
-	glib::CharStr t2value(g_utf8_normalize((const char*)get_impl(tvalue), -1, G_NORMALIZE_ALL_COMPOSE));
+	glib::CharStr t2value(g_utf8_normalize(text.c_str(), -1, G_NORMALIZE_ALL_COMPOSE));
 	if(!t2value) {
 		g_critical(normalization_failed_err,
-			element_beg_line_number, get_impl(tvalue));
+			element_beg_line_number, text.c_str());
 		return EXIT_FAILURE;
 	}
 	std::string data_str;
@@ -1056,17 +1166,125 @@ int textual_dict_parser_t::read_xml_text_item(const char* elem, std::string& val
 		trim_spaces(data_str.c_str(), beg, len);
 		value.assign(beg, len);
 	}
-	// read end element
-	ret = read_xml_end_element(elem);
-	if(ret == rrEOF) {
-		unexpected_eof();
+	return EXIT_SUCCESS;
+}
+
+/* queue text of a definition for processing, seq receives the sequence number of the definition
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int textual_dict_parser_t::add_definition_text(const char* elem, line_number_t line_number,
+	const std::string& text, size_t& seq)
+{
+	if(!definitions_job)
+		definitions_job = new definitions_job_t;
+	definitions_job->items.push_back(definitions_job_t::item_t());
+	definitions_job_t::item_t& item = definitions_job->items.back();
+	item.elem = elem;
+	item.line_number = line_number;
+	item.text = text;
+	item.result = EXIT_SUCCESS;
+	seq = next_definition_seq++;
+	if(definitions_job->items.size() >= DEFINITIONS_PER_JOB)
+		return push_definitions_job();
+	return EXIT_SUCCESS;
+}
+
+/* pass the job being filled to the pool, save processed definitions
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int textual_dict_parser_t::push_definitions_job(void)
+{
+	if(!definitions_job)
+		return EXIT_SUCCESS;
+	ordered_pool_t::job_t *done_job;
+	definitions_pool->push(definitions_job, done_job);
+	definitions_job = NULL;
+	if(done_job && save_definitions(done_job))
 		return EXIT_FAILURE;
+	while((done_job = definitions_pool->pop(false)))
+		if(save_definitions(done_job))
+			return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
+
+/* save processed definitions into norm_dict, delete the job
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int textual_dict_parser_t::save_definitions(ordered_pool_t::job_t *done_job)
+{
+	definitions_job_t *job = static_cast<definitions_job_t *>(done_job);
+	for(size_t i=0; i<job->items.size(); ++i) {
+		const definitions_job_t::item_t& item = job->items[i];
+		if(item.result) {
+			definitions_failed = true;
+			break;
+		}
+		definition_data_t data;
+		data.offset = 0;
+		data.size = item.value.length();
+		data.line_number = item.line_number;
+		if(data.size > 0 && norm_dict->write_data(item.value.c_str(), data.size, data.offset)) {
+			g_critical(save_into_temp_file_err);
+			definitions_failed = true;
+			break;
+		}
+		definitions.push_back(data);
 	}
-	if(ret == rrError)
+	delete job;
+	return definitions_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* wait till all definitions are processed and saved
+ * Return value:
+ * EXIT_FAILURE or EXIT_SUCCESS */
+int textual_dict_parser_t::flush_definitions(void)
+{
+	if(push_definitions_job())
 		return EXIT_FAILURE;
+	ordered_pool_t::job_t *done_job;
+	while((done_job = definitions_pool->pop(true)))
+		if(save_definitions(done_job))
+			return EXIT_FAILURE;
 	return EXIT_SUCCESS;
 }
 
+/* Replace sequence numbers of definitions with their offsets and sizes.
+ * Remove definitions with blank text and articles left without definitions. */
+void textual_dict_parser_t::resolve_definitions(void)
+{
+	std::vector<article_data_t>& articles = norm_dict->articles;
+	size_t article_cnt = 0;
+	for(size_t i=0; i<articles.size(); ++i) {
+		std::vector<article_def_t>& defs = articles[i].definitions;
+		size_t def_cnt = 0;
+		for(size_t j=0; j<defs.size(); ++j) {
+			if(defs[j].type != 'r') {
+				const definition_data_t& data = definitions[defs[j].offset];
+				if(data.size == 0) {
+					g_warning(element_blank_value, data.line_number, "definition");
+					g_message(fixed_ignore_msg);
+					continue;
+				}
+				defs[j].offset = data.offset;
+				defs[j].size = data.size;
+			}
+			if(def_cnt != j)
+				defs[def_cnt] = defs[j];
+			++def_cnt;
+		}
+		defs.resize(def_cnt);
+		if(defs.empty()) {
+			g_warning(article_definition_list_empty_err, articles[i].line_number);
+			g_message(fixed_ignore_msg);
+			continue;
+		}
+		if(article_cnt != i)
+			std::swap(articles[article_cnt], articles[i]);
+		++article_cnt;
+	}
+	articles.resize(article_cnt);
+}
+
 /* Read the next node. It must be text.
  * parameters:
  * open_elem - opened element, != NULL
@@ -109,6 +109,8 @@ void sd2foldoc(const char *ifofilename, print_info_t print_info)
 {
 	gchar *buffer;
 	g_file_get_contents(ifofilename, &buffer, NULL, NULL);
+	/* Only 32-bit index offsets are read. Dictionaries with idxoffsetbits=64
+	 * have version 3.0.0 and are rejected here. */
 	if (!g_str_has_prefix(buffer, "StarDict's dict ifo file\nversion=2.4.2\n")) {
 		print_info("Error, file version is not 2.4.2\n");
 		g_free(buffer);
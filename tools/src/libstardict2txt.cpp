@@ -27,8 +27,10 @@
 #include <string>
 
 #include "libstardict2txt.h"
+#include "ifo_file.h"
 
-static void convert2tabfile(const gchar *ifofilename, const gchar* txtfilename)
+/* offset64 - the index has 64-bit data offsets, idxoffsetbits=64 */
+static void convert2tabfile(const gchar *ifofilename, const gchar* txtfilename, bool offset64)
 {
 	std::string idxfilename=ifofilename;
 	idxfilename.replace(idxfilename.length()-sizeof("ifo")+1, sizeof("ifo")-1, "idx");
@@ -74,7 +76,8 @@ static void convert2tabfile(const gchar *ifofilename, const gchar* txtfilename)
 
 	gchar *p=idxbuffer;
 	int wordlen;
-	guint32 offset, size;
+	guint64 offset;
+	guint32 size;
 	gchar *data;
 	while (1) {
 		if (p == idxbuffer_end) {
@@ -84,9 +87,16 @@ static void convert2tabfile(const gchar *ifofilename, const gchar* txtfilename)
 		fwrite(p, wordlen, 1, txtfile);
 		fwrite("\t", 1, 1, txtfile);
 		p+=wordlen +1;
-		offset=*reinterpret_cast<guint32 *>(p);
-		offset=g_ntohl(offset);
-		p+=sizeof(guint32);
+		if (offset64) {
+			guint64 t;
+			memcpy(&t, p, sizeof(t));
+			offset=GUINT64_FROM_BE(t);
+			p+=sizeof(guint64);
+		} else {
+			offset=*reinterpret_cast<guint32 *>(p);
+			offset=g_ntohl(offset);
+			p+=sizeof(guint32);
+		}
 		size=*reinterpret_cast<guint32 *>(p);
 		size=g_ntohl(size);
 		p+=sizeof(guint32);
@@ -132,7 +142,12 @@ void convert_stardict2txt(const char *ifofilename, const char* txtfilename)
 	}
 	p2 += sizeof("\nsametypesequence=") -1;
 	if (g_ascii_islower(*p2) && *(p2+1)=='\n') {
-		convert2tabfile(ifofilename, txtfilename);
+		DictInfo dict_info;
+		if (!dict_info.load_from_ifo_file(ifofilename, DictInfoType_NormDict)) {
+			g_free(buffer);
+			return;
+		}
+		convert2tabfile(ifofilename, txtfilename, dict_info.get_idxoffsetbits() == 64);
 	} else {
 		g_critical("Error, sametypesequence must be a single lower case letter, preferably 'm'.");
 		g_free(buffer);
@@ -21,28 +21,15 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <cerrno>
 #include <string>
 #include <glib/gstdio.h>
 #include <glib.h>
 
 #include "libtabfile.h"
 #include "libcommon.h"
-
-struct _worditem
-{
-	gchar *word;
-	gchar *definition;
-};
-
-static gint comparefunc(gconstpointer a,gconstpointer b)
-{
-	gint x;
-	x = stardict_strcmp(((struct _worditem *)a)->word,((struct _worditem *)b)->word);
-	if (x == 0)
-		return ((struct _worditem *)a)->definition - ((struct _worditem *)b)->definition;
-	else
-		return x;
-}
+#include "lib_external_sort.h"
+#include "lib_read_line.h"
 
 static void my_strstrip(char *str, glong linenum)
 {
@@ -96,89 +83,63 @@ static void my_strstrip(char *str, glong linenum)
 	*p2 = '\0';
 }
 
-/* return: true - OK, false - error 
-Dictionary index is allowed to contain duplicates in fact. */
-/*
-static bool check_duplicate_words(GArray *array)
-{
-	if(array->len < 2)
-		return true;
-
-	gulong i;
-	struct _worditem *pworditem1, *pworditem2;
-	pworditem1 = &g_array_index(array, struct _worditem, 0);
-	bool return_var = true;
-	for (i=1; i < array->len; i++) {
-		pworditem2 = &g_array_index(array, struct _worditem, i);
-		if ((stardict_strcmp(pworditem1->word, pworditem2->word) == 0) && (strcmp(pworditem1->definition, pworditem2->definition) ==0)) {
-			g_warning("Error, duplicate word: %s", pworditem2->word);
-			return_var = false;
-		}
-		pworditem1 = pworditem2;
-	}
-	return return_var;
-}
-*/
-
-static bool read_tab_file(gchar *buffer, GArray *array)
+static bool read_tab_file(const char *filename, external_sorter_t& sorter)
 {
-	gchar *p, *p1, *p2;
-	p = buffer;
-	if(g_str_has_prefix(p, "\xEF\xBB\xBF")) // UTF-8 BOM
-		p+=3;
-	if(!g_utf8_validate(p, -1, NULL)) {
-		g_critical("Error, invalid UTF-8 encoded text.");
+	clib::File tabfile(g_fopen(filename, "rb"));
+	if (!tabfile) {
+		std::string err(g_strerror(errno));
+		g_critical(open_read_file_err, filename, err.c_str());
 		return false;
 	}
-	struct _worditem worditem;
+	std::string line;
+	bool newline;
 	glong linenum=1;
-	while (true) {
-		if (*p == '\0') {
-			g_message("Convertion is over.");
-			break;
-		}
-		p1 = strchr(p,'\n');
-		if (!p1) {
+	for (; read_line(get_impl(tabfile), line, newline); linenum++) {
+		if (linenum == 1 && g_str_has_prefix(line.c_str(), "\xEF\xBB\xBF")) // UTF-8 BOM
+			line.erase(0, 3);
+		if (!newline) {
 			g_critical("Error, no new line at the end.");
 			return false;
 		}
-		*p1 = '\0';
-		p1++;
-		p2 = strchr(p,'\t');
+		if (!g_utf8_validate(line.c_str(), line.length(), NULL)) {
+			g_critical("Error, line %ld: invalid UTF-8 encoded text.", linenum);
+			return false;
+		}
+		gchar *p = &line[0];
+		gchar *p2 = strchr(p,'\t');
 		if (!p2) {
 			g_warning("Warning: line %ld, no tab! Skipping line.", linenum);
-			p = p1;
-			linenum++;
 			continue;
 		}
 		*p2 = '\0';
 		p2++;
-		worditem.word = p;
-		worditem.definition = p2;
-		my_strstrip(worditem.word, linenum);
-		my_strstrip(worditem.definition, linenum);
-		g_strstrip(worditem.word);
-		g_strstrip(worditem.definition);
-		if (!worditem.word[0]) {
+		gchar *word = p;
+		gchar *definition = p2;
+		my_strstrip(word, linenum);
+		my_strstrip(definition, linenum);
+		g_strstrip(word);
+		g_strstrip(definition);
+		if (!word[0]) {
 			g_warning("Warning: line %ld, bad word! Skipping line.", linenum);
-			p = p1;
-			linenum++;
 			continue;
 		}
-		if (!worditem.definition[0]) {
+		if (!definition[0]) {
 			g_warning("Warning: line %ld, bad definition! Skipping line.", linenum);
-			p = p1;
-			linenum++;
 			continue;
 		}
-		g_array_append_val(array, worditem);
-		p = p1;
-		linenum++;
+		if (!sorter.add(word, definition, strlen(definition)))
+			return false;
 	}
+	if (ferror(get_impl(tabfile))) {
+		std::string err(g_strerror(errno));
+		g_critical(read_file_err, filename, err.c_str());
+		return false;
+	}
+	g_message("Convertion is over.");
 	return true;
 }
 
-static bool write_dictionary(const char *filename, GArray *array)
+static bool write_dictionary(const char *filename, external_sorter_t& sorter)
 {
 	glib::CharStr basefilename(g_path_get_basename(filename));
 	gchar *ch = strrchr(get_impl(basefilename), '.');
@@ -188,100 +149,60 @@ static bool write_dictionary(const char *filename, GArray *array)
 
 	const std::string fullbasefilename = build_path(get_impl(dirname), get_impl(basefilename));
 	const std::string ifofilename = fullbasefilename + ".ifo";
-	const std::string idxfilename = fullbasefilename + ".idx";
-	const std::string dicfilename = fullbasefilename + ".dict";
 	clib::File ifofile(g_fopen(ifofilename.c_str(),"wb"));
 	if (!ifofile) {
 		g_critical("Write to ifo file %s failed!", ifofilename.c_str());
 		return false;
 	}
-	clib::File idxfile(g_fopen(idxfilename.c_str(),"wb"));
-	if (!idxfile) {
-		g_critical("Write to idx file %s failed!", idxfilename.c_str());
+	sorted_dict_writer_t writer;
+	if (!writer.open(fullbasefilename))
 		return false;
-	}
-	clib::File dicfile(g_fopen(dicfilename.c_str(),"wb"));
-	if (!dicfile) {
-		g_critical("Write to dict file %s failed!", dicfilename.c_str());
+	const char *word, *definition;
+	guint32 definition_len;
+	while (sorter.next(word, definition, definition_len))
+		if (!writer.add(word, definition, definition_len))
+			return false;
+	if (sorter.failed() || !writer.finish())
 		return false;
-	}
-
-	guint32 offset_old;
-	guint32 tmpglong;
-	struct _worditem *pworditem;
-	gint definition_len;
-	gulong i;
-	for (i=0; i < array->len; i++) {
-		offset_old = ftell(get_impl(dicfile));
-		pworditem = &g_array_index(array, struct _worditem, i);
-		definition_len = strlen(pworditem->definition);
-		fwrite(pworditem->definition, 1 ,definition_len,get_impl(dicfile));
-		fwrite(pworditem->word,sizeof(gchar),strlen(pworditem->word)+1,get_impl(idxfile));
-		tmpglong = g_htonl(offset_old);
-		fwrite(&(tmpglong),sizeof(guint32),1,get_impl(idxfile));
-		tmpglong = g_htonl(definition_len);
-		fwrite(&(tmpglong),sizeof(guint32),1,get_impl(idxfile));
-	}
-	idxfile.reset(NULL);
-	dicfile.reset(NULL);
 
-	g_message("%s wordcount: %d.", get_impl(basefilename), array->len);
+	g_message("%s wordcount: %" G_GUINT64_FORMAT ".", get_impl(basefilename), writer.get_wordcount());
 
+	if (writer.get_offset64()) {
+		g_message("Dictionary file is larger than 4GB, it is not compressed.");
+	} else {
 #ifndef _WIN32
-	std::string command(std::string("dictzip ") + dicfilename);
-	int result;
-	result = system(command.c_str());
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+		std::string command(std::string("dictzip ") + writer.get_dict_file_name());
+		int result;
+		result = system(command.c_str());
+		if (result == -1) {
+			g_print("system() error!\n");
+		}
 #endif
+	}
 
-	stardict_stat_t stats;
-	g_stat(idxfilename.c_str(), &stats);
-	fprintf(get_impl(ifofile), "StarDict's dict ifo file\nversion=2.4.2\nwordcount=%d\n"
-		"idxfilesize=%ld\nbookname=%s\nsametypesequence=m\n",
-		array->len, (long) stats.st_size, get_impl(basefilename));
+	fprintf(get_impl(ifofile), "StarDict's dict ifo file\nversion=%s\nwordcount=%" G_GUINT64_FORMAT "\n"
+		"idxfilesize=%" G_GUINT64_FORMAT "\n%sbookname=%s\nsametypesequence=m\n",
+		writer.get_offset64() ? "3.0.0" : "2.4.2",
+		writer.get_wordcount(), writer.get_idxfilesize(),
+		writer.get_offset64() ? "idxoffsetbits=64\n" : "",
+		get_impl(basefilename));
 	return true;
 }
 
-class ArrayWrapper {
-public:
-	ArrayWrapper(GArray *array)
-		: array(array)
-	{
-	}
-	~ArrayWrapper(void)
-	{
-		g_array_free(array,TRUE);
-	}
-private:
-	GArray *array;
-};
-
-bool convert_tabfile(const char *filename)
+bool convert_tabfile(const char *filename, size_t memory_limit, guint max_threads)
 {
-	glib::CharStr buffer;
-	glib::Error err;
-	if(!g_file_get_contents(filename, get_addr(buffer), NULL, get_addr(err))) {
-		g_critical("Unable to open file %s, error: %s.", filename, err->message);
+	external_sorter_t sorter(memory_limit, max_threads);
+	if(!read_tab_file(filename, sorter))
 		return false;
-	}
-
-	GArray *array = g_array_sized_new(FALSE,FALSE, sizeof(struct _worditem),20000);
-	ArrayWrapper array_wrapper(array);
-	
-	if(!read_tab_file(get_impl(buffer), array))
+	if(!sorter.finish())
 		return false;
 
-	if(array->len < 1) {
+	if(sorter.empty()) {
 		g_critical("Error: empty dictionary.");
 		return false;
 	}
-	g_array_sort(array, comparefunc);
-	//if(!check_duplicate_words(array))
-	//	return false;
-	
-	if(!write_dictionary(filename, array))
+
+	if(!write_dictionary(filename, sorter))
 		return false;
 	return true;
 }
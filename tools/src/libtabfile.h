@@ -18,6 +18,12 @@
 #ifndef _LIBTABFILE_H_
 #define _LIBTABFILE_H_
 
-extern bool convert_tabfile(const char *filename);
+#include <glib.h>
+#include "lib_external_sort.h"
+
+/* memory_limit - memory used for sorting articles, in bytes,
+ * max_threads - number of threads sorting articles, 0 - number of processors */
+extern bool convert_tabfile(const char *filename,
+	size_t memory_limit = EXTERNAL_SORT_MEMORY_LIMIT, guint max_threads = 0);
 
 #endif
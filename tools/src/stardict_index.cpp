@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include <iomanip>
 #include "libcommon.h"
+#include "ifo_file.h"
 
 
 class Main {
@@ -50,6 +51,7 @@ private:
 			"Print context of StarDict index file in human readable form.\n"
 			"\n"
 			"Supported files: .idx, .ridx, .syn\n"
+			"The .ifo file next to an .idx file tells the size of data offsets.\n"
 			);
 		glib::Error err;
 		if (!g_option_context_parse(get_impl(opt_cnt), &argc, &argv, get_addr(err))) {
@@ -73,6 +75,22 @@ private:
 		syn_file = g_str_has_suffix(idx_file_name.c_str(), ".syn");
 		if(key_only)
 			quiet_mode = TRUE;
+		offset64 = FALSE;
+		if(g_str_has_suffix(idx_file_name.c_str(), ".idx")) {
+			// The size of data offsets is given in the .ifo file.
+			std::string ifo_file_name(idx_file_name, 0, idx_file_name.length() - (sizeof(".idx") - 1));
+			ifo_file_name += ".ifo";
+			if(g_file_test(ifo_file_name.c_str(), G_FILE_TEST_EXISTS)) {
+				DictInfo dict_info;
+				if(!dict_info.load_from_ifo_file(ifo_file_name, DictInfoType_NormDict)) {
+					std::cerr << "Unable to load " << ifo_file_name << std::endl;
+					return EXIT_FAILURE;
+				}
+				offset64 = dict_info.get_idxoffsetbits() == 64;
+			} else {
+				std::cerr << "warning: " << ifo_file_name << " not found, assuming 32-bit offsets." << std::endl;
+			}
+		}
 		return EXIT_SUCCESS;
 	}
 	void print_index(std::string& idx_file_name)
@@ -98,6 +116,10 @@ private:
 			while(p1<end) {
 				key = p1;
 				p1 += strlen(p1) + 1;
+				if(p1 > end || static_cast<size_t>(end - p1) < sizeof(guint32)) {
+					std::cerr << "Unexpected end of file." << std::endl;
+					break;
+				}
 				index = g_ntohl(*reinterpret_cast<guint32*>(p1));
 				p1 += sizeof(guint32);
 				++rec_no;
@@ -107,12 +129,25 @@ private:
 					std::cout << std::setw(10) << index << " " << key << std::endl;
 			}
 		} else {
-			guint32 offset, size;
+			guint64 offset;
+			guint32 size;
+			const size_t entry_size = (offset64 ? sizeof(guint64) : sizeof(guint32)) + sizeof(guint32);
 			while(p1<end) {
 				key = p1;
 				p1 += strlen(p1) + 1;
-				offset = g_ntohl(*reinterpret_cast<guint32*>(p1));
-				p1 += sizeof(guint32);
+				if(p1 > end || static_cast<size_t>(end - p1) < entry_size) {
+					std::cerr << "Unexpected end of file." << std::endl;
+					break;
+				}
+				if(offset64) {
+					guint64 t;
+					memcpy(&t, p1, sizeof(t));
+					offset = GUINT64_FROM_BE(t);
+					p1 += sizeof(guint64);
+				} else {
+					offset = g_ntohl(*reinterpret_cast<guint32*>(p1));
+					p1 += sizeof(guint32);
+				}
 				size = g_ntohl(*reinterpret_cast<guint32*>(p1));
 				p1 += sizeof(guint32);
 				++rec_no;
@@ -130,6 +165,8 @@ private:
 	gboolean quiet_mode;
 	gboolean key_only;
 	gboolean syn_file;
+	/* .idx file with 64-bit data offsets, idxoffsetbits=64 */
+	gboolean offset64;
 };
 
 
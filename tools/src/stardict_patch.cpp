@@ -0,0 +1,90 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <locale.h>
+#include <glib.h>
+#include <string>
+#include <iostream>
+#include "libcommon.h"
+#include "lib_stardict_patch.h"
+
+struct Main
+{
+	int main(int argc, char * argv [])
+	{
+		char* deleted_file = NULL;
+		static GOptionEntry entries[] = {
+			{ "delete", 'd', 0, G_OPTION_ARG_FILENAME, &deleted_file, "delete articles listed in FILE, one key per line", "FILE" },
+			{ NULL },
+		};
+		glib::OptionContext opt_cnt(g_option_context_new(" DICTIONARY.ifo [DELTA.xml]"));
+		g_option_context_add_main_entries(get_impl(opt_cnt), entries, NULL);
+		g_option_context_set_help_enabled(get_impl(opt_cnt), TRUE);
+		g_option_context_set_summary(get_impl(opt_cnt),
+				"Updates a StarDict dictionary in place\n"
+				"\n"
+				"DELTA.xml is a textual dictionary in the stardict-text2bin format. "
+				"Its articles are added to the dictionary, "
+				"an article with the key of an existing article replaces that article. "
+				"Articles listed in the file specified with --delete are removed.\n"
+				"\n"
+				"Only the new data is compressed, the index and synonym files are merged, "
+				"so the update is much faster than a full rebuild. "
+				"Data of replaced and deleted articles remains in the .dict file, "
+				"rebuild the dictionary from time to time to reclaim that space.\n"
+				"\n"
+				"EXIT STATUS\n"
+				"The utility exits with status 0 if the update succeeds, with non-zero status otherwise."
+			);
+		glib::Error err;
+		if (!g_option_context_parse(get_impl(opt_cnt), &argc, &argv, get_addr(err))) {
+			std::cerr << "Option parsing failed: " <<  err->message << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(argc < 2 || argc > 3) {
+			std::cerr << "Specify the dictionary and the delta file." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(argc < 3 && !deleted_file) {
+			std::cerr << "Nothing to do, specify the delta file or --delete option." << std::endl;
+			return EXIT_FAILURE;
+		}
+		ifofilename = argv[1];
+		if(argc > 2)
+			xmlfilename = argv[2];
+		if(deleted_file)
+			deletedfilename = deleted_file;
+		return EXIT_SUCCESS;
+	}
+	std::string ifofilename;
+	std::string xmlfilename;
+	std::string deletedfilename;
+};
+
+int main(int argc,char * argv [])
+{
+	setlocale(LC_ALL, "");
+	Main oMain;
+	if(oMain.main(argc, argv))
+		return EXIT_FAILURE;
+	return stardict_patch(oMain.ifofilename, oMain.xmlfilename, oMain.deletedfilename);
+}
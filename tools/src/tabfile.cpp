@@ -15,20 +15,47 @@
  * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <iostream>
+#include <stdlib.h>
 #include <locale.h>
 #include <gtk/gtk.h>
+#include <glib.h>
 
+#include "libcommon.h"
 #include "libtabfile.h"
 
 int main(int argc,char * argv [])
 {
+	setlocale(LC_ALL, "");
+	gint memory_limit = EXTERNAL_SORT_MEMORY_LIMIT / (1024*1024);
+	gint max_threads = 0;
+	static GOptionEntry entries[] = {
+		{ "memory-limit", 'm', 0, G_OPTION_ARG_INT, &memory_limit, "memory used for sorting articles, in MB", "MB" },
+		{ "threads", 't', 0, G_OPTION_ARG_INT, &max_threads, "number of threads sorting articles, 0 - number of processors", "N" },
+		{ NULL },
+	};
+	glib::OptionContext opt_cnt(g_option_context_new("FILE.tab..."));
+	g_option_context_add_main_entries(get_impl(opt_cnt), entries, NULL);
+	g_option_context_set_help_enabled(get_impl(opt_cnt), TRUE);
+	g_option_context_set_summary(get_impl(opt_cnt),
+		"Convert tab-separated dictionaries into StarDict format.\n"
+		"Each line is a word and its definition separated by a tab. "
+		"Articles that do not fit into the memory limit are sorted in temporary files.");
+	glib::Error err;
+	if (!g_option_context_parse(get_impl(opt_cnt), &argc, &argv, get_addr(err))) {
+		std::cerr << "Option parsing failed: " <<  err->message << std::endl;
+		return EXIT_FAILURE;
+	}
 	if (argc<2) {
 		printf("please type this:\n./tabfile Chinese-idiom-quick.pdb.tab.utf8\n");
 		return FALSE;
 	}
+	if (memory_limit <= 0 || max_threads < 0) {
+		std::cerr << "Invalid memory limit or number of threads." << std::endl;
+		return EXIT_FAILURE;
+	}
 
-	setlocale(LC_ALL, "");
 	for (int i=1; i< argc; i++)
-		convert_tabfile (argv[i]);
+		convert_tabfile (argv[i], size_t(memory_limit)*1024*1024, max_threads);
 	return FALSE;
 }